@@ -0,0 +1,329 @@
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <DuplicateFinder.hpp>
+#include <FLACTrack.hpp>
+#include <IDCache.hpp>
+#include <IngestWriter.hpp>
+#include <LibrarySnapshot.hpp>
+#include <Schema.hpp>
+#include <TrackTable.hpp>
+
+#include "FLACFixture.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+/**
+ * What a scan reads from the audio of a real file: its audio MD5, length and size.
+ */
+struct StreamDetails
+{
+  string audioMD5;
+  uint32_t duration;
+  uint64_t size;
+};
+
+/**
+ * Stream details of a three-minute encoded track, imported once per run.
+ */
+static const StreamDetails &streamDetails()
+{
+  static const StreamDetails details = [] {
+    const fs::path location = fs::temp_directory_path() / "mellophone-database-bench.flac";
+    FLACFixture fixture;
+    fixture.comments = {"TITLE=Benchmark Track"};
+    fixture.samples = 44100 * 180;
+    encodeFLAC(location, fixture);
+
+    FLACTrack track(location);
+    track.importMetadata();
+    StreamDetails result = {track.getContentKey().audioMD5, track.getDuration(), fs::file_size(location)};
+
+    fs::remove(location);
+    return result;
+  }();
+
+  return details;
+}
+
+/**
+ * Track with its tags filled in directly, and its stream details taken from a real file.
+ */
+class BenchTrack : public Track
+{
+public:
+  BenchTrack(uint32_t index, uint32_t albums) : Track(fs::path("/music/" + std::to_string(index) + ".flac"))
+  {
+    const uint32_t album = index % albums;
+    const StreamDetails &details = streamDetails();
+
+    this->artist.push_back("Artist " + std::to_string(album / 10));
+    this->album = "Album " + std::to_string(album);
+    this->title = "Track " + std::to_string(index);
+    this->genre = album % 2 == 0 ? "Rock" : "Jazz";
+    this->date = "2001-01-01";
+    this->trackNum = static_cast<uint8_t>(index / albums + 1);
+    this->duration = details.duration;
+    this->audioMD5 = details.audioMD5;
+    // Sizes stay distinct, so no two tracks are taken for copies of one file.
+    this->fingerprint.size = details.size + index;
+    this->partialHash = std::to_string(index);
+  }
+
+  void importMetadata() override {}
+};
+
+/**
+ * In-memory database at the latest schema.
+ */
+class BenchDatabase
+{
+public:
+  shared_ptr<sqlite3 *> db = std::make_shared<sqlite3 *>();
+  shared_ptr<StatementCache> statements;
+  shared_ptr<IDCache> ids = std::make_shared<IDCache>();
+
+  BenchDatabase()
+  {
+    sqlite3_open(":memory:", db.get());
+    Schema::migrate(db);
+    statements = std::make_shared<StatementCache>(db);
+  }
+
+  ~BenchDatabase()
+  {
+    statements->finalizeAll();
+    sqlite3_close_v2(*db);
+  }
+
+  /**
+   * Writes the given number of tracks, spread over `albums` albums by `albums / 10` artists.
+   */
+  void fill(uint32_t tracks, uint32_t albums)
+  {
+    vector<unique_ptr<Track>> batch;
+    for (uint32_t i = 0; i < tracks; i++)
+    {
+      batch.push_back(std::make_unique<BenchTrack>(i, albums));
+    }
+
+    IngestWriter writer(statements, ids);
+    writer.write(batch);
+  }
+};
+
+/**
+ * Warming the ID cache from a library of the given number of albums.
+ */
+static void BM_IDCacheLoad(benchmark::State &state)
+{
+  const uint32_t albums = static_cast<uint32_t>(state.range(0));
+  BenchDatabase database;
+  database.fill(albums, albums);
+
+  for (auto _ : state)
+  {
+    IDCache cache;
+    cache.load(database.statements);
+    benchmark::DoNotOptimize(cache.findAlbumID("Album 0"));
+  }
+
+  state.SetItemsProcessed(state.iterations() * albums);
+}
+BENCHMARK(BM_IDCacheLoad)
+    ->Arg(1000)
+    ->Arg(100000)
+    ->Unit(benchmark::kMillisecond);
+
+/**
+ * Resolving album and artist names that are already in the database.
+ */
+static void BM_IDCacheFind(benchmark::State &state)
+{
+  BenchDatabase database;
+  database.fill(10000, 10000);
+
+  std::vector<string> albums;
+  std::vector<string> artists;
+  for (uint32_t i = 0; i < 10000; i++)
+  {
+    albums.push_back("Album " + std::to_string(i));
+    artists.push_back("Artist " + std::to_string(i / 10));
+  }
+
+  size_t next = 0;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(database.ids->findAlbumID(albums[next]));
+    benchmark::DoNotOptimize(database.ids->findArtistID(artists[next]));
+    next = (next + 1) % albums.size();
+  }
+
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_IDCacheFind)->Unit(benchmark::kNanosecond);
+
+/**
+ * Writing tracks whose albums and artists are resolved through the cache, from one album
+ * per ten tracks down to one album per track.
+ */
+static void BM_IngestWriterWrite(benchmark::State &state)
+{
+  const uint32_t tracks = 10000;
+  const uint32_t albums = static_cast<uint32_t>(state.range(0));
+
+  vector<unique_ptr<Track>> batch;
+  for (uint32_t i = 0; i < tracks; i++)
+  {
+    batch.push_back(std::make_unique<BenchTrack>(i, albums));
+  }
+
+  for (auto _ : state)
+  {
+    state.PauseTiming();
+    BenchDatabase database;
+    state.ResumeTiming();
+
+    IngestWriter writer(database.statements, database.ids);
+    benchmark::DoNotOptimize(writer.write(batch));
+    writer.commit();
+  }
+
+  state.SetItemsProcessed(state.iterations() * tracks);
+  state.SetLabel(std::to_string(albums) + " albums");
+}
+BENCHMARK(BM_IngestWriterWrite)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
+
+/**
+ * Loading the browse table from the database.
+ */
+static void BM_TrackTableLoad(benchmark::State &state)
+{
+  const uint32_t tracks = static_cast<uint32_t>(state.range(0));
+  BenchDatabase database;
+  database.fill(tracks, tracks / 10);
+
+  for (auto _ : state)
+  {
+    TrackTable table = TrackTable::load(database.statements);
+    benchmark::DoNotOptimize(table.size());
+  }
+
+  state.SetItemsProcessed(state.iterations() * tracks);
+}
+BENCHMARK(BM_TrackTableLoad)
+    ->Arg(10000)
+    ->Arg(100000)
+    ->Unit(benchmark::kMillisecond);
+
+/**
+ * Sorting the browse table by artist, album, disc and track.
+ */
+static void BM_TrackTableSort(benchmark::State &state)
+{
+  const uint32_t tracks = static_cast<uint32_t>(state.range(0));
+  BenchDatabase database;
+  database.fill(tracks, tracks / 10);
+  const TrackTable table = TrackTable::load(database.statements);
+
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(table.sortedOrder(TrackSortKey::artist));
+  }
+
+  state.SetItemsProcessed(state.iterations() * tracks);
+}
+BENCHMARK(BM_TrackTableSort)
+    ->Arg(10000)
+    ->Arg(100000)
+    ->Unit(benchmark::kMillisecond);
+
+/**
+ * Writing a snapshot of the library.
+ */
+static void BM_SnapshotWrite(benchmark::State &state)
+{
+  const uint32_t tracks = static_cast<uint32_t>(state.range(0));
+  BenchDatabase database;
+  database.fill(tracks, tracks / 10);
+  const fs::path location = fs::temp_directory_path() / "mellophone-bench.snapshot";
+
+  for (auto _ : state)
+  {
+    LibrarySnapshot::write(location, database.statements);
+  }
+
+  fs::remove(location);
+  state.SetItemsProcessed(state.iterations() * tracks);
+}
+BENCHMARK(BM_SnapshotWrite)
+    ->Arg(100000)
+    ->Arg(1000000)
+    ->Unit(benchmark::kMillisecond);
+
+/**
+ * Opening a snapshot and reading the first screen of tracks, as at startup.
+ */
+static void BM_SnapshotOpen(benchmark::State &state)
+{
+  const uint32_t tracks = static_cast<uint32_t>(state.range(0));
+  BenchDatabase database;
+  database.fill(tracks, tracks / 10);
+  const fs::path location = fs::temp_directory_path() / "mellophone-bench.snapshot";
+  LibrarySnapshot::write(location, database.statements);
+
+  for (auto _ : state)
+  {
+    std::unique_ptr<LibrarySnapshot> snapshot = LibrarySnapshot::open(location);
+    for (size_t row = 0; row < 100; row++)
+    {
+      benchmark::DoNotOptimize(snapshot->track(row).title);
+    }
+  }
+
+  fs::remove(location);
+}
+BENCHMARK(BM_SnapshotOpen)
+    ->Arg(100000)
+    ->Arg(1000000)
+    ->Unit(benchmark::kMicrosecond);
+
+/**
+ * A full duplicate search, with one track in ten a retagged copy of the one before
+ * and one in ten a re-encode of it. Sizes are all distinct, so no file is read.
+ */
+static void BM_FindDuplicates(benchmark::State &state)
+{
+  const uint32_t tracks = static_cast<uint32_t>(state.range(0));
+  BenchDatabase database;
+  database.fill(tracks, tracks / 10);
+  sqlite3_exec(*database.db,
+               "UPDATE Tracks SET Duration = 180000 + ID * 7 % 60000, AudioMD5 = ID;"
+               "UPDATE Tracks SET AudioMD5 = ID - 1 WHERE ID % 10 == 1;"
+               "UPDATE Tracks SET (Title, Album) = (SELECT Title, Album FROM Tracks AS Prior WHERE Prior.ID == Tracks.ID - 1) "
+               "WHERE ID % 10 == 2;",
+               nullptr, nullptr, nullptr);
+
+  for (auto _ : state)
+  {
+    DuplicateFinder finder;
+    finder.load(database.statements);
+    benchmark::DoNotOptimize(finder.find());
+    finder.store(database.statements);
+  }
+
+  state.SetItemsProcessed(state.iterations() * tracks);
+}
+BENCHMARK(BM_FindDuplicates)
+    ->Arg(100000)
+    ->Arg(1000000)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
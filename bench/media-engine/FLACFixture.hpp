@@ -0,0 +1,290 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <openssl/evp.h>
+
+namespace fs = std::filesystem;
+
+/**
+ * Contents of a FLAC file written by encodeFLAC.
+ */
+struct FLACFixture
+{
+    // Vorbis comments, each NAME=value.
+    std::vector<std::string> comments;
+    // Image data of an embedded front cover, or empty for none.
+    std::vector<uint8_t> cover;
+    // Samples per channel of 16-bit stereo at 44.1 kHz.
+    uint32_t samples = 44100;
+    // Seeds the audio, which is noise, so fixtures with different seeds differ in their audio.
+    uint32_t seed = 1;
+    // Samples between seek points, or 0 for no seek table.
+    uint32_t seekSpacing = 0;
+    // Length of the padding block, or 0 for none.
+    uint32_t padding = 0;
+};
+
+namespace FLACFixtureDetail
+{
+
+/**
+ * Bytes of a FLAC stream, written most significant byte first.
+ */
+class Writer
+{
+public:
+    std::vector<uint8_t> bytes;
+
+    void put(uint64_t value, int byteCount)
+    {
+        for (int shift = (byteCount - 1) * 8; shift >= 0; shift -= 8)
+        {
+            this->bytes.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+
+    void putLittle(uint32_t value)
+    {
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            this->bytes.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+
+    void append(const void *data, size_t length)
+    {
+        const uint8_t *first = static_cast<const uint8_t *>(data);
+        this->bytes.insert(this->bytes.end(), first, first + length);
+    }
+};
+
+inline uint8_t crc8(const uint8_t *data, size_t length)
+{
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = static_cast<uint8_t>(crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+inline uint16_t crc16(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= static_cast<uint16_t>(data[i] << 8);
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = static_cast<uint16_t>(crc & 0x8000 ? (crc << 1) ^ 0x8005 : crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+/**
+ * Appends a frame number in the UTF-8 like coding of FLAC frame headers.
+ */
+inline void putFrameNumber(Writer &writer, uint32_t number)
+{
+    if (number < 0x80)
+    {
+        writer.put(number, 1);
+        return;
+    }
+
+    int continuations = 1;
+    while (continuations < 6 && number >= (1u << (5 * continuations + 6)))
+    {
+        continuations++;
+    }
+
+    const uint8_t lead = static_cast<uint8_t>(0xFF00 >> (continuations + 1));
+    writer.put(lead | (number >> (6 * continuations)), 1);
+    for (int i = continuations - 1; i >= 0; i--)
+    {
+        writer.put(0x80 | ((number >> (6 * i)) & 0x3F), 1);
+    }
+}
+
+inline void putBlockHeader(Writer &writer, uint8_t type, bool last, size_t length)
+{
+    writer.put((last ? 0x80 : 0) | type, 1);
+    writer.put(length, 3);
+}
+
+} // namespace FLACFixtureDetail
+
+/**
+ * Encodes a fixture the way an encoder lays a tagged file out: STREAMINFO with the
+ * audio MD5, the seek table, cover, comments and padding in that order, then frames of
+ * 4096 samples with their CRCs. Noise barely compresses, so each channel is stored as a
+ * verbatim subframe and the audio takes four bytes per sample.
+ *
+ * @throws std::runtime_error if the file cannot be written.
+ */
+inline void encodeFLAC(const fs::path &location, const FLACFixture &fixture)
+{
+    using namespace FLACFixtureDetail;
+
+    const uint32_t blockSize = 4096;
+    const uint32_t sampleRate = 44100;
+
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> md5(EVP_MD_CTX_new(), &EVP_MD_CTX_free);
+    EVP_DigestInit_ex(md5.get(), EVP_md5(), nullptr);
+
+    Writer audio;
+    std::vector<uint64_t> frameOffsets;
+    std::vector<int16_t> samples(blockSize * 2);
+    uint32_t noise = fixture.seed;
+    uint32_t minFrameSize = UINT32_MAX;
+    uint32_t maxFrameSize = 0;
+
+    for (uint32_t done = 0; done < fixture.samples; done += blockSize)
+    {
+        const uint32_t count = std::min(blockSize, fixture.samples - done);
+        for (uint32_t i = 0; i < count * 2; i++)
+        {
+            noise = noise * 1664525 + 1013904223;
+            samples[i] = static_cast<int16_t>(noise >> 16);
+        }
+
+        // The MD5 covers the interleaved samples, little endian.
+        for (uint32_t i = 0; i < count * 2; i++)
+        {
+            const uint8_t sample[2] = {static_cast<uint8_t>(samples[i]), static_cast<uint8_t>(samples[i] >> 8)};
+            EVP_DigestUpdate(md5.get(), sample, 2);
+        }
+
+        const size_t frameStart = audio.bytes.size();
+        frameOffsets.push_back(frameStart);
+
+        // Fixed blocking, 44.1 kHz, left and right channels of 16 bits. A short last frame
+        // stores its block size after the frame number.
+        audio.put(0xFFF8, 2);
+        audio.put((count == blockSize ? 0xC0 : 0x70) | 0x09, 1);
+        audio.put(0x18, 1);
+        putFrameNumber(audio, done / blockSize);
+        if (count != blockSize)
+        {
+            audio.put(count - 1, 2);
+        }
+        audio.put(crc8(audio.bytes.data() + frameStart, audio.bytes.size() - frameStart), 1);
+
+        for (int channel = 0; channel < 2; channel++)
+        {
+            audio.put(0x02, 1);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                audio.put(static_cast<uint16_t>(samples[i * 2 + channel]), 2);
+            }
+        }
+
+        audio.put(crc16(audio.bytes.data() + frameStart, audio.bytes.size() - frameStart), 2);
+
+        const uint32_t frameSize = static_cast<uint32_t>(audio.bytes.size() - frameStart);
+        minFrameSize = std::min(minFrameSize, frameSize);
+        maxFrameSize = std::max(maxFrameSize, frameSize);
+    }
+
+    uint8_t audioMD5[16];
+    EVP_DigestFinal_ex(md5.get(), audioMD5, nullptr);
+
+    Writer file;
+    file.append("fLaC", 4);
+
+    putBlockHeader(file, 0, false, 34);
+    file.put(blockSize, 2);
+    file.put(blockSize, 2);
+    file.put(frameOffsets.empty() ? 0 : minFrameSize, 3);
+    file.put(maxFrameSize, 3);
+    // Sample rate, channels - 1, bits per sample - 1 and the 36-bit sample count.
+    file.put((static_cast<uint64_t>(sampleRate) << 44) | (static_cast<uint64_t>(1) << 41) |
+                 (static_cast<uint64_t>(15) << 36) | fixture.samples,
+             8);
+    file.append(audioMD5, sizeof(audioMD5));
+
+    if (fixture.seekSpacing > 0)
+    {
+        // Each point names the frame holding its sample, and points sharing a frame merge.
+        std::vector<uint32_t> points;
+        for (uint64_t sample = 0; sample < fixture.samples; sample += fixture.seekSpacing)
+        {
+            const uint32_t frame = static_cast<uint32_t>(sample / blockSize);
+            if (points.empty() || points.back() != frame)
+            {
+                points.push_back(frame);
+            }
+        }
+
+        putBlockHeader(file, 3, false, points.size() * 18);
+        for (uint32_t frame : points)
+        {
+            file.put(static_cast<uint64_t>(frame) * blockSize, 8);
+            file.put(frameOffsets[frame], 8);
+            file.put(std::min(blockSize, fixture.samples - frame * blockSize), 2);
+        }
+    }
+
+    if (!fixture.cover.empty())
+    {
+        const std::string mimeType = "image/jpeg";
+        putBlockHeader(file, 6, false, 32 + mimeType.size() + fixture.cover.size());
+        file.put(3, 4);
+        file.put(mimeType.size(), 4);
+        file.append(mimeType.data(), mimeType.size());
+        // No description; 500x500, 24 bits per pixel, not indexed.
+        file.put(0, 4);
+        file.put(500, 4);
+        file.put(500, 4);
+        file.put(24, 4);
+        file.put(0, 4);
+        file.put(fixture.cover.size(), 4);
+        file.append(fixture.cover.data(), fixture.cover.size());
+    }
+
+    const std::string vendor = "mellophone bench";
+    size_t commentsLength = 8 + vendor.size();
+    for (const std::string &comment : fixture.comments)
+    {
+        commentsLength += 4 + comment.size();
+    }
+
+    putBlockHeader(file, 4, fixture.padding == 0, commentsLength);
+    file.putLittle(static_cast<uint32_t>(vendor.size()));
+    file.append(vendor.data(), vendor.size());
+    file.putLittle(static_cast<uint32_t>(fixture.comments.size()));
+    for (const std::string &comment : fixture.comments)
+    {
+        file.putLittle(static_cast<uint32_t>(comment.size()));
+        file.append(comment.data(), comment.size());
+    }
+
+    if (fixture.padding > 0)
+    {
+        putBlockHeader(file, 1, true, fixture.padding);
+        file.bytes.insert(file.bytes.end(), fixture.padding, 0);
+    }
+
+    std::ofstream out(location, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(file.bytes.data()), file.bytes.size());
+    out.write(reinterpret_cast<const char *>(audio.bytes.data()), audio.bytes.size());
+    if (!out)
+    {
+        throw std::runtime_error("Unable to write '" + location.string() + "'");
+    }
+}
@@ -0,0 +1,194 @@
+#include <array>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <FLACTrack.hpp>
+#include <HashReader.hpp>
+#include <Sha256Engine.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+namespace fs = std::filesystem;
+
+/**
+ * File to hash. Set MELLOPHONE_BENCH_FILE to measure a real (large) FLAC file;
+ * otherwise a 256 MiB file of random bytes is generated once per run.
+ */
+static const fs::path &benchFile()
+{
+  static fs::path filePath;
+
+  if (!filePath.empty())
+  {
+    return filePath;
+  }
+
+  const char *override = getenv("MELLOPHONE_BENCH_FILE");
+  if (override != nullptr)
+  {
+    filePath = override;
+    return filePath;
+  }
+
+  filePath = fs::temp_directory_path() / "mellophone-hash-bench.bin";
+  if (!fs::exists(filePath) || fs::file_size(filePath) != 256 * MEGABYTE)
+  {
+    std::mt19937_64 random(42);
+    std::vector<uint64_t> block(MEGABYTE / sizeof(uint64_t));
+    std::ofstream out(filePath, std::ios::binary);
+
+    for (uint32_t i = 0; i < 256; i++)
+    {
+      for (auto &word : block)
+      {
+        word = random();
+      }
+      out.write(reinterpret_cast<const char *>(block.data()), MEGABYTE);
+    }
+  }
+
+  return filePath;
+}
+
+static const char *modeLabel(HashReadMode mode)
+{
+  switch (mode)
+  {
+  case HashReadMode::mmap:
+    return "mmap";
+  case HashReadMode::ioUring:
+    return "io_uring";
+  default:
+    return "pread";
+  }
+}
+
+/**
+ * Raw read throughput of each mode, without hashing.
+ */
+static void BM_HashReaderRead(benchmark::State &state)
+{
+  HashReader reader(static_cast<HashReadMode>(state.range(0)));
+  const fs::path &filePath = benchFile();
+  const int64_t fileSize = fs::file_size(filePath);
+
+  for (auto _ : state)
+  {
+    uint64_t checksum = 0;
+    reader.read(filePath, [&checksum](const uint8_t *data, size_t length) {
+      checksum += data[0] + data[length - 1];
+    });
+    benchmark::DoNotOptimize(checksum);
+  }
+
+  state.SetBytesProcessed(state.iterations() * fileSize);
+  state.SetLabel(modeLabel(static_cast<HashReadMode>(state.range(0))));
+}
+BENCHMARK(BM_HashReaderRead)
+    ->Arg(static_cast<int>(HashReadMode::mmap))
+    ->Arg(static_cast<int>(HashReadMode::pread))
+    ->Arg(static_cast<int>(HashReadMode::ioUring))
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+/**
+ * End-to-end Track::generateFileHash throughput for each mode.
+ */
+static void BM_GenerateFileHash(benchmark::State &state)
+{
+  const HashReadMode mode = static_cast<HashReadMode>(state.range(0));
+  const fs::path &filePath = benchFile();
+  FLACTrack track(filePath);
+
+  for (auto _ : state)
+  {
+    track.generateFileHash(mode);
+  }
+
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(fs::file_size(filePath)));
+  state.SetLabel(modeLabel(mode));
+}
+BENCHMARK(BM_GenerateFileHash)
+    ->Arg(static_cast<int>(HashReadMode::mmap))
+    ->Arg(static_cast<int>(HashReadMode::pread))
+    ->Arg(static_cast<int>(HashReadMode::ioUring))
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+/**
+ * Single-stream SHA-256 throughput of each backend, on data already in memory.
+ */
+static void BM_Sha256Hasher(benchmark::State &state)
+{
+  const Sha256Backend backend = static_cast<Sha256Backend>(state.range(0));
+  if (!Sha256Engine::isSupported(backend))
+  {
+    state.SkipWithError("backend not supported on this CPU");
+    return;
+  }
+
+  std::vector<uint8_t> data(16 * MEGABYTE, 0x5a);
+  uint8_t digest[SHA256_DIGEST_SIZE];
+  Sha256Hasher hasher(backend);
+
+  for (auto _ : state)
+  {
+    hasher.reset();
+    hasher.update(data.data(), data.size());
+    hasher.finish(digest);
+    benchmark::DoNotOptimize(digest);
+  }
+
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(data.size()));
+  state.SetLabel(backend == Sha256Backend::shaNi ? "sha-ni" : "openssl");
+}
+BENCHMARK(BM_Sha256Hasher)
+    ->Arg(static_cast<int>(Sha256Backend::openssl))
+    ->Arg(static_cast<int>(Sha256Backend::shaNi))
+    ->Unit(benchmark::kMillisecond);
+
+/**
+ * Aggregate throughput of eight streams hashed in lock-step, on data already in memory.
+ */
+static void BM_Sha256MultiBuffer(benchmark::State &state)
+{
+  const Sha256Backend backend = static_cast<Sha256Backend>(state.range(0));
+  std::vector<uint8_t> data(4 * MEGABYTE, 0x5a);
+  std::array<const uint8_t *, Sha256MultiBuffer::LANES> laneData;
+  std::array<size_t, Sha256MultiBuffer::LANES> laneLengths;
+  uint8_t digest[SHA256_DIGEST_SIZE];
+  Sha256MultiBuffer hasher(backend);
+
+  laneData.fill(data.data());
+  laneLengths.fill(data.size());
+
+  for (auto _ : state)
+  {
+    for (size_t lane = 0; lane < Sha256MultiBuffer::LANES; lane++)
+    {
+      hasher.reset(lane);
+    }
+
+    hasher.update(laneData, laneLengths);
+
+    for (size_t lane = 0; lane < Sha256MultiBuffer::LANES; lane++)
+    {
+      hasher.finish(lane, digest);
+    }
+    benchmark::DoNotOptimize(digest);
+  }
+
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(data.size() * Sha256MultiBuffer::LANES));
+  state.SetLabel(hasher.isVectorized() ? "avx2" : "serial");
+}
+BENCHMARK(BM_Sha256MultiBuffer)
+    ->Arg(static_cast<int>(Sha256Backend::avx2))
+    ->Arg(static_cast<int>(Sha256Backend::openssl))
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
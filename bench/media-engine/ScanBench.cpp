@@ -0,0 +1,267 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <DirectoryWalker.hpp>
+#include <IoRing.hpp>
+#include <Library.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+namespace fs = std::filesystem;
+
+static const uint32_t CORPUS_FILES = 10000;
+static const uint32_t WALK_CORPUS_FILES = 200000;
+
+/**
+ * Directory to scan. Set MELLOPHONE_BENCH_CORPUS to measure a real library; otherwise
+ * 10,000 small FLAC files spread over 100 album folders are generated once per run.
+ *
+ * The page cache is left as it is, so the first iteration may read from disk and the
+ * rest from memory. Drop the caches between runs to compare the backends cold.
+ */
+static const fs::path &benchCorpus()
+{
+  static fs::path corpus;
+
+  if (!corpus.empty())
+  {
+    return corpus;
+  }
+
+  const char *override = getenv("MELLOPHONE_BENCH_CORPUS");
+  if (override != nullptr)
+  {
+    corpus = override;
+    return corpus;
+  }
+
+  corpus = fs::temp_directory_path() / "mellophone-scan-bench";
+  const fs::path marker = corpus / "complete";
+  if (fs::exists(marker))
+  {
+    return corpus;
+  }
+
+  fs::remove_all(corpus);
+
+  // Minimal FLAC files: STREAMINFO, a comment block giving a unique title so no file is
+  // a copy of another, then 16-48 KiB of audio.
+  for (uint32_t i = 0; i < CORPUS_FILES; i++)
+  {
+    const std::string entry = "TITLE=Track " + std::to_string(i);
+    const fs::path album = corpus / ("Album " + std::to_string(i / 100));
+    if (i % 100 == 0)
+    {
+      fs::create_directories(album);
+    }
+
+    std::vector<char> file = {'f', 'L', 'a', 'C', 0, 0, 0, 34};
+    file.insert(file.end(), 34, static_cast<char>(i));
+    file.insert(file.end(), {static_cast<char>(0x84), 0, 0, static_cast<char>(12 + entry.size())});
+    file.insert(file.end(), {0, 0, 0, 0, 1, 0, 0, 0, static_cast<char>(entry.size()), 0, 0, 0});
+    file.insert(file.end(), entry.begin(), entry.end());
+    for (uint32_t length = 16384 + (i % 3) * 16384; length > 0; length--)
+    {
+      file.push_back(static_cast<char>(i * 31 + length));
+    }
+
+    std::ofstream(album / (std::to_string(i) + ".flac"), std::ios::binary).write(file.data(), file.size());
+  }
+
+  std::ofstream(marker) << "";
+  return corpus;
+}
+
+/**
+ * Full import of the corpus into an empty library, with each read backend and hash policy.
+ */
+static void BM_ScanLibrary(benchmark::State &state)
+{
+  const ReadBackend backend = static_cast<ReadBackend>(state.range(0));
+  if (backend == ReadBackend::ioUring && !IoRing::isSupported())
+  {
+    state.SkipWithError("io_uring not available");
+    return;
+  }
+
+  const fs::path &corpus = benchCorpus();
+  const fs::path dataDir = fs::temp_directory_path() / "mellophone-scan-bench-data";
+
+  ScanOptions options;
+  options.readBackend = backend;
+  options.hashPolicy = static_cast<HashPolicy>(state.range(1));
+
+  uint64_t files = 0;
+  uint64_t bytes = 0;
+
+  for (auto _ : state)
+  {
+    state.PauseTiming();
+    fs::remove_all(dataDir);
+    state.ResumeTiming();
+
+    Library lib(corpus, dataDir);
+    lib.scanLibrary(options);
+
+    const ScanProgress progress = lib.getScanProgress();
+    files += progress.totals.filesSeen;
+    bytes += progress.bytesRead;
+  }
+
+  fs::remove_all(dataDir);
+
+  state.SetItemsProcessed(static_cast<int64_t>(files));
+  state.SetBytesProcessed(static_cast<int64_t>(bytes));
+  state.SetLabel(std::string(backend == ReadBackend::ioUring ? "io_uring" : "threads") +
+                 (options.hashPolicy == HashPolicy::full ? "/full" : "/tiered"));
+}
+BENCHMARK(BM_ScanLibrary)
+    ->Args({static_cast<int>(ReadBackend::threads), static_cast<int>(HashPolicy::tiered)})
+    ->Args({static_cast<int>(ReadBackend::ioUring), static_cast<int>(HashPolicy::tiered)})
+    ->Args({static_cast<int>(ReadBackend::threads), static_cast<int>(HashPolicy::full)})
+    ->Args({static_cast<int>(ReadBackend::ioUring), static_cast<int>(HashPolicy::full)})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+/**
+ * Rescan of an unchanged library, which costs a stat per file.
+ */
+static void BM_RescanUnchanged(benchmark::State &state)
+{
+  const ReadBackend backend = static_cast<ReadBackend>(state.range(0));
+  if (backend == ReadBackend::ioUring && !IoRing::isSupported())
+  {
+    state.SkipWithError("io_uring not available");
+    return;
+  }
+
+  const fs::path &corpus = benchCorpus();
+  const fs::path dataDir = fs::temp_directory_path() / "mellophone-rescan-bench-data";
+  fs::remove_all(dataDir);
+
+  ScanOptions options;
+  options.readBackend = backend;
+
+  Library lib(corpus, dataDir);
+  lib.scanLibrary(options);
+
+  for (auto _ : state)
+  {
+    lib.scanLibrary(options);
+  }
+
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(lib.getScanProgress().totals.filesSeen));
+  state.SetLabel(backend == ReadBackend::ioUring ? "io_uring" : "threads");
+}
+BENCHMARK(BM_RescanUnchanged)
+    ->Arg(static_cast<int>(ReadBackend::threads))
+    ->Arg(static_cast<int>(ReadBackend::ioUring))
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+/**
+ * Tree to walk: 200,000 empty files, half of them FLAC and half cover art and logs,
+ * in 2,000 album folders under 200 artist folders. Set MELLOPHONE_BENCH_CORPUS to
+ * walk a real library instead.
+ */
+static const fs::path &walkCorpus()
+{
+  static fs::path corpus;
+
+  if (!corpus.empty())
+  {
+    return corpus;
+  }
+
+  const char *override = getenv("MELLOPHONE_BENCH_CORPUS");
+  if (override != nullptr)
+  {
+    corpus = override;
+    return corpus;
+  }
+
+  corpus = fs::temp_directory_path() / "mellophone-walk-bench";
+  const fs::path marker = corpus / "complete";
+  if (fs::exists(marker))
+  {
+    return corpus;
+  }
+
+  fs::remove_all(corpus);
+
+  for (uint32_t i = 0; i < WALK_CORPUS_FILES; i++)
+  {
+    const fs::path album =
+        corpus / ("Artist " + std::to_string(i / 1000)) / ("Album " + std::to_string(i / 100));
+    if (i % 100 == 0)
+    {
+      fs::create_directories(album);
+    }
+
+    std::ofstream(album / (std::to_string(i) + (i % 2 == 0 ? ".flac" : ".jpg")));
+  }
+
+  std::ofstream(marker) << "";
+  return corpus;
+}
+
+/**
+ * Finding the FLAC files of the tree, as a full scan does before reading any of them.
+ */
+static void BM_WalkDirectory(benchmark::State &state)
+{
+  const fs::path &corpus = walkCorpus();
+
+  WalkOptions options;
+  options.threadCount = static_cast<uint32_t>(state.range(0));
+  options.extensions = {".flac"};
+  WalkSummary summary;
+
+  for (auto _ : state)
+  {
+    summary = DirectoryWalker(options).walk(corpus, [](fs::path &&location) {
+      benchmark::DoNotOptimize(location);
+      return true;
+    });
+  }
+
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(summary.files + summary.filtered));
+}
+BENCHMARK(BM_WalkDirectory)->Arg(1)->Arg(4)->Arg(8)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/**
+ * The same walk with std::filesystem, for comparison.
+ */
+static void BM_WalkDirectoryIterator(benchmark::State &state)
+{
+  const fs::path &corpus = walkCorpus();
+  int64_t entries = 0;
+
+  for (auto _ : state)
+  {
+    entries = 0;
+    std::error_code err;
+    for (auto iter = fs::recursive_directory_iterator(corpus, err), end = fs::recursive_directory_iterator();
+         iter != end; iter.increment(err))
+    {
+      if (iter->is_regular_file(err))
+      {
+        entries++;
+        if (iter->path().extension() == ".flac")
+        {
+          benchmark::DoNotOptimize(iter->path());
+        }
+      }
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * entries);
+}
+BENCHMARK(BM_WalkDirectoryIterator)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,140 @@
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <FLACMetadata.hpp>
+#include <FLACTrack.hpp>
+#include <Track.hpp>
+
+#include "FLACFixture.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace fs = std::filesystem;
+
+/**
+ * Exposes the protected helpers of Track to the benchmarks.
+ */
+class BenchTrack : public Track
+{
+public:
+  BenchTrack() : Track(fs::path("bench.flac")) {}
+
+  void importMetadata() override {}
+
+  using Track::parseVorbisComments;
+  using Track::urlEncode;
+};
+
+static const std::vector<std::string> COMMENTS = {
+    "TITLE=Benchmark Track", "ARTIST=Some Artist", "ARTIST=Another Artist", "ALBUM=Some Album",
+    "DATE=2020-04-01",       "TRACKNUMBER=3",      "TOTALTRACKS=12",        "DISCNUMBER=1",
+    "GENRE=Rock",            "COPYRIGHT=2020",     "ENCODER=bench",         "REPLAYGAIN_TRACK_GAIN=-7.1 dB"};
+
+/**
+ * FLAC file laid out like a tagged rip: STREAMINFO, a seek table, embedded cover art of
+ * the given size, comments and padding, followed by a megabyte of audio. Encoded once
+ * per cover size per run.
+ */
+static const fs::path &flacFile(uint32_t coverKilobytes)
+{
+  static std::map<uint32_t, fs::path> files;
+
+  fs::path &filePath = files[coverKilobytes];
+  if (!filePath.empty())
+  {
+    return filePath;
+  }
+
+  FLACFixture fixture;
+  fixture.comments = COMMENTS;
+  fixture.cover.assign(coverKilobytes * 1024, 0xFF);
+  fixture.samples = MEGABYTE / 4;
+  fixture.seekSpacing = 4096 * 10;
+  fixture.padding = 8192;
+
+  filePath = fs::temp_directory_path() / ("mellophone-track-bench-" + std::to_string(coverKilobytes) + ".flac");
+  encodeFLAC(filePath, fixture);
+
+  return filePath;
+}
+
+/**
+ * Per-file cost of FLACTrack::importMetadata, with cover art that fits in the first read
+ * and cover art that has to be skipped over.
+ */
+static void BM_FLACImportMetadata(benchmark::State &state)
+{
+  const fs::path &filePath = flacFile(static_cast<uint32_t>(state.range(0)));
+
+  for (auto _ : state)
+  {
+    FLACTrack track(filePath);
+    track.importMetadata();
+    benchmark::DoNotOptimize(track.getTitle());
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(std::to_string(state.range(0)) + " KiB cover");
+}
+BENCHMARK(BM_FLACImportMetadata)
+    ->Arg(16)
+    ->Arg(1024)
+    ->Unit(benchmark::kNanosecond);
+
+/**
+ * Cost of sniffing a file's format from its first bytes.
+ */
+static void BM_DetermineFormat(benchmark::State &state)
+{
+  const fs::path &filePath = flacFile(16);
+
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(Track::determineFormat(filePath));
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DetermineFormat)->Unit(benchmark::kNanosecond);
+
+/**
+ * Dispatch of already decoded comments into track fields.
+ */
+static void BM_ParseVorbisComments(benchmark::State &state)
+{
+  const fs::path &filePath = flacFile(16);
+  const FLACMetadata metadata = FLACMetadata::read(filePath);
+  BenchTrack track;
+
+  for (auto _ : state)
+  {
+    track.parseVorbisComments(metadata.comments);
+    benchmark::DoNotOptimize(track.getArtists().data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * metadata.comments.size());
+}
+BENCHMARK(BM_ParseVorbisComments)->Unit(benchmark::kNanosecond);
+
+/**
+ * URL encoding of a typical library path, with spaces and punctuation to escape.
+ */
+static void BM_UrlEncode(benchmark::State &state)
+{
+  const string path = "/home/user/Music/Black Keys, The/Attack & Release (HQ)/02 I Got Mine.flac";
+
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(BenchTrack::urlEncode(path));
+  }
+
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(path.size()));
+}
+BENCHMARK(BM_UrlEncode)->Unit(benchmark::kNanosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,119 @@
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <Track.hpp>
+#include <VorbisTrack.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+namespace fs = std::filesystem;
+
+static void putLittleEndian(std::vector<uint8_t> &out, uint64_t value, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+  {
+    out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+  }
+}
+
+/**
+ * Appends a page holding a single packet of less than 255 * 255 bytes.
+ */
+static void putPage(std::ofstream &out, uint8_t headerType, const std::vector<uint8_t> &packet)
+{
+  std::vector<uint8_t> page = {'O', 'g', 'g', 'S', 0, headerType};
+  putLittleEndian(page, 0, 8);
+  putLittleEndian(page, 1, 4);
+  putLittleEndian(page, 0, 4);
+  putLittleEndian(page, 0, 4);
+
+  page.push_back(static_cast<uint8_t>(packet.size() / 255 + 1));
+  page.insert(page.end(), packet.size() / 255, 255);
+  page.push_back(static_cast<uint8_t>(packet.size() % 255));
+  page.insert(page.end(), packet.begin(), packet.end());
+
+  out.write(reinterpret_cast<const char *>(page.data()), page.size());
+}
+
+/**
+ * Ogg Vorbis file with realistic headers followed by the given amount of audio pages.
+ * Generated once per size per run.
+ */
+static const fs::path &benchFile(uint32_t audioMegabytes)
+{
+  static std::map<uint32_t, fs::path> files;
+
+  fs::path &filePath = files[audioMegabytes];
+  if (!filePath.empty())
+  {
+    return filePath;
+  }
+
+  filePath = fs::temp_directory_path() / ("mellophone-vorbis-bench-" + std::to_string(audioMegabytes) + ".ogg");
+  std::ofstream out(filePath, std::ios::binary | std::ios::trunc);
+
+  std::vector<uint8_t> identification = {0x01, 'v', 'o', 'r', 'b', 'i', 's'};
+  putLittleEndian(identification, 0, 4);
+  identification.push_back(2);
+  putLittleEndian(identification, 44100, 4);
+  putLittleEndian(identification, 0, 4);
+  putLittleEndian(identification, 192000, 4);
+  putLittleEndian(identification, 0, 4);
+  identification.push_back(0xB8);
+  identification.push_back(1);
+  putPage(out, 0x02, identification);
+
+  const std::vector<std::string> entries = {"TITLE=Benchmark Track", "ARTIST=Some Artist", "ALBUM=Some Album",
+                                            "DATE=2020", "TRACKNUMBER=3", "TOTALTRACKS=12", "GENRE=Rock"};
+  std::vector<uint8_t> comments = {0x03, 'v', 'o', 'r', 'b', 'i', 's'};
+  putLittleEndian(comments, 0, 4);
+  putLittleEndian(comments, entries.size(), 4);
+  for (const auto &entry : entries)
+  {
+    putLittleEndian(comments, entry.size(), 4);
+    comments.insert(comments.end(), entry.begin(), entry.end());
+  }
+  comments.push_back(1);
+  putPage(out, 0, comments);
+
+  // Audio pages of about 4 KiB each.
+  const std::vector<uint8_t> audio(4000, 0x5a);
+  for (uint64_t written = 0; written < static_cast<uint64_t>(audioMegabytes) * MEGABYTE; written += audio.size())
+  {
+    putPage(out, 0, audio);
+  }
+
+  return filePath;
+}
+
+/**
+ * Per-file cost of VorbisTrack::importMetadata for tracks of increasing length. The
+ * time per file should stay flat, since only the header pages are read.
+ */
+static void BM_VorbisImportMetadata(benchmark::State &state)
+{
+  const fs::path &filePath = benchFile(static_cast<uint32_t>(state.range(0)));
+
+  for (auto _ : state)
+  {
+    VorbisTrack track(filePath);
+    track.importMetadata();
+    benchmark::DoNotOptimize(track.getTitle());
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(std::to_string(state.range(0)) + " MiB of audio");
+}
+BENCHMARK(BM_VorbisImportMetadata)
+    ->Arg(1)
+    ->Arg(16)
+    ->Arg(256)
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,43 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+
+using std::string;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+// Fixed queries behind the library's browse views. Each one is answered from an index
+// (see SQLITE_BROWSE_INDEXES_STMT); SchemaTest checks that none of them, nor the
+// filtered queries LibraryQuery builds, scans a table.
+
+// Hash of an album's cover art in the cover art cache.
+static const string ALBUM_COVER_SQL = "SELECT CoverHash FROM Albums WHERE ID == @id;";
+
+// Tracks below a folder, given the folder path with a trailing slash and the same path
+// with that slash replaced by the next character, '0'. A range rather than LIKE, which
+// cannot use the index.
+static const string FOLDER_TRACKS_SQL =
+    "SELECT ID, FileLocation FROM Tracks WHERE FileLocation >= @folder AND FileLocation < @folderEnd "
+    "ORDER BY FileLocation;";
+
+static const string BROWSE_QUERIES[] = {ALBUM_COVER_SQL, FOLDER_TRACKS_SQL};
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -0,0 +1,161 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "Thumbnail.hpp"
+
+namespace fs = std::filesystem;
+
+using std::string;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+/**
+ * Largest embedded picture the cache accepts. Anything bigger is almost certainly
+ * not cover art.
+ */
+static const uint32_t MAX_COVER_ART_SIZE = 32 * 1024 * 1024;
+
+/**
+ * On-disk store of cover art, addressed by the SHA-256 of each image.
+ *
+ * Every distinct image is stored once, however many albums or tracks embed it, as
+ * `originals/<first two hex digits>/<hash>.<ext>`. A JPEG thumbnail no larger than
+ * THUMBNAIL_SIZE is made for it in the background as `thumbnails/<hash>.jpg`, so grid
+ * views read a few kilobytes per album instead of the full image. The database only
+ * keeps the hash.
+ *
+ * Files are written under a temporary name and renamed into place, so readers never
+ * see a partial image. Every method may be called from any thread.
+ */
+class CoverArtCache
+{
+private:
+    fs::path originalsDir;
+    fs::path thumbnailsDir;
+    uint32_t threadCount;
+
+    // Thumbnails waiting for or being generated, by hash, and those not yet picked up.
+    std::mutex lock;
+    std::condition_variable queued;
+    std::condition_variable idle;
+    std::unordered_set<string> pending;
+    std::deque<string> queue;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    /**
+     * Writes a file atomically, replacing any file already at the location.
+     */
+    static void writeFile(const fs::path &location, const uint8_t *data, size_t length);
+
+    /**
+     * Queues a thumbnail for the background workers, starting them on first use.
+     */
+    void queueThumbnail(const string &hash);
+
+    /**
+     * Worker loop. Generates queued thumbnails until the cache is destroyed.
+     */
+    void generateThumbnails();
+
+    /**
+     * Generates the thumbnail for a stored image, if it does not exist yet.
+     *
+     * @returns false if the original is missing or could not be decoded.
+     */
+    bool generateThumbnail(const string &hash);
+
+    /**
+     * Finds the stored original of an image, whatever its extension.
+     *
+     * @returns the location of the original, or an empty path if it is not stored.
+     */
+    fs::path findOriginal(const string &hash);
+
+public:
+    /**
+     * @param cacheDir directory to keep the images in. Created if missing.
+     * @param threadCount number of background thumbnail workers. 0 uses half the
+     *                    hardware threads.
+     */
+    explicit CoverArtCache(const fs::path &cacheDir, uint32_t threadCount = 0);
+
+    /**
+     * Stops the thumbnail workers. Thumbnails still queued are dropped; they are made
+     * on demand when next requested.
+     */
+    ~CoverArtCache();
+
+    CoverArtCache(const CoverArtCache &) = delete;
+    CoverArtCache &operator=(const CoverArtCache &) = delete;
+
+    /**
+     * Adds an image to the cache unless it is already there, and queues its thumbnail.
+     *
+     * @param data image file contents
+     * @param length number of bytes in the image
+     *
+     * @returns the image's hash, as lowercase hex.
+     */
+    string store(const uint8_t *data, size_t length);
+
+    /**
+     * Reads an image embedded in a file and stores it.
+     *
+     * @param location file holding the image
+     * @param offset position of the image in the file
+     * @param length size of the image
+     *
+     * @returns the image's hash, or an empty string if it could not be read or is too large.
+     */
+    string storeFromFile(const fs::path &location, uint64_t offset, uint32_t length);
+
+    /**
+     * Returns the location of a stored original image, or an empty path if the hash
+     * is not in the cache.
+     */
+    fs::path getOriginal(const string &hash);
+
+    /**
+     * Returns the location of an image's thumbnail, generating it on the calling thread
+     * if the background workers have not got to it yet.
+     *
+     * @returns the thumbnail's location, or an empty path if the image is not stored or
+     *          cannot be decoded.
+     */
+    fs::path getThumbnail(const string &hash);
+
+    /**
+     * Waits until every queued thumbnail has been generated.
+     */
+    void waitForThumbnails();
+};
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -0,0 +1,152 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+using std::string;
+using std::string_view;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+/**
+ * Size of the buffer each DirectoryWalker thread reads directory entries into. Large
+ * enough for a few hundred entries per system call.
+ */
+static const size_t WALK_BUFFER_SIZE = 64 * 1024;
+
+/**
+ * Which parts of a tree a DirectoryWalker visits.
+ */
+struct WalkOptions
+{
+    /**
+     * Number of threads reading directories. A value of 0 uses one per hardware thread,
+     * up to 8; past that, the storage rather than the threads sets the pace.
+     */
+    uint32_t threadCount = 0;
+
+    /**
+     * Extensions, with their dot, of the files reported. Compared case-sensitively, as
+     * Track::formatFromExtension does. Empty to report every regular file.
+     */
+    std::vector<string> extensions;
+
+    /**
+     * Directories not to descend into. An absolute path excludes that directory; any
+     * other entry excludes every directory with that name.
+     */
+    std::vector<string> excludedDirectories;
+
+    /**
+     * Whether to skip directories whose name starts with a dot.
+     */
+    bool skipHidden = true;
+
+    /**
+     * Whether to descend into symbolic links to directories. Links to files are always
+     * reported.
+     */
+    bool followLinks = true;
+};
+
+/**
+ * Totals of a walk.
+ */
+struct WalkSummary
+{
+    uint64_t directories = 0;
+    // Files passed to the callback.
+    uint64_t files = 0;
+    // Files left out because of their extension.
+    uint64_t filtered = 0;
+    // Directories that could not be read, and links that could not be followed.
+    uint64_t unreadable = 0;
+    // Directories reached a second time, through a link or a mount, and not read again.
+    uint64_t revisited = 0;
+};
+
+/**
+ * Enumerates the regular files below a directory on several threads.
+ *
+ * Directories are read with getdents64 into a large buffer, so each system call returns
+ * hundreds of entries, and entries are sorted out by their type and extension before
+ * anything is stat'ed. Only symbolic links, and entries on filesystems that do not
+ * report a type, cost a stat, and each directory costs one fstat to tell whether it
+ * has been visited.
+ *
+ * Each thread keeps a stack of directories it has found and works depth-first through
+ * it; an idle thread steals the oldest directory from another's stack, which is the
+ * one nearest the root and so usually the largest piece of work left. A directory
+ * reached twice, whether through a link loop or two links to one place, is only read
+ * the first time, going by its device and inode.
+ */
+class DirectoryWalker
+{
+private:
+    struct Walk;
+
+    WalkOptions options;
+
+    /**
+     * Thread loop. Reads directories until the walk is finished or stopped.
+     */
+    void work(Walk &walk, size_t self);
+
+    /**
+     * Reads one directory, reporting its files and queueing its subdirectories.
+     */
+    void readDirectory(Walk &walk, size_t self, string &&path);
+
+    /**
+     * Whether a file name ends in one of the extensions reported.
+     */
+    bool isWanted(string_view name) const;
+
+    /**
+     * Whether a directory is to be skipped because it is hidden or excluded.
+     */
+    bool isExcluded(string_view name, const string &path) const;
+
+public:
+    explicit DirectoryWalker(const WalkOptions &options = WalkOptions());
+
+    /**
+     * Walks the tree below `root`. The callback is called on the walker's threads,
+     * possibly several at once, in no particular order.
+     *
+     * @param root directory to start from
+     * @param onFile receives the location of each file found. Returns false to end the
+     *               walk early.
+     *
+     * @returns totals of the walk.
+     *
+     * @throws std::runtime_error if `root` cannot be read.
+     */
+    WalkSummary walk(const fs::path &root, const std::function<bool(fs::path &&)> &onFile);
+};
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -0,0 +1,183 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+using std::string;
+using std::vector;
+
+struct inotify_event;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+/**
+ * Changes seen under a watched directory, coalesced by path.
+ */
+struct WatchBatch
+{
+    // Files created, rewritten or moved into the tree, in path order.
+    vector<fs::path> changed;
+
+    // Files and directories deleted or moved out of the tree, in path order.
+    vector<fs::path> removed;
+
+    // The kernel dropped events, so the batch is incomplete and the tree needs a full scan.
+    bool overflowed = false;
+
+    bool empty() const;
+};
+
+/**
+ * Tunables for a DirectoryWatcher.
+ */
+struct WatchOptions
+{
+    /**
+     * A batch is delivered once no event has arrived for this long...
+     */
+    std::chrono::milliseconds quietPeriod{500};
+
+    /**
+     * ...or once its first event is this old, so a steady stream of changes is still
+     * delivered regularly.
+     */
+    std::chrono::milliseconds maxDelay{5000};
+
+    /**
+     * Directories not watched, as for a full scan: absolute paths, or names excluded
+     * wherever they appear.
+     */
+    std::vector<std::string> excludedDirectories;
+
+    /**
+     * Whether directories whose name starts with a dot are not watched.
+     */
+    bool skipHiddenDirectories = true;
+};
+
+/**
+ * Recursive inotify watch of a directory tree.
+ *
+ * Events are gathered on a thread of the watcher's own and coalesced by path, so a
+ * tagger rewriting 200 files in a burst produces a single batch of 200 paths, and a
+ * file written several times appears in it once. Directories created or moved into
+ * the tree are watched as they appear and every file already inside them is reported.
+ *
+ * Files are reported once they are closed after writing or moved into place, never
+ * while they are still being written. Hidden and excluded directories are neither
+ * watched nor reported, as a full scan never descends into them.
+ */
+class DirectoryWatcher
+{
+private:
+    fs::path root;
+    WatchOptions options;
+    std::function<void(WatchBatch &&)> onBatch;
+
+    int inotifyFD = -1;
+    // Written to by the destructor to wake the watcher thread.
+    int wakeFD = -1;
+    bool watchLimitReported = false;
+
+    // Watched directories, by watch descriptor.
+    std::unordered_map<int, fs::path> directories;
+
+    // Paths changed since the last batch: true if the path now exists, false if it was removed.
+    std::map<string, bool> pending;
+    bool overflowed = false;
+
+    std::thread thread;
+
+    /**
+     * Watches a directory and every directory below it.
+     *
+     * @param dir directory to watch
+     * @param reportFiles whether files already in the tree are reported as changed
+     */
+    void watchTree(const fs::path &dir, bool reportFiles);
+
+    /**
+     * Whether a directory is left unwatched because it is hidden or excluded.
+     */
+    bool isExcluded(const fs::path &dir) const;
+
+    /**
+     * Stops watching a directory and every directory below it.
+     */
+    void unwatchTree(const fs::path &dir);
+
+    /**
+     * Records that a path was removed, dropping any change pending below it.
+     */
+    void markRemoved(const fs::path &location);
+
+    /**
+     * Reads every event waiting on the inotify descriptor.
+     */
+    void readEvents();
+
+    /**
+     * Folds a single event into the pending changes.
+     */
+    void handleEvent(const inotify_event &event);
+
+    /**
+     * Hands the pending changes to the callback and clears them.
+     */
+    void deliver();
+
+    /**
+     * Watcher loop. Reads events and delivers batches until the watcher is destroyed.
+     */
+    void run();
+
+public:
+    /**
+     * Starts watching a directory tree. Changes made after the constructor returns
+     * are reported.
+     *
+     * @param root directory to watch
+     * @param onBatch called on the watcher's thread with each batch of changes. Events
+     *                arriving while it runs wait in the kernel's queue.
+     * @param options debounce timings
+     */
+    DirectoryWatcher(const fs::path &root, const std::function<void(WatchBatch &&)> &onBatch,
+                     const WatchOptions &options = WatchOptions());
+
+    /**
+     * Stops watching. Changes still waiting out their quiet period are delivered
+     * before the destructor returns.
+     */
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(const DirectoryWatcher &) = delete;
+    DirectoryWatcher &operator=(const DirectoryWatcher &) = delete;
+};
+} // namespace MediaEngine
+} // namespace Mellophone
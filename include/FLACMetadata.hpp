@@ -0,0 +1,247 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+#include "VorbisComment.hpp"
+
+namespace fs = std::filesystem;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+/**
+ * Size of each read FLACMetadata::read issues. Covers the whole metadata section of
+ * almost every file that does not embed cover art ahead of its tags.
+ */
+static const size_t FLAC_HEAD_READ_SIZE = 64 * 1024;
+
+/**
+ * Contents of the STREAMINFO block.
+ */
+struct FLACStreamInfo
+{
+    uint32_t minBlockSize = 0;
+    uint32_t maxBlockSize = 0;
+    uint32_t minFrameSize = 0;
+    uint32_t maxFrameSize = 0;
+    uint32_t sampleRate = 0;
+    uint8_t channels = 0;
+    uint8_t bitsPerSample = 0;
+    uint64_t totalSamples = 0;
+    // MD5 of the decoded audio. All zeroes if the encoder did not compute it.
+    std::array<uint8_t, 16> audioMD5{};
+};
+
+/**
+ * One entry of the SEEKTABLE block.
+ */
+struct FLACSeekPoint
+{
+    uint64_t sampleNumber = 0;
+    // Offset of the target frame from the first frame, in bytes.
+    uint64_t streamOffset = 0;
+    uint16_t frameSamples = 0;
+};
+
+/**
+ * Header of a PICTURE block. The image itself is not read; its position in the file
+ * is recorded instead.
+ */
+struct FLACPicture
+{
+    uint32_t type = 0;
+    std::string_view mimeType;
+    std::string_view description;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t colorDepth = 0;
+    uint32_t colorCount = 0;
+    // Position of the image data in the file.
+    uint64_t dataOffset = 0;
+    uint32_t dataLength = 0;
+};
+
+class FLACMetadataParser;
+
+/**
+ * Metadata blocks of a FLAC file.
+ *
+ * Only the blocks the engine uses are kept, in a single buffer owned by this object.
+ * The vendor string, comments and picture strings are views into that buffer, so a
+ * FLACMetadata can be moved but not copied.
+ */
+class FLACMetadata
+{
+private:
+    friend class FLACMetadataParser;
+
+    std::vector<char> storage;
+
+public:
+    bool hasStreamInfo = false;
+    FLACStreamInfo streamInfo;
+
+    std::string_view vendor;
+    std::vector<VorbisComment> comments;
+
+    std::vector<FLACSeekPoint> seekPoints;
+    std::vector<FLACPicture> pictures;
+
+    // Position of the first audio frame in the file.
+    uint64_t audioOffset = 0;
+
+    FLACMetadata() = default;
+    FLACMetadata(const FLACMetadata &) = delete;
+    FLACMetadata &operator=(const FLACMetadata &) = delete;
+    FLACMetadata(FLACMetadata &&) = default;
+    FLACMetadata &operator=(FLACMetadata &&) = default;
+
+    /**
+     * Reads the metadata blocks of a FLAC file.
+     *
+     * The head of the file is read in FLAC_HEAD_READ_SIZE reads; the file is only
+     * read again if the metadata runs past the first one, and large blocks the engine
+     * does not use (picture data, padding) are skipped rather than read.
+     *
+     * @param filePath file to read
+     *
+     * @returns the file's metadata.
+     */
+    static FLACMetadata read(const fs::path &filePath);
+
+    /**
+     * Finishes reading the metadata blocks of a FLAC file with a parser that has
+     * already been fed part of the file, reading only from its nextOffset() on.
+     *
+     * @param filePath file to read
+     * @param parser parser to continue
+     *
+     * @returns the file's metadata.
+     */
+    static FLACMetadata read(const fs::path &filePath, FLACMetadataParser &parser);
+};
+
+/**
+ * Incremental walker over the metadata blocks at the start of a FLAC file.
+ *
+ * The parser is fed chunks of the file along with their position and takes the bytes
+ * it needs from them. Bytes it does not need, such as picture data, are skipped, so a
+ * caller reading the file itself can jump to nextOffset() instead of reading them.
+ * A leading ID3v2 tag is skipped as well.
+ */
+class FLACMetadataParser
+{
+private:
+    enum class Stage
+    {
+        magic,
+        id3Header,
+        blockHeader,
+        blockBody,
+        pictureMime,
+        pictureDescription,
+        pictureFields,
+        finished
+    };
+
+    /**
+     * A range of the metadata's storage.
+     */
+    struct StorageSpan
+    {
+        size_t offset = 0;
+        size_t length = 0;
+    };
+
+    /**
+     * Storage positions of a picture's strings, kept until the views can be made.
+     */
+    struct PendingPicture
+    {
+        StorageSpan mimeType;
+        StorageSpan description;
+    };
+
+    FLACMetadata metadata;
+    Stage stage = Stage::magic;
+
+    // Next byte of the file the parser needs.
+    uint64_t offset = 0;
+
+    // The unit being collected: where it starts in storage and how long it is.
+    size_t unitStart = 0;
+    size_t unitLength = 4;
+
+    // The block being walked.
+    uint8_t blockType = 0;
+    bool lastBlock = false;
+    uint64_t blockStart = 0;
+    uint32_t blockLength = 0;
+
+    std::vector<StorageSpan> commentBlocks;
+    std::vector<PendingPicture> pendingPictures;
+
+    void processUnit();
+    void beginUnit(size_t length);
+    void discardUnit();
+    void nextBlock();
+
+    void readStreamInfo(const uint8_t *data);
+    void readSeekTable(const uint8_t *data);
+
+public:
+    /**
+     * Takes the bytes the parser needs from a chunk of the file.
+     *
+     * Chunks may arrive in any size, but the parser must not be given a chunk that
+     * starts after nextOffset().
+     *
+     * @param chunkOffset position of the chunk in the file
+     * @param data chunk contents
+     * @param length number of bytes in the chunk
+     *
+     * @returns true once every metadata block has been walked.
+     */
+    bool feed(uint64_t chunkOffset, const uint8_t *data, size_t length);
+
+    /**
+     * Whether every metadata block has been walked.
+     */
+    bool isFinished();
+
+    /**
+     * Position of the next byte of the file the parser needs.
+     */
+    uint64_t nextOffset();
+
+    /**
+     * Completes the metadata once the parser has finished.
+     *
+     * @returns the metadata. The parser is left empty.
+     */
+    FLACMetadata finish();
+};
+} // namespace MediaEngine
+} // namespace Mellophone
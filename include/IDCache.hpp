@@ -0,0 +1,83 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "StatementCache.hpp"
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+static const string ARTIST_LOAD_SQL = "SELECT ID, Name FROM Artists ORDER BY ID;";
+static const string ALBUM_LOAD_SQL = "SELECT ID, Name FROM Albums ORDER BY ID;";
+
+/**
+ * In-memory map of artist and album names to their database IDs.
+ *
+ * The cache is warmed with the full Artists and Albums tables before the library
+ * first writes, so resolving a track's artist and album never needs a query. Since the
+ * writer is the only code that adds rows to those tables, a miss means the name
+ * is new. Like the statement cache, it must only be used by one thread at a time.
+ */
+class IDCache
+{
+private:
+    std::unordered_map<string, uint32_t> artistIDs;
+    std::unordered_map<string, uint32_t> albumIDs;
+
+public:
+    /**
+     * Replaces the cache contents with every artist and album in the database.
+     *
+     * @param statements statement cache of the connection to read from
+     */
+    void load(const shared_ptr<StatementCache> &statements);
+
+    /**
+     * Locates an artist's ID.
+     *
+     * @param name artist name to search for (case-sensitive)
+     *
+     * @returns the ID of the artist if known. 0 otherwise.
+     */
+    uint32_t findArtistID(const string &name);
+
+    /**
+     * Locates an album's ID.
+     *
+     * @param name album name to search for (case-sensitive)
+     *
+     * @returns the ID of the album if known. 0 otherwise.
+     */
+    uint32_t findAlbumID(const string &name);
+
+    /**
+     * Records the ID of a newly created artist.
+     */
+    void addArtist(const string &name, uint32_t id);
+
+    /**
+     * Records the ID of a newly created album.
+     */
+    void addAlbum(const string &name, uint32_t id);
+};
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -0,0 +1,276 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "ContentMatcher.hpp"
+#include "IDCache.hpp"
+#include "StatementCache.hpp"
+#include "Track.hpp"
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+// SQL STATEMENTS
+static const string ARTIST_INSERT_SQL = "INSERT INTO Artists(Name) VALUES(@name);";
+
+static const string ALBUM_INSERT_SQL = "INSERT INTO Albums(Name, Artist, CoverHash) VALUES(@name,@artistID,@cover);";
+// The first track with a picture gives an album created without one its cover.
+static const string ALBUM_COVER_UPDATE_SQL = "UPDATE Albums SET CoverHash = @cover WHERE ID == @id AND CoverHash IS NULL;";
+
+static const string BEGIN_TRANSACTION_SQL = "BEGIN TRANSACTION;";
+static const string COMMIT_TRANSACTION_SQL = "COMMIT;";
+
+static const string CHECKSUM_SELECT_SQL = "SELECT ID, FileLocation FROM Tracks WHERE Checksum == @chksum;";
+static const string LOCATION_SELECT_SQL =
+    "SELECT ID, FileSize, PartialHash, Checksum, AudioMD5 FROM Tracks WHERE FileLocation == @loc;";
+static const string SIZE_SELECT_SQL =
+    "SELECT ID, FileLocation, PartialHash, Checksum, AudioMD5 FROM Tracks WHERE FileSize == @size AND FileLocation != @loc;";
+
+// Replacing on conflict drops the stale row of a file that changed since its last import.
+static const string INSERT_TRACK_SQL =
+    "INSERT OR REPLACE INTO Tracks(Checksum, FileLocation, Title, Album, TrackNum, TotalTracks, DiscNum, TotalDiscs, "
+    "FileSize, ModifiedTime, Inode, Device, PartialHash, AudioMD5, Genre, Date, Duration) "
+    "VALUES(@chksum,@loc,@title,@album,@trackNum,@totalTracks,@discNum,@totalDiscs,@size,@mtime,@inode,@device,"
+    "@partial,@audioMD5,@genre,@date,@duration);";
+static const string UPDATE_FINGERPRINT_SQL =
+    "UPDATE Tracks SET FileSize = @size, ModifiedTime = @mtime, Inode = @inode, Device = @device, "
+    "PartialHash = COALESCE(@partial, PartialHash) WHERE ID == @id;";
+// Ignoring conflicts keeps the first row if two already hold the same contents.
+static const string UPDATE_CONTENT_KEYS_SQL =
+    "UPDATE OR IGNORE Tracks SET PartialHash = @partial, Checksum = @chksum WHERE ID == @id;";
+
+static const string DUPLICATE_FILE_INSERT_SQL =
+    "INSERT OR REPLACE INTO DuplicateFiles(FileLocation, Track, FileSize, ModifiedTime, Inode, Device) "
+    "VALUES(@loc,@track,@size,@mtime,@inode,@device);";
+// A file imported as a track is no longer a copy of another.
+static const string DUPLICATE_FILE_DELETE_SQL = "DELETE FROM DuplicateFiles WHERE FileLocation == @loc;";
+
+static const uint32_t DEFAULT_INGEST_BATCH_SIZE = 1000;
+
+/**
+ * Outcome of writing a batch of tracks.
+ */
+struct IngestResult
+{
+    uint64_t inserted = 0;
+    uint64_t duplicates = 0;
+    uint64_t refreshed = 0;
+    uint64_t failed = 0;
+
+    /**
+     * Number of rows written, whatever their outcome.
+     */
+    uint64_t written() const
+    {
+        return this->inserted + this->duplicates + this->refreshed;
+    }
+
+    IngestResult &operator+=(const IngestResult &other)
+    {
+        this->inserted += other.inserted;
+        this->duplicates += other.duplicates;
+        this->refreshed += other.refreshed;
+        this->failed += other.failed;
+        return *this;
+    }
+};
+
+/**
+ * What happened to a single track handed to the writer.
+ */
+enum class IngestOutcome
+{
+    // The track was added.
+    inserted,
+    // The same contents already exist under another path. The file is recorded as a copy
+    // of that track.
+    duplicate,
+    // The file was already imported with these contents; only its fingerprint was updated.
+    refreshed
+};
+
+/**
+ * Bulk writer for imported tracks.
+ *
+ * Duplicates are found with tiered content keys (see ContentMatcher): only tracks whose
+ * size and partial hash match an existing row are read in full, and full hashes computed
+ * for such a collision are stored so they are never computed again. A duplicate is not
+ * imported, but is recorded as a copy of the track it matches.
+ *
+ * Artists and albums are resolved through the IDCache, so existing names cost no
+ * query and new ones cost a single insert. Tracks are written inside a transaction that is committed every `batchSize`
+ * rows, so SQLite syncs to disk once per batch instead of once per row. A row is
+ * only counted once its transaction ends: as written if it committed, as failed if it
+ * was rolled back. Every
+ * statement comes from the connection's StatementCache, so the SQL is compiled once
+ * per connection. The writer must only be used from the thread that owns the
+ * database connection.
+ */
+class IngestWriter
+{
+private:
+    shared_ptr<sqlite3 *> db;
+    shared_ptr<StatementCache> statements;
+    shared_ptr<IDCache> ids;
+    ContentMatcher matcher;
+    uint32_t batchSize;
+    bool inTransaction = false;
+    // Rows written in the open transaction, counted once it commits.
+    IngestResult pending;
+    // Albums known to have a cover, so each is updated at most once per writer.
+    std::unordered_set<uint32_t> albumsWithCover;
+
+    /**
+     * Runs a statement that returns no rows.
+     *
+     * @param sql statement to run
+     */
+    void execute(const string &sql);
+
+    /**
+     * Attempts to locate the track's album ID in the ID cache. In the event that the album
+     * does not exist in the database, a new entry is created and the ID of that is returned.
+     *
+     * @param track track whose album is looked up
+     *
+     * @returns integer ID of the album.
+     */
+    uint32_t getAlbumID(Track &track);
+
+    /**
+     * Attempts to locate the track's artist ID in the ID cache. In the event that the artist
+     * does not exist in the database, a new entry is created and the ID of that is returned.
+     *
+     * @param track track whose artist is looked up
+     *
+     * @returns integer ID of the artist.
+     */
+    uint32_t getArtistID(Track &track);
+
+    /**
+     * Gives an album the track's cover art if the album has none yet.
+     *
+     * @param albumID album the track belongs to
+     * @param track track whose cover hash is used
+     */
+    void updateAlbumCover(uint32_t albumID, Track &track);
+
+    /**
+     * Adds a single track to the open transaction.
+     *
+     * @param track track to add
+     *
+     * @returns whether the track was inserted, was a duplicate or only had its fingerprint refreshed.
+     */
+    IngestOutcome insertTrack(Track &track);
+
+    /**
+     * Looks for an existing track at another location with the same contents.
+     *
+     * @param key keys of the new track. Hashes computed along the way are filled in.
+     *
+     * @returns ID of the track holding the same contents, or 0 if there is none.
+     */
+    sqlite3_int64 findDuplicate(ContentKey &key);
+
+    /**
+     * Records a file as a copy of an existing track, with its fingerprint, so the
+     * duplicate report can list it and rescans can skip it while it is unchanged.
+     *
+     * @param track the skipped file
+     * @param keptID ID of the track with the same contents
+     */
+    void recordDuplicate(Track &track, sqlite3_int64 keptID);
+
+    /**
+     * Determines whether a file still holds the contents recorded for it, without reading it.
+     *
+     * @param current keys of the file as it is now
+     * @param recorded keys stored at its last import
+     */
+    static bool matchesRecorded(const ContentKey &current, const ContentKey &recorded);
+
+    /**
+     * Reads the optional content keys stored in three consecutive columns: partial hash,
+     * checksum and audio MD5.
+     */
+    static void readContentKeys(sqlite3_stmt *stmt, int firstColumn, ContentKey &key);
+
+    /**
+     * Binds a string, or NULL if it is empty.
+     */
+    static void bindOptionalText(sqlite3_stmt *stmt, int index, const string &value);
+
+    /**
+     * Binds a fingerprint to four consecutive statement parameters.
+     *
+     * @param stmt statement to bind to
+     * @param firstIndex index of the size parameter
+     * @param fingerprint fingerprint to bind
+     */
+    static void bindFingerprint(sqlite3_stmt *stmt, int firstIndex, const FileFingerprint &fingerprint);
+
+public:
+    /**
+     * @param statements statement cache of the connection to write to
+     * @param ids artist and album IDs already in the database
+     * @param batchSize number of rows written per transaction
+     * @param hashReadMode how files are read when a collision needs their full hash
+     */
+    IngestWriter(const shared_ptr<StatementCache> &statements, const shared_ptr<IDCache> &ids,
+                 uint32_t batchSize = DEFAULT_INGEST_BATCH_SIZE, HashReadMode hashReadMode = HashReadMode::pread);
+
+    /**
+     * Commits any rows still pending. Their outcome is lost, so callers that count rows
+     * commit first.
+     */
+    ~IngestWriter();
+
+    IngestWriter(const IngestWriter &) = delete;
+    IngestWriter &operator=(const IngestWriter &) = delete;
+
+    /**
+     * Adds a batch of tracks and their supporting artists and albums to the database.
+     * A transaction is committed every time `batchSize` rows have been written.
+     *
+     * @param tracks fully imported tracks with at least their partial hash generated
+     *
+     * @returns number of tracks inserted, skipped as duplicates, refreshed or failed, out of
+     * those whose transaction ended during the call. Rows still in the open transaction are
+     * counted by a later call or by commit().
+     */
+    IngestResult write(const vector<unique_ptr<Track>> &tracks);
+
+    /**
+     * Commits the open transaction, if any. If the commit fails, the transaction is rolled
+     * back and its rows are counted as failed.
+     *
+     * @returns number of tracks in the transaction inserted, skipped as duplicates,
+     * refreshed or failed.
+     */
+    IngestResult commit();
+};
+} // namespace MediaEngine
+} // namespace Mellophone
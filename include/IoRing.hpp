@@ -0,0 +1,154 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct statx;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+/**
+ * Result of a finished request.
+ */
+struct IoCompletion
+{
+    uint64_t userData = 0;
+    // Bytes read, the new file descriptor, or 0 on success; -errno on failure.
+    int32_t result = 0;
+};
+
+/**
+ * Minimal io_uring submission and completion ring, driven through the raw system
+ * calls so the engine does not depend on liburing.
+ *
+ * Requests are queued with the prepare methods and handed to the kernel together
+ * by submit(), which can also wait for completions, so a batch of stats, opens and
+ * reads costs a single system call. At most as many requests as the ring was created
+ * with may be in flight.
+ * A ring must only be used by one thread at a time.
+ *
+ * The ring is only functional when built against kernel headers with io_uring
+ * (MELLOPHONE_HAVE_IO_URING). Even then the running kernel, or a seccomp policy,
+ * may refuse it, so check isSupported() before creating one.
+ */
+class IoRing
+{
+private:
+    int ringFD = -1;
+    uint32_t entries = 0;
+    // Requests prepared but not yet handed to the kernel.
+    uint32_t queued = 0;
+    // Requests prepared and not yet completed.
+    uint32_t inFlight = 0;
+
+    void *sqMapping = nullptr;
+    size_t sqMappingSize = 0;
+    void *cqMapping = nullptr;
+    size_t cqMappingSize = 0;
+    io_uring_sqe *sqes = nullptr;
+    size_t sqesSize = 0;
+
+    uint32_t *sqTail = nullptr;
+    // Tail including entries prepared since the last submit.
+    uint32_t sqLocalTail = 0;
+    uint32_t *sqMask = nullptr;
+    uint32_t *sqArray = nullptr;
+    uint32_t *cqHead = nullptr;
+    uint32_t *cqTail = nullptr;
+    uint32_t *cqMask = nullptr;
+    io_uring_cqe *cqes = nullptr;
+
+    /**
+     * Claims the next submission entry, cleared and tagged with the request's data.
+     */
+    io_uring_sqe *nextEntry(uint64_t userData);
+
+    /**
+     * Unmaps the rings and closes the ring's file descriptor.
+     */
+    void release();
+
+public:
+    /**
+     * Whether io_uring can be used here: built in, allowed by the kernel, and able to
+     * stat, open and read files.
+     */
+    static bool isSupported();
+
+    /**
+     * @param entries maximum number of requests in flight
+     */
+    explicit IoRing(uint32_t entries);
+
+    /**
+     * Waits for requests still in flight, since the kernel may be writing into their buffers.
+     */
+    ~IoRing();
+
+    IoRing(const IoRing &) = delete;
+    IoRing &operator=(const IoRing &) = delete;
+
+    /**
+     * Number of further requests that may be prepared before some must complete.
+     */
+    uint32_t available() const;
+
+    /**
+     * Number of requests prepared and not yet completed.
+     */
+    uint32_t pending() const;
+
+    /**
+     * Queues a statx of a path. The path and the destination must stay valid until
+     * the request completes.
+     */
+    void prepareStatx(const char *path, uint32_t mask, struct statx *info, uint64_t userData);
+
+    /**
+     * Queues an open of a path. The completion's result is the new descriptor.
+     */
+    void prepareOpen(const char *path, int flags, uint64_t userData);
+
+    /**
+     * Queues a read of `length` bytes at `offset`. The buffer must stay valid until the
+     * request completes.
+     */
+    void prepareRead(int fd, void *buffer, uint32_t length, uint64_t offset, uint64_t userData);
+
+    /**
+     * Hands every queued request to the kernel and collects the completions available,
+     * waiting until at least `waitFor` have arrived.
+     *
+     * @param waitFor number of completions to wait for. Capped at pending().
+     * @param completions the completions collected are appended here
+     */
+    void submit(uint32_t waitFor, std::vector<IoCompletion> &completions);
+
+    /**
+     * Waits for every request in flight and discards the results.
+     */
+    void drain();
+};
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -16,41 +16,204 @@
 
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include <sqlite3.h>
 
+#include "ConnectionPool.hpp"
+#include "CoverArtCache.hpp"
+#include "DirectoryWatcher.hpp"
+#include "DuplicateFinder.hpp"
+#include "IDCache.hpp"
+#include "LibraryQuery.hpp"
+#include "LibrarySnapshot.hpp"
+#include "ScanMetrics.hpp"
+#include "ScanOptions.hpp"
+#include "StatementCache.hpp"
+#include "TrackTable.hpp"
+
 namespace fs = std::filesystem;
 
 namespace Mellophone
 {
 namespace MediaEngine
 {
-static const std::string CHECK_STMT = "SELECT name FROM sqlite_master WHERE type=\'table\' AND name=\'Tracks\';";
-
 static const std::string USER_DATA_DIR = "/.local/share/mellophone/";
 
+// A snapshot is rewritten once no change has come in for this long, so a burst of
+// watcher batches costs one rewrite...
+static const std::chrono::milliseconds SNAPSHOT_QUIET_PERIOD{1000};
+// ...or once the first change waiting for it is this old.
+static const std::chrono::milliseconds SNAPSHOT_MAX_DELAY{10000};
+
+static const std::string TRACK_DELETE_SQL = "DELETE FROM Tracks WHERE FileLocation == @loc;";
+// Same range trick as FOLDER_TRACKS_SQL, so the delete uses the FileLocation index.
+static const std::string FOLDER_DELETE_SQL =
+    "DELETE FROM Tracks WHERE FileLocation >= @folder AND FileLocation < @folderEnd;";
+static const std::string COPY_DELETE_SQL = "DELETE FROM DuplicateFiles WHERE FileLocation == @loc;";
+static const std::string FOLDER_COPIES_DELETE_SQL =
+    "DELETE FROM DuplicateFiles WHERE FileLocation >= @folder AND FileLocation < @folderEnd;";
+// Copies of a removed track are forgotten, so the next full scan imports one of them in its place.
+static const std::string ORPHAN_COPIES_DELETE_SQL =
+    "DELETE FROM DuplicateFiles WHERE NOT EXISTS (SELECT 1 FROM Tracks WHERE Tracks.ID == DuplicateFiles.Track);";
+
 class Library
 {
 private:
-    std::shared_ptr<sqlite3 *> dbConnection = std::make_shared<sqlite3 *>();
+    std::unique_ptr<ConnectionPool> connections;
+    // Statements of the writer connection.
+    std::shared_ptr<StatementCache> statements;
+    std::shared_ptr<IDCache> ids = std::make_shared<IDCache>();
+    std::shared_ptr<ScanMetrics> scanMetrics = std::make_shared<ScanMetrics>();
+    std::shared_ptr<CoverArtCache> coverArt;
     fs::path userMusicDir;
     fs::path userDataDir;
 
+    // Held while the writer connection is in use, since a watcher applies changes on a
+    // thread of its own. Reads use pooled connections and never wait for it.
+    std::mutex writerLock;
+    std::unique_ptr<DirectoryWatcher> watcher;
+
+    // Finishes once initialize() has run on its background thread.
+    std::shared_future<void> initialized;
+    // Whether the ID cache has been filled. Guarded by writerLock, as only the writer uses it.
+    bool idsLoaded = false;
+
+    // Rewrites the snapshot through a read connection, so the writer is not held up for
+    // the seconds a large library takes to write out. Started by the first request.
+    std::thread snapshotThread;
+    std::mutex snapshotLock;
+    std::condition_variable snapshotWake;
+    // Counts of rewrites requested, started and finished. Guarded by snapshotLock.
+    uint64_t snapshotsRequested = 0;
+    uint64_t snapshotsStarted = 0;
+    uint64_t snapshotsWritten = 0;
+    std::chrono::steady_clock::time_point firstSnapshotRequest;
+    std::chrono::steady_clock::time_point lastSnapshotRequest;
+    // Set when someone waits for the rewrite, so it skips the quiet period.
+    bool snapshotUrgent = false;
+    bool snapshotStopping = false;
+
+    /**
+         * Creates the library's folders, opens the database and brings its schema up to
+         * date. Runs in the background, so a slow home folder never holds up the caller.
+         */
+    void initialize();
+
+    /**
+         * Fills the ID cache on the first write, so opening a large library does not
+         * read every artist and album before it can be browsed. Call with writerLock held.
+         */
+    void loadIDs();
+
+    /**
+         * Removes the tracks at the given locations, or below them if they were directories.
+         *
+         * @throws std::runtime_error if the tracks cannot be removed. Nothing is removed then.
+         */
+    void removeTracks(const std::vector<fs::path> &locations);
+
+    /**
+         * Bumps the database's generation before the writer changes the library, so the
+         * snapshot on disk is out of date from the first change on, even if the change
+         * never finishes.
+         * 
+         * @returns the writer's count of changed rows, including the bump.
+         */
+    int64_t invalidateSnapshot();
+
+    /**
+         * Asks for a new snapshot once the writer is done changing the library. If nothing
+         * changed, the generation is put back instead and the snapshot on disk stays current.
+         * Call with writerLock held.
+         * 
+         * @param changesBefore count returned by invalidateSnapshot
+         */
+    void updateSnapshot(int64_t changesBefore);
+
+    /**
+         * Snapshot loop. Rewrites the snapshot once the requests for it quiet down, until
+         * the library is closed. A request still waiting then is written first.
+         */
+    void writeSnapshots();
+
+    /**
+         * Waits until every rewrite of the snapshot requested so far has finished, asking
+         * for a waiting one to be written at once.
+         */
+    void flushSnapshot();
+
     /**
          * Confirms the existence of the database and connects to it or
-         * creates a new database and connects to it.
+         * creates a new database and connects to it. The database is kept in WAL
+         * mode so reads can run alongside a scan.
          * 
          * @param location where to locate database in filesystem
          */
     void initializeDatabase(const fs::path &location);
 
+    /**
+         * Determines the user's HOME music folder.
+         * 
+         * @returns path to the user's HOME music folder
+         */
+    static fs::path findUserMusicDir();
+
+    /**
+         * Determines the directory Mellophone keeps its data in, following the
+         * XDG base directory specification.
+         * 
+         * @returns path to the application data directory
+         */
+    static fs::path findUserDataDir();
+
 public:
+    /**
+         * Opens the library in the user's music folder. Returns at once: the folders
+         * and database are set up in the background, and every method that needs them
+         * waits for that to finish.
+         */
     Library();
 
+    /**
+         * Opens a library rooted at explicit locations instead of the user's defaults.
+         * Like the default constructor, returns before the database is open.
+         * 
+         * @param musicDir folder to scan for music
+         * @param dataDir folder holding the media database
+         */
+    Library(const fs::path &musicDir, const fs::path &dataDir);
+
+    /**
+         * Waits for the library to finish opening, then closes it.
+         */
     ~Library();
 
+    /**
+         * Checks whether the library has finished opening, without waiting.
+         * 
+         * @returns true once the database is open and up to date, or opening has failed.
+         */
+    bool isReady();
+
+    /**
+         * Waits for the library to finish opening. Other methods wait on their own;
+         * this only lets the caller choose when to, and see why opening failed.
+         * 
+         * @throws std::runtime_error if the folders or database could not be set up.
+         *         Every later call that needs the database throws the same error.
+         */
+    void waitUntilReady();
+
     /**
          * Returns a reference to the user's HOME music folder.
          * 
@@ -61,8 +224,124 @@ public:
     /**
          * Scans through the user's HOME music folder to locate songs in supported 
          * formats and adds them to the database.
+         * 
+         * @param options thread count and queue sizing for the scan
+         * 
+         * @returns number of files seen, imported, skipped and failed.
+         */
+    ScanSummary scanLibrary(const ScanOptions &options = ScanOptions());
+
+    /**
+         * Reads the counters, queue depths and per-stage latencies of the running
+         * scan, or of the last one if none is running. Safe to call from any thread.
+         * 
+         * @returns snapshot of the scan's progress.
+         */
+    ScanProgress getScanProgress();
+
+    /**
+         * Reads every track in the database into a compact, column-oriented table
+         * for browsing. The table is a snapshot and does not follow later scans.
+         * Safe to call from any thread, including while a scan is running; tracks
+         * the scan has not yet committed are not included.
+         * 
+         * @returns the library's tracks, in database order.
+         */
+    TrackTable loadTrackTable();
+
+    /**
+         * Maps the snapshot written after the library last changed, so the library can be
+         * browsed at startup without reading the database. A snapshot is written next to
+         * the database in the background after every scan and batch of changes; a rewrite
+         * still waiting is finished first.
+         * 
+         * @returns the snapshot, or null if there is none or the library has changed since
+         *          it was written; browse with the queries instead.
+         */
+    std::unique_ptr<LibrarySnapshot> openSnapshot();
+
+    /**
+         * Starts a query for tracks. Rows are read as the cursor moves and are not
+         * copied, so the whole library can be walked without holding it in memory.
+         * 
+         * The cursor keeps a pooled read connection until it is destroyed, which must
+         * happen before the library is. Safe to call from any thread, including while
+         * a scan is running.
+         * 
+         * @param query filters, order and page
+         * 
+         * @returns cursor positioned before the first row.
+         */
+    TrackCursor queryTracks(const TrackQuery &query = TrackQuery());
+
+    /**
+         * Starts a query for albums. See queryTracks.
+         */
+    AlbumCursor queryAlbums(const AlbumQuery &query = AlbumQuery());
+
+    /**
+         * Starts a query for artists. See queryTracks.
+         */
+    ArtistCursor queryArtists(const ArtistQuery &query = ArtistQuery());
+
+    /**
+         * Searches the whole library for duplicate tracks and replaces the stored
+         * report with the result. Files are only read when their size matches
+         * another track's, and the hashes read are kept for later searches.
+         * Blocks scans and changes while the report is stored, but not while
+         * searching.
+         * 
+         * @param options worker threads and matching tolerances
+         * 
+         * @returns number of tracks searched and groups found of each kind.
+         */
+    DuplicateSummary findDuplicates(const DuplicateOptions &options = DuplicateOptions());
+
+    /**
+         * Starts a query of the report stored by the last findDuplicates, one row
+         * per track. See queryTracks.
+         */
+    DuplicateCursor queryDuplicates(const DuplicateQuery &query = DuplicateQuery());
+
+    /**
+         * Finds the thumbnail of an album's cover art, generating it first if the
+         * background workers have not got to it yet.
+         * 
+         * @param albumID ID of the album
+         * 
+         * @returns location of the JPEG thumbnail, or an empty path if the album has no cover art.
+         */
+    fs::path getAlbumThumbnail(uint32_t albumID);
+
+    /**
+         * Brings the database up to date with a batch of changes from a DirectoryWatcher:
+         * removed files are deleted and changed files are imported through the scan
+         * pipeline, so a burst of edits costs one pipeline run and a few transactions. A
+         * batch that overflowed falls back to a full scan.
+         * 
+         * @param batch files changed and removed below the music folder
+         * @param options tunables for the import
+         * 
+         * @returns totals for the import of the changed files.
+         */
+    ScanSummary applyChanges(const WatchBatch &batch, const ScanOptions &options = ScanOptions());
+
+    /**
+         * Starts watching the music folder, applying each batch of changes as it is
+         * delivered. Meant to be called once the initial scan is done.
+         * 
+         * @param options tunables for each import. Its excluded and hidden directories are
+         *                not watched either.
+         * @param watchOptions debounce timings
+         * @param onUpdate called on the watcher's thread after each batch is applied, or null
+         */
+    void startWatching(const ScanOptions &options = ScanOptions(), const WatchOptions &watchOptions = WatchOptions(),
+                       const std::function<void(const ScanSummary &)> &onUpdate = nullptr);
+
+    /**
+         * Stops watching the music folder, applying any changes still pending first.
          */
-    void scanLibrary();
+    void stopWatching();
 };
 } // namespace MediaEngine
 } // namespace Mellophone
\ No newline at end of file
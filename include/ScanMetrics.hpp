@@ -0,0 +1,190 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "ScanOptions.hpp"
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+/**
+ * Parts of a scan whose time is measured separately.
+ */
+enum class ScanStage
+{
+    // Taking a file's stat fingerprint. One sample per file.
+    stat,
+    // Telling the format from the first bytes. One sample per file read.
+    detect,
+    // Parsing tags, including any reads past the chunks that were hashed. One sample per file read.
+    parse,
+    // Partial and full hashing. One sample per file read.
+    hash,
+    // Time spent reading a file that was not spent on the stages above, i.e. waiting on I/O.
+    read,
+    // Writing a batch of tracks to the database. One sample per batch.
+    write
+};
+
+static const size_t SCAN_STAGE_COUNT = 6;
+
+/**
+ * Returns the time on the monotonic clock, in nanoseconds.
+ */
+inline uint64_t monotonicNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/**
+ * Copy of a LatencyHistogram at one point in time.
+ */
+struct LatencySnapshot
+{
+    static const size_t BUCKETS = 48;
+
+    uint64_t count = 0;
+    uint64_t totalNanos = 0;
+    uint64_t maxNanos = 0;
+    // Bucket i counts samples of less than 2^(i + 1) nanoseconds that do not fit in bucket i - 1.
+    std::array<uint64_t, BUCKETS> buckets{};
+
+    /**
+     * Returns the average sample, in nanoseconds, or 0 with no samples.
+     */
+    uint64_t meanNanos() const;
+
+    /**
+     * Returns an upper bound on the given fraction of samples, such as 0.99 for the 99th
+     * percentile, accurate to within a factor of two. 0 with no samples.
+     */
+    uint64_t percentileNanos(double fraction) const;
+};
+
+/**
+ * Log-scale histogram of durations that any number of threads may record into while
+ * another reads it. Recording costs a few relaxed atomic increments.
+ */
+class LatencyHistogram
+{
+private:
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> totalNanos{0};
+    std::atomic<uint64_t> maxNanos{0};
+    std::array<std::atomic<uint64_t>, LatencySnapshot::BUCKETS> buckets{};
+
+public:
+    void record(uint64_t nanos);
+
+    LatencySnapshot snapshot() const;
+
+    void reset();
+};
+
+/**
+ * Progress of a running scan, as passed to ScanOptions::onProgress and returned by
+ * Library::getScanProgress.
+ */
+struct ScanProgress
+{
+    ScanSummary totals;
+    uint64_t bytesRead = 0;
+
+    // Items waiting between the walker and the workers, and between the workers and the writer.
+    uint64_t pathQueueDepth = 0;
+    uint64_t trackQueueDepth = 0;
+
+    // Set once every file has been found, after which filesSeen is the final total.
+    bool walkFinished = false;
+    bool scanFinished = false;
+    uint64_t elapsedNanos = 0;
+
+    std::array<LatencySnapshot, SCAN_STAGE_COUNT> stages;
+
+    const LatencySnapshot &stage(ScanStage stage) const
+    {
+        return this->stages[static_cast<size_t>(stage)];
+    }
+
+    /**
+     * Number of files that have been imported, skipped or have failed.
+     */
+    uint64_t filesDone() const
+    {
+        return this->totals.imported + this->totals.skipped + this->totals.failed;
+    }
+
+    /**
+     * Estimates the time left from the rate files have been finished at so far.
+     *
+     * @returns seconds left, or a negative value while the total is not yet known.
+     */
+    double secondsRemaining() const;
+};
+
+/**
+ * Counters and histograms shared by the threads of a scan.
+ *
+ * Every member may be updated from any thread and read while the scan runs. Values
+ * read together may be a few updates apart, which is fine for reporting.
+ */
+class ScanMetrics
+{
+private:
+    std::array<LatencyHistogram, SCAN_STAGE_COUNT> stages;
+    std::atomic<uint64_t> startNanos{0};
+    std::atomic<uint64_t> endNanos{0};
+
+public:
+    std::atomic<uint64_t> filesSeen{0};
+    std::atomic<uint64_t> imported{0};
+    std::atomic<uint64_t> skipped{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<uint64_t> bytesRead{0};
+    std::atomic<int64_t> pathQueueDepth{0};
+    std::atomic<int64_t> trackQueueDepth{0};
+    std::atomic<bool> walkFinished{false};
+
+    void record(ScanStage stage, uint64_t nanos)
+    {
+        this->stages[static_cast<size_t>(stage)].record(nanos);
+    }
+
+    /**
+     * Clears every value and starts the elapsed time.
+     */
+    void start();
+
+    /**
+     * Stops the elapsed time.
+     */
+    void finish();
+
+    ScanSummary summary() const;
+
+    ScanProgress snapshot() const;
+};
+} // namespace MediaEngine
+} // namespace Mellophone
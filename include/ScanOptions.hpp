@@ -0,0 +1,141 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "HashReader.hpp"
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+struct ScanProgress;
+
+/**
+ * When a scanned file's full SHA256 hash is computed.
+ */
+enum class HashPolicy
+{
+    // Only when the file's size and partial hash collide with a track already in the library.
+    tiered,
+    // For every imported file, up front.
+    full
+};
+
+/**
+ * How the scan's workers stat, open and read files.
+ */
+enum class ReadBackend
+{
+    // One blocking system call at a time per worker thread.
+    threads,
+    // Many requests in flight per worker through io_uring (see FileBatchReader). Falls
+    // back to threads where io_uring is unavailable.
+    ioUring
+};
+
+/**
+ * Tunables for a library scan.
+ */
+struct ScanOptions
+{
+    /**
+     * Number of worker threads used for format detection, tag parsing and hashing.
+     * A value of 0 uses one worker per hardware thread.
+     */
+    uint32_t threadCount = 0;
+
+    /**
+     * Maximum number of items allowed to wait between two pipeline stages.
+     */
+    uint32_t queueCapacity = 256;
+
+    /**
+     * Number of tracks written to the database per transaction.
+     */
+    uint32_t batchSize = 1000;
+
+    /**
+     * How files are read while they are hashed.
+     */
+    HashReadMode hashReadMode = HashReadMode::pread;
+
+    /**
+     * Whether every file is hashed in full or only those a duplicate check needs.
+     */
+    HashPolicy hashPolicy = HashPolicy::tiered;
+
+    /**
+     * Lets each worker hash up to Sha256MultiBuffer::LANES files at once on CPUs where
+     * that is faster than hashing them one at a time (AVX2 without SHA-NI). Only used
+     * with HashPolicy::full.
+     */
+    bool multiBufferHashing = true;
+
+    /**
+     * How files are stat'ed, opened and read.
+     */
+    ReadBackend readBackend = ReadBackend::threads;
+
+    /**
+     * With ReadBackend::ioUring, the number of files each worker keeps in flight.
+     */
+    uint32_t ioQueueDepth = 32;
+
+    /**
+     * Called every `progressInterval` while the scan runs, and once more when it ends.
+     * Runs on a thread of its own, so a slow callback does not hold up the scan.
+     */
+    std::function<void(const ScanProgress &)> onProgress;
+
+    std::chrono::milliseconds progressInterval{500};
+
+    /**
+     * Number of threads reading directories during a full scan. A value of 0 picks one
+     * from the hardware (see WalkOptions).
+     */
+    uint32_t walkThreadCount = 0;
+
+    /**
+     * Directories a full scan does not descend into: absolute paths, or names excluded
+     * wherever they appear.
+     */
+    std::vector<std::string> excludedDirectories;
+
+    /**
+     * Whether a full scan skips directories whose name starts with a dot.
+     */
+    bool skipHiddenDirectories = true;
+};
+
+/**
+ * Totals reported once a scan has finished.
+ */
+struct ScanSummary
+{
+    uint64_t filesSeen = 0;
+    uint64_t imported = 0;
+    uint64_t skipped = 0;
+    uint64_t failed = 0;
+};
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -0,0 +1,65 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <sqlite3.h>
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+static const std::string CHECK_STMT = "SELECT name FROM sqlite_master WHERE type=\'table\' AND name=\'Tracks\';";
+
+/**
+ * Creates and upgrades the media database schema.
+ *
+ * The schema version is stored in `PRAGMA user_version`. Each upgrade step runs in
+ * its own transaction together with the version bump, so an interrupted upgrade
+ * resumes from the last completed step.
+ */
+class Schema
+{
+public:
+    /**
+     * Version of the newest schema this build knows how to create.
+     */
+    static int getLatestVersion();
+
+    /**
+     * Reads the schema version of a database.
+     *
+     * Databases created before versioning was introduced report version 1 if
+     * they already contain the Tracks table.
+     *
+     * @param db database connection
+     *
+     * @returns the schema version. 0 for an empty database.
+     */
+    static int getVersion(const std::shared_ptr<sqlite3 *> &db);
+
+    /**
+     * Applies every upgrade step newer than the database's current version.
+     *
+     * @param db database connection
+     */
+    static void migrate(const std::shared_ptr<sqlite3 *> &db);
+};
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -0,0 +1,98 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+/**
+ * Longest side, in pixels, of the thumbnails made for grid views.
+ */
+static const uint32_t THUMBNAIL_SIZE = 256;
+
+/**
+ * Image file formats recognised from their first bytes.
+ */
+enum class ImageFormat
+{
+    jpeg,
+    png,
+    unknown
+};
+
+/**
+ * Decoded image, 8-bit RGB, rows stored top to bottom without padding.
+ */
+struct RGBImage
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+/**
+ * Decoding, scaling and encoding of cover art thumbnails with libjpeg and libpng.
+ */
+class Thumbnail
+{
+public:
+    /**
+     * Recognises an image file from its signature, regardless of its declared MIME type.
+     */
+    static ImageFormat detectFormat(const uint8_t *data, size_t length);
+
+    /**
+     * Decodes a JPEG or PNG image. JPEG images much larger than `minSize` are scaled
+     * down while they are decoded, which skips most of the decoding work; the result
+     * is still at least `minSize` on its longest side when the source is.
+     *
+     * @param data image file contents
+     * @param length number of bytes in the image
+     * @param minSize smallest longest side the caller needs, or 0 for full size
+     * @param image set to the decoded pixels
+     *
+     * @returns false if the image is not a JPEG or PNG image or is corrupt.
+     */
+    static bool decode(const uint8_t *data, size_t length, uint32_t minSize, RGBImage &image);
+
+    /**
+     * Scales an image down so its longest side is at most `maxSize`, averaging the
+     * source pixels each output pixel covers. Smaller images are returned unchanged.
+     */
+    static RGBImage scaleToFit(const RGBImage &image, uint32_t maxSize);
+
+    /**
+     * Encodes an image as a baseline JPEG.
+     *
+     * @returns the JPEG file contents.
+     */
+    static std::vector<uint8_t> encodeJPEG(const RGBImage &image, int quality = 85);
+
+    /**
+     * Makes a JPEG thumbnail of an image file.
+     *
+     * @returns false if the image could not be decoded.
+     */
+    static bool create(const uint8_t *data, size_t length, uint32_t maxSize, std::vector<uint8_t> &thumbnail);
+};
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -0,0 +1,180 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "ContentMatcher.hpp"
+#include "FLACMetadata.hpp"
+#include "FileFingerprint.hpp"
+#include "HashReader.hpp"
+#include "OggVorbisMetadata.hpp"
+#include "ScanMetrics.hpp"
+#include "Sha256Engine.hpp"
+#include "Track.hpp"
+
+namespace fs = std::filesystem;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+/**
+ * Time an ingestor spent on each part of its work, and how many bytes it was given.
+ */
+struct IngestTimings
+{
+    uint64_t detectNanos = 0;
+    uint64_t parseNanos = 0;
+    uint64_t hashNanos = 0;
+    uint64_t bytesConsumed = 0;
+};
+
+/**
+ * Builds a fully populated Track from a single pass over its file.
+ *
+ * The same chunks feed the format sniffer, the metadata parser, the partial hash and,
+ * when the whole file is read, the full SHA-256. The chunks may cover the whole file
+ * or only its ends (see HashReader::readEnds); metadata that lies outside the chunks
+ * given is read from the file when the ingestor finishes.
+ */
+class TrackIngestor
+{
+private:
+    fs::path location;
+    FileFingerprint fingerprint;
+    bool hashFile;
+
+    // First bytes of the file, kept until the format is known.
+    std::array<uint8_t, FORMAT_SNIFF_LENGTH> head;
+    size_t headLength = 0;
+    bool formatKnown = false;
+    Format format = Format::unknown;
+
+    FLACMetadataParser flacParser;
+    OggVorbisParser vorbisParser;
+    std::exception_ptr metadataError;
+
+    PartialHasher partialHasher;
+    Sha256Hasher fullHasher;
+    std::array<uint8_t, SHA256_DIGEST_SIZE> fullDigest;
+    bool fullDigestKnown = false;
+
+    // End of the bytes read from the start of the file without a gap, and of all bytes read.
+    uint64_t contiguousEnd = 0;
+    uint64_t streamEnd = 0;
+
+    IngestTimings timings;
+
+    void decideFormat();
+    void feedMetadata(uint64_t offset, const uint8_t *data, size_t length);
+
+public:
+    /**
+     * @param location file to ingest
+     * @param fingerprint fingerprint of the file, taken before it is read
+     * @param hashFile whether the ingestor computes the full hash itself. Without it the
+     *                 full hash is only known if it is given with setFileHash.
+     */
+    TrackIngestor(const fs::path &location, const FileFingerprint &fingerprint, bool hashFile);
+
+    TrackIngestor(const TrackIngestor &) = delete;
+    TrackIngestor &operator=(const TrackIngestor &) = delete;
+
+    /**
+     * Passes the next chunk of the file to every consumer. Chunks must arrive in order.
+     *
+     * Errors in the file's metadata are held until finish() so that the rest of the
+     * stream, which may be shared with other files, is unaffected.
+     *
+     * @param offset position of the chunk in the file
+     * @param data chunk contents
+     * @param length number of bytes in the chunk
+     */
+    void consume(uint64_t offset, const uint8_t *data, size_t length);
+
+    /**
+     * Supplies a full hash computed elsewhere from the same stream.
+     *
+     * @param digest the 32-byte SHA-256 of the file
+     */
+    void setFileHash(const uint8_t *digest);
+
+    /**
+     * Adds time spent hashing this file outside the ingestor, such as its share of a
+     * multi-buffer update.
+     */
+    void addHashTime(uint64_t nanos);
+
+    /**
+     * Builds the track once the stream has ended.
+     *
+     * @returns the track, or nullptr if the file's contents are not in a supported format.
+     */
+    unique_ptr<Track> finish();
+
+    /**
+     * Reads the file in a single pass and builds the track: the whole file if the
+     * ingestor hashes it, otherwise only its ends.
+     *
+     * @param mode how the whole file is read
+     *
+     * @returns the track, or nullptr if the file's contents are not in a supported format.
+     */
+    unique_ptr<Track> read(HashReadMode mode);
+
+    /**
+     * Reads several files side by side, hashing them in lock-step with
+     * Sha256MultiBuffer while the same chunks feed each ingestor.
+     *
+     * @param ingestors ingestors created without hashFile
+     * @param tracks set to each file's track, or nullptr if it failed or is not supported
+     * @param errors set to the error that stopped each file, or null
+     */
+    static void readInterleaved(const std::vector<unique_ptr<TrackIngestor>> &ingestors,
+                                std::vector<unique_ptr<Track>> &tracks, std::vector<std::exception_ptr> &errors);
+
+    /**
+     * Whether the file's extension names a format that can be ingested. Checked
+     * before the file is opened.
+     */
+    static bool canIngest(const fs::path &location);
+
+    /**
+     * Creates the Track subclass matching a format.
+     *
+     * @returns the new track, or nullptr if the format is not supported.
+     */
+    static unique_ptr<Track> createTrack(Format format, const fs::path &location);
+
+    /**
+     * Retrieves the location of the file being ingested.
+     */
+    fs::path getLocation();
+
+    /**
+     * Retrieves the time spent so far on each part of the file's ingestion.
+     */
+    const IngestTimings &getTimings() const;
+};
+} // namespace MediaEngine
+} // namespace Mellophone
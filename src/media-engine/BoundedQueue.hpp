@@ -0,0 +1,147 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+/**
+ * Fixed-capacity, multi-producer/multi-consumer FIFO used to hand work between
+ * the stages of a scan. Producers block while the queue is full, so a fast stage
+ * can never run arbitrarily far ahead of a slow one.
+ */
+template <typename T>
+class BoundedQueue
+{
+private:
+    std::deque<T> items;
+    size_t capacity;
+    bool closed = false;
+
+    std::mutex lock;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1)
+    {
+    }
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    /**
+     * Adds an item to the back of the queue, waiting for space if needed.
+     *
+     * @param item item to add
+     *
+     * @returns false if the queue was closed before the item could be added.
+     */
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> guard(this->lock);
+        this->notFull.wait(guard, [this] { return this->closed || this->items.size() < this->capacity; });
+
+        if (this->closed)
+        {
+            return false;
+        }
+
+        this->items.push_back(std::move(item));
+        guard.unlock();
+        this->notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * Removes the item at the front of the queue, waiting for one if needed.
+     *
+     * @param item destination of the removed item
+     *
+     * @returns false once the queue is closed and fully drained.
+     */
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> guard(this->lock);
+        this->notEmpty.wait(guard, [this] { return this->closed || !this->items.empty(); });
+
+        if (this->items.empty())
+        {
+            return false;
+        }
+
+        item = std::move(this->items.front());
+        this->items.pop_front();
+        guard.unlock();
+        this->notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * Removes the item at the front of the queue if one is immediately available.
+     *
+     * @param item destination of the removed item
+     *
+     * @returns false if the queue was empty.
+     */
+    bool tryPop(T &item)
+    {
+        std::unique_lock<std::mutex> guard(this->lock);
+
+        if (this->items.empty())
+        {
+            return false;
+        }
+
+        item = std::move(this->items.front());
+        this->items.pop_front();
+        guard.unlock();
+        this->notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * Stops the queue from accepting new items. Consumers may still drain
+     * whatever is left.
+     */
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->closed = true;
+        }
+        this->notFull.notify_all();
+        this->notEmpty.notify_all();
+    }
+
+    /**
+     * Returns the number of items currently waiting in the queue.
+     */
+    size_t size()
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        return this->items.size();
+    }
+};
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -0,0 +1,181 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+
+// Utility libs
+#include <boost/format.hpp>
+
+// Local includes
+#include "ConnectionPool.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace
+{
+/**
+ * Opens a connection and applies its pragmas, closing it again if either fails.
+ */
+void openConnection(const fs::path &location, int flags, const string &pragmas, sqlite3 **db)
+{
+    int result = sqlite3_open_v2(location.c_str(), db, flags, nullptr);
+
+    if (result == SQLITE_OK)
+    {
+        sqlite3_busy_timeout(*db, DATABASE_BUSY_TIMEOUT);
+        result = sqlite3_exec(*db, pragmas.c_str(), nullptr, nullptr, nullptr);
+    }
+
+    if (result != SQLITE_OK)
+    {
+        std::stringstream errStream;
+        errStream << boost::format("Failed to open database '%s': %s") % location.string() % sqlite3_errmsg(*db);
+        sqlite3_close_v2(*db);
+        *db = nullptr;
+        throw std::runtime_error(errStream.str());
+    }
+}
+} // namespace
+
+ReaderLease::ReaderLease(ConnectionPool *pool, const shared_ptr<StatementCache> &statements)
+    : pool(pool), statements(statements)
+{
+}
+
+ReaderLease::ReaderLease(ReaderLease &&other) noexcept : pool(other.pool), statements(std::move(other.statements))
+{
+    other.pool = nullptr;
+}
+
+ReaderLease::~ReaderLease()
+{
+    if (this->pool != nullptr && this->statements != nullptr)
+    {
+        this->pool->release(this->statements);
+    }
+}
+
+const shared_ptr<StatementCache> &ReaderLease::getStatements()
+{
+    return this->statements;
+}
+
+ConnectionPool::ConnectionPool(const fs::path &location, uint32_t maxReaders)
+    : location(location), maxReaders(std::max(1u, maxReaders))
+{
+    openConnection(this->location, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, WRITER_PRAGMAS_SQL, this->writer.get());
+    this->writerStatements = std::make_shared<StatementCache>(this->writer);
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    // Statements must be finalized before their connection can be closed.
+    for (auto &reader : this->idleReaders)
+    {
+        reader->finalizeAll();
+        sqlite3_close_v2(*reader->getConnection());
+    }
+
+    this->writerStatements->finalizeAll();
+    sqlite3_close_v2(*this->writer);
+}
+
+const shared_ptr<sqlite3 *> &ConnectionPool::getWriter()
+{
+    return this->writer;
+}
+
+const shared_ptr<StatementCache> &ConnectionPool::getWriterStatements()
+{
+    return this->writerStatements;
+}
+
+shared_ptr<StatementCache> ConnectionPool::openReader()
+{
+    auto db = std::make_shared<sqlite3 *>(nullptr);
+
+    // Each connection is only used by the thread holding its lease, so SQLite's own locking is unnecessary.
+    openConnection(this->location, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, READER_PRAGMAS_SQL, db.get());
+
+    return std::make_shared<StatementCache>(db);
+}
+
+ReaderLease ConnectionPool::acquireReader()
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+
+    // Waiting without a bound would deadlock a thread that already holds every connection.
+    this->readerReturned.wait_for(guard, std::chrono::milliseconds(READER_WAIT_TIMEOUT), [this] {
+        return !this->idleReaders.empty() || this->openReaders < this->maxReaders;
+    });
+
+    if (!this->idleReaders.empty())
+    {
+        shared_ptr<StatementCache> statements = std::move(this->idleReaders.back());
+        this->idleReaders.pop_back();
+        return ReaderLease(this, statements);
+    }
+
+    // Opening a connection reads the schema, so it is done without holding up other borrowers.
+    this->openReaders++;
+    guard.unlock();
+
+    try
+    {
+        return ReaderLease(this, this->openReader());
+    }
+    catch (...)
+    {
+        guard.lock();
+        this->openReaders--;
+        guard.unlock();
+        this->readerReturned.notify_one();
+        throw;
+    }
+}
+
+void ConnectionPool::release(const shared_ptr<StatementCache> &statements)
+{
+    bool keep = true;
+
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+
+        // A connection opened past the limit is closed rather than kept.
+        if (this->openReaders > this->maxReaders)
+        {
+            this->openReaders--;
+            keep = false;
+        }
+        else
+        {
+            this->idleReaders.push_back(statements);
+        }
+    }
+
+    if (!keep)
+    {
+        statements->finalizeAll();
+        sqlite3_close_v2(*statements->getConnection());
+        return;
+    }
+
+    this->readerReturned.notify_one();
+}
@@ -0,0 +1,171 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "StatementCache.hpp"
+
+namespace fs = std::filesystem;
+
+using std::shared_ptr;
+using std::string;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+// WAL lets readers keep reading their snapshot while the writer commits. With WAL,
+// NORMAL only risks the last transactions on power loss, never corruption.
+static const string WRITER_PRAGMAS_SQL = "PRAGMA journal_mode = WAL;"
+                                         "PRAGMA synchronous = NORMAL;"
+                                         "PRAGMA mmap_size = 268435456;"
+                                         "PRAGMA cache_size = -65536;";
+
+// Readers share the writer's mapping of the file through mmap, so their own page caches stay small.
+static const string READER_PRAGMAS_SQL = "PRAGMA mmap_size = 268435456;"
+                                         "PRAGMA cache_size = -16384;";
+
+/**
+ * Default number of read connections kept open.
+ */
+static const uint32_t DEFAULT_READER_COUNT = 4;
+
+/**
+ * How long a connection waits on a lock held by another before giving up, in milliseconds.
+ * In WAL mode only checkpoints and a second writer contend.
+ */
+static const int DATABASE_BUSY_TIMEOUT = 5000;
+
+/**
+ * How long a borrower waits for a read connection to be returned when the pool is at its
+ * limit, in milliseconds, before opening one past it.
+ */
+static const int READER_WAIT_TIMEOUT = 100;
+
+class ConnectionPool;
+
+/**
+ * A read connection borrowed from a ConnectionPool, handed back when the lease goes
+ * out of scope. Only the thread holding the lease may use the connection.
+ *
+ * A lease made without a pool just wraps the given statements, for connections
+ * managed elsewhere.
+ */
+class ReaderLease
+{
+private:
+    ConnectionPool *pool;
+    shared_ptr<StatementCache> statements;
+
+public:
+    ReaderLease(ConnectionPool *pool, const shared_ptr<StatementCache> &statements);
+    ~ReaderLease();
+
+    ReaderLease(ReaderLease &&other) noexcept;
+    ReaderLease(const ReaderLease &) = delete;
+    ReaderLease &operator=(const ReaderLease &) = delete;
+    ReaderLease &operator=(ReaderLease &&) = delete;
+
+    /**
+     * Returns the statement cache of the borrowed connection.
+     */
+    const shared_ptr<StatementCache> &getStatements();
+};
+
+/**
+ * Connections to the media database: one writer, and a pool of read-only connections.
+ *
+ * The database is switched to WAL, so reads are never blocked by the writer, even in
+ * the middle of an import's transaction; each sees the database as of its last
+ * committed transaction. Read connections are opened on demand, up to the pool's
+ * limit, and kept open with their prepared statements for the next borrower. Past the
+ * limit, a borrower that cannot wait for one to be returned gets a connection of its
+ * own, closed again when it is returned.
+ *
+ * The writer connection is not locked by the pool. Its users must take turns.
+ */
+class ConnectionPool
+{
+private:
+    fs::path location;
+    uint32_t maxReaders;
+
+    shared_ptr<sqlite3 *> writer = std::make_shared<sqlite3 *>(nullptr);
+    shared_ptr<StatementCache> writerStatements;
+
+    std::mutex lock;
+    std::condition_variable readerReturned;
+    std::vector<shared_ptr<StatementCache>> idleReaders;
+    uint32_t openReaders = 0;
+
+    /**
+     * Opens a read-only connection.
+     */
+    shared_ptr<StatementCache> openReader();
+
+    /**
+     * Takes back a connection from a lease.
+     */
+    void release(const shared_ptr<StatementCache> &statements);
+
+    friend class ReaderLease;
+
+public:
+    /**
+     * Opens the writer connection, creating the database if needed, and switches it to WAL.
+     *
+     * @param location database file
+     * @param maxReaders number of read connections kept open and shared by borrowers
+     */
+    explicit ConnectionPool(const fs::path &location, uint32_t maxReaders = DEFAULT_READER_COUNT);
+
+    /**
+     * Closes every connection. Every lease must have been returned.
+     */
+    ~ConnectionPool();
+
+    ConnectionPool(const ConnectionPool &) = delete;
+    ConnectionPool &operator=(const ConnectionPool &) = delete;
+
+    /**
+     * Returns the writer connection.
+     */
+    const shared_ptr<sqlite3 *> &getWriter();
+
+    /**
+     * Returns the statement cache of the writer connection.
+     */
+    const shared_ptr<StatementCache> &getWriterStatements();
+
+    /**
+     * Borrows a read connection, opening one if none is idle. If the pool is at its limit,
+     * waits up to READER_WAIT_TIMEOUT for one to be returned, then opens one past the
+     * limit; the caller may hold every connection itself, through open cursors.
+     */
+    ReaderLease acquireReader();
+};
+} // namespace MediaEngine
+} // namespace Mellophone
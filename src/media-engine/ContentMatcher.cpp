@@ -0,0 +1,231 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+
+// Local includes
+#include "ContentMatcher.hpp"
+#include "Sha256Engine.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace
+{
+/**
+ * Mixes in the file size and returns the hex digest of a partial hash.
+ */
+std::string finishPartialHash(Sha256Hasher &hasher, uint64_t fileSize)
+{
+    // Mix in the size so files that only differ in their middle length never collide.
+    uint8_t sizeBytes[8];
+    for (int i = 0; i < 8; i++)
+    {
+        sizeBytes[i] = static_cast<uint8_t>(fileSize >> (i * 8));
+    }
+    hasher.update(sizeBytes, sizeof(sizeBytes));
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    hasher.finish(digest);
+
+    return Sha256Engine::toHex(digest, SHA256_DIGEST_SIZE);
+}
+
+/**
+ * Splits each group into subgroups sharing the same key. Members whose key cannot be
+ * computed are dropped, as are subgroups left with a single member.
+ */
+template <typename KeyFunction>
+std::vector<std::vector<size_t>> refineGroups(const std::vector<std::vector<size_t>> &groups, KeyFunction keyOf)
+{
+    std::vector<std::vector<size_t>> refined;
+
+    for (const auto &group : groups)
+    {
+        std::map<std::string, std::vector<size_t>> byKey;
+
+        for (size_t index : group)
+        {
+            try
+            {
+                byKey[keyOf(index)].push_back(index);
+            }
+            catch (const std::runtime_error &err)
+            {
+                std::cerr << err.what() << std::endl;
+            }
+        }
+
+        for (auto &entry : byKey)
+        {
+            if (entry.second.size() > 1)
+            {
+                refined.push_back(std::move(entry.second));
+            }
+        }
+    }
+
+    return refined;
+}
+} // namespace
+
+PartialHasher::PartialHasher(uint64_t fileSize) : fileSize(fileSize)
+{
+    // The same ranges HashReader::readEnds reads.
+    this->headEnd = std::min<uint64_t>(PARTIAL_HASH_SPAN, fileSize);
+    this->tailStart = std::max<uint64_t>(this->headEnd, fileSize > PARTIAL_HASH_SPAN ? fileSize - PARTIAL_HASH_SPAN : 0);
+}
+
+void PartialHasher::update(uint64_t offset, const uint8_t *data, size_t length)
+{
+    const std::pair<uint64_t, uint64_t> ranges[] = {{0, this->headEnd}, {this->tailStart, this->fileSize}};
+    const uint64_t chunkEnd = offset + length;
+
+    for (const auto &range : ranges)
+    {
+        const uint64_t start = std::max({range.first, offset, this->position});
+        const uint64_t end = std::min(range.second, chunkEnd);
+
+        if (start < end)
+        {
+            this->hasher.update(data + (start - offset), static_cast<size_t>(end - start));
+            this->position = end;
+        }
+    }
+}
+
+std::string PartialHasher::finish()
+{
+    return finishPartialHash(this->hasher, this->fileSize);
+}
+
+ContentMatcher::ContentMatcher(HashReadMode mode) : mode(mode)
+{
+}
+
+std::string ContentMatcher::computePartialHash(const fs::path &filePath)
+{
+    Sha256Hasher hasher;
+
+    uint64_t fileSize = HashReader::readEnds(filePath, PARTIAL_HASH_SPAN, [&hasher](uint64_t, const uint8_t *data, size_t length) {
+        hasher.update(data, length);
+    });
+
+    return finishPartialHash(hasher, fileSize);
+}
+
+std::string ContentMatcher::computeFullHash(const fs::path &filePath)
+{
+    Sha256Hasher hasher;
+
+    HashReader reader(this->mode);
+    reader.read(filePath, [&hasher](const uint8_t *data, size_t length) {
+        hasher.update(data, length);
+    });
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    hasher.finish(digest);
+
+    return Sha256Engine::toHex(digest, SHA256_DIGEST_SIZE);
+}
+
+void ContentMatcher::ensurePartialHash(ContentKey &key)
+{
+    if (key.partialHash.empty())
+    {
+        key.partialHash = ContentMatcher::computePartialHash(key.location);
+    }
+}
+
+void ContentMatcher::ensureFullHash(ContentKey &key)
+{
+    if (key.fullHash.empty())
+    {
+        key.fullHash = this->computeFullHash(key.location);
+    }
+}
+
+bool ContentMatcher::sameContents(ContentKey &first, ContentKey &second)
+{
+    if (first.size != second.size)
+    {
+        return false;
+    }
+
+    // Keys already known on both sides settle it without touching either file.
+    if (!first.fullHash.empty() && !second.fullHash.empty())
+    {
+        return first.fullHash == second.fullHash;
+    }
+
+    this->ensurePartialHash(first);
+    this->ensurePartialHash(second);
+    if (first.partialHash != second.partialHash)
+    {
+        return false;
+    }
+
+    // Different audio means different files; the same audio may still carry different tags.
+    if (!first.audioMD5.empty() && !second.audioMD5.empty() && first.audioMD5 != second.audioMD5)
+    {
+        return false;
+    }
+
+    this->ensureFullHash(first);
+    this->ensureFullHash(second);
+
+    return first.fullHash == second.fullHash;
+}
+
+std::vector<std::vector<size_t>> ContentMatcher::groupIdentical(std::vector<ContentKey> &keys)
+{
+    std::unordered_map<uint64_t, std::vector<size_t>> bySize;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        bySize[keys[i].size].push_back(i);
+    }
+
+    std::vector<std::vector<size_t>> groups;
+    for (auto &entry : bySize)
+    {
+        if (entry.second.size() > 1)
+        {
+            groups.push_back(std::move(entry.second));
+        }
+    }
+
+    groups = refineGroups(groups, [this, &keys](size_t index) {
+        this->ensurePartialHash(keys[index]);
+        return keys[index].partialHash;
+    });
+
+    groups = refineGroups(groups, [this, &keys](size_t index) {
+        this->ensureFullHash(keys[index]);
+        return keys[index].fullHash;
+    });
+
+    for (auto &group : groups)
+    {
+        std::sort(group.begin(), group.end());
+    }
+    std::sort(groups.begin(), groups.end());
+
+    return groups;
+}
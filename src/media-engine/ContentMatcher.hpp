@@ -0,0 +1,170 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "HashReader.hpp"
+#include "Sha256Engine.hpp"
+
+namespace fs = std::filesystem;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+/**
+ * Number of bytes hashed from each end of a file for its partial hash.
+ */
+static const size_t PARTIAL_HASH_SPAN = 256 * 1024;
+
+/**
+ * Identity keys of a file's contents, from cheapest to most expensive.
+ *
+ * Only the size is required. The hashes are hex strings that stay empty until they
+ * are known; ContentMatcher fills them in as comparisons need them.
+ */
+struct ContentKey
+{
+    fs::path location;
+
+    // Size of the file in bytes.
+    uint64_t size = 0;
+
+    // SHA-256 of the size and the first and last PARTIAL_HASH_SPAN bytes.
+    std::string partialHash;
+
+    // SHA-256 of the whole file.
+    std::string fullHash;
+
+    // MD5 of the decoded audio, as stored by the format (FLAC STREAMINFO). Empty if not available.
+    std::string audioMD5;
+};
+
+/**
+ * Computes a partial hash from chunks of a file as they are read for some other purpose.
+ *
+ * The chunks may cover the whole file or only its ends, but must arrive in order.
+ * Bytes outside the ends are ignored.
+ */
+class PartialHasher
+{
+private:
+    Sha256Hasher hasher;
+    uint64_t fileSize;
+    uint64_t headEnd;
+    uint64_t tailStart;
+
+    // Next byte that may be hashed; keeps overlapping chunks from being hashed twice.
+    uint64_t position = 0;
+
+public:
+    /**
+     * @param fileSize size of the file the chunks come from
+     */
+    explicit PartialHasher(uint64_t fileSize);
+
+    /**
+     * Hashes the parts of a chunk that fall within the ends of the file.
+     *
+     * @param offset position of the chunk in the file
+     * @param data chunk contents
+     * @param length number of bytes in the chunk
+     */
+    void update(uint64_t offset, const uint8_t *data, size_t length);
+
+    /**
+     * @returns the same hex digest ContentMatcher::computePartialHash gives for the file.
+     */
+    std::string finish();
+};
+
+/**
+ * Tiered comparison of file contents.
+ *
+ * Files are compared by size first, then by partial hash, then by audio MD5 where both
+ * have one, and only files that match on all of those are read in full. Each key is
+ * computed at most once and kept in the ContentKey, so callers can store what was
+ * learned.
+ */
+class ContentMatcher
+{
+private:
+    HashReadMode mode;
+
+public:
+    /**
+     * @param mode how files are read when a full hash is needed
+     */
+    explicit ContentMatcher(HashReadMode mode = HashReadMode::pread);
+
+    /**
+     * Computes the partial hash of a file.
+     *
+     * @param filePath file to hash
+     *
+     * @returns hex SHA-256 of the file's size and its first and last PARTIAL_HASH_SPAN bytes.
+     */
+    static std::string computePartialHash(const fs::path &filePath);
+
+    /**
+     * Computes the SHA-256 of a whole file.
+     *
+     * @param filePath file to hash
+     *
+     * @returns hex SHA-256 of the file.
+     */
+    std::string computeFullHash(const fs::path &filePath);
+
+    /**
+     * Fills in a key's partial hash if it is not known yet.
+     */
+    void ensurePartialHash(ContentKey &key);
+
+    /**
+     * Fills in a key's full hash if it is not known yet.
+     */
+    void ensureFullHash(ContentKey &key);
+
+    /**
+     * Determines whether two files have identical contents, computing only the keys
+     * needed to decide.
+     *
+     * @param first first file's keys. Missing hashes are filled in as needed.
+     * @param second second file's keys. Missing hashes are filled in as needed.
+     *
+     * @returns true if the contents are identical.
+     */
+    bool sameContents(ContentKey &first, ContentKey &second);
+
+    /**
+     * Groups files with identical contents.
+     *
+     * Files with a unique size are never opened, files with a unique partial hash are
+     * never read in full. Files that cannot be read are left out of every group.
+     *
+     * @param keys files to group. Missing hashes are filled in as needed.
+     *
+     * @returns indexes into `keys` of every group of two or more identical files.
+     */
+    std::vector<std::vector<size_t>> groupIdentical(std::vector<ContentKey> &keys);
+};
+} // namespace MediaEngine
+} // namespace Mellophone
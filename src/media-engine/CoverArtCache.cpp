@@ -0,0 +1,303 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+// System libs
+#include <fcntl.h>
+#include <unistd.h>
+
+// Utility libs
+#include <boost/format.hpp>
+
+// Local includes
+#include "CoverArtCache.hpp"
+#include "Sha256Engine.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace
+{
+const char *const ORIGINAL_EXTENSIONS[] = {".jpg", ".png", ".img"};
+
+const char *extensionOf(ImageFormat format)
+{
+    switch (format)
+    {
+    case ImageFormat::jpeg:
+        return ORIGINAL_EXTENSIONS[0];
+    case ImageFormat::png:
+        return ORIGINAL_EXTENSIONS[1];
+    default:
+        return ORIGINAL_EXTENSIONS[2];
+    }
+}
+
+/**
+ * Fills `data` with the bytes of a file starting at `offset`.
+ *
+ * @returns false if the file could not be opened or is shorter than expected.
+ */
+bool readRange(const fs::path &location, uint64_t offset, std::vector<uint8_t> &data)
+{
+    const int fd = open(location.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    size_t done = 0;
+    while (done < data.size())
+    {
+        const ssize_t count = pread(fd, data.data() + done, data.size() - done, offset + done);
+        if (count <= 0)
+        {
+            break;
+        }
+        done += static_cast<size_t>(count);
+    }
+
+    close(fd);
+    return done == data.size();
+}
+} // namespace
+
+CoverArtCache::CoverArtCache(const fs::path &cacheDir, uint32_t threadCount)
+    : originalsDir(cacheDir / "originals"), thumbnailsDir(cacheDir / "thumbnails"), threadCount(threadCount)
+{
+    if (this->threadCount == 0)
+    {
+        this->threadCount = std::max(1u, std::thread::hardware_concurrency() / 2);
+    }
+
+    fs::create_directories(this->originalsDir);
+    fs::create_directories(this->thumbnailsDir);
+}
+
+CoverArtCache::~CoverArtCache()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stopping = true;
+    }
+    this->queued.notify_all();
+
+    for (auto &worker : this->workers)
+    {
+        worker.join();
+    }
+}
+
+void CoverArtCache::writeFile(const fs::path &location, const uint8_t *data, size_t length)
+{
+    // Unique per process and call, so concurrent writers of the same image never share a file.
+    static std::atomic<uint64_t> counter{0};
+
+    fs::create_directories(location.parent_path());
+
+    fs::path temporary = location;
+    temporary += ".tmp" + std::to_string(getpid()) + "-" + std::to_string(counter++);
+
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(data), length);
+
+        if (!out)
+        {
+            std::stringstream errStream;
+            errStream << boost::format("Unable to write '%s'.") % temporary;
+            throw std::runtime_error(errStream.str());
+        }
+    }
+
+    fs::rename(temporary, location);
+}
+
+string CoverArtCache::store(const uint8_t *data, size_t length)
+{
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    Sha256Hasher hasher;
+    hasher.update(data, length);
+    hasher.finish(digest);
+
+    const string hash = Sha256Engine::toHex(digest, SHA256_DIGEST_SIZE);
+    const fs::path original =
+        this->originalsDir / hash.substr(0, 2) / (hash + extensionOf(Thumbnail::detectFormat(data, length)));
+
+    if (!fs::exists(original))
+    {
+        CoverArtCache::writeFile(original, data, length);
+    }
+
+    if (!fs::exists(this->thumbnailsDir / (hash + ".jpg")))
+    {
+        this->queueThumbnail(hash);
+    }
+
+    return hash;
+}
+
+string CoverArtCache::storeFromFile(const fs::path &location, uint64_t offset, uint32_t length)
+{
+    if (length == 0 || length > MAX_COVER_ART_SIZE)
+    {
+        return "";
+    }
+
+    std::vector<uint8_t> data(length);
+    if (!readRange(location, offset, data))
+    {
+        return "";
+    }
+
+    return this->store(data.data(), data.size());
+}
+
+fs::path CoverArtCache::findOriginal(const string &hash)
+{
+    if (hash.size() < 2)
+    {
+        return fs::path();
+    }
+
+    for (const char *extension : ORIGINAL_EXTENSIONS)
+    {
+        fs::path original = this->originalsDir / hash.substr(0, 2) / (hash + extension);
+        if (fs::exists(original))
+        {
+            return original;
+        }
+    }
+
+    return fs::path();
+}
+
+fs::path CoverArtCache::getOriginal(const string &hash)
+{
+    return this->findOriginal(hash);
+}
+
+fs::path CoverArtCache::getThumbnail(const string &hash)
+{
+    const fs::path thumbnail = this->thumbnailsDir / (hash + ".jpg");
+    if (fs::exists(thumbnail) || this->generateThumbnail(hash))
+    {
+        return thumbnail;
+    }
+
+    return fs::path();
+}
+
+void CoverArtCache::queueThumbnail(const string &hash)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+
+        if (this->stopping || !this->pending.insert(hash).second)
+        {
+            // Already queued or being generated.
+            return;
+        }
+
+        this->queue.push_back(hash);
+
+        if (this->workers.empty())
+        {
+            for (uint32_t i = 0; i < this->threadCount; i++)
+            {
+                this->workers.emplace_back(&CoverArtCache::generateThumbnails, this);
+            }
+        }
+    }
+
+    this->queued.notify_one();
+}
+
+void CoverArtCache::generateThumbnails()
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+
+    while (true)
+    {
+        this->queued.wait(guard, [this] { return this->stopping || !this->queue.empty(); });
+        if (this->stopping)
+        {
+            return;
+        }
+
+        const string hash = std::move(this->queue.front());
+        this->queue.pop_front();
+
+        guard.unlock();
+        try
+        {
+            this->generateThumbnail(hash);
+        }
+        catch (const std::exception &err)
+        {
+            std::cerr << err.what() << std::endl;
+        }
+        guard.lock();
+
+        this->pending.erase(hash);
+        if (this->pending.empty())
+        {
+            this->idle.notify_all();
+        }
+    }
+}
+
+bool CoverArtCache::generateThumbnail(const string &hash)
+{
+    const fs::path thumbnailPath = this->thumbnailsDir / (hash + ".jpg");
+    if (fs::exists(thumbnailPath))
+    {
+        return true;
+    }
+
+    const fs::path original = this->findOriginal(hash);
+    if (original.empty())
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> data(fs::file_size(original));
+    if (!readRange(original, 0, data))
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> thumbnail;
+    if (!Thumbnail::create(data.data(), data.size(), THUMBNAIL_SIZE, thumbnail))
+    {
+        return false;
+    }
+
+    CoverArtCache::writeFile(thumbnailPath, thumbnail.data(), thumbnail.size());
+    return true;
+}
+
+void CoverArtCache::waitForThumbnails()
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    this->idle.wait(guard, [this] { return this->pending.empty() || this->stopping; });
+}
@@ -0,0 +1,409 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+
+// System libs
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Utility libs
+#include <boost/format.hpp>
+
+// Local includes
+#include "DirectoryWalker.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace
+{
+// Default number of threads reading directories, at most.
+const uint32_t MAX_DEFAULT_WALK_THREADS = 8;
+
+// Layout of a record returned by getdents64, which glibc does not declare.
+const size_t DIRENT_RECLEN_OFFSET = 16;
+const size_t DIRENT_TYPE_OFFSET = 18;
+const size_t DIRENT_NAME_OFFSET = 19;
+
+struct DirectoryID
+{
+    dev_t device;
+    ino_t inode;
+
+    bool operator==(const DirectoryID &other) const
+    {
+        return this->device == other.device && this->inode == other.inode;
+    }
+};
+
+struct DirectoryIDHash
+{
+    size_t operator()(const DirectoryID &id) const
+    {
+        return std::hash<uint64_t>()(static_cast<uint64_t>(id.inode) * 31 + static_cast<uint64_t>(id.device));
+    }
+};
+
+/**
+ * Closes a directory when the read of it ends, however it ends.
+ */
+struct DirectoryHandle
+{
+    int fd;
+
+    ~DirectoryHandle()
+    {
+        if (this->fd >= 0)
+        {
+            close(this->fd);
+        }
+    }
+};
+} // namespace
+
+struct DirectoryWalker::Walk
+{
+    /**
+     * Directories found by one thread and not yet read. The owner works from the back,
+     * thieves take from the front.
+     */
+    struct Stack
+    {
+        std::mutex lock;
+        std::deque<string> directories;
+    };
+
+    const std::function<bool(fs::path &&)> &onFile;
+    std::vector<Stack> stacks;
+
+    // Directories queued or being read. The walk is over once this reaches 0.
+    std::atomic<uint64_t> pending{0};
+    std::atomic<bool> stopped{false};
+
+    // Wakes idle threads when a directory is queued or the walk ends.
+    std::mutex idleLock;
+    std::condition_variable wake;
+
+    std::mutex visitedLock;
+    std::unordered_set<DirectoryID, DirectoryIDHash> visited;
+
+    std::atomic<uint64_t> directories{0};
+    std::atomic<uint64_t> files{0};
+    std::atomic<uint64_t> filtered{0};
+    std::atomic<uint64_t> unreadable{0};
+    std::atomic<uint64_t> revisited{0};
+
+    Walk(const std::function<bool(fs::path &&)> &onFile, size_t threadCount) : onFile(onFile), stacks(threadCount)
+    {
+    }
+
+    /**
+     * Queues a directory on a thread's stack.
+     */
+    void push(size_t self, string &&path)
+    {
+        this->pending++;
+
+        {
+            std::lock_guard<std::mutex> guard(this->stacks[self].lock);
+            this->stacks[self].directories.push_back(std::move(path));
+        }
+
+        this->wake.notify_one();
+    }
+
+    /**
+     * Takes the next directory off a thread's own stack, or else the oldest one off
+     * another thread's.
+     */
+    bool pop(size_t self, string &path)
+    {
+        {
+            Stack &own = this->stacks[self];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.directories.empty())
+            {
+                path = std::move(own.directories.back());
+                own.directories.pop_back();
+                return true;
+            }
+        }
+
+        for (size_t i = 1; i < this->stacks.size(); i++)
+        {
+            Stack &victim = this->stacks[(self + i) % this->stacks.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.directories.empty())
+            {
+                path = std::move(victim.directories.front());
+                victim.directories.pop_front();
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
+
+DirectoryWalker::DirectoryWalker(const WalkOptions &options) : options(options)
+{
+    if (this->options.threadCount == 0)
+    {
+        this->options.threadCount =
+            std::min(MAX_DEFAULT_WALK_THREADS, std::max(1u, std::thread::hardware_concurrency()));
+    }
+}
+
+WalkSummary DirectoryWalker::walk(const fs::path &root, const std::function<bool(fs::path &&)> &onFile)
+{
+    string rootPath = root.string();
+    while (rootPath.size() > 1 && rootPath.back() == '/')
+    {
+        rootPath.pop_back();
+    }
+
+    // Checked up front, so a missing root is an error rather than an empty library.
+    const DirectoryHandle rootHandle{open(rootPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+    if (rootHandle.fd < 0)
+    {
+        std::stringstream errStream;
+        errStream << boost::format("Unable to scan '%s': %s") % rootPath % std::strerror(errno);
+        throw std::runtime_error(errStream.str());
+    }
+
+    Walk walk(onFile, this->options.threadCount);
+    walk.push(0, std::move(rootPath));
+
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < this->options.threadCount; i++)
+    {
+        pool.emplace_back(&DirectoryWalker::work, this, std::ref(walk), i);
+    }
+
+    this->work(walk, 0);
+
+    for (std::thread &thread : pool)
+    {
+        thread.join();
+    }
+
+    WalkSummary summary;
+    summary.directories = walk.directories;
+    summary.files = walk.files;
+    summary.filtered = walk.filtered;
+    summary.unreadable = walk.unreadable;
+    summary.revisited = walk.revisited;
+    return summary;
+}
+
+void DirectoryWalker::work(Walk &walk, size_t self)
+{
+    string path;
+
+    while (!walk.stopped)
+    {
+        if (walk.pop(self, path))
+        {
+            this->readDirectory(walk, self, std::move(path));
+
+            // Only now are this directory's subdirectories all queued.
+            if (--walk.pending == 0)
+            {
+                walk.wake.notify_all();
+            }
+            continue;
+        }
+
+        if (walk.pending == 0)
+        {
+            return;
+        }
+
+        // The timeout covers a wake-up sent between the checks above and the wait.
+        std::unique_lock<std::mutex> guard(walk.idleLock);
+        walk.wake.wait_for(guard, std::chrono::milliseconds(1));
+    }
+
+    walk.wake.notify_all();
+}
+
+void DirectoryWalker::readDirectory(Walk &walk, size_t self, string &&path)
+{
+    const DirectoryHandle handle{open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+    struct stat info;
+
+    if (handle.fd < 0 || fstat(handle.fd, &info) != 0)
+    {
+        walk.unreadable++;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(walk.visitedLock);
+        if (!walk.visited.insert({info.st_dev, info.st_ino}).second)
+        {
+            walk.revisited++;
+            return;
+        }
+    }
+
+    walk.directories++;
+
+    const string prefix = path.back() == '/' ? path : path + '/';
+    alignas(8) char buffer[WALK_BUFFER_SIZE];
+
+    for (;;)
+    {
+        const long count = syscall(SYS_getdents64, handle.fd, buffer, sizeof(buffer));
+        if (count <= 0)
+        {
+            if (count < 0)
+            {
+                walk.unreadable++;
+            }
+            return;
+        }
+
+        uint16_t recordLength = 0;
+        for (long offset = 0; offset < count; offset += recordLength)
+        {
+            const char *record = buffer + offset;
+            std::memcpy(&recordLength, record + DIRENT_RECLEN_OFFSET, sizeof(recordLength));
+            unsigned char type = static_cast<unsigned char>(record[DIRENT_TYPE_OFFSET]);
+            const string_view name(record + DIRENT_NAME_OFFSET);
+
+            if (name == "." || name == "..")
+            {
+                continue;
+            }
+
+            if (type == DT_LNK || type == DT_UNKNOWN)
+            {
+                // A link that cannot lead anywhere wanted is left without a stat.
+                if (type == DT_LNK && !this->options.followLinks && !this->isWanted(name))
+                {
+                    continue;
+                }
+
+                struct stat target;
+                if (fstatat(handle.fd, record + DIRENT_NAME_OFFSET, &target, 0) != 0)
+                {
+                    walk.unreadable++;
+                    continue;
+                }
+
+                if (S_ISREG(target.st_mode))
+                {
+                    type = DT_REG;
+                }
+                else if (S_ISDIR(target.st_mode) && (type == DT_UNKNOWN || this->options.followLinks))
+                {
+                    type = DT_DIR;
+                }
+            }
+
+            if (type == DT_REG)
+            {
+                if (!this->isWanted(name))
+                {
+                    walk.filtered++;
+                    continue;
+                }
+
+                walk.files++;
+                if (!walk.onFile(fs::path(prefix + string(name))))
+                {
+                    walk.stopped = true;
+                    return;
+                }
+            }
+            else if (type == DT_DIR)
+            {
+                string child = prefix + string(name);
+                if (!this->isExcluded(name, child))
+                {
+                    walk.push(self, std::move(child));
+                }
+            }
+        }
+
+        if (walk.stopped)
+        {
+            return;
+        }
+    }
+}
+
+bool DirectoryWalker::isWanted(string_view name) const
+{
+    if (this->options.extensions.empty())
+    {
+        return true;
+    }
+
+    // The name must be longer than the extension: ".flac" on its own is a hidden file.
+    return std::any_of(this->options.extensions.begin(), this->options.extensions.end(),
+                       [name](const string &extension) {
+                           return name.size() > extension.size() &&
+                                  name.compare(name.size() - extension.size(), extension.size(), extension) == 0;
+                       });
+}
+
+bool DirectoryWalker::isExcluded(string_view name, const string &path) const
+{
+    if (this->options.skipHidden && name.front() == '.')
+    {
+        return true;
+    }
+
+    for (const string &excluded : this->options.excludedDirectories)
+    {
+        if (excluded.empty())
+        {
+            continue;
+        }
+
+        if (excluded.front() == '/')
+        {
+            const size_t length = excluded.find_last_not_of('/') + 1;
+            if (string_view(excluded).substr(0, length) == path)
+            {
+                return true;
+            }
+        }
+        else if (excluded == name)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,379 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+// System libs
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// Utility libs
+#include <boost/format.hpp>
+
+// Local includes
+#include "DirectoryWatcher.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+// Files are reported when closed after writing rather than on every write, so a file
+// is never read half written. Creations only matter for directories, which need watching.
+const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_ONLYDIR;
+
+// Room for many events per read. Each is at most sizeof(inotify_event) + NAME_MAX + 1 bytes.
+const size_t EVENT_BUFFER_SIZE = 64 * 1024;
+
+/**
+ * Returns the range of keys below a directory: its path with a trailing slash, and the
+ * same path with that slash replaced by the next character.
+ */
+std::pair<string, string> descendantRange(const fs::path &dir)
+{
+    const string prefix = dir.string();
+    return {prefix + '/', prefix + '0'};
+}
+} // namespace
+
+bool WatchBatch::empty() const
+{
+    return this->changed.empty() && this->removed.empty() && !this->overflowed;
+}
+
+DirectoryWatcher::DirectoryWatcher(const fs::path &root, const std::function<void(WatchBatch &&)> &onBatch,
+                                   const WatchOptions &options)
+    : root(root), options(options), onBatch(onBatch)
+{
+    this->inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    this->wakeFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (this->inotifyFD < 0 || this->wakeFD < 0)
+    {
+        const int error = errno;
+        if (this->inotifyFD >= 0)
+        {
+            close(this->inotifyFD);
+        }
+        if (this->wakeFD >= 0)
+        {
+            close(this->wakeFD);
+        }
+
+        std::stringstream errStream;
+        errStream << boost::format("Unable to watch '%s': %s") % root.string() % std::strerror(error);
+        throw std::runtime_error(errStream.str());
+    }
+
+    this->watchTree(this->root, false);
+    this->thread = std::thread(&DirectoryWatcher::run, this);
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+    const uint64_t wake = 1;
+    if (write(this->wakeFD, &wake, sizeof(wake)) != sizeof(wake))
+    {
+        std::cerr << "Unable to wake the directory watcher: " << std::strerror(errno) << std::endl;
+    }
+
+    this->thread.join();
+
+    close(this->inotifyFD);
+    close(this->wakeFD);
+}
+
+void DirectoryWatcher::watchTree(const fs::path &dir, bool reportFiles)
+{
+    auto addWatch = [this](const fs::path &location) {
+        const int wd = inotify_add_watch(this->inotifyFD, location.c_str(), WATCH_MASK);
+
+        if (wd >= 0)
+        {
+            this->directories[wd] = location;
+        }
+        else if (errno == ENOSPC && !this->watchLimitReported)
+        {
+            // Raising fs.inotify.max_user_watches is the only fix, so say so once.
+            std::cerr << "Out of inotify watches; changes below '" << location.string()
+                      << "' will not be seen until the next scan." << std::endl;
+            this->watchLimitReported = true;
+        }
+    };
+
+    addWatch(dir);
+
+    std::error_code err;
+    auto iter = fs::recursive_directory_iterator(dir, fs::directory_options::skip_permission_denied, err);
+
+    for (auto end = fs::recursive_directory_iterator(); !err && iter != end; iter.increment(err))
+    {
+        if (iter->is_directory(err) && !iter->is_symlink(err))
+        {
+            if (this->isExcluded(iter->path()))
+            {
+                iter.disable_recursion_pending();
+            }
+            else
+            {
+                addWatch(iter->path());
+            }
+        }
+        else if (reportFiles && iter->is_regular_file(err))
+        {
+            this->pending[iter->path().string()] = true;
+        }
+
+        // Skip the entry that failed and carry on with the rest of the tree.
+        err.clear();
+    }
+}
+
+bool DirectoryWatcher::isExcluded(const fs::path &dir) const
+{
+    const string name = dir.filename().string();
+    if (this->options.skipHiddenDirectories && !name.empty() && name.front() == '.')
+    {
+        return true;
+    }
+
+    for (const string &excluded : this->options.excludedDirectories)
+    {
+        if (excluded.empty())
+        {
+            continue;
+        }
+
+        if (excluded.front() == '/')
+        {
+            if (excluded.substr(0, excluded.find_last_not_of('/') + 1) == dir.string())
+            {
+                return true;
+            }
+        }
+        else if (excluded == name)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void DirectoryWatcher::unwatchTree(const fs::path &dir)
+{
+    const auto range = descendantRange(dir);
+    const string location = dir.string();
+
+    for (auto entry = this->directories.begin(); entry != this->directories.end();)
+    {
+        const string &watched = entry->second.native();
+
+        if (watched == location || (watched >= range.first && watched < range.second))
+        {
+            inotify_rm_watch(this->inotifyFD, entry->first);
+            entry = this->directories.erase(entry);
+        }
+        else
+        {
+            ++entry;
+        }
+    }
+}
+
+void DirectoryWatcher::markRemoved(const fs::path &location)
+{
+    const auto range = descendantRange(location);
+    this->pending.erase(this->pending.lower_bound(range.first), this->pending.lower_bound(range.second));
+    this->pending[location.string()] = false;
+}
+
+void DirectoryWatcher::handleEvent(const inotify_event &event)
+{
+    if (event.mask & IN_Q_OVERFLOW)
+    {
+        this->overflowed = true;
+        return;
+    }
+
+    auto dir = this->directories.find(event.wd);
+    if (dir == this->directories.end())
+    {
+        return;
+    }
+
+    if (event.mask & IN_IGNORED)
+    {
+        // The directory was deleted, or its watch removed.
+        this->directories.erase(dir);
+        return;
+    }
+
+    if (event.len == 0)
+    {
+        return;
+    }
+
+    const fs::path location = dir->second / event.name;
+
+    if (event.mask & IN_ISDIR)
+    {
+        if (this->isExcluded(location))
+        {
+            // Never watched, so nothing below it was reported either.
+            return;
+        }
+
+        if (event.mask & (IN_CREATE | IN_MOVED_TO))
+        {
+            // Files may have been added before the watch was in place, so report them all.
+            this->watchTree(location, true);
+        }
+        else if (event.mask & (IN_DELETE | IN_MOVED_FROM))
+        {
+            this->unwatchTree(location);
+            this->markRemoved(location);
+        }
+    }
+    else if (event.mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+    {
+        this->pending[location.string()] = true;
+    }
+    else if (event.mask & (IN_DELETE | IN_MOVED_FROM))
+    {
+        this->markRemoved(location);
+    }
+}
+
+void DirectoryWatcher::readEvents()
+{
+    alignas(inotify_event) char buffer[EVENT_BUFFER_SIZE];
+
+    while (true)
+    {
+        const ssize_t length = read(this->inotifyFD, buffer, sizeof(buffer));
+        if (length <= 0)
+        {
+            // EAGAIN once the queue is drained.
+            return;
+        }
+
+        for (ssize_t offset = 0; offset < length;)
+        {
+            const auto *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+            this->handleEvent(*event);
+            offset += sizeof(inotify_event) + event->len;
+        }
+    }
+}
+
+void DirectoryWatcher::deliver()
+{
+    WatchBatch batch;
+    batch.overflowed = this->overflowed;
+
+    for (const auto &entry : this->pending)
+    {
+        (entry.second ? batch.changed : batch.removed).emplace_back(entry.first);
+    }
+
+    this->pending.clear();
+    this->overflowed = false;
+
+    if (batch.empty())
+    {
+        return;
+    }
+
+    try
+    {
+        this->onBatch(std::move(batch));
+    }
+    catch (const std::exception &err)
+    {
+        std::cerr << err.what() << std::endl;
+    }
+}
+
+void DirectoryWatcher::run()
+{
+    pollfd fds[2] = {{this->inotifyFD, POLLIN, 0}, {this->wakeFD, POLLIN, 0}};
+    Clock::time_point firstEvent;
+    Clock::time_point lastEvent;
+
+    while (true)
+    {
+        const bool waiting = !this->pending.empty() || this->overflowed;
+        int timeout = -1;
+
+        if (waiting)
+        {
+            const Clock::time_point deadline =
+                std::min(lastEvent + this->options.quietPeriod, firstEvent + this->options.maxDelay);
+            const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+            timeout = static_cast<int>(std::max<int64_t>(0, remaining.count()));
+        }
+
+        const int ready = poll(fds, 2, timeout);
+        if (ready < 0 && errno != EINTR)
+        {
+            std::cerr << "Directory watcher stopped: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            // Pick up whatever happened just before the watcher was stopped.
+            this->readEvents();
+            break;
+        }
+
+        if (ready > 0 && (fds[0].revents & POLLIN))
+        {
+            this->readEvents();
+
+            const Clock::time_point now = Clock::now();
+            if (!waiting)
+            {
+                firstEvent = now;
+            }
+            lastEvent = now;
+
+            // A steady stream of events must not hold the batch back forever.
+            if (now - firstEvent < this->options.maxDelay)
+            {
+                continue;
+            }
+        }
+        else if (ready != 0 || !waiting)
+        {
+            continue;
+        }
+
+        this->deliver();
+    }
+
+    this->deliver();
+}
@@ -0,0 +1,648 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+
+// Utility libs
+#include <boost/format.hpp>
+
+// Local includes
+#include "DuplicateFinder.hpp"
+#include "IngestWriter.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace
+{
+// Tracks normalized per task, so workers take turns on the counter rarely.
+const size_t NORMALIZE_BLOCK_SIZE = 1024;
+
+// Title given to tracks without one. Tracks that all lack tags are not duplicates.
+const char UNTITLED[] = "unknown";
+
+/**
+ * Runs `work(i)` for every i below `count`, spread over `threads` threads including
+ * the caller's.
+ */
+void parallelFor(size_t count, uint32_t threads, const std::function<void(size_t)> &work)
+{
+    std::atomic<size_t> next{0};
+    auto worker = [&next, count, &work] {
+        for (size_t i = next++; i < count; i = next++)
+        {
+            work(i);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (uint32_t i = 1; i < threads && i < count; i++)
+    {
+        pool.emplace_back(worker);
+    }
+
+    worker();
+
+    for (std::thread &thread : pool)
+    {
+        thread.join();
+    }
+}
+
+string columnString(sqlite3_stmt *stmt, int column)
+{
+    const char *text = reinterpret_cast<const char *>(sqlite3_column_text(stmt, column));
+    return text != nullptr ? string(text, static_cast<size_t>(sqlite3_column_bytes(stmt, column))) : string();
+}
+
+void bindOptionalText(sqlite3_stmt *stmt, int index, const string &value)
+{
+    if (value.empty())
+    {
+        sqlite3_bind_null(stmt, index);
+    }
+    else
+    {
+        sqlite3_bind_text(stmt, index, value.c_str(), -1, SQLITE_STATIC);
+    }
+}
+
+void stepWrite(CachedStatement &stmt)
+{
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE)
+    {
+        std::stringstream errStream;
+        errStream << boost::format("Failed to store the duplicate report: %s") %
+                         sqlite3_errmsg(sqlite3_db_handle(stmt.get()));
+        throw std::runtime_error(errStream.str());
+    }
+}
+} // namespace
+
+DuplicateFinder::DuplicateFinder(const DuplicateOptions &options) : options(options)
+{
+    this->threadCount = options.threadCount != 0 ? options.threadCount : std::max(1u, std::thread::hardware_concurrency());
+}
+
+string DuplicateFinder::normalize(string_view text)
+{
+    string normalized;
+    normalized.reserve(text.size());
+
+    int depth = 0;
+    bool separated = false;
+
+    for (const char c : text)
+    {
+        if (c == '(' || c == '[')
+        {
+            depth++;
+            continue;
+        }
+
+        if ((c == ')' || c == ']') && depth > 0)
+        {
+            depth--;
+            separated = true;
+            continue;
+        }
+
+        if (depth > 0)
+        {
+            continue;
+        }
+
+        const unsigned char byte = static_cast<unsigned char>(c);
+        const bool upper = byte >= 'A' && byte <= 'Z';
+        const bool kept = upper || (byte >= 'a' && byte <= 'z') || (byte >= '0' && byte <= '9') || byte >= 0x80;
+
+        if (!kept)
+        {
+            separated = true;
+            continue;
+        }
+
+        if (separated && !normalized.empty())
+        {
+            normalized += ' ';
+        }
+        separated = false;
+
+        normalized += upper ? static_cast<char>(byte - 'A' + 'a') : c;
+    }
+
+    if (normalized.rfind("the ", 0) == 0)
+    {
+        normalized.erase(0, 4);
+    }
+
+    return normalized;
+}
+
+void DuplicateFinder::load(const shared_ptr<StatementCache> &statements)
+{
+    this->candidates.clear();
+
+    CachedStatement stmt = statements->acquire(DUPLICATE_CANDIDATES_SQL);
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW)
+    {
+        sqlite3_stmt *row = stmt.get();
+
+        Candidate candidate;
+        candidate.id = static_cast<uint32_t>(sqlite3_column_int64(row, 0));
+        candidate.content.location = columnString(row, 1);
+        candidate.content.size = static_cast<uint64_t>(sqlite3_column_int64(row, 2));
+        candidate.content.partialHash = columnString(row, 3);
+        candidate.content.fullHash = columnString(row, 4);
+        candidate.content.audioMD5 = columnString(row, 5);
+        candidate.title = columnString(row, 6);
+        candidate.album = columnString(row, 7);
+        candidate.artist = columnString(row, 8);
+        candidate.duration = static_cast<uint32_t>(sqlite3_column_int64(row, 9));
+
+        this->candidates.push_back(std::move(candidate));
+    }
+
+    this->copies.clear();
+
+    CachedStatement copyStmt = statements->acquire(DUPLICATE_COPIES_SQL);
+    while (sqlite3_step(copyStmt.get()) == SQLITE_ROW)
+    {
+        DuplicateCopy copy;
+        copy.location = columnString(copyStmt.get(), 0);
+        copy.track = static_cast<uint32_t>(sqlite3_column_int64(copyStmt.get(), 1));
+
+        this->copies.push_back(std::move(copy));
+    }
+}
+
+DuplicateSummary DuplicateFinder::find()
+{
+    DuplicateSummary summary;
+    summary.tracks = this->candidates.size();
+    summary.copies = this->copies.size();
+    this->groups.clear();
+
+    const size_t blocks = (this->candidates.size() + NORMALIZE_BLOCK_SIZE - 1) / NORMALIZE_BLOCK_SIZE;
+    parallelFor(blocks, this->threadCount, [this](size_t block) {
+        const size_t end = std::min(this->candidates.size(), (block + 1) * NORMALIZE_BLOCK_SIZE);
+        for (size_t i = block * NORMALIZE_BLOCK_SIZE; i < end; i++)
+        {
+            Candidate &candidate = this->candidates[i];
+            candidate.title = DuplicateFinder::normalize(candidate.title);
+            candidate.artist = DuplicateFinder::normalize(candidate.artist);
+            candidate.album = DuplicateFinder::normalize(candidate.album);
+        }
+    });
+
+    // The two sorts only read what is already known, so they run alongside the identical
+    // pass, which waits on the disk. The identical pass only writes the hashes, which
+    // neither sort reads.
+    std::future<std::vector<uint32_t>> audioOrder = std::async(std::launch::async, [this] {
+        std::vector<uint32_t> order;
+        for (uint32_t i = 0; i < this->candidates.size(); i++)
+        {
+            if (!this->candidates[i].content.audioMD5.empty())
+            {
+                order.push_back(i);
+            }
+        }
+
+        std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            return this->candidates[a].content.audioMD5 < this->candidates[b].content.audioMD5;
+        });
+        return order;
+    });
+
+    std::future<std::vector<uint32_t>> tagOrder = std::async(std::launch::async, [this] {
+        std::vector<uint32_t> order;
+        for (uint32_t i = 0; i < this->candidates.size(); i++)
+        {
+            const string &title = this->candidates[i].title;
+            if (!title.empty() && title != UNTITLED)
+            {
+                order.push_back(i);
+            }
+        }
+
+        // Unknown durations, stored as 0, sort first in each run of equal tags.
+        std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            const Candidate &first = this->candidates[a];
+            const Candidate &second = this->candidates[b];
+            return std::tie(first.artist, first.album, first.title, first.duration) <
+                   std::tie(second.artist, second.album, second.title, second.duration);
+        });
+        return order;
+    });
+
+    std::vector<uint32_t> classes = this->groupIdentical(summary);
+    this->groupSameAudio(audioOrder.get(), classes, summary);
+    this->groupSimilar(tagOrder.get(), classes, summary);
+
+    return summary;
+}
+
+std::vector<uint32_t> DuplicateFinder::groupIdentical(DuplicateSummary &summary)
+{
+    std::vector<uint32_t> classes(this->candidates.size());
+    std::iota(classes.begin(), classes.end(), 0);
+
+    // Tracks whose size is unknown were imported before sizes were recorded.
+    std::vector<uint32_t> bySize;
+    for (uint32_t i = 0; i < this->candidates.size(); i++)
+    {
+        if (this->candidates[i].content.size != 0)
+        {
+            bySize.push_back(i);
+        }
+    }
+
+    std::sort(bySize.begin(), bySize.end(), [this](uint32_t a, uint32_t b) {
+        return std::make_pair(this->candidates[a].content.size, a) < std::make_pair(this->candidates[b].content.size, b);
+    });
+
+    std::vector<std::vector<uint32_t>> runs;
+    for (size_t start = 0, end = 0; start < bySize.size(); start = end)
+    {
+        const uint64_t size = this->candidates[bySize[start]].content.size;
+        for (end = start + 1; end < bySize.size() && this->candidates[bySize[end]].content.size == size; end++)
+        {
+        }
+
+        if (end - start > 1)
+        {
+            runs.emplace_back(bySize.begin() + start, bySize.begin() + end);
+        }
+    }
+
+    // Only files of equal size are ever read, a run at a time on each worker.
+    std::vector<std::vector<std::vector<uint32_t>>> found(runs.size());
+    std::atomic<uint64_t> hashesComputed{0};
+
+    parallelFor(runs.size(), this->threadCount, [this, &runs, &found, &hashesComputed](size_t r) {
+        const std::vector<uint32_t> &run = runs[r];
+        ContentMatcher matcher(this->options.hashReadMode);
+
+        std::vector<ContentKey> keys;
+        for (uint32_t index : run)
+        {
+            keys.push_back(this->candidates[index].content);
+        }
+
+        const std::vector<std::vector<size_t>> matched = matcher.groupIdentical(keys);
+
+        for (size_t k = 0; k < run.size(); k++)
+        {
+            ContentKey &known = this->candidates[run[k]].content;
+            const int learned = (known.partialHash.empty() && !keys[k].partialHash.empty() ? 1 : 0) +
+                                (known.fullHash.empty() && !keys[k].fullHash.empty() ? 1 : 0);
+
+            if (learned > 0)
+            {
+                known.partialHash = keys[k].partialHash;
+                known.fullHash = keys[k].fullHash;
+                this->candidates[run[k]].hashesLearned = true;
+                hashesComputed += learned;
+            }
+        }
+
+        for (const std::vector<size_t> &group : matched)
+        {
+            std::vector<uint32_t> members;
+            for (size_t k : group)
+            {
+                members.push_back(run[k]);
+            }
+            found[r].push_back(std::move(members));
+        }
+    });
+
+    // Ordered by track, so groups of a track and its copies come out in a stable order.
+    std::map<uint32_t, std::vector<DuplicateCopy>> copiesOf;
+    for (const DuplicateCopy &copy : this->copies)
+    {
+        copiesOf[copy.track].push_back(copy);
+    }
+
+    auto takeCopies = [&copiesOf](uint32_t track, std::vector<DuplicateCopy> &into) {
+        auto found = copiesOf.find(track);
+        if (found != copiesOf.end())
+        {
+            into.insert(into.end(), found->second.begin(), found->second.end());
+            copiesOf.erase(found);
+        }
+    };
+
+    for (const auto &runGroups : found)
+    {
+        for (const std::vector<uint32_t> &members : runGroups)
+        {
+            for (uint32_t member : members)
+            {
+                classes[member] = members.front();
+            }
+
+            this->addGroup(DuplicateKind::identical, members, std::vector<uint32_t>());
+            for (uint32_t member : members)
+            {
+                takeCopies(this->candidates[member].id, this->groups.back().copies);
+            }
+            summary.identicalGroups++;
+        }
+    }
+
+    // Tracks with copies but no identical track.
+    while (!copiesOf.empty())
+    {
+        DuplicateGroup group;
+        group.kind = DuplicateKind::identical;
+        group.tracks.push_back(copiesOf.begin()->first);
+        takeCopies(group.tracks.front(), group.copies);
+
+        this->groups.push_back(std::move(group));
+        summary.identicalGroups++;
+    }
+
+    for (DuplicateGroup &group : this->groups)
+    {
+        std::sort(group.copies.begin(), group.copies.end(), [](const DuplicateCopy &a, const DuplicateCopy &b) {
+            return a.location < b.location;
+        });
+    }
+
+    summary.hashesComputed = hashesComputed;
+    return classes;
+}
+
+void DuplicateFinder::groupSameAudio(const std::vector<uint32_t> &order, std::vector<uint32_t> &classes,
+                                     DuplicateSummary &summary)
+{
+    for (size_t start = 0, end = 0; start < order.size(); start = end)
+    {
+        const string &audioMD5 = this->candidates[order[start]].content.audioMD5;
+        for (end = start + 1; end < order.size() && this->candidates[order[end]].content.audioMD5 == audioMD5; end++)
+        {
+        }
+
+        if (end - start < 2)
+        {
+            continue;
+        }
+
+        const std::vector<uint32_t> members(order.begin() + start, order.begin() + end);
+        if (this->addGroup(DuplicateKind::sameAudio, members, classes))
+        {
+            summary.sameAudioGroups++;
+        }
+
+        // Identical files share their audio, so every member of their classes is in the run.
+        const uint32_t joined = classes[members.front()];
+        for (uint32_t member : members)
+        {
+            classes[member] = joined;
+        }
+    }
+}
+
+void DuplicateFinder::groupSimilar(const std::vector<uint32_t> &order, const std::vector<uint32_t> &classes,
+                                   DuplicateSummary &summary)
+{
+    auto sameTags = [this](uint32_t a, uint32_t b) {
+        const Candidate &first = this->candidates[a];
+        const Candidate &second = this->candidates[b];
+        return first.title == second.title && first.artist == second.artist && first.album == second.album;
+    };
+
+    for (size_t start = 0, end = 0; start < order.size(); start = end)
+    {
+        for (end = start + 1; end < order.size() && sameTags(order[start], order[end]); end++)
+        {
+        }
+
+        if (end - start < 2)
+        {
+            continue;
+        }
+
+        size_t known = start;
+        while (known < end && this->candidates[order[known]].duration == 0)
+        {
+            known++;
+        }
+
+        // Split the run where consecutive lengths differ by more than the tolerance.
+        std::vector<std::vector<uint32_t>> clusters;
+        for (size_t i = known; i < end; i++)
+        {
+            if (clusters.empty() || this->candidates[order[i]].duration - this->candidates[order[i - 1]].duration >
+                                        this->options.durationTolerance)
+            {
+                clusters.emplace_back();
+            }
+            clusters.back().push_back(order[i]);
+        }
+
+        // A track of unknown length can only be placed if there is a single candidate for it.
+        if (known > start && clusters.size() <= 1)
+        {
+            if (clusters.empty())
+            {
+                clusters.emplace_back();
+            }
+            clusters.back().insert(clusters.back().end(), order.begin() + start, order.begin() + known);
+        }
+
+        for (const std::vector<uint32_t> &cluster : clusters)
+        {
+            if (cluster.size() > 1 && this->addGroup(DuplicateKind::similar, cluster, classes))
+            {
+                summary.similarGroups++;
+            }
+        }
+    }
+}
+
+bool DuplicateFinder::addGroup(DuplicateKind kind, const std::vector<uint32_t> &members,
+                               const std::vector<uint32_t> &classes)
+{
+    if (!classes.empty() && std::all_of(members.begin(), members.end(), [&classes, &members](uint32_t member) {
+            return classes[member] == classes[members.front()];
+        }))
+    {
+        return false;
+    }
+
+    DuplicateGroup group;
+    group.kind = kind;
+    for (uint32_t member : members)
+    {
+        group.tracks.push_back(this->candidates[member].id);
+    }
+    std::sort(group.tracks.begin(), group.tracks.end());
+
+    this->groups.push_back(std::move(group));
+    return true;
+}
+
+const std::vector<DuplicateGroup> &DuplicateFinder::getGroups() const
+{
+    return this->groups;
+}
+
+void DuplicateFinder::store(const shared_ptr<StatementCache> &statements)
+{
+    sqlite3 *db = *statements->getConnection();
+    sqlite3_exec(db, BEGIN_TRANSACTION_SQL.c_str(), nullptr, nullptr, nullptr);
+
+    try
+    {
+        {
+            CachedStatement stmt = statements->acquire(DUPLICATE_MEMBERS_CLEAR_SQL);
+            stepWrite(stmt);
+        }
+
+        {
+            CachedStatement stmt = statements->acquire(DUPLICATE_GROUPS_CLEAR_SQL);
+            stepWrite(stmt);
+        }
+
+        std::unordered_map<uint32_t, const string *> locations;
+        for (const Candidate &candidate : this->candidates)
+        {
+            locations.emplace(candidate.id, &candidate.content.location.native());
+        }
+
+        auto insertMember = [&statements](uint32_t groupID, const string &location, uint32_t track) {
+            CachedStatement stmt = statements->acquire(DUPLICATE_MEMBER_INSERT_SQL);
+            sqlite3_bind_int64(stmt.get(), 1, groupID);
+            sqlite3_bind_text(stmt.get(), 2, location.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int64(stmt.get(), 3, track);
+            stepWrite(stmt);
+        };
+
+        uint32_t groupID = 0;
+        for (const DuplicateGroup &group : this->groups)
+        {
+            groupID++;
+
+            {
+                CachedStatement stmt = statements->acquire(DUPLICATE_GROUP_INSERT_SQL);
+                sqlite3_bind_int64(stmt.get(), 1, groupID);
+                sqlite3_bind_int(stmt.get(), 2, static_cast<int>(group.kind));
+                sqlite3_bind_int64(stmt.get(), 3, static_cast<int64_t>(group.tracks.size() + group.copies.size()));
+                stepWrite(stmt);
+            }
+
+            for (uint32_t track : group.tracks)
+            {
+                insertMember(groupID, *locations.at(track), track);
+            }
+
+            for (const DuplicateCopy &copy : group.copies)
+            {
+                insertMember(groupID, copy.location, copy.track);
+            }
+        }
+
+        for (const Candidate &candidate : this->candidates)
+        {
+            if (candidate.hashesLearned)
+            {
+                {
+                    CachedStatement stmt = statements->acquire(UPDATE_CONTENT_KEYS_SQL);
+                    bindOptionalText(stmt.get(), 1, candidate.content.partialHash);
+                    bindOptionalText(stmt.get(), 2, candidate.content.fullHash);
+                    sqlite3_bind_int64(stmt.get(), 3, candidate.id);
+                    stepWrite(stmt);
+                }
+
+                // Checksums are unique, so only one of a group of identical files keeps its
+                // full hash. The others still keep the partial hash.
+                if (sqlite3_changes(db) == 0)
+                {
+                    CachedStatement stmt = statements->acquire(UPDATE_CONTENT_KEYS_SQL);
+                    bindOptionalText(stmt.get(), 1, candidate.content.partialHash);
+                    sqlite3_bind_int64(stmt.get(), 3, candidate.id);
+                    stepWrite(stmt);
+                }
+            }
+        }
+
+        if (sqlite3_exec(db, COMMIT_TRANSACTION_SQL.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK)
+        {
+            std::stringstream errStream;
+            errStream << boost::format("Failed to store the duplicate report: %s") % sqlite3_errmsg(db);
+            throw std::runtime_error(errStream.str());
+        }
+    }
+    catch (const std::runtime_error &err)
+    {
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        throw;
+    }
+}
+
+template <>
+bool DuplicateCursor::next()
+{
+    if (!this->query.step())
+    {
+        return false;
+    }
+
+    this->current.groupID = static_cast<uint32_t>(this->query.integer(0));
+    this->current.kind = static_cast<DuplicateKind>(this->query.integer(1));
+    this->current.trackID = static_cast<uint32_t>(this->query.integer(2));
+    this->current.copy = this->query.integer(8) != 0;
+    this->current.location = this->query.text(3);
+    this->current.title = this->query.text(4);
+    this->current.album = this->query.text(5);
+    this->current.artist = this->query.text(6);
+    this->current.duration = static_cast<uint32_t>(this->query.integer(7));
+
+    return true;
+}
+
+DuplicateCursor Mellophone::MediaEngine::openDuplicateCursor(ReaderLease &&reader, const DuplicateQuery &query)
+{
+    // Keys are (group ID, location).
+    if (!query.after.empty() && query.after.values.size() != 2)
+    {
+        throw std::invalid_argument("Cursor key does not belong to a duplicate report query.");
+    }
+
+    QueryCursor cursor(std::move(reader), DUPLICATE_REPORT_SQL, 2);
+    sqlite3_stmt *stmt = cursor.get();
+
+    sqlite3_bind_int(stmt, sqlite3_bind_parameter_index(stmt, "@kind"), static_cast<int>(query.kind));
+    sqlite3_bind_int64(stmt, sqlite3_bind_parameter_index(stmt, "@group"),
+                       query.after.empty() ? 0 : query.after.values[0].integer);
+    const string location = query.after.empty() ? string() : query.after.values[1].text;
+    sqlite3_bind_text(stmt, sqlite3_bind_parameter_index(stmt, "@loc"), location.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, sqlite3_bind_parameter_index(stmt, "@limit"), query.limit > 0 ? query.limit : -1);
+
+    return DuplicateCursor(std::move(cursor));
+}
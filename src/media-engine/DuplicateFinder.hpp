@@ -0,0 +1,292 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ContentMatcher.hpp"
+#include "HashReader.hpp"
+#include "LibraryQuery.hpp"
+#include "StatementCache.hpp"
+
+using std::string;
+using std::string_view;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+static const string DUPLICATE_CANDIDATES_SQL =
+    "SELECT Tracks.ID, Tracks.FileLocation, Tracks.FileSize, Tracks.PartialHash, Tracks.Checksum, Tracks.AudioMD5, "
+    "Tracks.Title, Albums.Name, Artists.Name, Tracks.Duration "
+    "FROM Tracks LEFT JOIN Albums ON Albums.ID == Tracks.Album LEFT JOIN Artists ON Artists.ID == Albums.Artist;";
+
+// Copies whose track has since been removed are left for the next scan to import.
+static const string DUPLICATE_COPIES_SQL =
+    "SELECT DuplicateFiles.FileLocation, DuplicateFiles.Track FROM DuplicateFiles "
+    "JOIN Tracks ON Tracks.ID == DuplicateFiles.Track;";
+
+static const string DUPLICATE_MEMBERS_CLEAR_SQL = "DELETE FROM DuplicateMembers;";
+static const string DUPLICATE_GROUPS_CLEAR_SQL = "DELETE FROM DuplicateGroups;";
+static const string DUPLICATE_GROUP_INSERT_SQL = "INSERT INTO DuplicateGroups(ID, Kind, Size) VALUES(@id,@kind,@size);";
+static const string DUPLICATE_MEMBER_INSERT_SQL =
+    "INSERT INTO DuplicateMembers(GroupID, FileLocation, Track) VALUES(@group,@loc,@track);";
+
+// Rows come in the order of DuplicateMembers' primary key, which is also the cursor's key.
+// A copy takes its tags from the track it copies.
+static const string DUPLICATE_REPORT_SQL =
+    "SELECT DuplicateGroups.ID, DuplicateGroups.Kind, Tracks.ID, DuplicateMembers.FileLocation, Tracks.Title, "
+    "Albums.Name, Artists.Name, Tracks.Duration, DuplicateMembers.FileLocation != Tracks.FileLocation, "
+    "DuplicateMembers.GroupID, DuplicateMembers.FileLocation "
+    "FROM DuplicateMembers JOIN DuplicateGroups ON DuplicateGroups.ID == DuplicateMembers.GroupID "
+    "JOIN Tracks ON Tracks.ID == DuplicateMembers.Track "
+    "LEFT JOIN Albums ON Albums.ID == Tracks.Album LEFT JOIN Artists ON Artists.ID == Albums.Artist "
+    "WHERE (@kind == 0 OR DuplicateGroups.Kind == @kind) "
+    "AND (DuplicateMembers.GroupID, DuplicateMembers.FileLocation) > (@group, @loc) "
+    "ORDER BY DuplicateMembers.GroupID, DuplicateMembers.FileLocation LIMIT @limit;";
+
+/**
+ * How the tracks of a duplicate group were matched. Stored in the database, so values
+ * must not change.
+ */
+enum class DuplicateKind
+{
+    // Only used in queries, to match every kind.
+    any = 0,
+    // Byte-for-byte identical files.
+    identical = 1,
+    // The same decoded audio, in files that differ in their tags or container.
+    sameAudio = 2,
+    // The same title, artist and album after normalization, and about as long.
+    similar = 3
+};
+
+/**
+ * Tunables for a duplicate search.
+ */
+struct DuplicateOptions
+{
+    /**
+     * Number of worker threads used for hashing and normalizing. A value of 0 uses one
+     * worker per hardware thread.
+     */
+    uint32_t threadCount = 0;
+
+    /**
+     * Largest difference in length, in milliseconds, between two tracks taken to be
+     * the same recording.
+     */
+    uint32_t durationTolerance = 2000;
+
+    /**
+     * How files are read when they have to be hashed.
+     */
+    HashReadMode hashReadMode = HashReadMode::pread;
+};
+
+/**
+ * Totals reported once a duplicate search has finished.
+ */
+struct DuplicateSummary
+{
+    uint64_t tracks = 0;
+    // Files skipped at import as copies of a track.
+    uint64_t copies = 0;
+    uint64_t identicalGroups = 0;
+    uint64_t sameAudioGroups = 0;
+    uint64_t similarGroups = 0;
+    // Partial and full hashes that had to be computed, and are now stored.
+    uint64_t hashesComputed = 0;
+};
+
+/**
+ * A file that was not imported because a track already held its contents.
+ */
+struct DuplicateCopy
+{
+    string location;
+    // ID of the track it copies.
+    uint32_t track = 0;
+};
+
+/**
+ * Tracks found to be copies of one another. Track IDs are in ascending order.
+ */
+struct DuplicateGroup
+{
+    DuplicateKind kind = DuplicateKind::identical;
+    std::vector<uint32_t> tracks;
+    // Only in groups of identical files, since that is all a copy is known to match.
+    std::vector<DuplicateCopy> copies;
+};
+
+/**
+ * Filter and page of a duplicate report query.
+ */
+struct DuplicateQuery
+{
+    DuplicateKind kind = DuplicateKind::any;
+
+    // Start after this row. Empty to start at the first.
+    CursorKey after;
+    // Maximum number of rows, or 0 for every row.
+    uint32_t limit = 0;
+};
+
+/**
+ * One file of a duplicate group. The views are valid until the cursor moves.
+ */
+struct DuplicateView
+{
+    uint32_t groupID = 0;
+    DuplicateKind kind = DuplicateKind::identical;
+    // The file's track, or for a copy, the track it copies, whose tags are given.
+    uint32_t trackID = 0;
+    // Whether the file is a copy skipped at import rather than a track.
+    bool copy = false;
+    string_view location;
+    string_view title;
+    string_view album;
+    string_view artist;
+    // Milliseconds, or 0 if unknown.
+    uint32_t duration = 0;
+};
+
+/**
+ * Rows of the duplicate report, one per file, grouped by group and in order of location
+ * within a group. A page may end in the middle of a group; the next page carries on
+ * with the rest of it.
+ */
+using DuplicateCursor = RowCursor<DuplicateView>;
+
+template <>
+bool DuplicateCursor::next();
+
+/**
+ * Starts a query of the duplicate report on a read connection.
+ */
+DuplicateCursor openDuplicateCursor(ReaderLease &&reader, const DuplicateQuery &query);
+
+/**
+ * Finds duplicate tracks across the whole library.
+ *
+ * Every kind of match is found by sorting the tracks on one key and walking the runs
+ * of equal keys, never by comparing pairs of tracks, so a search costs a few sorts of
+ * the library plus reading the files whose size collides. Those reads are spread over
+ * worker threads and follow the same tiers as an import (see ContentMatcher), and the
+ * hashes they produce are stored for next time.
+ *
+ * Files skipped at import as copies of a track were found identical to it then, so
+ * they join its group of identical files without being read again.
+ *
+ * A track that matches another in several ways is only reported for the strongest
+ * match: tracks with the same audio are only grouped if they are not all identical
+ * files, and similar tracks only if they do not all have the same audio.
+ */
+class DuplicateFinder
+{
+private:
+    struct Candidate
+    {
+        uint32_t id = 0;
+        ContentKey content;
+        // Normalized by find().
+        string title;
+        string artist;
+        string album;
+        uint32_t duration = 0;
+        // Whether find() computed a hash the database does not have yet.
+        bool hashesLearned = false;
+    };
+
+    DuplicateOptions options;
+    uint32_t threadCount;
+    std::vector<Candidate> candidates;
+    std::vector<DuplicateCopy> copies;
+    std::vector<DuplicateGroup> groups;
+
+    /**
+     * Groups identical files, hashing files of equal size on the worker threads, and
+     * adds each copy to the group of the track it copies.
+     *
+     * @returns for each candidate, the index of the first candidate identical to it.
+     */
+    std::vector<uint32_t> groupIdentical(DuplicateSummary &summary);
+
+    /**
+     * Groups the candidates of `order` (sorted by audio MD5) that share decoded audio.
+     *
+     * @param classes for each candidate, the first candidate known to match it. Updated
+     *                with the new groups.
+     */
+    void groupSameAudio(const std::vector<uint32_t> &order, std::vector<uint32_t> &classes, DuplicateSummary &summary);
+
+    /**
+     * Groups the candidates of `order` (sorted by normalized tags, then duration) that
+     * look like the same recording.
+     */
+    void groupSimilar(const std::vector<uint32_t> &order, const std::vector<uint32_t> &classes,
+                      DuplicateSummary &summary);
+
+    /**
+     * Records a group, unless its tracks were already all matched by a stronger kind.
+     */
+    bool addGroup(DuplicateKind kind, const std::vector<uint32_t> &members, const std::vector<uint32_t> &classes);
+
+public:
+    explicit DuplicateFinder(const DuplicateOptions &options = DuplicateOptions());
+
+    /**
+     * Reduces a tag to the form compared by the similarity pass: ASCII letters in lower
+     * case, bracketed asides such as "(Remastered)" dropped, punctuation and runs of
+     * spaces turned into a single space, and a leading "the " removed. Bytes outside
+     * ASCII are kept as they are.
+     */
+    static string normalize(string_view text);
+
+    /**
+     * Reads every track in the database, and the files skipped as copies of them.
+     *
+     * @param statements statement cache of the connection to read from
+     */
+    void load(const shared_ptr<StatementCache> &statements);
+
+    /**
+     * Groups the loaded tracks.
+     *
+     * @returns number of groups of each kind.
+     */
+    DuplicateSummary find();
+
+    /**
+     * Returns the groups found, identical files first, then same audio, then similar tracks.
+     */
+    const std::vector<DuplicateGroup> &getGroups() const;
+
+    /**
+     * Replaces the duplicate report in the database with the groups found, and stores
+     * the hashes computed along the way, in a single transaction.
+     *
+     * @param statements statement cache of the writer connection
+     */
+    void store(const shared_ptr<StatementCache> &statements);
+};
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -0,0 +1,460 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+// System libs
+#include <fcntl.h>
+#include <unistd.h>
+
+// Utility libs
+#include <boost/format.hpp>
+
+// Local includes
+#include "FLACMetadata.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace
+{
+const uint8_t STREAMINFO_BLOCK = 0;
+const uint8_t SEEKTABLE_BLOCK = 3;
+const uint8_t VORBIS_COMMENT_BLOCK = 4;
+const uint8_t PICTURE_BLOCK = 6;
+const uint8_t INVALID_BLOCK = 127;
+
+const uint32_t STREAMINFO_LENGTH = 34;
+const uint32_t SEEK_POINT_LENGTH = 18;
+const uint64_t PLACEHOLDER_SEEK_POINT = UINT64_MAX;
+
+// Picture type and MIME length, then description length, then the five trailing fields.
+const uint32_t PICTURE_FIXED_LENGTH = 32;
+
+/**
+ * Closes a file descriptor when it goes out of scope.
+ */
+struct FileHandle
+{
+    int fd;
+
+    ~FileHandle()
+    {
+        if (this->fd >= 0)
+        {
+            close(this->fd);
+        }
+    }
+};
+
+uint64_t readBigEndian(const uint8_t *data, size_t length)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        value = (value << 8) | data[i];
+    }
+
+    return value;
+}
+
+uint32_t readUInt32(const uint8_t *data)
+{
+    return static_cast<uint32_t>(readBigEndian(data, 4));
+}
+
+[[noreturn]] void throwMalformed(const char *what)
+{
+    std::stringstream errStream;
+    errStream << boost::format("Malformed FLAC metadata: %s") % what;
+    throw std::runtime_error(errStream.str());
+}
+} // namespace
+
+FLACMetadata FLACMetadata::read(const fs::path &filePath)
+{
+    FLACMetadataParser parser;
+    return FLACMetadata::read(filePath, parser);
+}
+
+FLACMetadata FLACMetadata::read(const fs::path &filePath, FLACMetadataParser &parser)
+{
+    if (parser.isFinished())
+    {
+        return parser.finish();
+    }
+
+    FileHandle file{open(filePath.c_str(), O_RDONLY | O_CLOEXEC)};
+
+    if (file.fd < 0)
+    {
+        std::stringstream errStream;
+        errStream << boost::format("Unable to open '%s' to read metadata: %s") % filePath % strerror(errno);
+        throw std::runtime_error(errStream.str());
+    }
+
+    thread_local std::vector<uint8_t> buffer(FLAC_HEAD_READ_SIZE);
+
+    while (!parser.isFinished())
+    {
+        const uint64_t offset = parser.nextOffset();
+        ssize_t bytesRead = pread(file.fd, buffer.data(), buffer.size(), static_cast<off_t>(offset));
+
+        if (bytesRead < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (bytesRead < 0)
+        {
+            std::stringstream errStream;
+            errStream << boost::format("Unable to read metadata from '%s': %s") % filePath % strerror(errno);
+            throw std::runtime_error(errStream.str());
+        }
+
+        if (bytesRead == 0)
+        {
+            throw std::runtime_error("Failed to locate metadata in FLAC file.");
+        }
+
+        parser.feed(offset, buffer.data(), static_cast<size_t>(bytesRead));
+    }
+
+    return parser.finish();
+}
+
+bool FLACMetadataParser::feed(uint64_t chunkOffset, const uint8_t *data, size_t length)
+{
+    std::vector<char> &storage = this->metadata.storage;
+
+    while (this->stage != Stage::finished)
+    {
+        const size_t collected = storage.size() - this->unitStart;
+
+        if (collected < this->unitLength)
+        {
+            if (this->offset < chunkOffset)
+            {
+                throw std::logic_error("FLAC metadata parser was given a chunk past the bytes it needs.");
+            }
+
+            if (this->offset >= chunkOffset + length)
+            {
+                // Nothing more in this chunk; the next byte needed is further on.
+                break;
+            }
+
+            const size_t start = static_cast<size_t>(this->offset - chunkOffset);
+            const size_t count = std::min(this->unitLength - collected, length - start);
+
+            const char *source = reinterpret_cast<const char *>(data + start);
+            storage.insert(storage.end(), source, source + count);
+            this->offset += count;
+
+            if (collected + count < this->unitLength)
+            {
+                break;
+            }
+        }
+
+        this->processUnit();
+    }
+
+    return this->stage == Stage::finished;
+}
+
+bool FLACMetadataParser::isFinished()
+{
+    return this->stage == Stage::finished;
+}
+
+uint64_t FLACMetadataParser::nextOffset()
+{
+    return this->offset;
+}
+
+void FLACMetadataParser::beginUnit(size_t length)
+{
+    this->unitStart = this->metadata.storage.size();
+    this->unitLength = length;
+}
+
+void FLACMetadataParser::discardUnit()
+{
+    this->metadata.storage.resize(this->unitStart);
+}
+
+void FLACMetadataParser::nextBlock()
+{
+    const uint64_t blockEnd = this->blockStart + this->blockLength;
+
+    if (this->lastBlock)
+    {
+        this->metadata.audioOffset = blockEnd;
+        this->stage = Stage::finished;
+        return;
+    }
+
+    this->offset = blockEnd;
+    this->stage = Stage::blockHeader;
+    this->beginUnit(4);
+}
+
+void FLACMetadataParser::processUnit()
+{
+    const uint8_t *unit = reinterpret_cast<const uint8_t *>(this->metadata.storage.data() + this->unitStart);
+
+    switch (this->stage)
+    {
+    case Stage::magic:
+        if (memcmp(unit, "fLaC", 4) == 0)
+        {
+            this->discardUnit();
+            this->stage = Stage::blockHeader;
+            this->beginUnit(4);
+        }
+        else if (memcmp(unit, "ID3", 3) == 0)
+        {
+            // The rest of the 10 byte ID3v2 header: minor version, flags and size.
+            this->discardUnit();
+            this->stage = Stage::id3Header;
+            this->beginUnit(6);
+        }
+        else
+        {
+            throw std::runtime_error("Failed to locate metadata in FLAC file.");
+        }
+        break;
+
+    case Stage::id3Header:
+    {
+        // The tag size is a 28 bit "syncsafe" integer, 7 bits per byte.
+        uint64_t tagSize = 0;
+        for (size_t i = 2; i < 6; i++)
+        {
+            tagSize = (tagSize << 7) | (unit[i] & 0x7f);
+        }
+
+        const bool hasFooter = (unit[1] & 0x10) != 0;
+
+        this->discardUnit();
+        this->offset += tagSize + (hasFooter ? 10 : 0);
+        this->stage = Stage::magic;
+        this->beginUnit(4);
+        break;
+    }
+
+    case Stage::blockHeader:
+        this->blockType = unit[0] & 0x7f;
+        this->lastBlock = (unit[0] & 0x80) != 0;
+        this->blockLength = static_cast<uint32_t>(readBigEndian(unit + 1, 3));
+        this->blockStart = this->offset;
+        this->discardUnit();
+
+        switch (this->blockType)
+        {
+        case STREAMINFO_BLOCK:
+            if (this->blockLength < STREAMINFO_LENGTH)
+            {
+                throwMalformed("STREAMINFO block is too short");
+            }
+            this->stage = Stage::blockBody;
+            this->beginUnit(this->blockLength);
+            break;
+        case SEEKTABLE_BLOCK:
+        case VORBIS_COMMENT_BLOCK:
+            this->stage = Stage::blockBody;
+            this->beginUnit(this->blockLength);
+            break;
+        case PICTURE_BLOCK:
+            if (this->blockLength < PICTURE_FIXED_LENGTH)
+            {
+                throwMalformed("PICTURE block is too short");
+            }
+            this->stage = Stage::pictureMime;
+            this->beginUnit(8);
+            break;
+        case INVALID_BLOCK:
+            throwMalformed("invalid block type");
+        default:
+            // Padding, application data and cue sheets are of no use to the engine.
+            this->nextBlock();
+            break;
+        }
+        break;
+
+    case Stage::blockBody:
+        if (this->blockType == STREAMINFO_BLOCK)
+        {
+            this->readStreamInfo(unit);
+            this->discardUnit();
+        }
+        else if (this->blockType == SEEKTABLE_BLOCK)
+        {
+            this->readSeekTable(unit);
+            this->discardUnit();
+        }
+        else
+        {
+            // Decoded by finish(), once the storage has stopped moving.
+            this->commentBlocks.push_back(StorageSpan{this->unitStart, this->unitLength});
+        }
+
+        this->nextBlock();
+        break;
+
+    case Stage::pictureMime:
+    {
+        FLACPicture picture;
+        picture.type = readUInt32(unit);
+        const uint32_t mimeLength = readUInt32(unit + 4);
+
+        if (mimeLength > this->blockLength - PICTURE_FIXED_LENGTH)
+        {
+            throwMalformed("PICTURE MIME type overruns the block");
+        }
+
+        this->metadata.pictures.push_back(picture);
+        this->pendingPictures.emplace_back();
+
+        this->discardUnit();
+        this->stage = Stage::pictureDescription;
+        this->beginUnit(mimeLength + 4);
+        break;
+    }
+
+    case Stage::pictureDescription:
+    {
+        const size_t mimeLength = this->unitLength - 4;
+        const uint32_t descriptionLength = readUInt32(unit + mimeLength);
+
+        if (descriptionLength > this->blockLength - PICTURE_FIXED_LENGTH - mimeLength)
+        {
+            throwMalformed("PICTURE description overruns the block");
+        }
+
+        this->pendingPictures.back().mimeType = StorageSpan{this->unitStart, mimeLength};
+
+        // Keep the MIME type, drop the description length.
+        this->metadata.storage.resize(this->unitStart + mimeLength);
+        this->stage = Stage::pictureFields;
+        this->beginUnit(descriptionLength + 20);
+        break;
+    }
+
+    case Stage::pictureFields:
+    {
+        const size_t descriptionLength = this->unitLength - 20;
+        const uint8_t *fields = unit + descriptionLength;
+
+        FLACPicture &picture = this->metadata.pictures.back();
+        picture.width = readUInt32(fields);
+        picture.height = readUInt32(fields + 4);
+        picture.colorDepth = readUInt32(fields + 8);
+        picture.colorCount = readUInt32(fields + 12);
+        picture.dataLength = readUInt32(fields + 16);
+        picture.dataOffset = this->offset;
+
+        if (picture.dataLength > this->blockStart + this->blockLength - this->offset)
+        {
+            throwMalformed("PICTURE data overruns the block");
+        }
+
+        this->pendingPictures.back().description = StorageSpan{this->unitStart, descriptionLength};
+
+        // Keep the description; the image data itself is skipped.
+        this->metadata.storage.resize(this->unitStart + descriptionLength);
+        this->nextBlock();
+        break;
+    }
+
+    case Stage::finished:
+        break;
+    }
+}
+
+void FLACMetadataParser::readStreamInfo(const uint8_t *data)
+{
+    FLACStreamInfo &info = this->metadata.streamInfo;
+
+    info.minBlockSize = static_cast<uint32_t>(readBigEndian(data, 2));
+    info.maxBlockSize = static_cast<uint32_t>(readBigEndian(data + 2, 2));
+    info.minFrameSize = static_cast<uint32_t>(readBigEndian(data + 4, 3));
+    info.maxFrameSize = static_cast<uint32_t>(readBigEndian(data + 7, 3));
+
+    // 20 bits of sample rate, 3 of channels - 1, 5 of bits per sample - 1 and 36 of total samples.
+    const uint64_t packed = readBigEndian(data + 10, 8);
+    info.sampleRate = static_cast<uint32_t>(packed >> 44);
+    info.channels = static_cast<uint8_t>(((packed >> 41) & 0x07) + 1);
+    info.bitsPerSample = static_cast<uint8_t>(((packed >> 36) & 0x1f) + 1);
+    info.totalSamples = packed & 0xfffffffffULL;
+
+    std::copy(data + 18, data + 34, info.audioMD5.begin());
+
+    this->metadata.hasStreamInfo = true;
+}
+
+void FLACMetadataParser::readSeekTable(const uint8_t *data)
+{
+    const uint32_t count = this->blockLength / SEEK_POINT_LENGTH;
+    this->metadata.seekPoints.reserve(count);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const uint8_t *point = data + i * SEEK_POINT_LENGTH;
+
+        FLACSeekPoint seekPoint;
+        seekPoint.sampleNumber = readBigEndian(point, 8);
+        seekPoint.streamOffset = readBigEndian(point + 8, 8);
+        seekPoint.frameSamples = static_cast<uint16_t>(readBigEndian(point + 16, 2));
+
+        if (seekPoint.sampleNumber != PLACEHOLDER_SEEK_POINT)
+        {
+            this->metadata.seekPoints.push_back(seekPoint);
+        }
+    }
+}
+
+FLACMetadata FLACMetadataParser::finish()
+{
+    if (this->stage != Stage::finished)
+    {
+        throw std::runtime_error("FLAC metadata ended before its last block.");
+    }
+
+    const char *storage = this->metadata.storage.data();
+
+    for (const StorageSpan &span : this->commentBlocks)
+    {
+        decodeVorbisComments(std::string_view(storage + span.offset, span.length), this->metadata.vendor,
+                             this->metadata.comments);
+    }
+
+    for (size_t i = 0; i < this->pendingPictures.size(); i++)
+    {
+        const PendingPicture &pending = this->pendingPictures[i];
+        FLACPicture &picture = this->metadata.pictures[i];
+
+        picture.mimeType = std::string_view(storage + pending.mimeType.offset, pending.mimeType.length);
+        picture.description = std::string_view(storage + pending.description.offset, pending.description.length);
+    }
+
+    return std::move(this->metadata);
+}
@@ -14,12 +14,10 @@
     limitations under the License.
 */
 
+#include <algorithm>
+#include <cstdio>
 #include <memory>
 
-#include <FLAC/format.h>
-#include <FLAC/metadata.h>
-#include <FLAC++/metadata.h>
-
 #include "FLACTrack.hpp"
 
 using std::shared_ptr;
@@ -34,39 +32,77 @@ FLACTrack::FLACTrack(const fs::path &trackLocation) : Track(trackLocation)
 
 void FLACTrack::importMetadata()
 {
-    FLAC__StreamMetadata *streamMetadata = FLAC__metadata_object_new(FLAC__METADATA_TYPE_VORBIS_COMMENT);
+    this->applyMetadata(FLACMetadata::read(this->trackLocation));
+}
+
+void FLACTrack::applyMetadata(const FLACMetadata &metadata)
+{
+    this->readAudioMD5(metadata.streamInfo);
 
-    if (!FLAC__metadata_get_tags(this->trackLocation.c_str(), &streamMetadata))
+    // A total of 0 samples means the encoder did not know the length.
+    const FLACStreamInfo &streamInfo = metadata.streamInfo;
+    if (streamInfo.sampleRate != 0)
     {
-        throw std::runtime_error("Failed to locate metadata in FLAC file.");
+        const uint64_t milliseconds = streamInfo.totalSamples * 1000 / streamInfo.sampleRate;
+        this->duration = static_cast<uint32_t>(std::min<uint64_t>(milliseconds, UINT32_MAX));
     }
 
-    const auto &vorbisComment = streamMetadata->data.vorbis_comment;
+    // FLAC uses the standard Vorbis comment system
+    this->parseVorbisComments(metadata.comments);
 
-    uint32_t numComments = vorbisComment.num_comments;
-    map<string, string> commentEntries;
+    this->selectCoverArt(metadata.pictures);
+}
 
-    uint8_t artistCount = 0;
-    for (uint32_t i = 0; i < numComments; i++)
-    {
-        string entry = reinterpret_cast<char *>(vorbisComment.comments[i].entry);
+void FLACTrack::selectCoverArt(const vector<FLACPicture> &pictures)
+{
+    this->coverArt = EmbeddedPicture();
 
-        uint64_t splitLoc = entry.find('=');
+    const FLACPicture *chosen = nullptr;
+    for (const FLACPicture &picture : pictures)
+    {
+        // A MIME type of "-->" means the data is a URL to the image, not the image.
+        if (picture.dataLength == 0 || picture.mimeType == "-->")
+        {
+            continue;
+        }
 
-        string name = entry.substr(0, splitLoc);
-        string value = entry.substr(splitLoc + 1);
+        if (picture.type == FRONT_COVER_PICTURE)
+        {
+            chosen = &picture;
+            break;
+        }
 
-        if (name == "ARTIST")
+        if (chosen == nullptr)
         {
-            artistCount++;
-            name.append(std::to_string(artistCount));
+            chosen = &picture;
         }
+    }
 
-        commentEntries[name] = value;
+    if (chosen != nullptr)
+    {
+        this->coverArt.offset = chosen->dataOffset;
+        this->coverArt.length = chosen->dataLength;
+        this->coverArt.mimeType = string(chosen->mimeType);
     }
+}
 
-    FLAC__metadata_object_delete(streamMetadata);
+void FLACTrack::readAudioMD5(const FLACStreamInfo &streamInfo)
+{
+    this->audioMD5.clear();
 
-    // FLAC uses the standard Vorbis comment system
-    this->parseVorbisCommentMap(commentEntries);
+    const auto &md5 = streamInfo.audioMD5;
+
+    // Encoders that did not compute the MD5 leave it zeroed.
+    if (std::all_of(md5.begin(), md5.end(), [](uint8_t value) { return value == 0; }))
+    {
+        return;
+    }
+
+    char outBuff[33];
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        sprintf(outBuff + (i * 2), "%02x", md5[i]);
+    }
+
+    this->audioMD5 = string(outBuff, 32);
 }
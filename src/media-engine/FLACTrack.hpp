@@ -18,6 +18,7 @@
 
 #include <filesystem>
 
+#include "FLACMetadata.hpp"
 #include "Track.hpp"
 
 namespace fs = std::filesystem;
@@ -26,8 +27,29 @@ namespace Mellophone
 {
 namespace MediaEngine
 {
+/**
+ * PICTURE block type of the front cover, as defined by ID3v2 APIC.
+ */
+static const uint32_t FRONT_COVER_PICTURE = 3;
+
 class FLACTrack : public Track
 {
+private:
+    /**
+     * Picks the picture to use as cover art: the front cover if there is one,
+     * otherwise the first picture.
+     * 
+     * @param pictures the file's PICTURE blocks
+     */
+    void selectCoverArt(const vector<FLACPicture> &pictures);
+
+    /**
+     * Reads the MD5 of the decoded audio from the STREAMINFO block.
+     * 
+     * @param streamInfo the file's STREAMINFO block
+     */
+    void readAudioMD5(const FLACStreamInfo &streamInfo);
+
 public:
     explicit FLACTrack(const fs::path &trackLocation);
 
@@ -35,7 +57,13 @@ public:
      * Attempts to fill the Track's metadata entries using the data
      * from the track's file.
      */
-    void importMetadata();
+    void importMetadata() override;
+
+    /**
+     * Fills the Track's metadata entries from metadata blocks that have already
+     * been read.
+     */
+    void applyMetadata(const FLACMetadata &metadata);
 };
 } // namespace MediaEngine
 } // namespace Mellophone
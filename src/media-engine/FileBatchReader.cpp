@@ -0,0 +1,313 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+// System libs
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Utility libs
+#include <boost/format.hpp>
+
+// Local includes
+#include "ContentMatcher.hpp"
+#include "FileBatchReader.hpp"
+#include "HashReader.hpp"
+#include "ScanMetrics.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace
+{
+std::exception_ptr readError(const char *action, const fs::path &filePath, int error)
+{
+    std::stringstream errStream;
+    errStream << boost::format("Unable to %s '%s': %s") % action % filePath % strerror(error);
+    return std::make_exception_ptr(std::runtime_error(errStream.str()));
+}
+
+enum class SlotStage
+{
+    idle,
+    stat,
+    open,
+    read
+};
+} // namespace
+
+/**
+ * One file in progress, and the buffer its reads land in.
+ */
+struct FileBatchReader::Slot
+{
+    SlotStage stage = SlotStage::idle;
+    size_t fileIndex = 0;
+    uint64_t statStart = 0;
+    struct statx info;
+
+    int fd = -1;
+
+    // Ranges of the file to read, as offset and length, and the position reached.
+    std::pair<uint64_t, uint64_t> ranges[2];
+    size_t rangeCount = 0;
+    size_t range = 0;
+    uint64_t offset = 0;
+
+    std::unique_ptr<uint8_t, decltype(&free)> buffer{nullptr, &free};
+};
+
+FileBatchReader::FileBatchReader(uint32_t depth) : ring(std::max(1u, depth)), slots(std::max(1u, depth))
+{
+    for (auto &slot : this->slots)
+    {
+        slot.buffer.reset(static_cast<uint8_t *>(aligned_alloc(HASH_BUFFER_ALIGNMENT, BATCH_READ_SIZE)));
+
+        if (slot.buffer == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+    }
+}
+
+FileBatchReader::~FileBatchReader()
+{
+    // The ring must stop writing into the buffers before they are freed.
+    this->ring.drain();
+}
+
+void FileBatchReader::read(const std::vector<fs::path> &filePaths, ReadExtent extent, BatchReadConsumer &consumer)
+{
+    size_t nextFile = 0;
+    std::vector<IoCompletion> completions;
+
+    auto queueRead = [this](size_t slotIndex) {
+        Slot &slot = this->slots[slotIndex];
+        const auto &range = slot.ranges[slot.range];
+
+        const uint64_t length = std::min<uint64_t>(BATCH_READ_SIZE, range.first + range.second - slot.offset);
+        this->ring.prepareRead(slot.fd, slot.buffer.get(), static_cast<uint32_t>(length), slot.offset, slotIndex);
+    };
+
+    auto finishFile = [&](size_t slotIndex, std::exception_ptr error) {
+        Slot &slot = this->slots[slotIndex];
+
+        if (slot.fd >= 0)
+        {
+            // Nothing else will read these pages; leave the cache to the rest of the system.
+            posix_fadvise(slot.fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(slot.fd);
+            slot.fd = -1;
+        }
+
+        slot.stage = SlotStage::idle;
+        consumer.end(slot.fileIndex, error);
+    };
+
+    // Gives an idle slot the next file in the list.
+    auto startFile = [&](size_t slotIndex) {
+        if (nextFile >= filePaths.size())
+        {
+            return;
+        }
+
+        Slot &slot = this->slots[slotIndex];
+        slot.fileIndex = nextFile++;
+        slot.stage = SlotStage::stat;
+        slot.statStart = monotonicNanos();
+        this->ring.prepareStatx(filePaths[slot.fileIndex].c_str(), FINGERPRINT_STATX_MASK, &slot.info, slotIndex);
+    };
+
+    auto handleStat = [&](size_t slotIndex, int32_t result) {
+        Slot &slot = this->slots[slotIndex];
+        const fs::path &filePath = filePaths[slot.fileIndex];
+
+        if (result < 0)
+        {
+            slot.stage = SlotStage::idle;
+            consumer.end(slot.fileIndex, readError("stat", filePath, -result));
+            return;
+        }
+
+        const FileFingerprint fingerprint = FileFingerprint::fromStatx(slot.info);
+
+        if (!consumer.begin(slot.fileIndex, fingerprint, monotonicNanos() - slot.statStart))
+        {
+            slot.stage = SlotStage::idle;
+            return;
+        }
+
+        // The same ranges HashReader::readEnds reads.
+        const uint64_t fileSize = fingerprint.size;
+        const uint64_t headLength = extent == ReadExtent::whole ? fileSize : std::min<uint64_t>(PARTIAL_HASH_SPAN, fileSize);
+        const uint64_t tailStart = std::max<uint64_t>(headLength, fileSize > PARTIAL_HASH_SPAN ? fileSize - PARTIAL_HASH_SPAN : 0);
+
+        slot.rangeCount = 0;
+        for (const auto &range : {std::make_pair(uint64_t(0), headLength), std::make_pair(tailStart, fileSize - tailStart)})
+        {
+            if (range.second > 0)
+            {
+                slot.ranges[slot.rangeCount++] = range;
+            }
+        }
+
+        if (slot.rangeCount == 0)
+        {
+            // Empty files have nothing to read.
+            slot.stage = SlotStage::idle;
+            consumer.end(slot.fileIndex, nullptr);
+            return;
+        }
+
+        slot.stage = SlotStage::open;
+        this->ring.prepareOpen(filePath.c_str(), O_RDONLY | O_CLOEXEC, slotIndex);
+    };
+
+    auto handleOpen = [&](size_t slotIndex, int32_t result) {
+        Slot &slot = this->slots[slotIndex];
+
+        if (result < 0)
+        {
+            finishFile(slotIndex, readError("open", filePaths[slot.fileIndex], -result));
+            return;
+        }
+
+        slot.fd = result;
+        if (extent == ReadExtent::whole)
+        {
+            posix_fadvise(slot.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+
+        slot.stage = SlotStage::read;
+        slot.range = 0;
+        slot.offset = slot.ranges[0].first;
+        queueRead(slotIndex);
+    };
+
+    auto handleRead = [&](size_t slotIndex, int32_t result) {
+        Slot &slot = this->slots[slotIndex];
+
+        if (result == -EINTR || result == -EAGAIN)
+        {
+            queueRead(slotIndex);
+            return;
+        }
+
+        if (result <= 0)
+        {
+            // A read of nothing before the end means the file shrank while it was being read.
+            finishFile(slotIndex, readError("read", filePaths[slot.fileIndex], result == 0 ? EIO : -result));
+            return;
+        }
+
+        consumer.consume(slot.fileIndex, slot.offset, slot.buffer.get(), static_cast<size_t>(result));
+        slot.offset += static_cast<uint64_t>(result);
+
+        const auto &range = slot.ranges[slot.range];
+        if (slot.offset < range.first + range.second)
+        {
+            // Short reads carry on from where they stopped.
+            queueRead(slotIndex);
+            return;
+        }
+
+        if (++slot.range < slot.rangeCount)
+        {
+            slot.offset = slot.ranges[slot.range].first;
+            queueRead(slotIndex);
+            return;
+        }
+
+        finishFile(slotIndex, nullptr);
+    };
+
+    try
+    {
+        for (size_t slotIndex = 0; slotIndex < this->slots.size(); slotIndex++)
+        {
+            startFile(slotIndex);
+        }
+
+        while (this->ring.pending() > 0)
+        {
+            completions.clear();
+            this->ring.submit(1, completions);
+
+            for (const IoCompletion &completion : completions)
+            {
+                const size_t slotIndex = static_cast<size_t>(completion.userData);
+
+                switch (this->slots[slotIndex].stage)
+                {
+                case SlotStage::stat:
+                    handleStat(slotIndex, completion.result);
+                    break;
+                case SlotStage::open:
+                    handleOpen(slotIndex, completion.result);
+                    break;
+                case SlotStage::read:
+                    handleRead(slotIndex, completion.result);
+                    break;
+                case SlotStage::idle:
+                    break;
+                }
+
+                if (this->slots[slotIndex].stage == SlotStage::idle)
+                {
+                    startFile(slotIndex);
+                }
+            }
+        }
+    }
+    catch (...)
+    {
+        // A consumer threw. Let the kernel finish with the buffers, and close every file
+        // left open, including any opened by requests still in flight.
+        completions.clear();
+        while (this->ring.pending() > 0)
+        {
+            this->ring.submit(this->ring.pending(), completions);
+        }
+
+        for (const IoCompletion &completion : completions)
+        {
+            const Slot &slot = this->slots[static_cast<size_t>(completion.userData)];
+            if (slot.stage == SlotStage::open && completion.result >= 0)
+            {
+                close(completion.result);
+            }
+        }
+
+        for (auto &slot : this->slots)
+        {
+            if (slot.fd >= 0)
+            {
+                close(slot.fd);
+                slot.fd = -1;
+            }
+            slot.stage = SlotStage::idle;
+        }
+        throw;
+    }
+}
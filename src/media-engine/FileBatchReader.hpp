@@ -0,0 +1,124 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "FileFingerprint.hpp"
+#include "IoRing.hpp"
+
+namespace fs = std::filesystem;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+/**
+ * Size of each read a FileBatchReader issues. Matches PARTIAL_HASH_SPAN so the ends of
+ * a file take one read each.
+ */
+static const uint32_t BATCH_READ_SIZE = 256 * 1024;
+
+/**
+ * How much of each file a FileBatchReader reads.
+ */
+enum class ReadExtent
+{
+    // Every byte, from start to end.
+    whole,
+    // The first and last PARTIAL_HASH_SPAN bytes, as HashReader::readEnds reads them.
+    ends
+};
+
+/**
+ * Receives the files read by a FileBatchReader. Calls for one file arrive in order, but
+ * calls for different files are interleaved.
+ */
+class BatchReadConsumer
+{
+public:
+    virtual ~BatchReadConsumer() = default;
+
+    /**
+     * A file has been stat'ed and is about to be opened.
+     *
+     * @param fileIndex index of the file in the list being read
+     * @param fingerprint the file's fingerprint
+     * @param statNanos time from queueing the stat to its completion
+     *
+     * @returns false to skip the file. end() is not called for skipped files.
+     */
+    virtual bool begin(size_t fileIndex, const FileFingerprint &fingerprint, uint64_t statNanos) = 0;
+
+    /**
+     * The next chunk of a file. Chunks of the same file arrive in order.
+     */
+    virtual void consume(size_t fileIndex, uint64_t offset, const uint8_t *data, size_t length) = 0;
+
+    /**
+     * A file has been read to the end of its extent, or has failed.
+     *
+     * @param fileIndex index of the file in the list being read
+     * @param error null if the file was read, otherwise the error that stopped it
+     */
+    virtual void end(size_t fileIndex, std::exception_ptr error) = 0;
+};
+
+/**
+ * Reads many files at once through io_uring.
+ *
+ * Each file is stat'ed, opened and read by requests queued on the ring, and up to
+ * `depth` files are in progress at a time, so the storage sees a deep queue of
+ * requests while the thread only makes a system call per round of completions. Each
+ * file has one read in flight at a time, which keeps its chunks in order.
+ *
+ * Check IoRing::isSupported() before creating one.
+ */
+class FileBatchReader
+{
+private:
+    struct Slot;
+
+    IoRing ring;
+    std::vector<Slot> slots;
+
+public:
+    /**
+     * @param depth maximum number of files read at once
+     */
+    explicit FileBatchReader(uint32_t depth = 32);
+    ~FileBatchReader();
+
+    FileBatchReader(const FileBatchReader &) = delete;
+    FileBatchReader &operator=(const FileBatchReader &) = delete;
+
+    /**
+     * Reads the given files. Returns once every file has been passed to end() or skipped.
+     *
+     * @param filePaths files to read
+     * @param extent how much of each file is read
+     * @param consumer receives the fingerprints, chunks and results
+     */
+    void read(const std::vector<fs::path> &filePaths, ReadExtent extent, BatchReadConsumer &consumer);
+};
+} // namespace MediaEngine
+} // namespace Mellophone
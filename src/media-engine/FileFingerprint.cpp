@@ -0,0 +1,78 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "FileFingerprint.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+static const int64_t NANOSECONDS_PER_SECOND = 1000000000;
+
+bool FileFingerprint::read(const fs::path &filePath, FileFingerprint &fingerprint)
+{
+#ifdef STATX_BASIC_STATS
+    // statx lets us ask for just the fields we compare.
+    struct statx info;
+    if (statx(AT_FDCWD, filePath.c_str(), 0, FINGERPRINT_STATX_MASK, &info) != 0)
+    {
+        return false;
+    }
+
+    fingerprint = FileFingerprint::fromStatx(info);
+#else
+    struct stat info;
+    if (stat(filePath.c_str(), &info) != 0)
+    {
+        return false;
+    }
+
+    fingerprint.size = info.st_size;
+    fingerprint.modifiedTime = info.st_mtim.tv_sec * NANOSECONDS_PER_SECOND + info.st_mtim.tv_nsec;
+    fingerprint.inode = info.st_ino;
+    fingerprint.device = info.st_dev;
+#endif
+
+    return true;
+}
+
+#ifdef STATX_BASIC_STATS
+FileFingerprint FileFingerprint::fromStatx(const struct statx &info)
+{
+    static_assert(FINGERPRINT_STATX_MASK == (STATX_SIZE | STATX_MTIME | STATX_INO), "statx mask out of date");
+
+    FileFingerprint fingerprint;
+    fingerprint.size = info.stx_size;
+    fingerprint.modifiedTime = info.stx_mtime.tv_sec * NANOSECONDS_PER_SECOND + info.stx_mtime.tv_nsec;
+    fingerprint.inode = info.stx_ino;
+    fingerprint.device = makedev(info.stx_dev_major, info.stx_dev_minor);
+
+    return fingerprint;
+}
+#endif
+
+bool FileFingerprint::operator==(const FileFingerprint &other) const
+{
+    return this->size == other.size && this->modifiedTime == other.modifiedTime &&
+           this->inode == other.inode && this->device == other.device;
+}
+
+bool FileFingerprint::operator!=(const FileFingerprint &other) const
+{
+    return !(*this == other);
+}
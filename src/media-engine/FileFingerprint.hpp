@@ -0,0 +1,67 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+struct statx;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+/**
+ * Fields a statx call must ask for to build a fingerprint (STATX_SIZE | STATX_MTIME | STATX_INO).
+ */
+static const uint32_t FINGERPRINT_STATX_MASK = 0x200 | 0x40 | 0x100;
+
+/**
+ * Cheap identity of a file's current contents, taken from a single stat call.
+ *
+ * If the size, modification time, inode and device all match what was stored
+ * at import time, the file is assumed unchanged and is neither hashed nor parsed.
+ */
+struct FileFingerprint
+{
+    uint64_t size = 0;
+    int64_t modifiedTime = 0; // nanoseconds since the epoch
+    uint64_t inode = 0;
+    uint64_t device = 0;
+
+    /**
+     * Reads the fingerprint of a file.
+     *
+     * @param filePath file to stat
+     * @param fingerprint destination for the result
+     *
+     * @returns false if the file could not be stat'd.
+     */
+    static bool read(const fs::path &filePath, FileFingerprint &fingerprint);
+
+    /**
+     * Builds a fingerprint from a statx result holding at least FINGERPRINT_STATX_MASK.
+     */
+    static FileFingerprint fromStatx(const struct statx &info);
+
+    bool operator==(const FileFingerprint &other) const;
+    bool operator!=(const FileFingerprint &other) const;
+};
+} // namespace MediaEngine
+} // namespace Mellophone
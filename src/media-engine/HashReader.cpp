@@ -0,0 +1,537 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+// System libs
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Utility libs
+#include <boost/format.hpp>
+
+// Local includes
+#include "HashReader.hpp"
+#include "IoRing.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace
+{
+struct FreeDeleter
+{
+    void operator()(uint8_t *buffer) const
+    {
+        free(buffer);
+    }
+};
+
+/**
+ * Closes a file descriptor when it goes out of scope.
+ */
+struct FileHandle
+{
+    int fd;
+
+    ~FileHandle()
+    {
+        if (this->fd >= 0)
+        {
+            close(this->fd);
+        }
+    }
+};
+
+std::runtime_error readError(const char *action, const fs::path &filePath)
+{
+    std::stringstream errStream;
+    errStream << boost::format("Unable to %s '%s' to generate hash: %s") % action % filePath % strerror(errno);
+    return std::runtime_error(errStream.str());
+}
+
+[[noreturn]] void throwReadError(const char *action, const fs::path &filePath)
+{
+    throw readError(action, filePath);
+}
+
+/**
+ * Returns this thread's read buffer, allocating it on first use.
+ */
+uint8_t *threadBuffer()
+{
+    thread_local std::unique_ptr<uint8_t, FreeDeleter> buffer;
+
+    if (buffer == nullptr)
+    {
+        buffer.reset(static_cast<uint8_t *>(aligned_alloc(HASH_BUFFER_ALIGNMENT, HASH_READ_SIZE)));
+
+        if (buffer == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+    }
+
+    return buffer.get();
+}
+
+/**
+ * Returns this thread's buffers for interleaved reads, allocating them on first use.
+ */
+uint8_t *laneBuffer(size_t lane)
+{
+    thread_local std::vector<std::unique_ptr<uint8_t, FreeDeleter>> buffers;
+
+    while (buffers.size() <= lane)
+    {
+        buffers.emplace_back(static_cast<uint8_t *>(aligned_alloc(HASH_BUFFER_ALIGNMENT, HASH_LANE_READ_SIZE)));
+
+        if (buffers.back() == nullptr)
+        {
+            buffers.pop_back();
+            throw std::bad_alloc();
+        }
+    }
+
+    return buffers[lane].get();
+}
+
+/**
+ * State of one lane of an interleaved read.
+ */
+struct ReadLane
+{
+    int fd = -1;
+    off_t offset = 0;
+    size_t fileIndex = 0;
+};
+
+/**
+ * Returns this thread's ring for queued reads, creating it on first use, or null if
+ * io_uring cannot be used.
+ */
+IoRing *threadRing()
+{
+    thread_local std::unique_ptr<IoRing> ring;
+    thread_local bool unavailable = !IoRing::isSupported();
+
+    if (ring == nullptr && !unavailable)
+    {
+        try
+        {
+            ring = std::make_unique<IoRing>(HASH_QUEUED_READS);
+        }
+        catch (const std::runtime_error &)
+        {
+            // Usually a locked-memory limit too low for the ring; pread still works.
+            unavailable = true;
+        }
+    }
+
+    return ring.get();
+}
+
+/**
+ * A read of the queued reader, and how much of it has arrived.
+ */
+struct QueuedRead
+{
+    uint64_t offset = 0;
+    size_t length = 0;
+    size_t filled = 0;
+};
+} // namespace
+
+HashReader::HashReader(HashReadMode mode) : mode(mode)
+{
+}
+
+HashReadMode HashReader::getMode()
+{
+    return this->mode;
+}
+
+void HashReader::read(const fs::path &filePath, const ChunkConsumer &consumer)
+{
+    FileHandle file{open(filePath.c_str(), O_RDONLY | O_CLOEXEC)};
+
+    if (file.fd < 0)
+    {
+        throwReadError("open", filePath);
+    }
+
+    if (this->mode == HashReadMode::mmap)
+    {
+        HashReader::readMapped(file.fd, filePath, consumer);
+    }
+    else if (this->mode == HashReadMode::ioUring)
+    {
+        HashReader::readQueued(file.fd, filePath, consumer);
+    }
+    else
+    {
+        HashReader::readBuffered(file.fd, filePath, consumer);
+    }
+}
+
+void HashReader::readMapped(int fd, const fs::path &filePath, const ChunkConsumer &consumer)
+{
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        throwReadError("stat", filePath);
+    }
+
+    const size_t fileSize = static_cast<size_t>(info.st_size);
+    if (fileSize == 0)
+    {
+        return;
+    }
+
+    void *mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        throwReadError("map", filePath);
+    }
+
+    madvise(mapping, fileSize, MADV_SEQUENTIAL);
+
+    const uint8_t *data = static_cast<const uint8_t *>(mapping);
+
+    try
+    {
+        for (size_t offset = 0; offset < fileSize; offset += HASH_READ_SIZE)
+        {
+            consumer(data + offset, std::min(HASH_READ_SIZE, fileSize - offset));
+        }
+    }
+    catch (...)
+    {
+        munmap(mapping, fileSize);
+        throw;
+    }
+
+    munmap(mapping, fileSize);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+void HashReader::readBuffered(int fd, const fs::path &filePath, const ChunkConsumer &consumer)
+{
+    uint8_t *buffer = threadBuffer();
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    off_t offset = 0;
+    while (true)
+    {
+        ssize_t bytesRead = pread(fd, buffer, HASH_READ_SIZE, offset);
+
+        if (bytesRead < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            throwReadError("read", filePath);
+        }
+
+        if (bytesRead == 0)
+        {
+            break;
+        }
+
+        consumer(buffer, static_cast<size_t>(bytesRead));
+
+        // The chunk has been consumed; there is no reason to keep it cached.
+        posix_fadvise(fd, offset, bytesRead, POSIX_FADV_DONTNEED);
+        offset += bytesRead;
+    }
+}
+
+void HashReader::readQueued(int fd, const fs::path &filePath, const ChunkConsumer &consumer)
+{
+    IoRing *ring = threadRing();
+    if (ring == nullptr)
+    {
+        HashReader::readBuffered(fd, filePath, consumer);
+        return;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        throwReadError("stat", filePath);
+    }
+
+    const uint64_t fileSize = static_cast<uint64_t>(info.st_size);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // Each read has a lane buffer of its own; they are handed out round-robin, so the
+    // read holding the next bytes of the file is always reads[nextChunk % HASH_QUEUED_READS].
+    QueuedRead reads[HASH_QUEUED_READS];
+    uint64_t nextOffset = 0;
+    size_t nextRead = 0;
+    size_t nextChunk = 0;
+    std::vector<IoCompletion> completions;
+
+    auto queueRead = [&](size_t index) {
+        QueuedRead &read = reads[index];
+        ring->prepareRead(fd, laneBuffer(index) + read.filled, static_cast<uint32_t>(read.length - read.filled),
+                          read.offset + read.filled, index);
+    };
+
+    auto queueNext = [&]() {
+        while (nextOffset < fileSize && nextRead < nextChunk + HASH_QUEUED_READS)
+        {
+            const size_t index = nextRead++ % HASH_QUEUED_READS;
+            const uint64_t length = std::min<uint64_t>(HASH_LANE_READ_SIZE, fileSize - nextOffset);
+
+            reads[index] = QueuedRead{nextOffset, static_cast<size_t>(length), 0};
+            nextOffset += reads[index].length;
+            queueRead(index);
+        }
+    };
+
+    try
+    {
+        queueNext();
+
+        while (nextChunk < nextRead)
+        {
+            completions.clear();
+            ring->submit(1, completions);
+
+            for (const IoCompletion &completion : completions)
+            {
+                QueuedRead &read = reads[completion.userData];
+
+                if (completion.result == -EINTR || completion.result == -EAGAIN)
+                {
+                    queueRead(completion.userData);
+                    continue;
+                }
+
+                if (completion.result <= 0)
+                {
+                    // A read of nothing before the end means the file shrank while it was being read.
+                    errno = completion.result == 0 ? EIO : -completion.result;
+                    throwReadError("read", filePath);
+                }
+
+                read.filled += static_cast<size_t>(completion.result);
+                if (read.filled < read.length)
+                {
+                    queueRead(completion.userData);
+                }
+            }
+
+            // Hand over every chunk now complete, in file order, and reuse their buffers.
+            while (nextChunk < nextRead)
+            {
+                const size_t index = nextChunk % HASH_QUEUED_READS;
+                if (reads[index].filled < reads[index].length)
+                {
+                    break;
+                }
+
+                consumer(laneBuffer(index), reads[index].length);
+                posix_fadvise(fd, reads[index].offset, reads[index].length, POSIX_FADV_DONTNEED);
+                nextChunk++;
+            }
+
+            queueNext();
+        }
+    }
+    catch (...)
+    {
+        // The ring is reused by the thread's next file, and the kernel may still be writing into the buffers.
+        ring->drain();
+        throw;
+    }
+}
+
+uint64_t HashReader::readEnds(const fs::path &filePath, size_t span, const RangeConsumer &consumer)
+{
+    FileHandle file{open(filePath.c_str(), O_RDONLY | O_CLOEXEC)};
+
+    if (file.fd < 0)
+    {
+        throwReadError("open", filePath);
+    }
+
+    struct stat info;
+    if (fstat(file.fd, &info) != 0)
+    {
+        throwReadError("stat", filePath);
+    }
+
+    const uint64_t fileSize = static_cast<uint64_t>(info.st_size);
+    const uint64_t headLength = std::min<uint64_t>(span, fileSize);
+    const uint64_t tailStart = std::max<uint64_t>(headLength, fileSize > span ? fileSize - span : 0);
+
+    thread_local std::vector<uint8_t> buffer;
+    buffer.resize(span);
+
+    const std::pair<uint64_t, uint64_t> ranges[] = {{0, headLength}, {tailStart, fileSize - tailStart}};
+
+    for (const auto &range : ranges)
+    {
+        size_t filled = 0;
+        while (filled < range.second)
+        {
+            ssize_t bytesRead = pread(file.fd, buffer.data() + filled, range.second - filled, range.first + filled);
+
+            if (bytesRead < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (bytesRead == 0)
+            {
+                // The file shrank while it was being read.
+                errno = EIO;
+            }
+
+            if (bytesRead <= 0)
+            {
+                throwReadError("read", filePath);
+            }
+
+            filled += static_cast<size_t>(bytesRead);
+        }
+
+        if (filled > 0)
+        {
+            consumer(range.first, buffer.data(), filled);
+        }
+    }
+
+    return fileSize;
+}
+
+void HashReader::readInterleaved(const std::vector<fs::path> &filePaths, size_t laneCount, InterleavedConsumer &consumer)
+{
+    laneCount = std::max<size_t>(1, std::min(laneCount, filePaths.size()));
+
+    std::vector<ReadLane> lanes(laneCount);
+    std::vector<const uint8_t *> data(laneCount, nullptr);
+    std::vector<size_t> lengths(laneCount, 0);
+    size_t nextFile = 0;
+
+    auto closeLane = [&](size_t lane, std::exception_ptr error) {
+        close(lanes[lane].fd);
+        lanes[lane].fd = -1;
+        consumer.end(lane, lanes[lane].fileIndex, error);
+    };
+
+    try
+    {
+        while (true)
+        {
+            size_t openLanes = 0;
+
+            for (size_t lane = 0; lane < laneCount; lane++)
+            {
+                // Give idle lanes the next file that can be opened.
+                while (lanes[lane].fd < 0 && nextFile < filePaths.size())
+                {
+                    const size_t fileIndex = nextFile++;
+                    int fd = open(filePaths[fileIndex].c_str(), O_RDONLY | O_CLOEXEC);
+
+                    if (fd < 0)
+                    {
+                        consumer.end(lane, fileIndex, std::make_exception_ptr(readError("open", filePaths[fileIndex])));
+                        continue;
+                    }
+
+                    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+                    lanes[lane] = ReadLane{fd, 0, fileIndex};
+                    consumer.begin(lane, fileIndex);
+                }
+
+                lengths[lane] = 0;
+                if (lanes[lane].fd < 0)
+                {
+                    continue;
+                }
+
+                uint8_t *buffer = laneBuffer(lane);
+                ssize_t bytesRead;
+                do
+                {
+                    bytesRead = pread(lanes[lane].fd, buffer, HASH_LANE_READ_SIZE, lanes[lane].offset);
+                } while (bytesRead < 0 && errno == EINTR);
+
+                if (bytesRead < 0)
+                {
+                    closeLane(lane, std::make_exception_ptr(readError("read", filePaths[lanes[lane].fileIndex])));
+                    continue;
+                }
+
+                if (bytesRead == 0)
+                {
+                    closeLane(lane, nullptr);
+                    continue;
+                }
+
+                data[lane] = buffer;
+                lengths[lane] = static_cast<size_t>(bytesRead);
+                openLanes++;
+            }
+
+            if (openLanes == 0 && nextFile >= filePaths.size())
+            {
+                break;
+            }
+
+            if (openLanes > 0)
+            {
+                consumer.consume(data, lengths);
+            }
+
+            for (size_t lane = 0; lane < laneCount; lane++)
+            {
+                if (lengths[lane] > 0)
+                {
+                    posix_fadvise(lanes[lane].fd, lanes[lane].offset, lengths[lane], POSIX_FADV_DONTNEED);
+                    lanes[lane].offset += lengths[lane];
+                }
+            }
+        }
+    }
+    catch (...)
+    {
+        // A consumer threw; don't leak the open files.
+        for (auto &lane : lanes)
+        {
+            if (lane.fd >= 0)
+            {
+                close(lane.fd);
+            }
+        }
+        throw;
+    }
+}
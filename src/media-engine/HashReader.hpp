@@ -0,0 +1,171 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+/**
+ * Size of each read issued by the pread reader and of each chunk handed out by the mmap reader.
+ */
+static const size_t HASH_READ_SIZE = 4 * 1024 * 1024;
+
+/**
+ * Size of each read when several files are read side by side.
+ */
+static const size_t HASH_LANE_READ_SIZE = 1024 * 1024;
+
+/**
+ * Alignment of the per-thread read buffer. Matches the page size so the kernel can
+ * copy whole pages.
+ */
+static const size_t HASH_BUFFER_ALIGNMENT = 4096;
+
+/**
+ * How a file is read for hashing.
+ */
+enum class HashReadMode
+{
+    // Map the file and walk it with MADV_SEQUENTIAL read-ahead.
+    mmap,
+    // Large preads into a reused, page-aligned per-thread buffer.
+    pread,
+    // Several reads of HASH_LANE_READ_SIZE in flight at once through io_uring. Falls back
+    // to pread where io_uring is unavailable.
+    ioUring
+};
+
+/**
+ * Number of reads the io_uring reader keeps in flight for a file.
+ */
+static const size_t HASH_QUEUED_READS = 4;
+
+/**
+ * Receives the chunks of several files read side by side. See HashReader::readInterleaved.
+ */
+class InterleavedConsumer
+{
+public:
+    virtual ~InterleavedConsumer() = default;
+
+    /**
+     * A lane has started reading a file.
+     *
+     * @param lane lane the file was assigned to
+     * @param fileIndex index of the file in the list being read
+     */
+    virtual void begin(size_t lane, size_t fileIndex) = 0;
+
+    /**
+     * The next chunk of every lane. Lanes with nothing to give this round have a length of 0.
+     *
+     * @param data start of each lane's chunk
+     * @param lengths number of bytes in each lane's chunk
+     */
+    virtual void consume(const std::vector<const uint8_t *> &data, const std::vector<size_t> &lengths) = 0;
+
+    /**
+     * A lane has finished with a file, either at the end of the file or because it failed.
+     *
+     * @param lane lane the file was assigned to
+     * @param fileIndex index of the file in the list being read
+     * @param error null if the whole file was read, otherwise the error that stopped it
+     */
+    virtual void end(size_t lane, size_t fileIndex, std::exception_ptr error) = 0;
+};
+
+/**
+ * Sequential whole-file reader used for hashing.
+ *
+ * Every mode tells the kernel the access is sequential and drop the pages from the
+ * page cache once they have been consumed, so a library scan does not push the
+ * rest of the system's working set out of memory.
+ */
+class HashReader
+{
+public:
+    /**
+     * Receives each chunk of the file, in order.
+     */
+    using ChunkConsumer = std::function<void(const uint8_t *data, size_t length)>;
+
+    /**
+     * Receives a chunk of the file along with its position in the file.
+     */
+    using RangeConsumer = std::function<void(uint64_t offset, const uint8_t *data, size_t length)>;
+
+private:
+    HashReadMode mode;
+
+    static void readMapped(int fd, const fs::path &filePath, const ChunkConsumer &consumer);
+    static void readBuffered(int fd, const fs::path &filePath, const ChunkConsumer &consumer);
+    static void readQueued(int fd, const fs::path &filePath, const ChunkConsumer &consumer);
+
+public:
+    explicit HashReader(HashReadMode mode = HashReadMode::pread);
+
+    /**
+     * Reads an entire file, passing it to the consumer in chunks of at most HASH_READ_SIZE bytes.
+     * With HashReadMode::ioUring only the bytes present when the file was opened are read.
+     *
+     * @param filePath file to read
+     * @param consumer callback receiving each chunk
+     */
+    void read(const fs::path &filePath, const ChunkConsumer &consumer);
+
+    /**
+     * Reads only the start and end of a file: the first `span` bytes and the last `span`
+     * bytes. Files no larger than twice the span are read whole, with no byte read twice.
+     *
+     * @param filePath file to read
+     * @param span number of bytes to read from each end
+     * @param consumer callback receiving the head, then the tail
+     *
+     * @returns size of the file in bytes.
+     */
+    static uint64_t readEnds(const fs::path &filePath, size_t span, const RangeConsumer &consumer);
+
+    /**
+     * Reads several files side by side, one chunk of up to HASH_LANE_READ_SIZE bytes from
+     * each open file per round. As soon as a file is finished its lane takes the next
+     * file from the list, so every lane stays busy until the list runs out.
+     *
+     * Always uses pread, whatever the reader's mode.
+     *
+     * @param filePaths files to read
+     * @param laneCount maximum number of files open at once
+     * @param consumer receives the chunks and the start and end of each file
+     */
+    static void readInterleaved(const std::vector<fs::path> &filePaths, size_t laneCount, InterleavedConsumer &consumer);
+
+    /**
+     * Retrieves the mode this reader was created with.
+     */
+    HashReadMode getMode();
+};
+} // namespace MediaEngine
+} // namespace Mellophone
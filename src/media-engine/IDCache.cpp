@@ -0,0 +1,68 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#include "IDCache.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+/**
+ * Reads (ID, Name) rows into the given map. Duplicate names keep their lowest ID.
+ */
+static void loadNames(const shared_ptr<StatementCache> &statements, const string &sql,
+                      std::unordered_map<string, uint32_t> &names)
+{
+    CachedStatement stmt = statements->acquire(sql);
+
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW)
+    {
+        const char *name = reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1));
+        if (name != nullptr)
+        {
+            names.emplace(name, sqlite3_column_int(stmt.get(), 0));
+        }
+    }
+}
+
+void IDCache::load(const shared_ptr<StatementCache> &statements)
+{
+    this->artistIDs.clear();
+    this->albumIDs.clear();
+
+    loadNames(statements, ARTIST_LOAD_SQL, this->artistIDs);
+    loadNames(statements, ALBUM_LOAD_SQL, this->albumIDs);
+}
+
+uint32_t IDCache::findArtistID(const string &name)
+{
+    auto found = this->artistIDs.find(name);
+    return found != this->artistIDs.end() ? found->second : 0;
+}
+
+uint32_t IDCache::findAlbumID(const string &name)
+{
+    auto found = this->albumIDs.find(name);
+    return found != this->albumIDs.end() ? found->second : 0;
+}
+
+void IDCache::addArtist(const string &name, uint32_t id)
+{
+    this->artistIDs[name] = id;
+}
+
+void IDCache::addAlbum(const string &name, uint32_t id)
+{
+    this->albumIDs[name] = id;
+}
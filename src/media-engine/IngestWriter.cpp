@@ -0,0 +1,448 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+// Utility libs
+#include <boost/format.hpp>
+
+// Local includes
+#include "IngestWriter.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+IngestWriter::IngestWriter(const shared_ptr<StatementCache> &statements, const shared_ptr<IDCache> &ids,
+                           uint32_t batchSize, HashReadMode hashReadMode)
+    : db(statements->getConnection()), statements(statements), ids(ids), matcher(hashReadMode),
+      batchSize(batchSize > 0 ? batchSize : 1)
+{
+}
+
+IngestWriter::~IngestWriter()
+{
+    try
+    {
+        this->commit();
+    }
+    catch (const std::runtime_error &err)
+    {
+        std::cerr << err.what() << std::endl;
+    }
+}
+
+void IngestWriter::execute(const string &sql)
+{
+    CachedStatement stmt = this->statements->acquire(sql);
+
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE)
+    {
+        std::stringstream errStream;
+        errStream << boost::format("Failed to run '%s': %s") % sql % sqlite3_errmsg(*this->db);
+        throw std::runtime_error(errStream.str());
+    }
+}
+
+IngestResult IngestWriter::commit()
+{
+    IngestResult result;
+
+    if (!this->inTransaction)
+    {
+        return result;
+    }
+
+    this->inTransaction = false;
+    std::swap(result, this->pending);
+
+    try
+    {
+        this->execute(COMMIT_TRANSACTION_SQL);
+    }
+    catch (const std::runtime_error &err)
+    {
+        std::cerr << err.what() << std::endl;
+
+        // Artists and albums created in the lost transaction may already be cached.
+        sqlite3_exec(*this->db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        this->ids->load(this->statements);
+        this->albumsWithCover.clear();
+
+        // None of the transaction's rows were kept.
+        result.failed += result.written();
+        result.inserted = 0;
+        result.duplicates = 0;
+        result.refreshed = 0;
+    }
+
+    return result;
+}
+
+IngestResult IngestWriter::write(const vector<unique_ptr<Track>> &tracks)
+{
+    IngestResult result;
+
+    for (const auto &track : tracks)
+    {
+        try
+        {
+            if (!this->inTransaction)
+            {
+                this->execute(BEGIN_TRANSACTION_SQL);
+                this->inTransaction = true;
+            }
+
+            switch (this->insertTrack(*track))
+            {
+            case IngestOutcome::inserted:
+                this->pending.inserted++;
+                break;
+            case IngestOutcome::duplicate:
+                this->pending.duplicates++;
+                break;
+            case IngestOutcome::refreshed:
+                this->pending.refreshed++;
+                break;
+            }
+        }
+        catch (const std::runtime_error &err)
+        {
+            std::cerr << err.what() << std::endl;
+            result.failed++;
+        }
+
+        if (this->pending.written() >= this->batchSize)
+        {
+            result += this->commit();
+        }
+    }
+
+    return result;
+}
+
+uint32_t IngestWriter::getAlbumID(Track &track)
+{
+    const string albumName = track.getAlbum();
+    uint32_t id = this->ids->findAlbumID(albumName);
+
+    if (id != 0)
+    {
+        return id;
+    }
+
+    // No corresponding album was found, so a new entry will be created.
+    uint32_t artistID = this->getArtistID(track);
+    const string coverHash = track.getCoverHash();
+
+    CachedStatement stmt = this->statements->acquire(ALBUM_INSERT_SQL);
+    sqlite3_bind_text(stmt.get(), 1, albumName.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt.get(), 2, artistID);
+    IngestWriter::bindOptionalText(stmt.get(), 3, coverHash);
+
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE)
+    {
+        std::stringstream errStream;
+        errStream << boost::format("Failed to add album '%s' to the database: %s") % albumName % sqlite3_errmsg(*this->db);
+        throw std::runtime_error(errStream.str());
+    }
+
+    id = static_cast<uint32_t>(sqlite3_last_insert_rowid(*this->db));
+    this->ids->addAlbum(albumName, id);
+
+    if (!coverHash.empty())
+    {
+        this->albumsWithCover.insert(id);
+    }
+
+    return id;
+}
+
+void IngestWriter::updateAlbumCover(uint32_t albumID, Track &track)
+{
+    const string coverHash = track.getCoverHash();
+    if (coverHash.empty() || this->albumsWithCover.count(albumID) != 0)
+    {
+        return;
+    }
+
+    CachedStatement stmt = this->statements->acquire(ALBUM_COVER_UPDATE_SQL);
+    sqlite3_bind_text(stmt.get(), 1, coverHash.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt.get(), 2, albumID);
+    sqlite3_step(stmt.get());
+
+    // Whether or not this set the cover, the album has one now.
+    this->albumsWithCover.insert(albumID);
+}
+
+uint32_t IngestWriter::getArtistID(Track &track)
+{
+    const string artistName = track.getArtist();
+    uint32_t id = this->ids->findArtistID(artistName);
+
+    if (id != 0)
+    {
+        return id;
+    }
+
+    // No corresponding artist was found, so a new entry will be created.
+    CachedStatement stmt = this->statements->acquire(ARTIST_INSERT_SQL);
+    sqlite3_bind_text(stmt.get(), 1, artistName.c_str(), -1, SQLITE_STATIC);
+
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE)
+    {
+        std::stringstream errStream;
+        errStream << boost::format("Failed to add artist '%s' to the database: %s") % artistName % sqlite3_errmsg(*this->db);
+        throw std::runtime_error(errStream.str());
+    }
+
+    id = static_cast<uint32_t>(sqlite3_last_insert_rowid(*this->db));
+    this->ids->addArtist(artistName, id);
+
+    return id;
+}
+
+void IngestWriter::bindFingerprint(sqlite3_stmt *stmt, int firstIndex, const FileFingerprint &fingerprint)
+{
+    sqlite3_bind_int64(stmt, firstIndex, static_cast<sqlite3_int64>(fingerprint.size));
+    sqlite3_bind_int64(stmt, firstIndex + 1, fingerprint.modifiedTime);
+    sqlite3_bind_int64(stmt, firstIndex + 2, static_cast<sqlite3_int64>(fingerprint.inode));
+    sqlite3_bind_int64(stmt, firstIndex + 3, static_cast<sqlite3_int64>(fingerprint.device));
+}
+
+void IngestWriter::bindOptionalText(sqlite3_stmt *stmt, int index, const string &value)
+{
+    if (value.empty())
+    {
+        sqlite3_bind_null(stmt, index);
+    }
+    else
+    {
+        sqlite3_bind_text(stmt, index, value.c_str(), -1, SQLITE_STATIC);
+    }
+}
+
+void IngestWriter::readContentKeys(sqlite3_stmt *stmt, int firstColumn, ContentKey &key)
+{
+    string *columns[] = {&key.partialHash, &key.fullHash, &key.audioMD5};
+
+    for (int i = 0; i < 3; i++)
+    {
+        const char *value = reinterpret_cast<const char *>(sqlite3_column_text(stmt, firstColumn + i));
+        *columns[i] = value != nullptr ? value : "";
+    }
+}
+
+bool IngestWriter::matchesRecorded(const ContentKey &current, const ContentKey &recorded)
+{
+    if (!current.fullHash.empty() && !recorded.fullHash.empty())
+    {
+        return current.fullHash == recorded.fullHash;
+    }
+
+    // The recorded file is the current one, so there is nothing else to read and compare:
+    // a change that keeps the size, both ends and the decoded audio is taken as no change.
+    if (current.size != recorded.size || current.partialHash.empty() || current.partialHash != recorded.partialHash)
+    {
+        return false;
+    }
+
+    return current.audioMD5.empty() || recorded.audioMD5.empty() || current.audioMD5 == recorded.audioMD5;
+}
+
+sqlite3_int64 IngestWriter::findDuplicate(ContentKey &key)
+{
+    vector<std::pair<sqlite3_int64, ContentKey>> candidates;
+
+    {
+        const string location = key.location.string();
+        CachedStatement stmt = this->statements->acquire(SIZE_SELECT_SQL);
+        sqlite3_bind_int64(stmt.get(), 1, static_cast<sqlite3_int64>(key.size));
+        sqlite3_bind_text(stmt.get(), 2, location.c_str(), -1, SQLITE_STATIC);
+
+        while (sqlite3_step(stmt.get()) == SQLITE_ROW)
+        {
+            ContentKey candidate;
+            candidate.location = reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1));
+            candidate.size = key.size;
+            IngestWriter::readContentKeys(stmt.get(), 2, candidate);
+
+            candidates.emplace_back(sqlite3_column_int64(stmt.get(), 0), std::move(candidate));
+        }
+    }
+
+    for (auto &candidate : candidates)
+    {
+        ContentKey &recorded = candidate.second;
+        const bool hadPartial = !recorded.partialHash.empty();
+        const bool hadFull = !recorded.fullHash.empty();
+        bool same = false;
+
+        try
+        {
+            same = this->matcher.sameContents(key, recorded);
+        }
+        catch (const std::runtime_error &err)
+        {
+            // Most likely the recorded file has been moved or deleted since it was imported.
+            std::cerr << err.what() << std::endl;
+            continue;
+        }
+
+        // Keep the hashes the comparison had to compute so it never has to again.
+        if (hadPartial != !recorded.partialHash.empty() || hadFull != !recorded.fullHash.empty())
+        {
+            CachedStatement stmt = this->statements->acquire(UPDATE_CONTENT_KEYS_SQL);
+            IngestWriter::bindOptionalText(stmt.get(), 1, recorded.partialHash);
+            IngestWriter::bindOptionalText(stmt.get(), 2, recorded.fullHash);
+            sqlite3_bind_int64(stmt.get(), 3, candidate.first);
+            sqlite3_step(stmt.get());
+        }
+
+        if (same)
+        {
+            return candidate.first;
+        }
+    }
+
+    return 0;
+}
+
+void IngestWriter::recordDuplicate(Track &track, sqlite3_int64 keptID)
+{
+    const string location = track.getLocation().string();
+
+    CachedStatement stmt = this->statements->acquire(DUPLICATE_FILE_INSERT_SQL);
+    sqlite3_bind_text(stmt.get(), 1, location.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt.get(), 2, keptID);
+    IngestWriter::bindFingerprint(stmt.get(), 3, track.getFingerprint());
+
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE)
+    {
+        std::stringstream errStream;
+        errStream << boost::format("Failed to record '%s' as a duplicate: %s") % location % sqlite3_errmsg(*this->db);
+        throw std::runtime_error(errStream.str());
+    }
+}
+
+IngestOutcome IngestWriter::insertTrack(Track &track)
+{
+    ContentKey key = track.getContentKey();
+    const string location = key.location.string();
+
+    // A checksum that is already known is the cheapest key of all to look up.
+    if (!key.fullHash.empty())
+    {
+        sqlite3_int64 keptID = 0;
+
+        {
+            CachedStatement stmt = this->statements->acquire(CHECKSUM_SELECT_SQL);
+            sqlite3_bind_text(stmt.get(), 1, key.fullHash.c_str(), -1, SQLITE_STATIC);
+
+            if (sqlite3_step(stmt.get()) == SQLITE_ROW)
+            {
+                const char *existing = reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1));
+
+                if (existing == nullptr || location != existing)
+                {
+                    // A file with the same checksum was already in the db.
+                    keptID = sqlite3_column_int64(stmt.get(), 0);
+                }
+            }
+        }
+
+        if (keptID != 0)
+        {
+            this->recordDuplicate(track, keptID);
+            return IngestOutcome::duplicate;
+        }
+    }
+
+    sqlite3_int64 existingID = 0;
+    ContentKey recorded;
+
+    {
+        CachedStatement stmt = this->statements->acquire(LOCATION_SELECT_SQL);
+        sqlite3_bind_text(stmt.get(), 1, location.c_str(), -1, SQLITE_STATIC);
+
+        if (sqlite3_step(stmt.get()) == SQLITE_ROW)
+        {
+            existingID = sqlite3_column_int64(stmt.get(), 0);
+            recorded.size = static_cast<uint64_t>(sqlite3_column_int64(stmt.get(), 1));
+            IngestWriter::readContentKeys(stmt.get(), 2, recorded);
+        }
+    }
+
+    if (existingID != 0 && IngestWriter::matchesRecorded(key, recorded))
+    {
+        // Same file, same contents: only the stat fingerprint went stale (e.g. the file was touched).
+        CachedStatement stmt = this->statements->acquire(UPDATE_FINGERPRINT_SQL);
+        IngestWriter::bindFingerprint(stmt.get(), 1, track.getFingerprint());
+        IngestWriter::bindOptionalText(stmt.get(), 5, key.partialHash);
+        sqlite3_bind_int64(stmt.get(), 6, existingID);
+        sqlite3_step(stmt.get());
+
+        return IngestOutcome::refreshed;
+    }
+
+    const sqlite3_int64 keptID = this->findDuplicate(key);
+    if (keptID != 0)
+    {
+        this->recordDuplicate(track, keptID);
+        return IngestOutcome::duplicate;
+    }
+
+    // Check if the album exists. Also checks for artist.
+    uint32_t albumID = this->getAlbumID(track);
+    this->updateAlbumCover(albumID, track);
+
+    const string title = track.getTitle();
+    const string genre = track.getGenre();
+    const string date = track.getDate();
+
+    CachedStatement stmt = this->statements->acquire(INSERT_TRACK_SQL);
+    IngestWriter::bindOptionalText(stmt.get(), 1, key.fullHash);
+    sqlite3_bind_text(stmt.get(), 2, location.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt.get(), 3, title.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt.get(), 4, albumID);
+    sqlite3_bind_int(stmt.get(), 5, track.getTrackNum());
+    sqlite3_bind_int(stmt.get(), 6, track.getTotalTracks());
+    sqlite3_bind_int(stmt.get(), 7, track.getDiscNum());
+    sqlite3_bind_int(stmt.get(), 8, track.getTotalDiscs());
+    IngestWriter::bindFingerprint(stmt.get(), 9, track.getFingerprint());
+    IngestWriter::bindOptionalText(stmt.get(), 13, key.partialHash);
+    IngestWriter::bindOptionalText(stmt.get(), 14, key.audioMD5);
+    IngestWriter::bindOptionalText(stmt.get(), 15, genre);
+    IngestWriter::bindOptionalText(stmt.get(), 16, date);
+    if (track.getDuration() != 0)
+    {
+        sqlite3_bind_int64(stmt.get(), 17, track.getDuration());
+    }
+
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE)
+    {
+        std::stringstream errStream;
+        errStream << boost::format("Failed to add '%s' to the database: %s") % location % sqlite3_errmsg(*this->db);
+        throw std::runtime_error(errStream.str());
+    }
+
+    CachedStatement copyStmt = this->statements->acquire(DUPLICATE_FILE_DELETE_SQL);
+    sqlite3_bind_text(copyStmt.get(), 1, location.c_str(), -1, SQLITE_STATIC);
+    sqlite3_step(copyStmt.get());
+
+    return IngestOutcome::inserted;
+}
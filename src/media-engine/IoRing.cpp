@@ -0,0 +1,391 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+// System libs
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef MELLOPHONE_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+// Utility libs
+#include <boost/format.hpp>
+
+// Local includes
+#include "IoRing.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace
+{
+[[noreturn]] void throwRingError(const char *action, int error)
+{
+    std::stringstream errStream;
+    errStream << boost::format("io_uring %s failed: %s") % action % strerror(error);
+    throw std::runtime_error(errStream.str());
+}
+
+#ifdef MELLOPHONE_HAVE_IO_URING
+int ringSetup(uint32_t entries, io_uring_params *params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ringEnter(int fd, uint32_t toSubmit, uint32_t minComplete, uint32_t flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int ringRegister(int fd, uint32_t opcode, void *arg, uint32_t count)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+/**
+ * Asks the kernel whether it implements the operations the engine issues. statx and
+ * openat arrived in 5.6, the same release as the probe itself.
+ */
+bool probeOperations()
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    const int fd = ringSetup(2, &params);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    const size_t probeSize = sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op);
+    std::vector<uint8_t> storage(probeSize, 0);
+    auto *probe = reinterpret_cast<io_uring_probe *>(storage.data());
+
+    bool supported = ringRegister(fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0;
+
+    for (uint8_t op : {IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ})
+    {
+        supported = supported && op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    close(fd);
+    return supported;
+}
+#endif
+} // namespace
+
+bool IoRing::isSupported()
+{
+#ifdef MELLOPHONE_HAVE_IO_URING
+    static const bool supported = probeOperations();
+    return supported;
+#else
+    return false;
+#endif
+}
+
+#ifdef MELLOPHONE_HAVE_IO_URING
+
+IoRing::IoRing(uint32_t entries)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    this->ringFD = ringSetup(std::max(1u, entries), &params);
+    if (this->ringFD < 0)
+    {
+        throwRingError("setup", errno);
+    }
+
+    this->entries = params.sq_entries;
+
+    this->sqMappingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    this->cqMappingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    // Since 5.4 both rings share a single mapping.
+    const bool singleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMapping)
+    {
+        this->sqMappingSize = this->cqMappingSize = std::max(this->sqMappingSize, this->cqMappingSize);
+    }
+
+    this->sqMapping = mmap(nullptr, this->sqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           this->ringFD, IORING_OFF_SQ_RING);
+    if (this->sqMapping == MAP_FAILED)
+    {
+        const int error = errno;
+        this->sqMapping = nullptr;
+        this->release();
+        throwRingError("mmap", error);
+    }
+
+    if (singleMapping)
+    {
+        this->cqMapping = this->sqMapping;
+    }
+    else
+    {
+        this->cqMapping = mmap(nullptr, this->cqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                               this->ringFD, IORING_OFF_CQ_RING);
+        if (this->cqMapping == MAP_FAILED)
+        {
+            const int error = errno;
+            this->cqMapping = nullptr;
+            this->release();
+            throwRingError("mmap", error);
+        }
+    }
+
+    this->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(nullptr, this->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ringFD,
+                      IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        const int error = errno;
+        this->release();
+        throwRingError("mmap", error);
+    }
+    this->sqes = static_cast<io_uring_sqe *>(sqes);
+
+    auto *sq = static_cast<uint8_t *>(this->sqMapping);
+    this->sqTail = reinterpret_cast<uint32_t *>(sq + params.sq_off.tail);
+    this->sqMask = reinterpret_cast<uint32_t *>(sq + params.sq_off.ring_mask);
+    this->sqArray = reinterpret_cast<uint32_t *>(sq + params.sq_off.array);
+    this->sqLocalTail = *this->sqTail;
+
+    auto *cq = static_cast<uint8_t *>(this->cqMapping);
+    this->cqHead = reinterpret_cast<uint32_t *>(cq + params.cq_off.head);
+    this->cqTail = reinterpret_cast<uint32_t *>(cq + params.cq_off.tail);
+    this->cqMask = reinterpret_cast<uint32_t *>(cq + params.cq_off.ring_mask);
+    this->cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+}
+
+IoRing::~IoRing()
+{
+    try
+    {
+        this->drain();
+    }
+    catch (const std::runtime_error &)
+    {
+        // Closing the ring below cancels whatever is left.
+    }
+
+    this->release();
+}
+
+void IoRing::release()
+{
+    if (this->sqes != nullptr)
+    {
+        munmap(this->sqes, this->sqesSize);
+    }
+
+    if (this->cqMapping != nullptr && this->cqMapping != this->sqMapping)
+    {
+        munmap(this->cqMapping, this->cqMappingSize);
+    }
+
+    if (this->sqMapping != nullptr)
+    {
+        munmap(this->sqMapping, this->sqMappingSize);
+    }
+
+    if (this->ringFD >= 0)
+    {
+        close(this->ringFD);
+    }
+
+    this->sqes = nullptr;
+    this->sqMapping = this->cqMapping = nullptr;
+    this->ringFD = -1;
+}
+
+io_uring_sqe *IoRing::nextEntry(uint64_t userData)
+{
+    if (this->inFlight >= this->entries)
+    {
+        throw std::runtime_error("io_uring request prepared with every entry already in flight.");
+    }
+
+    // The kernel sees the entry once submit() publishes the new tail.
+    const uint32_t index = this->sqLocalTail++ & *this->sqMask;
+
+    io_uring_sqe *sqe = &this->sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = userData;
+    this->sqArray[index] = index;
+
+    this->queued++;
+    this->inFlight++;
+
+    return sqe;
+}
+
+void IoRing::prepareStatx(const char *path, uint32_t mask, struct statx *info, uint64_t userData)
+{
+    io_uring_sqe *sqe = this->nextEntry(userData);
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uint64_t>(path);
+    sqe->len = mask;
+    sqe->off = reinterpret_cast<uint64_t>(info);
+}
+
+void IoRing::prepareOpen(const char *path, int flags, uint64_t userData)
+{
+    io_uring_sqe *sqe = this->nextEntry(userData);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uint64_t>(path);
+    sqe->open_flags = static_cast<uint32_t>(flags);
+}
+
+void IoRing::prepareRead(int fd, void *buffer, uint32_t length, uint64_t offset, uint64_t userData)
+{
+    io_uring_sqe *sqe = this->nextEntry(userData);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = length;
+    sqe->off = offset;
+}
+
+void IoRing::submit(uint32_t waitFor, std::vector<IoCompletion> &completions)
+{
+    waitFor = std::min(waitFor, this->inFlight);
+    uint32_t collected = 0;
+
+    while (true)
+    {
+        // Collect what has already arrived before asking the kernel for more.
+        uint32_t head = *this->cqHead;
+        const uint32_t tail = __atomic_load_n(this->cqTail, __ATOMIC_ACQUIRE);
+        const uint32_t arrived = tail - head;
+
+        for (; head != tail; head++)
+        {
+            const io_uring_cqe &cqe = this->cqes[head & *this->cqMask];
+            completions.push_back(IoCompletion{cqe.user_data, cqe.res});
+        }
+
+        // Hands the entries back to the kernel.
+        __atomic_store_n(this->cqHead, head, __ATOMIC_RELEASE);
+        this->inFlight -= arrived;
+        collected += arrived;
+
+        if (this->queued == 0 && collected >= waitFor)
+        {
+            break;
+        }
+
+        __atomic_store_n(this->sqTail, this->sqLocalTail, __ATOMIC_RELEASE);
+
+        const uint32_t stillWanted = collected >= waitFor ? 0 : waitFor - collected;
+        const int submitted = ringEnter(this->ringFD, this->queued, stillWanted,
+                                        stillWanted > 0 ? IORING_ENTER_GETEVENTS : 0);
+
+        if (submitted < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+            {
+                // Interrupted, or the completion queue needs draining first; collect and retry.
+                continue;
+            }
+
+            throwRingError("submit", errno);
+        }
+
+        this->queued -= std::min<uint32_t>(this->queued, static_cast<uint32_t>(submitted));
+    }
+}
+
+void IoRing::drain()
+{
+    std::vector<IoCompletion> discarded;
+
+    while (this->inFlight > 0)
+    {
+        discarded.clear();
+        this->submit(this->inFlight, discarded);
+    }
+}
+
+#else
+
+IoRing::IoRing(uint32_t)
+{
+    throwRingError("setup", ENOSYS);
+}
+
+IoRing::~IoRing()
+{
+}
+
+void IoRing::release()
+{
+}
+
+io_uring_sqe *IoRing::nextEntry(uint64_t)
+{
+    throwRingError("setup", ENOSYS);
+}
+
+void IoRing::prepareStatx(const char *, uint32_t, struct statx *, uint64_t)
+{
+    throwRingError("setup", ENOSYS);
+}
+
+void IoRing::prepareOpen(const char *, int, uint64_t)
+{
+    throwRingError("setup", ENOSYS);
+}
+
+void IoRing::prepareRead(int, void *, uint32_t, uint64_t, uint64_t)
+{
+    throwRingError("setup", ENOSYS);
+}
+
+void IoRing::submit(uint32_t, std::vector<IoCompletion> &)
+{
+    throwRingError("setup", ENOSYS);
+}
+
+void IoRing::drain()
+{
+}
+
+#endif
+
+uint32_t IoRing::available() const
+{
+    return this->entries - this->inFlight;
+}
+
+uint32_t IoRing::pending() const
+{
+    return this->inFlight;
+}
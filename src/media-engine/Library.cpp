@@ -14,16 +14,67 @@
     limitations under the License.
 */
 
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
 #include <unistd.h>
 #include <sys/types.h>
 #include <pwd.h>
 
-#include "sqlite_init.h"
+#include <boost/format.hpp>
+
+#include "BrowseQueries.hpp"
 #include "Library.hpp"
+#include "ScanPipeline.hpp"
+#include "Schema.hpp"
 
 using namespace Mellophone::MediaEngine;
 
-Library::Library()
+Library::Library() : Library(Library::findUserMusicDir(), Library::findUserDataDir())
+{
+}
+
+Library::Library(const fs::path &musicDir, const fs::path &dataDir)
+{
+    this->userMusicDir = musicDir;
+    this->userDataDir = dataDir;
+
+    this->initialized = std::async(std::launch::async, [this] { this->initialize(); }).share();
+}
+
+void Library::initialize()
+{
+    if (!fs::exists(this->userMusicDir))
+    {
+        fs::create_directories(this->userMusicDir);
+    }
+
+    if (!fs::exists(this->userDataDir))
+    {
+        fs::create_directories(this->userDataDir);
+    }
+
+    this->coverArt = std::make_shared<CoverArtCache>(this->userDataDir / "covers");
+
+    fs::path dbPath = this->userDataDir;
+    dbPath /= "media_library.sqlite";
+
+    this->initializeDatabase(dbPath);
+}
+
+bool Library::isReady()
+{
+    return this->initialized.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+void Library::waitUntilReady()
+{
+    this->initialized.get();
+}
+
+fs::path Library::findUserMusicDir()
 {
     // Determine the user's Music directory.
     const char *userHome = getenv("HOME");
@@ -36,80 +87,201 @@ Library::Library()
     {
         std::string pathStr = userHome;
         pathStr.append("/Music");
-        this->userMusicDir = fs::path(pathStr);
-    }
-    else
-    {
-        this->userMusicDir = fs::path(".");
+        return fs::path(pathStr);
     }
 
-    if (!fs::exists(this->userMusicDir))
-    {
-        fs::create_directories(this->userMusicDir);
-    }
+    return fs::path(".");
+}
 
+fs::path Library::findUserDataDir()
+{
     // Determine the user's application data directory.
     const char *dataHome = getenv("XDG_DATA_HOME");
     std::string dataDir;
     if (dataHome == nullptr)
     {
-        dataDir = userHome;
+        const char *userHome = getenv("HOME");
+        if (userHome == nullptr)
+        {
+            userHome = getpwuid(getuid())->pw_dir;
+        }
+
+        dataDir = userHome != nullptr ? userHome : ".";
         dataDir.append(USER_DATA_DIR);
-        this->userDataDir = fs::path(dataDir);
     }
     else
     {
         dataDir = dataHome;
         dataDir.append("/mellophone/");
-        this->userDataDir = dataDir;
     }
 
-    if (!fs::exists(this->userDataDir))
+    return fs::path(dataDir);
+}
+
+Library::~Library()
+{
+    // The background thread still uses the members until it is done.
+    this->initialized.wait();
+
+    // The watcher applies its last batch through the connection.
+    this->stopWatching();
+
+    // A rewrite still waiting is written before the connections close.
     {
-        fs::create_directories(this->userDataDir);
+        std::lock_guard<std::mutex> guard(this->snapshotLock);
+        this->snapshotStopping = true;
     }
+    this->snapshotWake.notify_all();
 
-    fs::path dbPath = this->userDataDir;
-    dbPath /= "media_library.sqlite";
-
-    try
+    if (this->snapshotThread.joinable())
     {
-        this->initializeDatabase(dbPath);
+        this->snapshotThread.join();
     }
-    catch (const std::runtime_error &err)
+
+    // Closes every connection, finalizing their statements first.
+    this->statements.reset();
+    this->connections.reset();
+}
+
+void Library::initializeDatabase(const fs::path &location)
+{
+    this->connections = std::make_unique<ConnectionPool>(location);
+
+    // Set up the database if it's empty or bring it up to date.
+    Schema::migrate(this->connections->getWriter());
+
+    this->statements = this->connections->getWriterStatements();
+}
+
+void Library::loadIDs()
+{
+    if (!this->idsLoaded)
     {
-        throw err;
+        this->ids->load(this->statements);
+        this->idsLoaded = true;
     }
 }
 
-Library::~Library()
+int64_t Library::invalidateSnapshot()
 {
-    sqlite3_close_v2(*this->dbConnection);
+    CachedStatement stmt = this->statements->acquire(GENERATION_BUMP_SQL);
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE)
+    {
+        std::stringstream errStream;
+        errStream << boost::format("Failed to update the library generation: %s") %
+                         sqlite3_errmsg(*this->connections->getWriter());
+        throw std::runtime_error(errStream.str());
+    }
+
+    return sqlite3_total_changes64(*this->connections->getWriter());
 }
 
-void Library::initializeDatabase(const fs::path &location)
+void Library::updateSnapshot(int64_t changesBefore)
 {
-    int result = sqlite3_open_v2(location.c_str(), this->dbConnection.get(),
-                                 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
+    try
+    {
+        if (sqlite3_total_changes64(*this->connections->getWriter()) == changesBefore)
+        {
+            // A rescan that found nothing new need not rewrite the whole snapshot.
+            const uint64_t generation = LibrarySnapshot::readGeneration(this->statements);
+            std::unique_ptr<LibrarySnapshot> current = LibrarySnapshot::open(this->userDataDir / SNAPSHOT_FILE_NAME);
+
+            if (current != nullptr && current->getGeneration() + 1 == generation)
+            {
+                CachedStatement stmt = this->statements->acquire(GENERATION_SET_SQL);
+                sqlite3_bind_int64(stmt.get(), 1, static_cast<int64_t>(current->getGeneration()));
+                sqlite3_step(stmt.get());
+                return;
+            }
+        }
+    }
+    catch (const std::exception &err)
+    {
+        // The library is still browsable through the database, which the stale snapshot defers to.
+        std::cerr << err.what() << std::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(this->snapshotLock);
+
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (this->snapshotsRequested == this->snapshotsStarted)
+    {
+        this->firstSnapshotRequest = now;
+    }
+    this->lastSnapshotRequest = now;
+    this->snapshotsRequested++;
 
-    if (result != SQLITE_OK)
+    if (!this->snapshotThread.joinable())
     {
-        sqlite3_close_v2(*this->dbConnection.get());
-        throw std::runtime_error("Failed to open database.");
+        this->snapshotThread = std::thread(&Library::writeSnapshots, this);
     }
+    this->snapshotWake.notify_all();
+}
+
+void Library::writeSnapshots()
+{
+    std::unique_lock<std::mutex> guard(this->snapshotLock);
+
+    while (true)
+    {
+        this->snapshotWake.wait(guard, [this] {
+            return this->snapshotsRequested > this->snapshotsStarted || this->snapshotStopping;
+        });
 
-    // Set up the database if it's empty.
-    sqlite3_stmt *checkStmt;
-    sqlite3_prepare_v2(*this->dbConnection, CHECK_STMT.c_str(), CHECK_STMT.length(), &checkStmt, nullptr);
-    result = sqlite3_step(checkStmt);
+        if (this->snapshotsRequested == this->snapshotsStarted)
+        {
+            return;
+        }
 
-    sqlite3_finalize(checkStmt);
+        // A burst of watcher batches costs one rewrite, unless the snapshot is wanted now.
+        while (!this->snapshotUrgent && !this->snapshotStopping)
+        {
+            const std::chrono::steady_clock::time_point deadline = std::min(
+                this->lastSnapshotRequest + SNAPSHOT_QUIET_PERIOD, this->firstSnapshotRequest + SNAPSHOT_MAX_DELAY);
 
-    if (result == SQLITE_DONE)
+            if (this->snapshotWake.wait_until(guard, deadline) == std::cv_status::timeout)
+            {
+                break;
+            }
+        }
+
+        const uint64_t requests = this->snapshotsRequested;
+        this->snapshotsStarted = requests;
+        this->snapshotUrgent = false;
+        guard.unlock();
+
+        try
+        {
+            // The snapshot is read in one transaction, so the writer can carry on meanwhile.
+            ReaderLease reader = this->connections->acquireReader();
+            LibrarySnapshot::write(this->userDataDir / SNAPSHOT_FILE_NAME, reader.getStatements());
+        }
+        catch (const std::exception &err)
+        {
+            // The library is still browsable through the database, which the stale snapshot defers to.
+            std::cerr << err.what() << std::endl;
+        }
+
+        guard.lock();
+        this->snapshotsWritten = requests;
+        this->snapshotWake.notify_all();
+    }
+}
+
+void Library::flushSnapshot()
+{
+    std::unique_lock<std::mutex> guard(this->snapshotLock);
+
+    const uint64_t requests = this->snapshotsRequested;
+    if (this->snapshotsWritten >= requests)
     {
-        // No rows were returned, so the db can be assumed to be empty.
-        sqlite3_exec(*this->dbConnection, SQLITE_INIT_STMT, nullptr, nullptr, nullptr);
+        return;
     }
+
+    this->snapshotUrgent = true;
+    this->snapshotWake.notify_all();
+    this->snapshotWake.wait(guard, [this, requests] { return this->snapshotsWritten >= requests; });
 }
 
 /**
@@ -126,6 +298,249 @@ const fs::path Library::getMusicFolderPath()
  * Scans through the user's HOME music folder to locate songs in supported 
  * formats and adds them to the database.
  */
-void Library::scanLibrary()
+ScanSummary Library::scanLibrary(const ScanOptions &options)
+{
+    this->waitUntilReady();
+
+    std::lock_guard<std::mutex> guard(this->writerLock);
+    this->loadIDs();
+    const int64_t changesBefore = this->invalidateSnapshot();
+
+    ScanPipeline pipeline(this->statements, this->ids, options, this->scanMetrics, this->coverArt);
+    const ScanSummary summary = pipeline.run(this->userMusicDir);
+
+    this->updateSnapshot(changesBefore);
+    return summary;
+}
+
+ScanProgress Library::getScanProgress()
 {
-}
\ No newline at end of file
+    return this->scanMetrics->snapshot();
+}
+
+TrackTable Library::loadTrackTable()
+{
+    this->waitUntilReady();
+
+    ReaderLease reader = this->connections->acquireReader();
+    return TrackTable::load(reader.getStatements());
+}
+
+std::unique_ptr<LibrarySnapshot> Library::openSnapshot()
+{
+    this->waitUntilReady();
+    this->flushSnapshot();
+
+    std::unique_ptr<LibrarySnapshot> snapshot = LibrarySnapshot::open(this->userDataDir / SNAPSHOT_FILE_NAME);
+    if (snapshot == nullptr)
+    {
+        return nullptr;
+    }
+
+    ReaderLease reader = this->connections->acquireReader();
+    if (snapshot->getGeneration() != LibrarySnapshot::readGeneration(reader.getStatements()))
+    {
+        return nullptr;
+    }
+
+    return snapshot;
+}
+
+TrackCursor Library::queryTracks(const TrackQuery &query)
+{
+    this->waitUntilReady();
+
+    return openTrackCursor(this->connections->acquireReader(), query);
+}
+
+AlbumCursor Library::queryAlbums(const AlbumQuery &query)
+{
+    this->waitUntilReady();
+
+    return openAlbumCursor(this->connections->acquireReader(), query);
+}
+
+ArtistCursor Library::queryArtists(const ArtistQuery &query)
+{
+    this->waitUntilReady();
+
+    return openArtistCursor(this->connections->acquireReader(), query);
+}
+
+DuplicateSummary Library::findDuplicates(const DuplicateOptions &options)
+{
+    this->waitUntilReady();
+
+    DuplicateFinder finder(options);
+
+    {
+        ReaderLease reader = this->connections->acquireReader();
+        finder.load(reader.getStatements());
+    }
+
+    const DuplicateSummary summary = finder.find();
+
+    std::lock_guard<std::mutex> guard(this->writerLock);
+    finder.store(this->statements);
+    return summary;
+}
+
+DuplicateCursor Library::queryDuplicates(const DuplicateQuery &query)
+{
+    this->waitUntilReady();
+
+    return openDuplicateCursor(this->connections->acquireReader(), query);
+}
+
+fs::path Library::getAlbumThumbnail(uint32_t albumID)
+{
+    this->waitUntilReady();
+
+    string coverHash;
+
+    {
+        ReaderLease reader = this->connections->acquireReader();
+        CachedStatement stmt = reader.getStatements()->acquire(ALBUM_COVER_SQL);
+        sqlite3_bind_int(stmt.get(), 1, albumID);
+
+        if (sqlite3_step(stmt.get()) == SQLITE_ROW && sqlite3_column_type(stmt.get(), 0) != SQLITE_NULL)
+        {
+            coverHash = reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 0));
+        }
+    }
+
+    if (coverHash.empty())
+    {
+        return fs::path();
+    }
+
+    return this->coverArt->getThumbnail(coverHash);
+}
+
+void Library::removeTracks(const std::vector<fs::path> &locations)
+{
+    if (locations.empty())
+    {
+        return;
+    }
+
+    sqlite3 *db = *this->connections->getWriter();
+
+    auto fail = [db]() {
+        std::stringstream errStream;
+        errStream << boost::format("Failed to remove tracks: %s") % sqlite3_errmsg(db);
+        return std::runtime_error(errStream.str());
+    };
+
+    if (sqlite3_exec(db, "BEGIN TRANSACTION;", nullptr, nullptr, nullptr) != SQLITE_OK)
+    {
+        throw fail();
+    }
+
+    try
+    {
+        for (const fs::path &location : locations)
+        {
+            const string locationStr = location.string();
+
+            for (const string &sql : {TRACK_DELETE_SQL, COPY_DELETE_SQL})
+            {
+                CachedStatement stmt = this->statements->acquire(sql);
+                sqlite3_bind_text(stmt.get(), 1, locationStr.c_str(), -1, SQLITE_STATIC);
+                if (sqlite3_step(stmt.get()) != SQLITE_DONE)
+                {
+                    throw fail();
+                }
+            }
+
+            // Whether the location was a file or a directory is gone along with it.
+            const string folder = locationStr + '/';
+            const string folderEnd = locationStr + '0';
+
+            for (const string &sql : {FOLDER_DELETE_SQL, FOLDER_COPIES_DELETE_SQL})
+            {
+                CachedStatement stmt = this->statements->acquire(sql);
+                sqlite3_bind_text(stmt.get(), 1, folder.c_str(), -1, SQLITE_STATIC);
+                sqlite3_bind_text(stmt.get(), 2, folderEnd.c_str(), -1, SQLITE_STATIC);
+                if (sqlite3_step(stmt.get()) != SQLITE_DONE)
+                {
+                    throw fail();
+                }
+            }
+        }
+
+        {
+            CachedStatement stmt = this->statements->acquire(ORPHAN_COPIES_DELETE_SQL);
+            if (sqlite3_step(stmt.get()) != SQLITE_DONE)
+            {
+                throw fail();
+            }
+        }
+
+        if (sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK)
+        {
+            throw fail();
+        }
+    }
+    catch (const std::runtime_error &err)
+    {
+        // Nothing is removed unless everything is, so the next batch can try again.
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        throw;
+    }
+}
+
+ScanSummary Library::applyChanges(const WatchBatch &batch, const ScanOptions &options)
+{
+    if (batch.overflowed)
+    {
+        // Some changes were lost, so only a full scan can be trusted.
+        return this->scanLibrary(options);
+    }
+
+    this->waitUntilReady();
+
+    std::lock_guard<std::mutex> guard(this->writerLock);
+    this->loadIDs();
+    const int64_t changesBefore = this->invalidateSnapshot();
+
+    this->removeTracks(batch.removed);
+
+    ScanSummary summary;
+    if (!batch.changed.empty())
+    {
+        ScanPipeline pipeline(this->statements, this->ids, options, this->scanMetrics, this->coverArt);
+        summary = pipeline.run(batch.changed);
+    }
+
+    this->updateSnapshot(changesBefore);
+    return summary;
+}
+
+void Library::startWatching(const ScanOptions &options, const WatchOptions &watchOptions,
+                            const std::function<void(const ScanSummary &)> &onUpdate)
+{
+    this->waitUntilReady();
+    this->stopWatching();
+
+    // The watch covers the same directories as a full scan.
+    WatchOptions filteredOptions = watchOptions;
+    filteredOptions.excludedDirectories = options.excludedDirectories;
+    filteredOptions.skipHiddenDirectories = options.skipHiddenDirectories;
+
+    this->watcher = std::make_unique<DirectoryWatcher>(
+        this->userMusicDir,
+        [this, options, onUpdate](WatchBatch &&batch) {
+            ScanSummary summary = this->applyChanges(batch, options);
+            if (onUpdate)
+            {
+                onUpdate(summary);
+            }
+        },
+        filteredOptions);
+}
+
+void Library::stopWatching()
+{
+    this->watcher.reset();
+}
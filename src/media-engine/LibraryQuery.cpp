@@ -0,0 +1,415 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <sstream>
+#include <stdexcept>
+
+// Utility libs
+#include <boost/format.hpp>
+
+// Local includes
+#include "LibraryQuery.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace
+{
+using Columns = std::vector<const char *>;
+
+const char TRACK_COLUMNS[] = "SELECT Tracks.ID, Tracks.Title, Tracks.FileLocation, Tracks.TrackNum, Tracks.DiscNum, "
+                             "Tracks.Genre, Tracks.Album, Albums.Name, Albums.Artist, Artists.Name";
+const char TRACK_SOURCE[] = "FROM Tracks LEFT JOIN Albums ON Albums.ID == Tracks.Album "
+                            "LEFT JOIN Artists ON Artists.ID == Albums.Artist";
+
+const char ALBUM_COLUMNS[] = "SELECT Albums.ID, Albums.Name, Albums.Artist, Artists.Name, Albums.CoverHash";
+const char ALBUM_SOURCE[] = "FROM Albums LEFT JOIN Artists ON Artists.ID == Albums.Artist";
+
+const char ARTIST_COLUMNS[] = "SELECT Artists.ID, Artists.Name";
+const char ARTIST_SOURCE[] = "FROM Artists";
+
+/**
+ * Columns that order each query, ending with a unique one so every row has a distinct
+ * key. Each list matches an index (or the table itself), so rows come out in order
+ * without a sort.
+ */
+Columns trackKey(TrackOrder order)
+{
+    switch (order)
+    {
+    case TrackOrder::title:
+        return {"Tracks.Title", "Tracks.ID"};
+    case TrackOrder::location:
+        return {"Tracks.FileLocation"};
+    case TrackOrder::album:
+        return {"Tracks.Album", "Tracks.DiscNum", "Tracks.TrackNum", "Tracks.Title", "Tracks.ID"};
+    default:
+        return {"Tracks.ID"};
+    }
+}
+
+Columns albumKey(AlbumOrder order)
+{
+    if (order == AlbumOrder::name)
+    {
+        return {"Albums.Name", "Albums.Artist", "Albums.ID"};
+    }
+
+    return {"Albums.ID"};
+}
+
+Columns artistKey(ArtistOrder order)
+{
+    if (order == ArtistOrder::name)
+    {
+        return {"Artists.Name"};
+    }
+
+    return {"Artists.ID"};
+}
+
+/**
+ * Assembles a query from its parts. The key columns are selected again after the
+ * row's own columns so the cursor can read the key back.
+ */
+string assembleQuery(const char *columns, const char *source, std::vector<string> conditions, const Columns &key,
+                     bool descending, bool hasAfter, bool hasLimit)
+{
+    std::stringstream sql;
+    sql << columns;
+    for (const char *column : key)
+    {
+        sql << ", " << column;
+    }
+    sql << " " << source;
+
+    if (hasAfter)
+    {
+        // A row value comparison, which SQLite turns into a range on the ordering's index.
+        std::stringstream range;
+        range << "(";
+        for (size_t i = 0; i < key.size(); i++)
+        {
+            range << (i > 0 ? ", " : "") << key[i];
+        }
+        range << (descending ? ") < (" : ") > (");
+        for (size_t i = 0; i < key.size(); i++)
+        {
+            range << (i > 0 ? ", " : "") << "@key" << i;
+        }
+        range << ")";
+        conditions.push_back(range.str());
+    }
+
+    for (size_t i = 0; i < conditions.size(); i++)
+    {
+        sql << (i == 0 ? " WHERE " : " AND ") << conditions[i];
+    }
+
+    sql << " ORDER BY ";
+    for (size_t i = 0; i < key.size(); i++)
+    {
+        sql << (i > 0 ? ", " : "") << key[i] << (descending ? " DESC" : "");
+    }
+
+    if (hasLimit)
+    {
+        sql << " LIMIT @limit";
+    }
+
+    sql << ";";
+    return sql.str();
+}
+
+/**
+ * Adds the bounds of a prefix match. A range rather than LIKE, which cannot use an index.
+ */
+void addPrefix(std::vector<string> &conditions, const char *column, const string &prefix)
+{
+    if (!prefix.empty())
+    {
+        conditions.push_back(string(column) + " >= @prefix AND " + column + " < @prefixEnd");
+    }
+}
+
+void bindInt(sqlite3_stmt *stmt, const char *name, int64_t value)
+{
+    const int index = sqlite3_bind_parameter_index(stmt, name);
+    if (index > 0)
+    {
+        sqlite3_bind_int64(stmt, index, value);
+    }
+}
+
+void bindText(sqlite3_stmt *stmt, const char *name, const string &value)
+{
+    const int index = sqlite3_bind_parameter_index(stmt, name);
+    if (index > 0)
+    {
+        sqlite3_bind_text(stmt, index, value.c_str(), static_cast<int>(value.size()), SQLITE_TRANSIENT);
+    }
+}
+
+/**
+ * Binds the parameters every query shares: the prefix, the key to start after and the limit.
+ */
+void bindCommon(sqlite3_stmt *stmt, const string &prefix, const CursorKey &after, uint32_t limit)
+{
+    if (!prefix.empty())
+    {
+        bindText(stmt, "@prefix", prefix);
+        // 0xFF never appears in UTF-8, so every string starting with the prefix sorts before this.
+        bindText(stmt, "@prefixEnd", prefix + '\xff');
+    }
+
+    for (size_t i = 0; i < after.values.size(); i++)
+    {
+        const string name = "@key" + std::to_string(i);
+        const KeyValue &value = after.values[i];
+
+        if (value.isText)
+        {
+            bindText(stmt, name.c_str(), value.text);
+        }
+        else
+        {
+            bindInt(stmt, name.c_str(), value.integer);
+        }
+    }
+
+    bindInt(stmt, "@limit", limit);
+}
+
+/**
+ * Checks a key was taken from a query with the same order, which has as many key columns.
+ */
+void checkKey(const CursorKey &after, const Columns &key)
+{
+    if (!after.empty() && after.values.size() != key.size())
+    {
+        throw std::invalid_argument("Cursor key does not belong to a query with this order.");
+    }
+}
+} // namespace
+
+bool CursorKey::empty() const
+{
+    return this->values.empty();
+}
+
+QueryCursor::QueryCursor(ReaderLease &&reader, const string &sql, int keyCount)
+    : reader(std::move(reader)), stmt(this->reader.getStatements()->acquire(sql)), keyCount(keyCount)
+{
+    this->keyColumn = sqlite3_column_count(this->stmt.get()) - keyCount;
+}
+
+sqlite3_stmt *QueryCursor::get()
+{
+    return this->stmt.get();
+}
+
+bool QueryCursor::step()
+{
+    const int result = sqlite3_step(this->stmt.get());
+
+    if (result == SQLITE_ROW)
+    {
+        return true;
+    }
+
+    if (result == SQLITE_DONE)
+    {
+        return false;
+    }
+
+    std::stringstream errStream;
+    errStream << boost::format("Failed to read query results: %s") % sqlite3_errmsg(sqlite3_db_handle(this->stmt.get()));
+    throw std::runtime_error(errStream.str());
+}
+
+int64_t QueryCursor::integer(int column)
+{
+    return sqlite3_column_int64(this->stmt.get(), column);
+}
+
+string_view QueryCursor::text(int column)
+{
+    // The text must be fetched before its length, which may convert it.
+    const char *text = reinterpret_cast<const char *>(sqlite3_column_text(this->stmt.get(), column));
+    if (text == nullptr)
+    {
+        return string_view();
+    }
+
+    return string_view(text, static_cast<size_t>(sqlite3_column_bytes(this->stmt.get(), column)));
+}
+
+CursorKey QueryCursor::key()
+{
+    CursorKey key;
+    key.values.resize(this->keyCount);
+
+    for (int i = 0; i < this->keyCount; i++)
+    {
+        const int column = this->keyColumn + i;
+        KeyValue &value = key.values[i];
+
+        value.isText = sqlite3_column_type(this->stmt.get(), column) == SQLITE_TEXT;
+        if (value.isText)
+        {
+            value.text = string(this->text(column));
+        }
+        else
+        {
+            value.integer = this->integer(column);
+        }
+    }
+
+    return key;
+}
+
+template <>
+bool TrackCursor::next()
+{
+    if (!this->query.step())
+    {
+        return false;
+    }
+
+    this->current.id = static_cast<uint32_t>(this->query.integer(0));
+    this->current.title = this->query.text(1);
+    this->current.location = this->query.text(2);
+    this->current.trackNum = static_cast<uint8_t>(this->query.integer(3));
+    this->current.discNum = static_cast<uint8_t>(this->query.integer(4));
+    this->current.genre = this->query.text(5);
+    this->current.albumID = static_cast<uint32_t>(this->query.integer(6));
+    this->current.album = this->query.text(7);
+    this->current.artistID = static_cast<uint32_t>(this->query.integer(8));
+    this->current.artist = this->query.text(9);
+
+    return true;
+}
+
+template <>
+bool AlbumCursor::next()
+{
+    if (!this->query.step())
+    {
+        return false;
+    }
+
+    this->current.id = static_cast<uint32_t>(this->query.integer(0));
+    this->current.name = this->query.text(1);
+    this->current.artistID = static_cast<uint32_t>(this->query.integer(2));
+    this->current.artist = this->query.text(3);
+    this->current.coverHash = this->query.text(4);
+
+    return true;
+}
+
+template <>
+bool ArtistCursor::next()
+{
+    if (!this->query.step())
+    {
+        return false;
+    }
+
+    this->current.id = static_cast<uint32_t>(this->query.integer(0));
+    this->current.name = this->query.text(1);
+
+    return true;
+}
+
+string Mellophone::MediaEngine::buildTrackQuery(const TrackQuery &query)
+{
+    std::vector<string> conditions;
+
+    if (query.albumID != 0)
+    {
+        conditions.push_back("Tracks.Album == @album");
+    }
+
+    if (query.artistID != 0)
+    {
+        conditions.push_back("Albums.Artist == @artist");
+    }
+
+    addPrefix(conditions, "Tracks.Title", query.titlePrefix);
+
+    return assembleQuery(TRACK_COLUMNS, TRACK_SOURCE, conditions, trackKey(query.order), query.descending,
+                         !query.after.empty(), query.limit > 0);
+}
+
+string Mellophone::MediaEngine::buildAlbumQuery(const AlbumQuery &query)
+{
+    std::vector<string> conditions;
+
+    if (query.artistID != 0)
+    {
+        conditions.push_back("Albums.Artist == @artist");
+    }
+
+    addPrefix(conditions, "Albums.Name", query.namePrefix);
+
+    return assembleQuery(ALBUM_COLUMNS, ALBUM_SOURCE, conditions, albumKey(query.order), query.descending,
+                         !query.after.empty(), query.limit > 0);
+}
+
+string Mellophone::MediaEngine::buildArtistQuery(const ArtistQuery &query)
+{
+    std::vector<string> conditions;
+    addPrefix(conditions, "Artists.Name", query.namePrefix);
+
+    return assembleQuery(ARTIST_COLUMNS, ARTIST_SOURCE, conditions, artistKey(query.order), query.descending,
+                         !query.after.empty(), query.limit > 0);
+}
+
+TrackCursor Mellophone::MediaEngine::openTrackCursor(ReaderLease &&reader, const TrackQuery &query)
+{
+    const Columns key = trackKey(query.order);
+    checkKey(query.after, key);
+
+    QueryCursor cursor(std::move(reader), buildTrackQuery(query), static_cast<int>(key.size()));
+    bindInt(cursor.get(), "@album", query.albumID);
+    bindInt(cursor.get(), "@artist", query.artistID);
+    bindCommon(cursor.get(), query.titlePrefix, query.after, query.limit);
+
+    return TrackCursor(std::move(cursor));
+}
+
+AlbumCursor Mellophone::MediaEngine::openAlbumCursor(ReaderLease &&reader, const AlbumQuery &query)
+{
+    const Columns key = albumKey(query.order);
+    checkKey(query.after, key);
+
+    QueryCursor cursor(std::move(reader), buildAlbumQuery(query), static_cast<int>(key.size()));
+    bindInt(cursor.get(), "@artist", query.artistID);
+    bindCommon(cursor.get(), query.namePrefix, query.after, query.limit);
+
+    return AlbumCursor(std::move(cursor));
+}
+
+ArtistCursor Mellophone::MediaEngine::openArtistCursor(ReaderLease &&reader, const ArtistQuery &query)
+{
+    const Columns key = artistKey(query.order);
+    checkKey(query.after, key);
+
+    QueryCursor cursor(std::move(reader), buildArtistQuery(query), static_cast<int>(key.size()));
+    bindCommon(cursor.get(), query.namePrefix, query.after, query.limit);
+
+    return ArtistCursor(std::move(cursor));
+}
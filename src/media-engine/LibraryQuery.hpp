@@ -0,0 +1,276 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "ConnectionPool.hpp"
+#include "StatementCache.hpp"
+
+using std::string;
+using std::string_view;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+/**
+ * One column of a row's position in its ordering.
+ */
+struct KeyValue
+{
+    bool isText = false;
+    int64_t integer = 0;
+    string text;
+};
+
+/**
+ * Position of a row in a query's ordering. Passing the key of the last row of a page
+ * as the next query's `after` continues from the row after it, however far into the
+ * results it is, without the cost of skipping rows that OFFSET has.
+ *
+ * A key is only meaningful to a query with the same order.
+ */
+struct CursorKey
+{
+    std::vector<KeyValue> values;
+
+    bool empty() const;
+};
+
+enum class TrackOrder
+{
+    id,
+    // Title, then ID.
+    title,
+    // File location.
+    location,
+    // Album, then disc and track number: each album in play order.
+    album
+};
+
+enum class AlbumOrder
+{
+    id,
+    // Name, then artist ID and album ID.
+    name
+};
+
+enum class ArtistOrder
+{
+    id,
+    name
+};
+
+/**
+ * Filters, order and page of a track query. Zero IDs and empty prefixes match everything.
+ */
+struct TrackQuery
+{
+    uint32_t albumID = 0;
+    uint32_t artistID = 0;
+    // Only tracks whose title starts with these bytes.
+    string titlePrefix;
+
+    TrackOrder order = TrackOrder::title;
+    bool descending = false;
+
+    // Start after this row. Empty to start at the first.
+    CursorKey after;
+    // Maximum number of rows, or 0 for every row.
+    uint32_t limit = 0;
+};
+
+struct AlbumQuery
+{
+    uint32_t artistID = 0;
+    string namePrefix;
+
+    AlbumOrder order = AlbumOrder::name;
+    bool descending = false;
+
+    CursorKey after;
+    uint32_t limit = 0;
+};
+
+struct ArtistQuery
+{
+    string namePrefix;
+
+    ArtistOrder order = ArtistOrder::name;
+    bool descending = false;
+
+    CursorKey after;
+    uint32_t limit = 0;
+};
+
+/**
+ * A track row. The views point into SQLite's copy of the row and are only valid until
+ * the cursor moves.
+ */
+struct TrackView
+{
+    uint32_t id = 0;
+    string_view title;
+    string_view location;
+    uint8_t trackNum = 0;
+    uint8_t discNum = 0;
+    string_view genre;
+    uint32_t albumID = 0;
+    string_view album;
+    uint32_t artistID = 0;
+    string_view artist;
+};
+
+struct AlbumView
+{
+    uint32_t id = 0;
+    string_view name;
+    uint32_t artistID = 0;
+    string_view artist;
+    // Hash of the album's cover art in the cover art cache, or empty.
+    string_view coverHash;
+};
+
+struct ArtistView
+{
+    uint32_t id = 0;
+    string_view name;
+};
+
+/**
+ * A running query on a borrowed read connection.
+ *
+ * Rows are stepped one at a time and read in place, so iterating a whole library
+ * allocates nothing per row. The connection is returned to its pool when the cursor
+ * is destroyed.
+ */
+class QueryCursor
+{
+private:
+    ReaderLease reader;
+    CachedStatement stmt;
+    // Columns at the end of each row holding its key.
+    int keyColumn;
+    int keyCount;
+
+public:
+    /**
+     * @param reader connection to run the query on
+     * @param sql query whose last `keyCount` columns are the row's key
+     * @param keyCount number of key columns
+     */
+    QueryCursor(ReaderLease &&reader, const string &sql, int keyCount);
+
+    QueryCursor(QueryCursor &&other) = default;
+
+    /**
+     * Returns the statement, for binding parameters before the first step.
+     */
+    sqlite3_stmt *get();
+
+    /**
+     * Moves to the next row.
+     *
+     * @returns false once the rows run out.
+     */
+    bool step();
+
+    int64_t integer(int column);
+
+    /**
+     * Returns a column as text, without copying it. Empty for NULL.
+     */
+    string_view text(int column);
+
+    /**
+     * Copies the current row's key.
+     */
+    CursorKey key();
+};
+
+/**
+ * Typed cursor over the rows of a query.
+ */
+template <typename View>
+class RowCursor
+{
+private:
+    QueryCursor query;
+    View current;
+
+public:
+    explicit RowCursor(QueryCursor &&query) : query(std::move(query))
+    {
+    }
+
+    /**
+     * Moves to the next row.
+     *
+     * @returns false once the rows run out.
+     */
+    bool next();
+
+    /**
+     * Returns the current row. Its views are valid until the next call to next().
+     */
+    const View &row() const
+    {
+        return this->current;
+    }
+
+    /**
+     * Copies the current row's key, to continue after it with another query.
+     */
+    CursorKey key()
+    {
+        return this->query.key();
+    }
+};
+
+using TrackCursor = RowCursor<TrackView>;
+using AlbumCursor = RowCursor<AlbumView>;
+using ArtistCursor = RowCursor<ArtistView>;
+
+template <>
+bool TrackCursor::next();
+template <>
+bool AlbumCursor::next();
+template <>
+bool ArtistCursor::next();
+
+/**
+ * Builds the SQL of a query. The same filters and order always give the same text,
+ * so each combination is prepared once per connection.
+ */
+string buildTrackQuery(const TrackQuery &query);
+string buildAlbumQuery(const AlbumQuery &query);
+string buildArtistQuery(const ArtistQuery &query);
+
+/**
+ * Starts a query on a read connection.
+ */
+TrackCursor openTrackCursor(ReaderLease &&reader, const TrackQuery &query);
+AlbumCursor openAlbumCursor(ReaderLease &&reader, const AlbumQuery &query);
+ArtistCursor openArtistCursor(ReaderLease &&reader, const ArtistQuery &query);
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -0,0 +1,446 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+// System libs
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Utility libs
+#include <boost/format.hpp>
+
+// Local includes
+#include "LibrarySnapshot.hpp"
+#include "TrackTable.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace
+{
+const char SNAPSHOT_MAGIC[8] = {'M', 'E', 'L', 'L', 'S', 'N', 'A', 'P'};
+
+// Bumped whenever the layout of the file changes. Older files are then ignored and rewritten.
+const uint32_t SNAPSHOT_FORMAT_VERSION = 1;
+
+/**
+ * An array of fixed-size entries within the file.
+ */
+struct Section
+{
+    uint64_t offset;
+    uint64_t count;
+};
+
+uint64_t alignSection(uint64_t offset)
+{
+    return (offset + 7) & ~uint64_t(7);
+}
+
+/**
+ * Checks a section lies within the file and is aligned for its entries.
+ */
+bool fits(const Section &section, size_t entrySize, size_t entryAlignment, size_t fileSize)
+{
+    return section.offset % entryAlignment == 0 && section.offset <= fileSize &&
+           section.count <= (fileSize - section.offset) / entrySize;
+}
+
+/**
+ * Flushes a file's contents to the disk.
+ */
+void syncFile(const fs::path &location)
+{
+    const int fd = open(location.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0 || fsync(fd) != 0)
+    {
+        const int error = errno;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        std::stringstream errStream;
+        errStream << boost::format("Unable to flush the library snapshot '%s': %s") % location.string() %
+                         std::strerror(error);
+        throw std::runtime_error(errStream.str());
+    }
+
+    close(fd);
+}
+} // namespace
+
+struct LibrarySnapshot::Header
+{
+    char magic[8];
+    uint32_t formatVersion;
+    uint32_t reserved;
+    uint64_t generation;
+    // Checked against the file's size, which catches a file cut short.
+    uint64_t fileSize;
+
+    Section tracks;
+    Section albums;
+    Section artists;
+    // End of each string in `chars`. String 0 is always the empty string.
+    Section stringEnds;
+    Section chars;
+};
+
+// Text fields are indexes into the string table.
+struct LibrarySnapshot::Track
+{
+    uint32_t id;
+    uint32_t albumID;
+    uint32_t artistID;
+    uint32_t title;
+    uint32_t location;
+    uint32_t genre;
+    uint32_t album;
+    uint32_t artist;
+    uint8_t trackNum;
+    uint8_t discNum;
+    uint8_t padding[2];
+};
+
+struct LibrarySnapshot::Album
+{
+    uint32_t id;
+    uint32_t artistID;
+    uint32_t name;
+    uint32_t artist;
+    uint32_t coverHash;
+};
+
+struct LibrarySnapshot::Artist
+{
+    uint32_t id;
+    uint32_t name;
+};
+
+std::unique_ptr<LibrarySnapshot> LibrarySnapshot::open(const fs::path &location)
+{
+    const int fd = ::open(location.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(Header))
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    const size_t fileSize = static_cast<size_t>(info.st_size);
+    void *mapping = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<LibrarySnapshot> snapshot(new LibrarySnapshot());
+    snapshot->mapping = mapping;
+    snapshot->mappingSize = fileSize;
+
+    const Header *header = static_cast<const Header *>(mapping);
+    if (std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        header->formatVersion != SNAPSHOT_FORMAT_VERSION || header->fileSize != fileSize ||
+        !fits(header->tracks, sizeof(Track), alignof(Track), fileSize) ||
+        !fits(header->albums, sizeof(Album), alignof(Album), fileSize) ||
+        !fits(header->artists, sizeof(Artist), alignof(Artist), fileSize) ||
+        !fits(header->stringEnds, sizeof(uint32_t), alignof(uint32_t), fileSize) ||
+        !fits(header->chars, 1, 1, fileSize) || header->stringEnds.count == 0)
+    {
+        return nullptr;
+    }
+
+    // Only the header is checked up front, so opening never touches the rest of the file.
+    // Row indexes are the caller's to keep in range; string indexes are checked on use.
+    const char *base = static_cast<const char *>(mapping);
+    snapshot->header = header;
+    snapshot->tracks = reinterpret_cast<const Track *>(base + header->tracks.offset);
+    snapshot->albums = reinterpret_cast<const Album *>(base + header->albums.offset);
+    snapshot->artists = reinterpret_cast<const Artist *>(base + header->artists.offset);
+    snapshot->stringEnds = reinterpret_cast<const uint32_t *>(base + header->stringEnds.offset);
+    snapshot->chars = base + header->chars.offset;
+
+    return snapshot;
+}
+
+void LibrarySnapshot::write(const fs::path &location, const shared_ptr<StatementCache> &statements)
+{
+    // Strings shared by many rows, such as album and artist names, are stored once.
+    StringPool strings;
+    std::vector<Track> tracks;
+    std::vector<Album> albums;
+    std::vector<Artist> artists;
+
+    // The rows are read in one transaction, so a writer running alongside cannot mix two
+    // generations into the snapshot.
+    sqlite3 *db = *statements->getConnection();
+    const bool ownTransaction = sqlite3_get_autocommit(db) != 0;
+    if (ownTransaction && sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr) != SQLITE_OK)
+    {
+        std::stringstream errStream;
+        errStream << boost::format("Failed to read the library for its snapshot: %s") % sqlite3_errmsg(db);
+        throw std::runtime_error(errStream.str());
+    }
+
+    uint64_t generation = 0;
+
+    try
+    {
+        generation = LibrarySnapshot::readGeneration(statements);
+
+        {
+            TrackCursor cursor = openTrackCursor(ReaderLease(nullptr, statements), TrackQuery());
+            while (cursor.next())
+            {
+                const TrackView &row = cursor.row();
+                tracks.push_back({row.id, row.albumID, row.artistID, strings.intern(row.title),
+                                  strings.intern(row.location), strings.intern(row.genre), strings.intern(row.album),
+                                  strings.intern(row.artist), row.trackNum, row.discNum, {0, 0}});
+            }
+        }
+
+        {
+            AlbumCursor cursor = openAlbumCursor(ReaderLease(nullptr, statements), AlbumQuery());
+            while (cursor.next())
+            {
+                const AlbumView &row = cursor.row();
+                albums.push_back({row.id, row.artistID, strings.intern(row.name), strings.intern(row.artist),
+                                  strings.intern(row.coverHash)});
+            }
+        }
+
+        {
+            ArtistCursor cursor = openArtistCursor(ReaderLease(nullptr, statements), ArtistQuery());
+            while (cursor.next())
+            {
+                const ArtistView &row = cursor.row();
+                artists.push_back({row.id, strings.intern(row.name)});
+            }
+        }
+    }
+    catch (const std::exception &err)
+    {
+        if (ownTransaction)
+        {
+            sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        }
+        throw;
+    }
+
+    if (ownTransaction)
+    {
+        sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+    }
+
+    std::vector<uint32_t> stringEnds(strings.size());
+    uint64_t charCount = 0;
+    for (uint32_t i = 0; i < strings.size(); i++)
+    {
+        charCount += strings.get(i).size();
+        if (charCount > UINT32_MAX)
+        {
+            throw std::runtime_error("Library snapshot text exceeds 4 GiB.");
+        }
+        stringEnds[i] = static_cast<uint32_t>(charCount);
+    }
+
+    Header header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.formatVersion = SNAPSHOT_FORMAT_VERSION;
+    header.generation = generation;
+
+    uint64_t offset = alignSection(sizeof(Header));
+    auto place = [&offset](Section &section, uint64_t count, size_t entrySize) {
+        section = {offset, count};
+        offset = alignSection(offset + count * entrySize);
+    };
+    place(header.tracks, tracks.size(), sizeof(Track));
+    place(header.albums, albums.size(), sizeof(Album));
+    place(header.artists, artists.size(), sizeof(Artist));
+    place(header.stringEnds, stringEnds.size(), sizeof(uint32_t));
+    place(header.chars, charCount, 1);
+    header.fileSize = offset;
+
+    fs::path temporary = location;
+    temporary += ".tmp" + std::to_string(getpid());
+
+    try
+    {
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            uint64_t written = 0;
+            auto append = [&out, &written](const void *data, uint64_t length) {
+                out.write(static_cast<const char *>(data), length);
+                written += length;
+            };
+            auto pad = [&out, &written](const Section &section) {
+                static const char zeros[8] = {};
+                out.write(zeros, section.offset - written);
+                written = section.offset;
+            };
+
+            append(&header, sizeof(Header));
+            pad(header.tracks);
+            append(tracks.data(), tracks.size() * sizeof(Track));
+            pad(header.albums);
+            append(albums.data(), albums.size() * sizeof(Album));
+            pad(header.artists);
+            append(artists.data(), artists.size() * sizeof(Artist));
+            pad(header.stringEnds);
+            append(stringEnds.data(), stringEnds.size() * sizeof(uint32_t));
+            pad(header.chars);
+            for (uint32_t i = 0; i < strings.size(); i++)
+            {
+                append(strings.get(i).data(), strings.get(i).size());
+            }
+            pad({header.fileSize, 0});
+
+            // Closed here so a failure to flush the last of the file is caught too.
+            out.close();
+            if (!out)
+            {
+                std::stringstream errStream;
+                errStream << boost::format("Unable to write the library snapshot '%s'.") % temporary;
+                throw std::runtime_error(errStream.str());
+            }
+        }
+
+        // Flushed before the rename, or a crash could leave a partly written file under the final name.
+        syncFile(temporary);
+        fs::rename(temporary, location);
+    }
+    catch (...)
+    {
+        std::error_code ignored;
+        fs::remove(temporary, ignored);
+        throw;
+    }
+}
+
+uint64_t LibrarySnapshot::readGeneration(const shared_ptr<StatementCache> &statements)
+{
+    CachedStatement stmt = statements->acquire(GENERATION_SQL);
+
+    if (sqlite3_step(stmt.get()) != SQLITE_ROW)
+    {
+        std::stringstream errStream;
+        errStream << boost::format("Failed to read the library generation: %s") %
+                         sqlite3_errmsg(*statements->getConnection());
+        throw std::runtime_error(errStream.str());
+    }
+
+    return static_cast<uint64_t>(sqlite3_column_int64(stmt.get(), 0));
+}
+
+LibrarySnapshot::~LibrarySnapshot()
+{
+    munmap(this->mapping, this->mappingSize);
+}
+
+string_view LibrarySnapshot::text(uint32_t index) const
+{
+    if (index >= this->header->stringEnds.count)
+    {
+        return string_view();
+    }
+
+    const uint32_t start = index == 0 ? 0 : this->stringEnds[index - 1];
+    const uint32_t end = this->stringEnds[index];
+    if (start > end || end > this->header->chars.count)
+    {
+        return string_view();
+    }
+
+    return string_view(this->chars + start, end - start);
+}
+
+uint64_t LibrarySnapshot::getGeneration() const
+{
+    return this->header->generation;
+}
+
+size_t LibrarySnapshot::trackCount() const
+{
+    return this->header->tracks.count;
+}
+
+size_t LibrarySnapshot::albumCount() const
+{
+    return this->header->albums.count;
+}
+
+size_t LibrarySnapshot::artistCount() const
+{
+    return this->header->artists.count;
+}
+
+TrackView LibrarySnapshot::track(size_t row) const
+{
+    const Track &track = this->tracks[row];
+
+    TrackView view;
+    view.id = track.id;
+    view.title = this->text(track.title);
+    view.location = this->text(track.location);
+    view.trackNum = track.trackNum;
+    view.discNum = track.discNum;
+    view.genre = this->text(track.genre);
+    view.albumID = track.albumID;
+    view.album = this->text(track.album);
+    view.artistID = track.artistID;
+    view.artist = this->text(track.artist);
+    return view;
+}
+
+AlbumView LibrarySnapshot::album(size_t row) const
+{
+    const Album &album = this->albums[row];
+
+    AlbumView view;
+    view.id = album.id;
+    view.name = this->text(album.name);
+    view.artistID = album.artistID;
+    view.artist = this->text(album.artist);
+    view.coverHash = this->text(album.coverHash);
+    return view;
+}
+
+ArtistView LibrarySnapshot::artist(size_t row) const
+{
+    const Artist &artist = this->artists[row];
+
+    ArtistView view;
+    view.id = artist.id;
+    view.name = this->text(artist.name);
+    return view;
+}
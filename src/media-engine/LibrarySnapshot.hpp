@@ -0,0 +1,130 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "LibraryQuery.hpp"
+#include "StatementCache.hpp"
+
+namespace fs = std::filesystem;
+
+using std::string;
+using std::string_view;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+static const string SNAPSHOT_FILE_NAME = "media_library.snapshot";
+
+static const string GENERATION_SQL = "SELECT Generation FROM LibraryState;";
+static const string GENERATION_BUMP_SQL = "UPDATE LibraryState SET Generation = Generation + 1;";
+static const string GENERATION_SET_SQL = "UPDATE LibraryState SET Generation = @generation;";
+
+/**
+ * Read-only copy of the track, album and artist tables in a single file, mapped into
+ * memory instead of read, so a library can be browsed as soon as the file is opened.
+ *
+ * The file holds fixed-size records that refer to each other by ID and to their text by
+ * an index into a table of distinct strings, so it is used in place without being
+ * parsed. Tracks, albums and artists are stored in the default order of their queries:
+ * by title, by name and by name.
+ *
+ * A snapshot records the database's generation, which the library bumps before every
+ * change; one whose generation no longer matches the database is out of date.
+ */
+class LibrarySnapshot
+{
+private:
+    struct Header;
+    struct Track;
+    struct Album;
+    struct Artist;
+
+    void *mapping = nullptr;
+    size_t mappingSize = 0;
+
+    const Header *header = nullptr;
+    const Track *tracks = nullptr;
+    const Album *albums = nullptr;
+    const Artist *artists = nullptr;
+    const uint32_t *stringEnds = nullptr;
+    const char *chars = nullptr;
+
+    LibrarySnapshot() = default;
+
+    /**
+     * Returns the string with the given index, or an empty view if the index is out of range.
+     */
+    string_view text(uint32_t index) const;
+
+public:
+    /**
+     * Maps a snapshot file.
+     *
+     * @param location snapshot file
+     *
+     * @returns the snapshot, or null if the file is missing, truncated or of another format.
+     */
+    static std::unique_ptr<LibrarySnapshot> open(const fs::path &location);
+
+    /**
+     * Writes a snapshot of the database, replacing the file at `location` in one step, so
+     * a snapshot that is mapped elsewhere is never changed under it. The new file is on the
+     * disk before it replaces the old one; if the write fails, the old one is left as it was.
+     * The database is read in a single transaction, so the connection need not be the
+     * writer's.
+     *
+     * @param location snapshot file
+     * @param statements statement cache of the connection to read from
+     */
+    static void write(const fs::path &location, const shared_ptr<StatementCache> &statements);
+
+    /**
+     * Reads the current generation of the database.
+     */
+    static uint64_t readGeneration(const shared_ptr<StatementCache> &statements);
+
+    ~LibrarySnapshot();
+
+    LibrarySnapshot(const LibrarySnapshot &) = delete;
+    LibrarySnapshot &operator=(const LibrarySnapshot &) = delete;
+
+    /**
+     * Returns the generation of the database the snapshot was taken from.
+     */
+    uint64_t getGeneration() const;
+
+    size_t trackCount() const;
+    size_t albumCount() const;
+    size_t artistCount() const;
+
+    /**
+     * Returns a row of a table. The views point into the mapped file and are valid for
+     * the lifetime of the snapshot.
+     */
+    TrackView track(size_t row) const;
+    AlbumView album(size_t row) const;
+    ArtistView artist(size_t row) const;
+};
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -0,0 +1,341 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+// System libs
+#include <fcntl.h>
+#include <unistd.h>
+
+// Utility libs
+#include <boost/format.hpp>
+
+// Local includes
+#include "OggVorbisMetadata.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace
+{
+const size_t PAGE_HEADER_LENGTH = 27;
+const uint8_t BEGINNING_OF_STREAM = 0x02;
+
+const size_t IDENTIFICATION_LENGTH = 30;
+const size_t PACKET_SIGNATURE_LENGTH = 7;
+
+// Same bound as a FLAC metadata block; anything larger is taken to be corrupt.
+const size_t MAX_COMMENT_LENGTH = 16 * 1024 * 1024;
+
+/**
+ * Closes a file descriptor when it goes out of scope.
+ */
+struct FileHandle
+{
+    int fd;
+
+    ~FileHandle()
+    {
+        if (this->fd >= 0)
+        {
+            close(this->fd);
+        }
+    }
+};
+
+uint32_t readUInt32(const uint8_t *data)
+{
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+           (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+bool hasSignature(const char *packet, size_t length, char type)
+{
+    return length >= PACKET_SIGNATURE_LENGTH && packet[0] == type && memcmp(packet + 1, "vorbis", 6) == 0;
+}
+
+[[noreturn]] void throwMalformed(const char *what)
+{
+    std::stringstream errStream;
+    errStream << boost::format("Malformed Ogg Vorbis headers: %s") % what;
+    throw std::runtime_error(errStream.str());
+}
+} // namespace
+
+OggVorbisMetadata OggVorbisMetadata::read(const fs::path &filePath)
+{
+    OggVorbisParser parser;
+    return OggVorbisMetadata::read(filePath, parser);
+}
+
+OggVorbisMetadata OggVorbisMetadata::read(const fs::path &filePath, OggVorbisParser &parser)
+{
+    if (parser.isFinished())
+    {
+        return parser.finish();
+    }
+
+    FileHandle file{open(filePath.c_str(), O_RDONLY | O_CLOEXEC)};
+
+    if (file.fd < 0)
+    {
+        std::stringstream errStream;
+        errStream << boost::format("Unable to open '%s' to read metadata: %s") % filePath % strerror(errno);
+        throw std::runtime_error(errStream.str());
+    }
+
+    thread_local std::vector<uint8_t> buffer(OGG_HEAD_READ_SIZE);
+
+    while (!parser.isFinished())
+    {
+        const uint64_t offset = parser.nextOffset();
+        ssize_t bytesRead = pread(file.fd, buffer.data(), buffer.size(), static_cast<off_t>(offset));
+
+        if (bytesRead < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (bytesRead < 0)
+        {
+            std::stringstream errStream;
+            errStream << boost::format("Unable to read metadata from '%s': %s") % filePath % strerror(errno);
+            throw std::runtime_error(errStream.str());
+        }
+
+        if (bytesRead == 0)
+        {
+            throw std::runtime_error("Failed to locate Vorbis headers in Ogg file.");
+        }
+
+        parser.feed(offset, buffer.data(), static_cast<size_t>(bytesRead));
+    }
+
+    return parser.finish();
+}
+
+OggVorbisParser::OggVorbisParser()
+{
+    this->beginUnit(PAGE_HEADER_LENGTH);
+}
+
+bool OggVorbisParser::feed(uint64_t chunkOffset, const uint8_t *data, size_t length)
+{
+    while (this->stage != Stage::finished)
+    {
+        if (this->unit.size() < this->unitLength)
+        {
+            if (this->offset < chunkOffset)
+            {
+                throw std::logic_error("Ogg Vorbis parser was given a chunk past the bytes it needs.");
+            }
+
+            if (this->offset >= chunkOffset + length)
+            {
+                // Nothing more in this chunk; the next byte needed is further on.
+                break;
+            }
+
+            const size_t start = static_cast<size_t>(this->offset - chunkOffset);
+            const size_t count = std::min(this->unitLength - this->unit.size(), length - start);
+
+            this->unit.insert(this->unit.end(), data + start, data + start + count);
+            this->offset += count;
+
+            if (this->unit.size() < this->unitLength)
+            {
+                break;
+            }
+        }
+
+        this->processUnit();
+    }
+
+    return this->stage == Stage::finished;
+}
+
+bool OggVorbisParser::isFinished()
+{
+    return this->stage == Stage::finished;
+}
+
+uint64_t OggVorbisParser::nextOffset()
+{
+    return this->offset;
+}
+
+void OggVorbisParser::beginUnit(size_t length)
+{
+    this->unit.clear();
+    this->unitLength = length;
+}
+
+void OggVorbisParser::processUnit()
+{
+    switch (this->stage)
+    {
+    case Stage::pageHeader:
+        if (memcmp(this->unit.data(), "OggS", 4) != 0 || this->unit[4] != 0)
+        {
+            throw std::runtime_error("Failed to locate Vorbis headers in Ogg file.");
+        }
+
+        this->headerType = this->unit[5];
+        this->pageSerial = readUInt32(this->unit.data() + 14);
+
+        this->stage = Stage::segmentTable;
+        this->beginUnit(this->unit[26]);
+        break;
+
+    case Stage::segmentTable:
+    {
+        this->segments = this->unit;
+
+        size_t bodyLength = 0;
+        for (uint8_t lacing : this->segments)
+        {
+            bodyLength += lacing;
+        }
+
+        if (!this->streamFound && (this->headerType & BEGINNING_OF_STREAM) == 0)
+        {
+            // Every stream's first page comes before any other page.
+            throwMalformed("no Vorbis stream");
+        }
+
+        if (this->streamFound && this->pageSerial != this->metadata.streamInfo.serialNumber)
+        {
+            // A page of another logical stream; skip it without reading it.
+            this->offset += bodyLength;
+            this->stage = Stage::pageHeader;
+            this->beginUnit(PAGE_HEADER_LENGTH);
+            break;
+        }
+
+        this->stage = Stage::pageBody;
+        this->beginUnit(bodyLength);
+        break;
+    }
+
+    case Stage::pageBody:
+        this->readPage();
+
+        if (this->stage != Stage::finished)
+        {
+            this->stage = Stage::pageHeader;
+            this->beginUnit(PAGE_HEADER_LENGTH);
+        }
+        break;
+
+    case Stage::finished:
+        break;
+    }
+}
+
+void OggVorbisParser::readPage()
+{
+    const char *body = reinterpret_cast<const char *>(this->unit.data());
+
+    if (!this->streamFound)
+    {
+        if (!hasSignature(body, this->unit.size(), 0x01))
+        {
+            // The first page of some other kind of stream.
+            return;
+        }
+
+        this->streamFound = true;
+        this->metadata.streamInfo.serialNumber = this->pageSerial;
+    }
+
+    size_t position = 0;
+    for (uint8_t lacing : this->segments)
+    {
+        std::vector<char> &packet = this->packetIndex == 0 ? this->identification : this->metadata.storage;
+        packet.insert(packet.end(), body + position, body + position + lacing);
+        position += lacing;
+
+        if (packet.size() > MAX_COMMENT_LENGTH)
+        {
+            throwMalformed("header packet is too large");
+        }
+
+        // A lacing value below 255 ends the packet.
+        if (lacing == 255)
+        {
+            continue;
+        }
+
+        if (this->packetIndex == 0)
+        {
+            this->readIdentification();
+            this->packetIndex++;
+            continue;
+        }
+
+        if (!hasSignature(packet.data(), packet.size(), 0x03))
+        {
+            throwMalformed("comment header missing");
+        }
+
+        // The setup header and the audio that follow are of no use to the engine.
+        this->stage = Stage::finished;
+        return;
+    }
+}
+
+void OggVorbisParser::readIdentification()
+{
+    const char *packet = this->identification.data();
+
+    if (this->identification.size() < IDENTIFICATION_LENGTH || !hasSignature(packet, this->identification.size(), 0x01))
+    {
+        throwMalformed("identification header is too short");
+    }
+
+    const uint8_t *fields = reinterpret_cast<const uint8_t *>(packet + PACKET_SIGNATURE_LENGTH);
+    if (readUInt32(fields) != 0)
+    {
+        throwMalformed("unsupported Vorbis version");
+    }
+
+    VorbisStreamInfo &info = this->metadata.streamInfo;
+    info.channels = fields[4];
+    info.sampleRate = readUInt32(fields + 5);
+    info.maxBitrate = static_cast<int32_t>(readUInt32(fields + 9));
+    info.nominalBitrate = static_cast<int32_t>(readUInt32(fields + 13));
+    info.minBitrate = static_cast<int32_t>(readUInt32(fields + 17));
+
+    this->identification.clear();
+}
+
+OggVorbisMetadata OggVorbisParser::finish()
+{
+    if (this->stage != Stage::finished)
+    {
+        throw std::runtime_error("Ogg Vorbis headers ended before the comment header.");
+    }
+
+    const std::vector<char> &storage = this->metadata.storage;
+    decodeVorbisComments(std::string_view(storage.data() + PACKET_SIGNATURE_LENGTH, storage.size() - PACKET_SIGNATURE_LENGTH),
+                         this->metadata.vendor, this->metadata.comments);
+
+    return std::move(this->metadata);
+}
@@ -0,0 +1,187 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+#include "VorbisComment.hpp"
+
+namespace fs = std::filesystem;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+/**
+ * Size of each read OggVorbisMetadata::read issues. The identification and comment
+ * headers of a file without embedded cover art fit in the first one.
+ */
+static const size_t OGG_HEAD_READ_SIZE = 16 * 1024;
+
+/**
+ * Contents of the Vorbis identification header.
+ */
+struct VorbisStreamInfo
+{
+    uint8_t channels = 0;
+    uint32_t sampleRate = 0;
+    // Bitrates in bits per second. 0 if the encoder did not set them.
+    int32_t maxBitrate = 0;
+    int32_t nominalBitrate = 0;
+    int32_t minBitrate = 0;
+    uint32_t serialNumber = 0;
+};
+
+class OggVorbisParser;
+
+/**
+ * Headers of the first Vorbis stream in an Ogg file.
+ *
+ * The comment header is kept in a buffer owned by this object and the vendor
+ * string and comments are views into it, so an OggVorbisMetadata can be moved
+ * but not copied.
+ */
+class OggVorbisMetadata
+{
+private:
+    friend class OggVorbisParser;
+
+    std::vector<char> storage;
+
+public:
+    VorbisStreamInfo streamInfo;
+
+    std::string_view vendor;
+    std::vector<VorbisComment> comments;
+
+    OggVorbisMetadata() = default;
+    OggVorbisMetadata(const OggVorbisMetadata &) = delete;
+    OggVorbisMetadata &operator=(const OggVorbisMetadata &) = delete;
+    OggVorbisMetadata(OggVorbisMetadata &&) = default;
+    OggVorbisMetadata &operator=(OggVorbisMetadata &&) = default;
+
+    /**
+     * Reads the identification and comment headers of an Ogg Vorbis file.
+     *
+     * Reading stops at the end of the comment header, so the cost does not depend
+     * on the length of the track. Pages of other logical streams are skipped
+     * rather than read.
+     *
+     * @param filePath file to read
+     *
+     * @returns the file's headers.
+     */
+    static OggVorbisMetadata read(const fs::path &filePath);
+
+    /**
+     * Finishes reading the headers of an Ogg Vorbis file with a parser that has
+     * already been fed part of the file, reading only from its nextOffset() on.
+     *
+     * @param filePath file to read
+     * @param parser parser to continue
+     *
+     * @returns the file's headers.
+     */
+    static OggVorbisMetadata read(const fs::path &filePath, OggVorbisParser &parser);
+};
+
+/**
+ * Incremental reader of the Ogg pages at the start of a file, up to the end of the
+ * first Vorbis stream's comment header.
+ *
+ * Works like FLACMetadataParser: it is fed chunks of the file with their position
+ * and takes only the bytes it needs. Page checksums are not verified and audio
+ * packets are never looked at.
+ */
+class OggVorbisParser
+{
+private:
+    enum class Stage
+    {
+        pageHeader,
+        segmentTable,
+        pageBody,
+        finished
+    };
+
+    OggVorbisMetadata metadata;
+    Stage stage = Stage::pageHeader;
+
+    // Next byte of the file the parser needs.
+    uint64_t offset = 0;
+
+    // The unit being collected.
+    std::vector<uint8_t> unit;
+    size_t unitLength = 0;
+
+    // The page being walked.
+    uint8_t headerType = 0;
+    uint32_t pageSerial = 0;
+    std::vector<uint8_t> segments;
+
+    // The stream being read, once its first page has been found.
+    bool streamFound = false;
+
+    // Header packet being assembled: 0 for identification, 1 for comment.
+    size_t packetIndex = 0;
+    std::vector<char> identification;
+
+    void beginUnit(size_t length);
+    void processUnit();
+    void readPage();
+    void readIdentification();
+
+public:
+    OggVorbisParser();
+
+    /**
+     * Takes the bytes the parser needs from a chunk of the file.
+     *
+     * Chunks may arrive in any size, but the parser must not be given a chunk that
+     * starts after nextOffset().
+     *
+     * @param chunkOffset position of the chunk in the file
+     * @param data chunk contents
+     * @param length number of bytes in the chunk
+     *
+     * @returns true once the comment header has been read.
+     */
+    bool feed(uint64_t chunkOffset, const uint8_t *data, size_t length);
+
+    /**
+     * Whether the comment header has been read.
+     */
+    bool isFinished();
+
+    /**
+     * Position of the next byte of the file the parser needs.
+     */
+    uint64_t nextOffset();
+
+    /**
+     * Completes the metadata once the parser has finished.
+     *
+     * @returns the metadata. The parser is left empty.
+     */
+    OggVorbisMetadata finish();
+};
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -0,0 +1,169 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "ScanMetrics.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+uint64_t LatencySnapshot::meanNanos() const
+{
+    return this->count == 0 ? 0 : this->totalNanos / this->count;
+}
+
+uint64_t LatencySnapshot::percentileNanos(double fraction) const
+{
+    if (this->count == 0)
+    {
+        return 0;
+    }
+
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * this->count)));
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++)
+    {
+        seen += this->buckets[i];
+        if (seen >= rank)
+        {
+            // The top of the bucket, but never more than the largest sample.
+            return std::min(this->maxNanos, (uint64_t(1) << (i + 1)) - 1);
+        }
+    }
+
+    return this->maxNanos;
+}
+
+void LatencyHistogram::record(uint64_t nanos)
+{
+    // Index of the highest set bit, with 0 and 1 sharing the first bucket.
+    size_t bucket = 0;
+    for (uint64_t value = nanos >> 1; value != 0; value >>= 1)
+    {
+        bucket++;
+    }
+
+    this->buckets[std::min(bucket, LatencySnapshot::BUCKETS - 1)].fetch_add(1, std::memory_order_relaxed);
+    this->totalNanos.fetch_add(nanos, std::memory_order_relaxed);
+    this->count.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max = this->maxNanos.load(std::memory_order_relaxed);
+    while (nanos > max && !this->maxNanos.compare_exchange_weak(max, nanos, std::memory_order_relaxed))
+    {
+    }
+}
+
+LatencySnapshot LatencyHistogram::snapshot() const
+{
+    LatencySnapshot snapshot;
+    snapshot.count = this->count.load(std::memory_order_relaxed);
+    snapshot.totalNanos = this->totalNanos.load(std::memory_order_relaxed);
+    snapshot.maxNanos = this->maxNanos.load(std::memory_order_relaxed);
+
+    for (size_t i = 0; i < LatencySnapshot::BUCKETS; i++)
+    {
+        snapshot.buckets[i] = this->buckets[i].load(std::memory_order_relaxed);
+    }
+
+    return snapshot;
+}
+
+void LatencyHistogram::reset()
+{
+    this->count = 0;
+    this->totalNanos = 0;
+    this->maxNanos = 0;
+
+    for (auto &bucket : this->buckets)
+    {
+        bucket = 0;
+    }
+}
+
+double ScanProgress::secondsRemaining() const
+{
+    if (this->scanFinished)
+    {
+        return 0;
+    }
+
+    const uint64_t done = this->filesDone();
+    if (!this->walkFinished || done == 0)
+    {
+        return -1;
+    }
+
+    const double secondsPerFile = this->elapsedNanos / 1e9 / done;
+    return secondsPerFile * (this->totals.filesSeen - std::min(done, this->totals.filesSeen));
+}
+
+void ScanMetrics::start()
+{
+    for (auto &stage : this->stages)
+    {
+        stage.reset();
+    }
+
+    this->filesSeen = 0;
+    this->imported = 0;
+    this->skipped = 0;
+    this->failed = 0;
+    this->bytesRead = 0;
+    this->pathQueueDepth = 0;
+    this->trackQueueDepth = 0;
+    this->walkFinished = false;
+    this->endNanos = 0;
+    this->startNanos = monotonicNanos();
+}
+
+void ScanMetrics::finish()
+{
+    this->endNanos = monotonicNanos();
+}
+
+ScanSummary ScanMetrics::summary() const
+{
+    ScanSummary summary;
+    summary.filesSeen = this->filesSeen;
+    summary.imported = this->imported;
+    summary.skipped = this->skipped;
+    summary.failed = this->failed;
+    return summary;
+}
+
+ScanProgress ScanMetrics::snapshot() const
+{
+    ScanProgress progress;
+    progress.totals = this->summary();
+    progress.bytesRead = this->bytesRead;
+    progress.pathQueueDepth = static_cast<uint64_t>(std::max<int64_t>(0, this->pathQueueDepth));
+    progress.trackQueueDepth = static_cast<uint64_t>(std::max<int64_t>(0, this->trackQueueDepth));
+    progress.walkFinished = this->walkFinished;
+
+    const uint64_t start = this->startNanos;
+    const uint64_t end = this->endNanos;
+    progress.scanFinished = start != 0 && end != 0;
+    progress.elapsedNanos = start == 0 ? 0 : (end != 0 ? end : monotonicNanos()) - start;
+
+    for (size_t i = 0; i < SCAN_STAGE_COUNT; i++)
+    {
+        progress.stages[i] = this->stages[i].snapshot();
+    }
+
+    return progress;
+}
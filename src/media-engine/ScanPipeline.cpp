@@ -0,0 +1,607 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Local includes
+#include "DirectoryWalker.hpp"
+#include "IngestWriter.hpp"
+#include "ScanPipeline.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+/**
+ * Turns the files of a FileBatchReader batch into tracks, one TrackIngestor per file.
+ */
+class ScanPipeline::BatchIngestor : public BatchReadConsumer
+{
+private:
+    ScanPipeline &pipeline;
+    const vector<fs::path> &paths;
+    bool hashFile;
+
+    vector<unique_ptr<TrackIngestor>> ingestors;
+    vector<uint64_t> startNanos;
+    // Files already counted, as skipped, failed or queued for the writer.
+    vector<bool> counted;
+
+public:
+    BatchIngestor(ScanPipeline &pipeline, const vector<fs::path> &paths, bool hashFile)
+        : pipeline(pipeline), paths(paths), hashFile(hashFile), ingestors(paths.size()), startNanos(paths.size(), 0),
+          counted(paths.size(), false)
+    {
+    }
+
+    /**
+     * Number of files of the batch not yet counted, which a failed read leaves behind.
+     */
+    size_t uncounted() const
+    {
+        return std::count(this->counted.begin(), this->counted.end(), false);
+    }
+
+    bool begin(size_t fileIndex, const FileFingerprint &fingerprint, uint64_t statNanos) override
+    {
+        this->pipeline.metrics->record(ScanStage::stat, statNanos);
+
+        if (this->pipeline.isUnchanged(this->paths[fileIndex], fingerprint))
+        {
+            this->pipeline.metrics->skipped++;
+            this->counted[fileIndex] = true;
+            return false;
+        }
+
+        this->ingestors[fileIndex] = std::make_unique<TrackIngestor>(this->paths[fileIndex], fingerprint, this->hashFile);
+        this->startNanos[fileIndex] = monotonicNanos();
+        return true;
+    }
+
+    void consume(size_t fileIndex, uint64_t offset, const uint8_t *data, size_t length) override
+    {
+        this->ingestors[fileIndex]->consume(offset, data, length);
+    }
+
+    void end(size_t fileIndex, std::exception_ptr error) override
+    {
+        unique_ptr<TrackIngestor> ingestor = std::move(this->ingestors[fileIndex]);
+        unique_ptr<Track> track;
+
+        if (error == nullptr)
+        {
+            try
+            {
+                track = ingestor->finish();
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+        }
+
+        if (ingestor != nullptr)
+        {
+            // Time between the file's stat and its end, most of it spent waiting on the ring.
+            this->pipeline.recordIngest(*ingestor, monotonicNanos() - this->startNanos[fileIndex]);
+        }
+
+        if (error != nullptr)
+        {
+            try
+            {
+                std::rethrow_exception(error);
+            }
+            catch (const std::exception &err)
+            {
+                std::cerr << err.what() << std::endl;
+            }
+            this->pipeline.metrics->failed++;
+            this->counted[fileIndex] = true;
+            return;
+        }
+
+        this->pipeline.queueTrack(std::move(track));
+        this->counted[fileIndex] = true;
+    }
+};
+
+ScanPipeline::ScanPipeline(const shared_ptr<StatementCache> &statements, const shared_ptr<IDCache> &ids,
+                           const ScanOptions &options, const shared_ptr<ScanMetrics> &metrics,
+                           const shared_ptr<CoverArtCache> &coverArt)
+    : statements(statements), ids(ids), options(options), pathQueue(options.queueCapacity),
+      trackQueue(options.queueCapacity), metrics(metrics), coverArt(coverArt)
+{
+    this->useRing = this->options.readBackend == ReadBackend::ioUring && IoRing::isSupported();
+
+    // The ring reads every file on its own, so there are no lanes to hash side by side.
+    this->useMultiBuffer = this->options.hashPolicy == HashPolicy::full && this->options.multiBufferHashing &&
+                           !this->useRing && Sha256Engine::prefersMultiBuffer();
+
+    if (this->options.threadCount == 0)
+    {
+        this->options.threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+ScanSummary ScanPipeline::run(const fs::path &root)
+{
+    return this->runStages([this] { this->loadKnownFiles(); }, [this, &root] { this->walkDirectory(root); });
+}
+
+ScanSummary ScanPipeline::run(const vector<fs::path> &paths)
+{
+    return this->runStages([this, &paths] { this->loadKnownFiles(paths); }, [this, &paths] { this->queuePaths(paths); });
+}
+
+ScanSummary ScanPipeline::runStages(const std::function<void()> &loadKnown, const std::function<void()> &produce)
+{
+    this->metrics->start();
+
+    // Done before the writer starts, while this thread may still use the connection. No
+    // thread is running yet, so if this throws there is nothing to join.
+    loadKnown();
+
+    std::thread reporter;
+    if (this->options.onProgress)
+    {
+        reporter = std::thread(&ScanPipeline::reportProgress, this);
+    }
+
+    std::thread writer(&ScanPipeline::writeTracks, this);
+
+    vector<std::thread> workers;
+    workers.reserve(this->options.threadCount);
+    for (uint32_t i = 0; i < this->options.threadCount; i++)
+    {
+        workers.emplace_back(&ScanPipeline::processFiles, this);
+    }
+
+    // Paths are produced on the calling thread; a full scan's walker adds threads of its own.
+    produce();
+    this->metrics->walkFinished = true;
+    this->pathQueue.close();
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    this->trackQueue.close();
+    writer.join();
+
+    this->metrics->finish();
+
+    if (reporter.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> guard(this->progressLock);
+            this->scanDone = true;
+        }
+        this->progressWake.notify_all();
+        reporter.join();
+    }
+
+    return this->metrics->summary();
+}
+
+void ScanPipeline::loadKnownFiles()
+{
+    CachedStatement stmt = this->statements->acquire(FINGERPRINT_LOAD_SQL);
+
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW)
+    {
+        const char *location = reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 0));
+        if (location == nullptr)
+        {
+            continue;
+        }
+
+        FileFingerprint fingerprint;
+        fingerprint.size = static_cast<uint64_t>(sqlite3_column_int64(stmt.get(), 1));
+        fingerprint.modifiedTime = sqlite3_column_int64(stmt.get(), 2);
+        fingerprint.inode = static_cast<uint64_t>(sqlite3_column_int64(stmt.get(), 3));
+        fingerprint.device = static_cast<uint64_t>(sqlite3_column_int64(stmt.get(), 4));
+
+        this->knownFiles.emplace(location, fingerprint);
+    }
+}
+
+void ScanPipeline::loadKnownFiles(const vector<fs::path> &paths)
+{
+    CachedStatement stmt = this->statements->acquire(FINGERPRINT_BY_LOCATION_SQL);
+
+    for (const fs::path &location : paths)
+    {
+        const string locationStr = location.string();
+        sqlite3_bind_text(stmt.get(), 1, locationStr.c_str(), -1, SQLITE_STATIC);
+
+        if (sqlite3_step(stmt.get()) == SQLITE_ROW)
+        {
+            FileFingerprint fingerprint;
+            fingerprint.size = static_cast<uint64_t>(sqlite3_column_int64(stmt.get(), 0));
+            fingerprint.modifiedTime = sqlite3_column_int64(stmt.get(), 1);
+            fingerprint.inode = static_cast<uint64_t>(sqlite3_column_int64(stmt.get(), 2));
+            fingerprint.device = static_cast<uint64_t>(sqlite3_column_int64(stmt.get(), 3));
+
+            this->knownFiles.emplace(locationStr, fingerprint);
+        }
+
+        sqlite3_reset(stmt.get());
+    }
+}
+
+void ScanPipeline::queuePaths(const vector<fs::path> &paths)
+{
+    for (const fs::path &location : paths)
+    {
+        this->metrics->filesSeen++;
+        this->metrics->pathQueueDepth++;
+        if (!this->pathQueue.push(location))
+        {
+            this->metrics->pathQueueDepth--;
+            return;
+        }
+    }
+}
+
+void ScanPipeline::walkDirectory(const fs::path &root)
+{
+    WalkOptions walkOptions;
+    walkOptions.threadCount = this->options.walkThreadCount;
+    walkOptions.extensions = Track::supportedExtensions();
+    walkOptions.excludedDirectories = this->options.excludedDirectories;
+    walkOptions.skipHidden = this->options.skipHiddenDirectories;
+
+    WalkSummary walked;
+
+    try
+    {
+        walked = DirectoryWalker(walkOptions).walk(root, [this](fs::path &&location) {
+            this->metrics->filesSeen++;
+            this->metrics->pathQueueDepth++;
+            if (!this->pathQueue.push(std::move(location)))
+            {
+                this->metrics->pathQueueDepth--;
+                return false;
+            }
+            return true;
+        });
+    }
+    catch (const std::runtime_error &err)
+    {
+        std::cerr << err.what() << std::endl;
+        return;
+    }
+
+    // Files in other formats never reach the workers, but still count as seen and skipped.
+    this->metrics->filesSeen += walked.filtered;
+    this->metrics->skipped += walked.filtered;
+}
+
+void ScanPipeline::processFiles()
+{
+    if (this->useRing)
+    {
+        unique_ptr<FileBatchReader> reader;
+
+        try
+        {
+            reader = std::make_unique<FileBatchReader>(this->options.ioQueueDepth);
+        }
+        catch (const std::runtime_error &err)
+        {
+            // Usually a locked-memory limit too low for the ring; this worker reads with system calls instead.
+            std::cerr << err.what() << std::endl;
+        }
+
+        if (reader != nullptr)
+        {
+            this->processBatches(*reader);
+            return;
+        }
+    }
+
+    const size_t groupSize = this->useMultiBuffer ? Sha256MultiBuffer::LANES : 1;
+    vector<unique_ptr<TrackIngestor>> group;
+    fs::path trackPath;
+
+    while (this->pathQueue.pop(trackPath))
+    {
+        this->metrics->pathQueueDepth--;
+        if (auto ingestor = this->prepareIngestor(trackPath))
+        {
+            group.push_back(std::move(ingestor));
+        }
+
+        // Fill the rest of the hashing lanes with whatever is already waiting.
+        while (group.size() < groupSize && this->pathQueue.tryPop(trackPath))
+        {
+            this->metrics->pathQueueDepth--;
+            if (auto ingestor = this->prepareIngestor(trackPath))
+            {
+                group.push_back(std::move(ingestor));
+            }
+        }
+
+        this->ingestFiles(group);
+    }
+}
+
+void ScanPipeline::processBatches(FileBatchReader &reader)
+{
+    // Enough paths to refill the reader's slots several times before it runs dry.
+    const size_t batchSize = static_cast<size_t>(std::max(1u, this->options.ioQueueDepth)) * 4;
+    const bool hashFile = this->options.hashPolicy == HashPolicy::full;
+    const ReadExtent extent = hashFile ? ReadExtent::whole : ReadExtent::ends;
+
+    vector<fs::path> batch;
+    fs::path trackPath;
+
+    while (this->pathQueue.pop(trackPath))
+    {
+        do
+        {
+            this->metrics->pathQueueDepth--;
+
+            // The extension is checked first, so unsupported files are never stat'ed.
+            if (TrackIngestor::canIngest(trackPath))
+            {
+                batch.push_back(std::move(trackPath));
+            }
+            else
+            {
+                this->metrics->skipped++;
+            }
+        } while (batch.size() < batchSize && this->pathQueue.tryPop(trackPath));
+
+        if (batch.empty())
+        {
+            continue;
+        }
+
+        BatchIngestor ingestor(*this, batch, hashFile);
+
+        try
+        {
+            reader.read(batch, extent, ingestor);
+        }
+        catch (const std::exception &err)
+        {
+            // Files of the batch already counted stand; the rest are lost.
+            std::cerr << err.what() << std::endl;
+            this->metrics->failed += ingestor.uncounted();
+        }
+
+        batch.clear();
+    }
+}
+
+bool ScanPipeline::isUnchanged(const fs::path &trackPath, const FileFingerprint &fingerprint) const
+{
+    auto known = this->knownFiles.find(trackPath.string());
+    return known != this->knownFiles.end() && known->second == fingerprint;
+}
+
+unique_ptr<TrackIngestor> ScanPipeline::prepareIngestor(const fs::path &trackPath)
+{
+    FileFingerprint fingerprint;
+    const uint64_t start = monotonicNanos();
+    const bool found = FileFingerprint::read(trackPath, fingerprint);
+    this->metrics->record(ScanStage::stat, monotonicNanos() - start);
+
+    if (!found)
+    {
+        this->metrics->failed++;
+        return nullptr;
+    }
+
+    if (this->isUnchanged(trackPath, fingerprint))
+    {
+        // Unchanged since the last import.
+        this->metrics->skipped++;
+        return nullptr;
+    }
+
+    if (!TrackIngestor::canIngest(trackPath))
+    {
+        this->metrics->skipped++;
+        return nullptr;
+    }
+
+    // With multi-buffer hashing the full hash is computed alongside the ingestor instead.
+    const bool hashFile = this->options.hashPolicy == HashPolicy::full && !this->useMultiBuffer;
+
+    return std::make_unique<TrackIngestor>(trackPath, fingerprint, hashFile);
+}
+
+void ScanPipeline::ingestFiles(vector<unique_ptr<TrackIngestor>> &group)
+{
+    if (group.empty())
+    {
+        return;
+    }
+
+    if (this->useMultiBuffer)
+    {
+        vector<unique_ptr<Track>> tracks;
+        vector<std::exception_ptr> errors;
+        const uint64_t start = monotonicNanos();
+
+        try
+        {
+            TrackIngestor::readInterleaved(group, tracks, errors);
+        }
+        catch (const std::exception &err)
+        {
+            std::cerr << err.what() << std::endl;
+            this->metrics->failed += group.size();
+            group.clear();
+            return;
+        }
+
+        // The files were read side by side, so each is charged an equal share of the group's time.
+        const uint64_t shareNanos = (monotonicNanos() - start) / group.size();
+
+        for (size_t i = 0; i < group.size(); i++)
+        {
+            this->recordIngest(*group[i], shareNanos);
+
+            if (errors[i] != nullptr)
+            {
+                try
+                {
+                    std::rethrow_exception(errors[i]);
+                }
+                catch (const std::exception &err)
+                {
+                    std::cerr << err.what() << std::endl;
+                }
+                this->metrics->failed++;
+                continue;
+            }
+
+            this->queueTrack(std::move(tracks[i]));
+        }
+    }
+    else
+    {
+        for (auto &ingestor : group)
+        {
+            const uint64_t start = monotonicNanos();
+            unique_ptr<Track> track;
+
+            try
+            {
+                track = ingestor->read(this->options.hashReadMode);
+            }
+            catch (const std::exception &err)
+            {
+                this->recordIngest(*ingestor, monotonicNanos() - start);
+                std::cerr << err.what() << std::endl;
+                this->metrics->failed++;
+                continue;
+            }
+
+            this->recordIngest(*ingestor, monotonicNanos() - start);
+            this->queueTrack(std::move(track));
+        }
+    }
+
+    group.clear();
+}
+
+void ScanPipeline::recordIngest(const TrackIngestor &ingestor, uint64_t totalNanos)
+{
+    const IngestTimings &timings = ingestor.getTimings();
+
+    this->metrics->record(ScanStage::detect, timings.detectNanos);
+    this->metrics->record(ScanStage::parse, timings.parseNanos);
+    this->metrics->record(ScanStage::hash, timings.hashNanos);
+
+    const uint64_t busyNanos = timings.detectNanos + timings.parseNanos + timings.hashNanos;
+    this->metrics->record(ScanStage::read, totalNanos > busyNanos ? totalNanos - busyNanos : 0);
+    this->metrics->bytesRead += timings.bytesConsumed;
+}
+
+void ScanPipeline::storeCoverArt(Track &track)
+{
+    if (this->coverArt == nullptr || !track.hasCoverArt())
+    {
+        return;
+    }
+
+    const EmbeddedPicture picture = track.getCoverArt();
+
+    try
+    {
+        track.setCoverHash(this->coverArt->storeFromFile(track.getLocation(), picture.offset, picture.length));
+    }
+    catch (const std::exception &err)
+    {
+        // The track is still worth importing without its cover.
+        std::cerr << err.what() << std::endl;
+    }
+}
+
+void ScanPipeline::queueTrack(unique_ptr<Track> track)
+{
+    if (track == nullptr)
+    {
+        // The extension claimed a supported format but the contents did not match.
+        this->metrics->skipped++;
+        return;
+    }
+
+    this->storeCoverArt(*track);
+
+    this->metrics->trackQueueDepth++;
+    if (!this->trackQueue.push(std::move(track)))
+    {
+        this->metrics->trackQueueDepth--;
+    }
+}
+
+void ScanPipeline::writeTracks()
+{
+    IngestWriter writer(this->statements, this->ids, this->options.batchSize, this->options.hashReadMode);
+    vector<unique_ptr<Track>> batch;
+    unique_ptr<Track> track;
+
+    while (this->trackQueue.pop(track))
+    {
+        // Take whatever else is already waiting so the writer works in batches.
+        batch.push_back(std::move(track));
+        while (batch.size() < this->options.batchSize && this->trackQueue.tryPop(track))
+        {
+            batch.push_back(std::move(track));
+        }
+        this->metrics->trackQueueDepth -= batch.size();
+
+        const uint64_t start = monotonicNanos();
+
+        this->countWritten(writer.write(batch));
+        this->metrics->record(ScanStage::write, monotonicNanos() - start);
+
+        batch.clear();
+    }
+
+    this->countWritten(writer.commit());
+}
+
+void ScanPipeline::countWritten(const IngestResult &result)
+{
+    this->metrics->imported += result.inserted;
+    this->metrics->skipped += result.duplicates + result.refreshed;
+    this->metrics->failed += result.failed;
+}
+
+void ScanPipeline::reportProgress()
+{
+    std::unique_lock<std::mutex> guard(this->progressLock);
+
+    while (!this->progressWake.wait_for(guard, this->options.progressInterval, [this] { return this->scanDone; }))
+    {
+        // The callback may be slow, so the lock is not held while it runs.
+        guard.unlock();
+        this->options.onProgress(this->metrics->snapshot());
+        guard.lock();
+    }
+
+    guard.unlock();
+    this->options.onProgress(this->metrics->snapshot());
+}
@@ -0,0 +1,242 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include <sqlite3.h>
+
+#include "BoundedQueue.hpp"
+#include "CoverArtCache.hpp"
+#include "FileBatchReader.hpp"
+#include "FileFingerprint.hpp"
+#include "IDCache.hpp"
+#include "IngestWriter.hpp"
+#include "ScanMetrics.hpp"
+#include "ScanOptions.hpp"
+#include "StatementCache.hpp"
+#include "Track.hpp"
+#include "TrackIngestor.hpp"
+
+namespace fs = std::filesystem;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+// Copies of a track are known files too, as long as the track they copy is still there.
+static const string FINGERPRINT_LOAD_SQL =
+    "SELECT FileLocation, FileSize, ModifiedTime, Inode, Device FROM Tracks "
+    "UNION ALL SELECT DuplicateFiles.FileLocation, DuplicateFiles.FileSize, DuplicateFiles.ModifiedTime, "
+    "DuplicateFiles.Inode, DuplicateFiles.Device FROM DuplicateFiles JOIN Tracks ON Tracks.ID == DuplicateFiles.Track;";
+static const string FINGERPRINT_BY_LOCATION_SQL =
+    "SELECT FileSize, ModifiedTime, Inode, Device FROM Tracks WHERE FileLocation == @loc "
+    "UNION ALL SELECT DuplicateFiles.FileSize, DuplicateFiles.ModifiedTime, DuplicateFiles.Inode, "
+    "DuplicateFiles.Device FROM DuplicateFiles JOIN Tracks ON Tracks.ID == DuplicateFiles.Track "
+    "WHERE DuplicateFiles.FileLocation == @loc;";
+
+/**
+ * Multi-threaded import of a directory tree.
+ *
+ * The scan runs as three stages connected by bounded queues:
+ *
+ * 1. a DirectoryWalker that enumerates the files in supported formats below the
+ *    root (or, for an incremental update, the calling thread queuing the files it
+ *    was given),
+ * 2. a pool of workers that read each new file once, detecting its format, importing
+ *    its tags and taking its partial hash (and its full hash with HashPolicy::full)
+ *    from the same chunks,
+ * 3. a single writer thread, the only thread that touches the database connection.
+ *
+ * Embedded cover art is copied into the CoverArtCache by the workers, so the writer
+ * only records each album's cover hash.
+ *
+ * With ReadBackend::ioUring each worker instead takes a batch of paths at a time and
+ * stats, opens and reads them through a FileBatchReader, keeping many files in flight.
+ *
+ * Files whose stat fingerprint matches the one recorded at their last import are
+ * skipped before they are opened, so rescanning an unchanged library costs one
+ * stat per file.
+ *
+ * Every stage records its counts and timings in a ScanMetrics, which may be read
+ * from other threads while the scan runs.
+ */
+class ScanPipeline
+{
+private:
+    class BatchIngestor;
+
+    shared_ptr<StatementCache> statements;
+    shared_ptr<IDCache> ids;
+    ScanOptions options;
+    bool useMultiBuffer;
+    bool useRing;
+
+    // Fingerprints of every imported file and recorded copy, keyed by location. Read-only once the scan starts.
+    std::unordered_map<string, FileFingerprint> knownFiles;
+
+    BoundedQueue<fs::path> pathQueue;
+    BoundedQueue<unique_ptr<Track>> trackQueue;
+
+    shared_ptr<ScanMetrics> metrics;
+    shared_ptr<CoverArtCache> coverArt;
+
+    // Wakes the progress reporter early when the scan ends.
+    std::mutex progressLock;
+    std::condition_variable progressWake;
+    bool scanDone = false;
+
+    /**
+     * Runs the three stages, with the calling thread producing paths.
+     *
+     * @param loadKnown loads the fingerprints the workers compare files against
+     * @param produce queues the paths to scan
+     */
+    ScanSummary runStages(const std::function<void()> &loadKnown, const std::function<void()> &produce);
+
+    /**
+     * Loads the fingerprints of every file already in the database.
+     */
+    void loadKnownFiles();
+
+    /**
+     * Loads the fingerprints of the given files, for scans of a few files in a large library.
+     */
+    void loadKnownFiles(const vector<fs::path> &paths);
+
+    /**
+     * Walks the directory tree and queues every file in a supported format.
+     *
+     * @param root directory to start from
+     */
+    void walkDirectory(const fs::path &root);
+
+    /**
+     * Queues the given files.
+     */
+    void queuePaths(const vector<fs::path> &paths);
+
+    /**
+     * Worker loop. Turns queued paths into fully populated tracks.
+     */
+    void processFiles();
+
+    /**
+     * Worker loop for ReadBackend::ioUring. Reads batches of queued paths through the
+     * given reader.
+     */
+    void processBatches(FileBatchReader &reader);
+
+    /**
+     * Stats the file and skips it if it is unchanged or not in a supported format.
+     *
+     * @param trackPath file to prepare
+     *
+     * @returns an ingestor for the file, or nullptr if the file was skipped or failed.
+     */
+    unique_ptr<TrackIngestor> prepareIngestor(const fs::path &trackPath);
+
+    /**
+     * Reads a group of files and queues their tracks for the writer. With
+     * multi-buffer hashing the group is read side by side; otherwise each file is
+     * read on its own. Files that fail are dropped.
+     *
+     * @param group files to read. Emptied on return.
+     */
+    void ingestFiles(vector<unique_ptr<TrackIngestor>> &group);
+
+    /**
+     * Whether a file's fingerprint matches the one recorded at its last import.
+     */
+    bool isUnchanged(const fs::path &trackPath, const FileFingerprint &fingerprint) const;
+
+    /**
+     * Records the time an ingestor spent on each stage and the bytes it read.
+     *
+     * @param ingestor ingestor that has finished
+     * @param totalNanos time the file took from its first read to its finished track
+     */
+    void recordIngest(const TrackIngestor &ingestor, uint64_t totalNanos);
+
+    /**
+     * Copies a track's embedded cover art into the cache and records its hash on the track.
+     */
+    void storeCoverArt(Track &track);
+
+    /**
+     * Counts a track produced by an ingestor, stores its cover art and queues it for the writer.
+     *
+     * @param track track to queue, or nullptr if the file turned out not to be supported
+     */
+    void queueTrack(unique_ptr<Track> track);
+
+    /**
+     * Writer loop. Adds finished tracks to the database.
+     */
+    void writeTracks();
+
+    /**
+     * Adds the outcome of written rows to the metrics.
+     *
+     * @param result rows whose transaction committed or was rolled back
+     */
+    void countWritten(const IngestResult &result);
+
+    /**
+     * Reporter loop. Passes a snapshot of the metrics to the progress callback at every
+     * interval until the scan ends, then once more.
+     */
+    void reportProgress();
+
+public:
+    /**
+     * @param statements statement cache of the connection to write to
+     * @param ids artist and album IDs already in the database
+     * @param options tunables for the scan
+     * @param metrics where the scan records its progress. Cleared when the scan starts.
+     * @param coverArt where embedded cover art is stored, or null to ignore it
+     */
+    ScanPipeline(const shared_ptr<StatementCache> &statements, const shared_ptr<IDCache> &ids,
+                 const ScanOptions &options, const shared_ptr<ScanMetrics> &metrics,
+                 const shared_ptr<CoverArtCache> &coverArt = nullptr);
+
+    /**
+     * Scans the given directory and imports every supported track found.
+     *
+     * @param root directory to scan
+     *
+     * @returns totals for the scan.
+     */
+    ScanSummary run(const fs::path &root);
+
+    /**
+     * Imports the given files, without walking a directory. Files that no longer
+     * exist are counted as failed.
+     *
+     * @param paths files to import
+     *
+     * @returns totals for the scan.
+     */
+    ScanSummary run(const vector<fs::path> &paths);
+};
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -0,0 +1,120 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <sstream>
+#include <stdexcept>
+
+// Utility libs
+#include <boost/format.hpp>
+
+// Local includes
+#include "sqlite_init.h"
+#include "Schema.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+/**
+ * Upgrade steps, in order. Step `i` moves the schema from version `i` to `i + 1`.
+ */
+static const char *const SCHEMA_STEPS[] = {
+    SQLITE_INIT_STMT,
+    SQLITE_FINGERPRINT_STMT,
+    SQLITE_CONTENT_KEYS_STMT,
+    SQLITE_TRACK_DETAILS_STMT,
+    SQLITE_BROWSE_INDEXES_STMT,
+    SQLITE_COVER_HASH_STMT,
+    SQLITE_TRACK_TITLE_INDEX_STMT,
+    SQLITE_GENERATION_STMT,
+    SQLITE_DUPLICATES_STMT,
+};
+
+static const int SCHEMA_STEP_COUNT = sizeof(SCHEMA_STEPS) / sizeof(SCHEMA_STEPS[0]);
+
+static void execute(sqlite3 *db, const std::string &sql)
+{
+    char *errMsg = nullptr;
+
+    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK)
+    {
+        std::stringstream errStream;
+        errStream << boost::format("Failed to upgrade the database schema: %s") % (errMsg != nullptr ? errMsg : "unknown error");
+        sqlite3_free(errMsg);
+        throw std::runtime_error(errStream.str());
+    }
+}
+
+int Schema::getLatestVersion()
+{
+    return SCHEMA_STEP_COUNT;
+}
+
+int Schema::getVersion(const std::shared_ptr<sqlite3 *> &db)
+{
+    sqlite3_stmt *stmt = nullptr;
+    int version = 0;
+
+    sqlite3_prepare_v2(*db, "PRAGMA user_version;", -1, &stmt, nullptr);
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        version = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    if (version != 0)
+    {
+        return version;
+    }
+
+    // Databases from before user_version was tracked only ever had the initial tables.
+    sqlite3_prepare_v2(*db, CHECK_STMT.c_str(), -1, &stmt, nullptr);
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        version = 1;
+    }
+    sqlite3_finalize(stmt);
+
+    return version;
+}
+
+void Schema::migrate(const std::shared_ptr<sqlite3 *> &db)
+{
+    int version = Schema::getVersion(db);
+
+    if (version > SCHEMA_STEP_COUNT)
+    {
+        std::stringstream errStream;
+        errStream << boost::format("Database schema version %d is newer than this build supports (%d).") % version % SCHEMA_STEP_COUNT;
+        throw std::runtime_error(errStream.str());
+    }
+
+    for (; version < SCHEMA_STEP_COUNT; version++)
+    {
+        execute(*db, "BEGIN TRANSACTION;");
+
+        try
+        {
+            execute(*db, SCHEMA_STEPS[version]);
+            execute(*db, "PRAGMA user_version = " + std::to_string(version + 1) + ";");
+            execute(*db, "COMMIT;");
+        }
+        catch (const std::runtime_error &err)
+        {
+            sqlite3_exec(*db, "ROLLBACK;", nullptr, nullptr, nullptr);
+            throw;
+        }
+    }
+}
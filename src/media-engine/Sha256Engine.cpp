@@ -0,0 +1,613 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// System libs
+#if defined(__x86_64__) || defined(__i386__)
+#define MELLOPHONE_SHA256_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+// Local includes
+#include "Sha256Engine.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace
+{
+const uint32_t ROUND_CONSTANTS[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+const std::array<uint32_t, 8> INITIAL_STATE = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+using CompressFunction = void (*)(uint32_t *state, const uint8_t *data, size_t blocks);
+
+inline uint32_t rotateRight(uint32_t value, int bits)
+{
+    return (value >> bits) | (value << (32 - bits));
+}
+
+inline uint32_t loadBigEndian(const uint8_t *data)
+{
+    return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+}
+
+/**
+ * Portable compression function. Only used for the odd block in multi-buffer mode
+ * on CPUs without SHA-NI; single streams fall back to OpenSSL instead.
+ */
+void compressScalar(uint32_t *state, const uint8_t *data, size_t blocks)
+{
+    uint32_t w[64];
+
+    for (; blocks > 0; blocks--, data += SHA256_BLOCK_SIZE)
+    {
+        for (int t = 0; t < 16; t++)
+        {
+            w[t] = loadBigEndian(data + t * 4);
+        }
+        for (int t = 16; t < 64; t++)
+        {
+            uint32_t s0 = rotateRight(w[t - 15], 7) ^ rotateRight(w[t - 15], 18) ^ (w[t - 15] >> 3);
+            uint32_t s1 = rotateRight(w[t - 2], 17) ^ rotateRight(w[t - 2], 19) ^ (w[t - 2] >> 10);
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int t = 0; t < 64; t++)
+        {
+            uint32_t t1 = h + (rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25)) + ((e & f) ^ (~e & g)) +
+                          ROUND_CONSTANTS[t] + w[t];
+            uint32_t t2 = (rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef MELLOPHONE_SHA256_X86
+bool cpuHasShaNi()
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    {
+        return false;
+    }
+
+    // CPUID.(EAX=7,ECX=0):EBX bit 29 is SHA.
+    return (ebx & (1u << 29)) != 0 && __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3");
+}
+
+__attribute__((target("sha,sse4.1,ssse3"))) void compressShaNi(uint32_t *state, const uint8_t *data, size_t blocks)
+{
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // The SHA instructions keep the state as ABEF/CDGH pairs.
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[0]));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[4]));
+
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);
+    state1 = _mm_shuffle_epi32(state1, 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; blocks > 0; blocks--, data += SHA256_BLOCK_SIZE)
+    {
+        const __m128i savedState0 = state0;
+        const __m128i savedState1 = state1;
+        __m128i w[16];
+
+        for (int group = 0; group < 16; group++)
+        {
+            if (group < 4)
+            {
+                w[group] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + group * 16)), byteSwap);
+            }
+            else
+            {
+                __m128i next = _mm_sha256msg1_epu32(w[group - 4], w[group - 3]);
+                next = _mm_add_epi32(next, _mm_alignr_epi8(w[group - 1], w[group - 2], 4));
+                w[group] = _mm_sha256msg2_epu32(next, w[group - 1]);
+            }
+
+            __m128i message = _mm_add_epi32(w[group], _mm_loadu_si128(reinterpret_cast<const __m128i *>(&ROUND_CONSTANTS[group * 4])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+            message = _mm_shuffle_epi32(message, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, message);
+        }
+
+        state0 = _mm_add_epi32(state0, savedState0);
+        state1 = _mm_add_epi32(state1, savedState1);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[4]), state1);
+}
+
+__attribute__((target("avx2"))) inline __m256i rotateRight8(__m256i value, int bits)
+{
+    return _mm256_or_si256(_mm256_srli_epi32(value, bits), _mm256_slli_epi32(value, 32 - bits));
+}
+
+/**
+ * Runs the compression function over `blocks` blocks of eight independent streams.
+ * Lane `i` reads from `data[i]`, advancing `strides[i]` bytes per block.
+ */
+__attribute__((target("avx2"))) void compressAvx2(uint32_t *const *states, const uint8_t *const *data,
+                                                  const size_t *strides, size_t blocks)
+{
+    __m256i v[8];
+    for (int word = 0; word < 8; word++)
+    {
+        v[word] = _mm256_setr_epi32(states[0][word], states[1][word], states[2][word], states[3][word],
+                                    states[4][word], states[5][word], states[6][word], states[7][word]);
+    }
+
+    __m256i w[64];
+
+    for (size_t block = 0; block < blocks; block++)
+    {
+        const uint8_t *lane[8];
+        for (int i = 0; i < 8; i++)
+        {
+            lane[i] = data[i] + block * strides[i];
+        }
+
+        for (int t = 0; t < 16; t++)
+        {
+            w[t] = _mm256_setr_epi32(loadBigEndian(lane[0] + t * 4), loadBigEndian(lane[1] + t * 4),
+                                     loadBigEndian(lane[2] + t * 4), loadBigEndian(lane[3] + t * 4),
+                                     loadBigEndian(lane[4] + t * 4), loadBigEndian(lane[5] + t * 4),
+                                     loadBigEndian(lane[6] + t * 4), loadBigEndian(lane[7] + t * 4));
+        }
+        for (int t = 16; t < 64; t++)
+        {
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotateRight8(w[t - 15], 7), rotateRight8(w[t - 15], 18)),
+                                          _mm256_srli_epi32(w[t - 15], 3));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotateRight8(w[t - 2], 17), rotateRight8(w[t - 2], 19)),
+                                          _mm256_srli_epi32(w[t - 2], 10));
+            w[t] = _mm256_add_epi32(_mm256_add_epi32(w[t - 16], s0), _mm256_add_epi32(w[t - 7], s1));
+        }
+
+        __m256i a = v[0], b = v[1], c = v[2], d = v[3], e = v[4], f = v[5], g = v[6], h = v[7];
+
+        for (int t = 0; t < 64; t++)
+        {
+            __m256i bigSigma1 = _mm256_xor_si256(_mm256_xor_si256(rotateRight8(e, 6), rotateRight8(e, 11)), rotateRight8(e, 25));
+            __m256i choose = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+            __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, bigSigma1),
+                                          _mm256_add_epi32(_mm256_add_epi32(choose, w[t]), _mm256_set1_epi32(ROUND_CONSTANTS[t])));
+            __m256i bigSigma0 = _mm256_xor_si256(_mm256_xor_si256(rotateRight8(a, 2), rotateRight8(a, 13)), rotateRight8(a, 22));
+            __m256i majority = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)),
+                                                _mm256_and_si256(b, c));
+            __m256i t2 = _mm256_add_epi32(bigSigma0, majority);
+
+            h = g;
+            g = f;
+            f = e;
+            e = _mm256_add_epi32(d, t1);
+            d = c;
+            c = b;
+            b = a;
+            a = _mm256_add_epi32(t1, t2);
+        }
+
+        v[0] = _mm256_add_epi32(v[0], a);
+        v[1] = _mm256_add_epi32(v[1], b);
+        v[2] = _mm256_add_epi32(v[2], c);
+        v[3] = _mm256_add_epi32(v[3], d);
+        v[4] = _mm256_add_epi32(v[4], e);
+        v[5] = _mm256_add_epi32(v[5], f);
+        v[6] = _mm256_add_epi32(v[6], g);
+        v[7] = _mm256_add_epi32(v[7], h);
+    }
+
+    alignas(32) uint32_t words[8];
+    for (int word = 0; word < 8; word++)
+    {
+        _mm256_store_si256(reinterpret_cast<__m256i *>(words), v[word]);
+        for (int i = 0; i < 8; i++)
+        {
+            states[i][word] = words[i];
+        }
+    }
+}
+#endif
+
+bool hasShaNi()
+{
+#ifdef MELLOPHONE_SHA256_X86
+    static const bool supported = cpuHasShaNi();
+    return supported;
+#else
+    return false;
+#endif
+}
+
+bool hasAvx2()
+{
+#ifdef MELLOPHONE_SHA256_X86
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Compression function for a single stream: SHA-NI if present, portable code otherwise.
+ */
+CompressFunction singleStreamCompress()
+{
+#ifdef MELLOPHONE_SHA256_X86
+    if (hasShaNi())
+    {
+        return compressShaNi;
+    }
+#endif
+    return compressScalar;
+}
+
+/**
+ * Adds bytes to a block-buffered digest.
+ */
+void updateBlocks(uint32_t *state, uint8_t *pending, size_t &pendingLength, uint64_t &totalLength,
+                  const uint8_t *data, size_t length, CompressFunction compress)
+{
+    totalLength += length;
+
+    if (pendingLength > 0)
+    {
+        size_t take = std::min(SHA256_BLOCK_SIZE - pendingLength, length);
+        memcpy(pending + pendingLength, data, take);
+        pendingLength += take;
+        data += take;
+        length -= take;
+
+        if (pendingLength < SHA256_BLOCK_SIZE)
+        {
+            return;
+        }
+
+        compress(state, pending, 1);
+        pendingLength = 0;
+    }
+
+    size_t blocks = length / SHA256_BLOCK_SIZE;
+    if (blocks > 0)
+    {
+        compress(state, data, blocks);
+        data += blocks * SHA256_BLOCK_SIZE;
+        length -= blocks * SHA256_BLOCK_SIZE;
+    }
+
+    memcpy(pending, data, length);
+    pendingLength = length;
+}
+
+/**
+ * Pads the final block and writes out the big-endian digest.
+ */
+void finishBlocks(uint32_t *state, uint8_t *pending, size_t pendingLength, uint64_t totalLength,
+                  CompressFunction compress, uint8_t *digest)
+{
+    const uint64_t bitLength = totalLength * 8;
+
+    pending[pendingLength++] = 0x80;
+    if (pendingLength > SHA256_BLOCK_SIZE - 8)
+    {
+        memset(pending + pendingLength, 0, SHA256_BLOCK_SIZE - pendingLength);
+        compress(state, pending, 1);
+        pendingLength = 0;
+    }
+
+    memset(pending + pendingLength, 0, SHA256_BLOCK_SIZE - 8 - pendingLength);
+    for (int i = 0; i < 8; i++)
+    {
+        pending[SHA256_BLOCK_SIZE - 1 - i] = static_cast<uint8_t>(bitLength >> (i * 8));
+    }
+    compress(state, pending, 1);
+
+    for (int i = 0; i < 8; i++)
+    {
+        digest[i * 4] = static_cast<uint8_t>(state[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(state[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(state[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(state[i]);
+    }
+}
+} // namespace
+
+bool Sha256Engine::isSupported(Sha256Backend backend)
+{
+    switch (backend)
+    {
+    case Sha256Backend::shaNi:
+        return hasShaNi();
+    case Sha256Backend::avx2:
+        return hasAvx2();
+    default:
+        return true;
+    }
+}
+
+Sha256Backend Sha256Engine::getPreferredBackend()
+{
+    // OpenSSL's assembly already uses SHA-NI when the CPU has it, and schedules it better
+    // than compressShaNi (see HashReaderBench), so it stays the default for single streams.
+    return Sha256Backend::openssl;
+}
+
+bool Sha256Engine::prefersMultiBuffer()
+{
+    return hasAvx2() && !hasShaNi();
+}
+
+std::string Sha256Engine::toHex(const uint8_t *digest, size_t length)
+{
+    static const char DIGITS[] = "0123456789abcdef";
+    std::string hex(length * 2, '0');
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hex[i * 2] = DIGITS[digest[i] >> 4];
+        hex[i * 2 + 1] = DIGITS[digest[i] & 0x0f];
+    }
+
+    return hex;
+}
+
+Sha256Hasher::Sha256Hasher(Sha256Backend backend)
+{
+    // Only SHA-NI has its own single-stream path; everything else goes through OpenSSL.
+    this->backend = (backend == Sha256Backend::shaNi && hasShaNi()) ? Sha256Backend::shaNi : Sha256Backend::openssl;
+
+    if (this->backend == Sha256Backend::openssl)
+    {
+        this->context = EVP_MD_CTX_new();
+        if (this->context == nullptr)
+        {
+            throw std::runtime_error("Failed to create SHA256 context.");
+        }
+    }
+
+    this->reset();
+}
+
+Sha256Hasher::~Sha256Hasher()
+{
+    EVP_MD_CTX_free(this->context);
+}
+
+void Sha256Hasher::reset()
+{
+    if (this->backend == Sha256Backend::openssl)
+    {
+        EVP_DigestInit_ex(this->context, EVP_sha256(), nullptr);
+        return;
+    }
+
+    this->state = INITIAL_STATE;
+    this->pendingLength = 0;
+    this->totalLength = 0;
+}
+
+void Sha256Hasher::update(const uint8_t *data, size_t length)
+{
+    if (this->backend == Sha256Backend::openssl)
+    {
+        EVP_DigestUpdate(this->context, data, length);
+        return;
+    }
+
+    updateBlocks(this->state.data(), this->pending.data(), this->pendingLength, this->totalLength, data, length,
+                 singleStreamCompress());
+}
+
+void Sha256Hasher::finish(uint8_t *digest)
+{
+    if (this->backend == Sha256Backend::openssl)
+    {
+        EVP_DigestFinal_ex(this->context, digest, nullptr);
+        return;
+    }
+
+    finishBlocks(this->state.data(), this->pending.data(), this->pendingLength, this->totalLength,
+                 singleStreamCompress(), digest);
+}
+
+Sha256Backend Sha256Hasher::getBackend()
+{
+    return this->backend;
+}
+
+Sha256MultiBuffer::Sha256MultiBuffer(Sha256Backend backend)
+{
+    this->vectorized = backend == Sha256Backend::avx2 && hasAvx2();
+
+    for (size_t lane = 0; lane < LANES; lane++)
+    {
+        this->reset(lane);
+    }
+}
+
+bool Sha256MultiBuffer::isVectorized()
+{
+    return this->vectorized;
+}
+
+void Sha256MultiBuffer::reset(size_t lane)
+{
+    this->lanes[lane].state = INITIAL_STATE;
+    this->lanes[lane].pendingLength = 0;
+    this->lanes[lane].totalLength = 0;
+}
+
+void Sha256MultiBuffer::update(const std::array<const uint8_t *, LANES> &data, const std::array<size_t, LANES> &lengths)
+{
+    const CompressFunction compress = singleStreamCompress();
+
+    std::array<const uint8_t *, LANES> position = data;
+    std::array<size_t, LANES> remaining = lengths;
+
+    // Complete any partial block one lane at a time, so the rest starts on a block boundary.
+    for (size_t i = 0; i < LANES; i++)
+    {
+        Lane &lane = this->lanes[i];
+
+        if (remaining[i] == 0 || lane.pendingLength == 0)
+        {
+            continue;
+        }
+
+        size_t take = std::min(SHA256_BLOCK_SIZE - lane.pendingLength, remaining[i]);
+        updateBlocks(lane.state.data(), lane.pending.data(), lane.pendingLength, lane.totalLength, position[i], take, compress);
+        position[i] += take;
+        remaining[i] -= take;
+    }
+
+    std::array<size_t, LANES> blocks;
+    for (size_t i = 0; i < LANES; i++)
+    {
+        blocks[i] = remaining[i] / SHA256_BLOCK_SIZE;
+        this->lanes[i].totalLength += blocks[i] * SHA256_BLOCK_SIZE;
+    }
+
+    while (true)
+    {
+        size_t activeLanes = 0;
+        size_t lockStepBlocks = SIZE_MAX;
+
+        for (size_t i = 0; i < LANES; i++)
+        {
+            if (blocks[i] > 0)
+            {
+                activeLanes++;
+                lockStepBlocks = std::min(lockStepBlocks, blocks[i]);
+            }
+        }
+
+        if (activeLanes == 0)
+        {
+            break;
+        }
+
+#ifdef MELLOPHONE_SHA256_X86
+        if (this->vectorized && activeLanes > 1)
+        {
+            // Idle lanes hash a dummy block into a scratch state that is thrown away.
+            static const uint8_t idleBlock[SHA256_BLOCK_SIZE] = {};
+            uint32_t scratch[LANES][8];
+            uint32_t *states[LANES];
+            const uint8_t *sources[LANES];
+            size_t strides[LANES];
+
+            for (size_t i = 0; i < LANES; i++)
+            {
+                bool active = blocks[i] > 0;
+                states[i] = active ? this->lanes[i].state.data() : scratch[i];
+                sources[i] = active ? position[i] : idleBlock;
+                strides[i] = active ? SHA256_BLOCK_SIZE : 0;
+                if (!active)
+                {
+                    std::copy(INITIAL_STATE.begin(), INITIAL_STATE.end(), scratch[i]);
+                }
+            }
+
+            compressAvx2(states, sources, strides, lockStepBlocks);
+
+            for (size_t i = 0; i < LANES; i++)
+            {
+                if (blocks[i] > 0)
+                {
+                    position[i] += lockStepBlocks * SHA256_BLOCK_SIZE;
+                    remaining[i] -= lockStepBlocks * SHA256_BLOCK_SIZE;
+                    blocks[i] -= lockStepBlocks;
+                }
+            }
+
+            continue;
+        }
+#endif
+
+        // A single remaining lane (or no AVX2): finish the whole blocks one lane at a time.
+        for (size_t i = 0; i < LANES; i++)
+        {
+            if (blocks[i] > 0)
+            {
+                compress(this->lanes[i].state.data(), position[i], blocks[i]);
+                position[i] += blocks[i] * SHA256_BLOCK_SIZE;
+                remaining[i] -= blocks[i] * SHA256_BLOCK_SIZE;
+                blocks[i] = 0;
+            }
+        }
+    }
+
+    // Keep the tail of each lane for the next update.
+    for (size_t i = 0; i < LANES; i++)
+    {
+        if (remaining[i] > 0)
+        {
+            Lane &lane = this->lanes[i];
+            memcpy(lane.pending.data(), position[i], remaining[i]);
+            lane.pendingLength = remaining[i];
+            lane.totalLength += remaining[i];
+        }
+    }
+}
+
+void Sha256MultiBuffer::finish(size_t lane, uint8_t *digest)
+{
+    Lane &current = this->lanes[lane];
+    finishBlocks(current.state.data(), current.pending.data(), current.pendingLength, current.totalLength,
+                 singleStreamCompress(), digest);
+}
@@ -0,0 +1,185 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <openssl/evp.h>
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+static const size_t SHA256_BLOCK_SIZE = 64;
+static const size_t SHA256_DIGEST_SIZE = 32;
+
+/**
+ * Implementation used to compute SHA-256 digests. All of them produce identical output.
+ */
+enum class Sha256Backend
+{
+    // OpenSSL's EVP digest. Always available.
+    openssl,
+    // Intel SHA extensions, one stream at a time.
+    shaNi,
+    // AVX2, eight independent streams per instruction.
+    avx2
+};
+
+/**
+ * Runtime CPU feature detection for the SHA-256 implementations.
+ */
+class Sha256Engine
+{
+public:
+    /**
+     * Whether the CPU (and build) can run the given backend.
+     */
+    static bool isSupported(Sha256Backend backend);
+
+    /**
+     * The fastest backend for hashing a single stream. This is OpenSSL, which picks its
+     * own SHA-NI or AVX2 assembly at runtime.
+     */
+    static Sha256Backend getPreferredBackend();
+
+    /**
+     * Whether hashing several files at once with Sha256MultiBuffer beats hashing
+     * them one after the other. True on AVX2 machines without SHA-NI.
+     */
+    static bool prefersMultiBuffer();
+
+    /**
+     * Formats a digest as lowercase hex.
+     */
+    static std::string toHex(const uint8_t *digest, size_t length);
+};
+
+/**
+ * Incremental SHA-256 of a single stream.
+ */
+class Sha256Hasher
+{
+private:
+    Sha256Backend backend;
+
+    // Used by the hardware backend.
+    std::array<uint32_t, 8> state;
+    std::array<uint8_t, SHA256_BLOCK_SIZE> pending;
+    size_t pendingLength = 0;
+    uint64_t totalLength = 0;
+
+    // Used by the OpenSSL backend.
+    EVP_MD_CTX *context = nullptr;
+
+public:
+    /**
+     * @param backend implementation to use. Falls back to OpenSSL if the CPU does not support it.
+     */
+    explicit Sha256Hasher(Sha256Backend backend = Sha256Engine::getPreferredBackend());
+
+    ~Sha256Hasher();
+
+    Sha256Hasher(const Sha256Hasher &) = delete;
+    Sha256Hasher &operator=(const Sha256Hasher &) = delete;
+
+    /**
+     * Starts a new digest.
+     */
+    void reset();
+
+    /**
+     * Adds bytes to the digest.
+     */
+    void update(const uint8_t *data, size_t length);
+
+    /**
+     * Completes the digest. The hasher must be reset before it is used again.
+     *
+     * @param digest destination for the 32-byte digest
+     */
+    void finish(uint8_t *digest);
+
+    /**
+     * Retrieves the backend in use after any fallback.
+     */
+    Sha256Backend getBackend();
+};
+
+/**
+ * Multi-buffer SHA-256: up to LANES independent streams hashed in lock-step.
+ *
+ * With AVX2 each 256-bit register holds the same state word of eight streams, so
+ * one pass over the compression function advances all eight lanes. Lanes that run
+ * out of data drop out of the lock-step and are finished one at a time. Without
+ * AVX2 the lanes are simply hashed one after another.
+ */
+class Sha256MultiBuffer
+{
+public:
+    static const size_t LANES = 8;
+
+private:
+    struct Lane
+    {
+        std::array<uint32_t, 8> state;
+        std::array<uint8_t, SHA256_BLOCK_SIZE> pending;
+        size_t pendingLength = 0;
+        uint64_t totalLength = 0;
+    };
+
+    std::array<Lane, LANES> lanes;
+    bool vectorized;
+
+public:
+    /**
+     * @param backend Sha256Backend::avx2 for the vectorized path; anything else hashes lanes serially.
+     */
+    explicit Sha256MultiBuffer(Sha256Backend backend = Sha256Backend::avx2);
+
+    /**
+     * Starts a new digest in a lane.
+     */
+    void reset(size_t lane);
+
+    /**
+     * Adds data to every lane at once. Lanes with a length of 0 are left untouched.
+     * Throughput is best when every lane is given the same amount of data.
+     *
+     * @param data start of each lane's data
+     * @param lengths number of bytes for each lane
+     */
+    void update(const std::array<const uint8_t *, LANES> &data, const std::array<size_t, LANES> &lengths);
+
+    /**
+     * Completes a lane's digest. The lane must be reset before it is used again.
+     *
+     * @param lane lane to finish
+     * @param digest destination for the 32-byte digest
+     */
+    void finish(size_t lane, uint8_t *digest);
+
+    /**
+     * Whether the AVX2 path is in use.
+     */
+    bool isVectorized();
+};
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -0,0 +1,96 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <sstream>
+#include <stdexcept>
+
+// Utility libs
+#include <boost/format.hpp>
+
+// Local includes
+#include "StatementCache.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+CachedStatement::CachedStatement(sqlite3_stmt *stmt) : stmt(stmt)
+{
+}
+
+CachedStatement::CachedStatement(CachedStatement &&other) noexcept : stmt(other.stmt)
+{
+    other.stmt = nullptr;
+}
+
+CachedStatement::~CachedStatement()
+{
+    if (this->stmt != nullptr)
+    {
+        sqlite3_reset(this->stmt);
+        sqlite3_clear_bindings(this->stmt);
+    }
+}
+
+sqlite3_stmt *CachedStatement::get()
+{
+    return this->stmt;
+}
+
+StatementCache::StatementCache(const shared_ptr<sqlite3 *> &db) : db(db)
+{
+}
+
+StatementCache::~StatementCache()
+{
+    this->finalizeAll();
+}
+
+CachedStatement StatementCache::acquire(const string &sql)
+{
+    auto found = this->statements.find(sql);
+
+    if (found != this->statements.end())
+    {
+        return CachedStatement(found->second);
+    }
+
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(*this->db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+    {
+        std::stringstream errStream;
+        errStream << boost::format("Failed to prepare '%s': %s") % sql % sqlite3_errmsg(*this->db);
+        sqlite3_finalize(stmt);
+        throw std::runtime_error(errStream.str());
+    }
+
+    this->statements.emplace(sql, stmt);
+    return CachedStatement(stmt);
+}
+
+void StatementCache::finalizeAll()
+{
+    for (auto &entry : this->statements)
+    {
+        sqlite3_finalize(entry.second);
+    }
+
+    this->statements.clear();
+}
+
+const shared_ptr<sqlite3 *> &StatementCache::getConnection()
+{
+    return this->db;
+}
@@ -0,0 +1,102 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <sqlite3.h>
+
+using std::shared_ptr;
+using std::string;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+/**
+ * Borrowed prepared statement. The statement is reset and its bindings are
+ * cleared when the handle goes out of scope, ready for the next user.
+ */
+class CachedStatement
+{
+private:
+    sqlite3_stmt *stmt;
+
+public:
+    explicit CachedStatement(sqlite3_stmt *stmt);
+
+    ~CachedStatement();
+
+    CachedStatement(CachedStatement &&other) noexcept;
+    CachedStatement(const CachedStatement &) = delete;
+    CachedStatement &operator=(const CachedStatement &) = delete;
+    CachedStatement &operator=(CachedStatement &&) = delete;
+
+    /**
+     * Returns the underlying statement for binding, stepping and reading columns.
+     */
+    sqlite3_stmt *get();
+};
+
+/**
+ * Prepared statements for a single database connection, keyed by their SQL text.
+ *
+ * Each statement is compiled the first time it is requested and kept until the
+ * cache is finalized, so hot queries are parsed once per connection instead of
+ * once per use. Like the connection it belongs to, a cache must only be used by
+ * one thread at a time.
+ */
+class StatementCache
+{
+private:
+    shared_ptr<sqlite3 *> db;
+    std::unordered_map<string, sqlite3_stmt *> statements;
+
+public:
+    explicit StatementCache(const shared_ptr<sqlite3 *> &db);
+
+    /**
+     * Finalizes every cached statement.
+     */
+    ~StatementCache();
+
+    StatementCache(const StatementCache &) = delete;
+    StatementCache &operator=(const StatementCache &) = delete;
+
+    /**
+     * Retrieves the prepared statement for the given SQL, compiling it on first use.
+     *
+     * @param sql statement text
+     *
+     * @returns handle that resets the statement when released.
+     */
+    CachedStatement acquire(const string &sql);
+
+    /**
+     * Finalizes every cached statement. Must be called before the connection is closed.
+     */
+    void finalizeAll();
+
+    /**
+     * Returns the connection the statements are prepared against.
+     */
+    const shared_ptr<sqlite3 *> &getConnection();
+};
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -0,0 +1,272 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Utility libs
+#include <jpeglib.h>
+#include <png.h>
+
+// Local includes
+#include "Thumbnail.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace
+{
+// Images with more pixels than this are not decoded, so a corrupt header cannot ask for gigabytes.
+const uint64_t MAX_IMAGE_PIXELS = 64 * 1024 * 1024;
+
+/**
+ * libjpeg error manager that jumps back to the caller instead of exiting the process.
+ */
+struct JPEGErrorManager
+{
+    jpeg_error_mgr base;
+    std::jmp_buf jump;
+};
+
+void jpegErrorExit(j_common_ptr cinfo)
+{
+    std::longjmp(reinterpret_cast<JPEGErrorManager *>(cinfo->err)->jump, 1);
+}
+
+void jpegOutputMessage(j_common_ptr)
+{
+    // Corrupt cover art is common and not worth reporting.
+}
+
+/**
+ * Decodes a JPEG image. Kept free of objects with destructors, since errors longjmp out.
+ */
+bool decodeJPEG(const uint8_t *data, size_t length, uint32_t minSize, RGBImage &image)
+{
+    jpeg_decompress_struct cinfo;
+    JPEGErrorManager errors;
+
+    cinfo.err = jpeg_std_error(&errors.base);
+    errors.base.error_exit = jpegErrorExit;
+    errors.base.output_message = jpegOutputMessage;
+
+    if (setjmp(errors.jump))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, const_cast<unsigned char *>(data), static_cast<unsigned long>(length));
+    jpeg_read_header(&cinfo, TRUE);
+
+    if (static_cast<uint64_t>(cinfo.image_width) * cinfo.image_height > MAX_IMAGE_PIXELS)
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    cinfo.out_color_space = JCS_RGB;
+
+    // Let the IDCT scale by 1/2, 1/4 or 1/8 as long as the result stays at least minSize.
+    const uint32_t longest = std::max(cinfo.image_width, cinfo.image_height);
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 1;
+    while (minSize > 0 && cinfo.scale_denom < 8 && longest / (cinfo.scale_denom * 2) >= minSize)
+    {
+        cinfo.scale_denom *= 2;
+    }
+
+    jpeg_start_decompress(&cinfo);
+
+    image.width = cinfo.output_width;
+    image.height = cinfo.output_height;
+    image.pixels.resize(static_cast<size_t>(image.width) * image.height * 3);
+
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        JSAMPROW row = image.pixels.data() + static_cast<size_t>(cinfo.output_scanline) * image.width * 3;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+
+    return true;
+}
+
+bool decodePNG(const uint8_t *data, size_t length, RGBImage &image)
+{
+    png_image png;
+    std::memset(&png, 0, sizeof(png));
+    png.version = PNG_IMAGE_VERSION;
+
+    if (!png_image_begin_read_from_memory(&png, data, length))
+    {
+        return false;
+    }
+
+    if (static_cast<uint64_t>(png.width) * png.height > MAX_IMAGE_PIXELS)
+    {
+        png_image_free(&png);
+        return false;
+    }
+
+    // Transparent areas are composited onto white, which is what a grid view shows behind them.
+    png.format = PNG_FORMAT_RGB;
+    png_color background = {255, 255, 255};
+
+    image.width = png.width;
+    image.height = png.height;
+    image.pixels.resize(PNG_IMAGE_SIZE(png));
+
+    if (!png_image_finish_read(&png, &background, image.pixels.data(), 0, nullptr))
+    {
+        png_image_free(&png);
+        return false;
+    }
+
+    return true;
+}
+} // namespace
+
+ImageFormat Thumbnail::detectFormat(const uint8_t *data, size_t length)
+{
+    static const uint8_t PNG_SIGNATURE[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+    if (length >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF)
+    {
+        return ImageFormat::jpeg;
+    }
+
+    if (length >= sizeof(PNG_SIGNATURE) && std::memcmp(data, PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) == 0)
+    {
+        return ImageFormat::png;
+    }
+
+    return ImageFormat::unknown;
+}
+
+bool Thumbnail::decode(const uint8_t *data, size_t length, uint32_t minSize, RGBImage &image)
+{
+    switch (Thumbnail::detectFormat(data, length))
+    {
+    case ImageFormat::jpeg:
+        return decodeJPEG(data, length, minSize, image);
+    case ImageFormat::png:
+        return decodePNG(data, length, image);
+    default:
+        return false;
+    }
+}
+
+RGBImage Thumbnail::scaleToFit(const RGBImage &image, uint32_t maxSize)
+{
+    const uint32_t longest = std::max(image.width, image.height);
+    if (longest <= maxSize || maxSize == 0)
+    {
+        return image;
+    }
+
+    RGBImage scaled;
+    scaled.width = std::max(1u, static_cast<uint32_t>(static_cast<uint64_t>(image.width) * maxSize / longest));
+    scaled.height = std::max(1u, static_cast<uint32_t>(static_cast<uint64_t>(image.height) * maxSize / longest));
+    scaled.pixels.resize(static_cast<size_t>(scaled.width) * scaled.height * 3);
+
+    for (uint32_t y = 0; y < scaled.height; y++)
+    {
+        // Source rows and columns covered by this output pixel.
+        const uint32_t top = static_cast<uint32_t>(static_cast<uint64_t>(y) * image.height / scaled.height);
+        const uint32_t bottom = std::max(top + 1, static_cast<uint32_t>(static_cast<uint64_t>(y + 1) * image.height / scaled.height));
+
+        for (uint32_t x = 0; x < scaled.width; x++)
+        {
+            const uint32_t left = static_cast<uint32_t>(static_cast<uint64_t>(x) * image.width / scaled.width);
+            const uint32_t right = std::max(left + 1, static_cast<uint32_t>(static_cast<uint64_t>(x + 1) * image.width / scaled.width));
+
+            uint64_t sums[3] = {0, 0, 0};
+            for (uint32_t sy = top; sy < bottom; sy++)
+            {
+                const uint8_t *pixel = image.pixels.data() + (static_cast<size_t>(sy) * image.width + left) * 3;
+                for (uint32_t sx = left; sx < right; sx++, pixel += 3)
+                {
+                    sums[0] += pixel[0];
+                    sums[1] += pixel[1];
+                    sums[2] += pixel[2];
+                }
+            }
+
+            const uint64_t count = static_cast<uint64_t>(bottom - top) * (right - left);
+            uint8_t *out = scaled.pixels.data() + (static_cast<size_t>(y) * scaled.width + x) * 3;
+            for (int c = 0; c < 3; c++)
+            {
+                out[c] = static_cast<uint8_t>((sums[c] + count / 2) / count);
+            }
+        }
+    }
+
+    return scaled;
+}
+
+std::vector<uint8_t> Thumbnail::encodeJPEG(const RGBImage &image, int quality)
+{
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr errors;
+
+    // Encoding pixels already in memory only fails when memory runs out, which the default handler reports.
+    cinfo.err = jpeg_std_error(&errors);
+    jpeg_create_compress(&cinfo);
+
+    unsigned char *buffer = nullptr;
+    unsigned long bufferSize = 0;
+    jpeg_mem_dest(&cinfo, &buffer, &bufferSize);
+
+    cinfo.image_width = image.width;
+    cinfo.image_height = image.height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+        JSAMPROW row = const_cast<uint8_t *>(image.pixels.data()) + static_cast<size_t>(cinfo.next_scanline) * image.width * 3;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    std::vector<uint8_t> encoded(buffer, buffer + bufferSize);
+    free(buffer);
+
+    return encoded;
+}
+
+bool Thumbnail::create(const uint8_t *data, size_t length, uint32_t maxSize, std::vector<uint8_t> &thumbnail)
+{
+    RGBImage image;
+    if (!Thumbnail::decode(data, length, maxSize, image))
+    {
+        return false;
+    }
+
+    thumbnail = Thumbnail::encodeJPEG(Thumbnail::scaleToFit(image, maxSize));
+    return true;
+}
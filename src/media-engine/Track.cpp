@@ -15,6 +15,7 @@
 */
 
 // Standard libs
+#include <algorithm>
 #include <fstream>
 #include <memory>
 #include <cstdlib>
@@ -25,13 +26,34 @@
 
 // Utility libs
 #include <boost/format.hpp>
-#include <sqlite3.h>
 
 // Local includes
 #include "Track.hpp"
 
 using namespace Mellophone::MediaEngine;
 
+namespace
+{
+/**
+ * Reads the leading decimal digits of a tag value, so "2/11" gives 2.
+ */
+uint8_t parseTagNumber(std::string_view value)
+{
+    unsigned long number = 0;
+    for (char c : value)
+    {
+        if (c < '0' || c > '9')
+        {
+            break;
+        }
+
+        number = std::min(number * 10 + static_cast<unsigned long>(c - '0'), 255ul);
+    }
+
+    return static_cast<uint8_t>(number);
+}
+} // namespace
+
 string Track::urlEncode(const string &value)
 {
     std::ostringstream encodedStr;
@@ -62,32 +84,111 @@ Track::Track(const fs::path &trackLocation)
     this->trackLocation = trackLocation;
 }
 
-void Track::generateFileHash()
+void Track::generateFileHash(HashReadMode mode)
 {
-    std::stringstream errStream;
-    std::ifstream trackStream = std::ifstream(this->trackLocation, std::ios::binary);
+    Sha256Hasher hasher;
+
+    HashReader reader(mode);
+    reader.read(this->trackLocation, [&hasher](const uint8_t *data, size_t length) {
+        hasher.update(data, length);
+    });
+
+    hasher.finish(this->shaDigest.data());
+    this->fileHashed = true;
+}
+
+void Track::generatePartialHash()
+{
+    this->partialHash = ContentMatcher::computePartialHash(this->trackLocation);
+}
 
-    if (!trackStream.is_open())
+bool Track::hasFileHash()
+{
+    return this->fileHashed;
+}
+
+ContentKey Track::getContentKey()
+{
+    ContentKey key;
+    key.location = this->trackLocation;
+    key.size = this->fingerprint.size;
+    key.partialHash = this->partialHash;
+    key.audioMD5 = this->audioMD5;
+
+    if (this->fileHashed)
     {
-        errStream << boost::format("Unable to open '%s' to generate hash.") % this->trackLocation;
-        throw std::runtime_error(errStream.str());
+        key.fullHash = this->getHashAsString();
     }
 
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
+    return key;
+}
 
-    uint8_t *buffer = new uint8_t[HASH_BUFF_SIZE];
+namespace
+{
+/**
+ * Feeds interleaved file reads into a Sha256MultiBuffer, one file per lane.
+ */
+class MultiBufferHashConsumer : public InterleavedConsumer
+{
+private:
+    Sha256MultiBuffer hasher;
+    vector<uint8_t *> digests;
+    vector<std::exception_ptr> &errors;
+
+public:
+    MultiBufferHashConsumer(vector<uint8_t *> digests, vector<std::exception_ptr> &errors)
+        : digests(std::move(digests)), errors(errors)
+    {
+    }
 
-    uint32_t bytesRead = 0;
+    void begin(size_t lane, size_t) override
+    {
+        this->hasher.reset(lane);
+    }
 
-    while ((bytesRead = trackStream.readsome(reinterpret_cast<char *>(buffer), HASH_BUFF_SIZE)))
+    void consume(const vector<const uint8_t *> &data, const vector<size_t> &lengths) override
     {
-        SHA256_Update(&sha256, buffer, bytesRead);
+        array<const uint8_t *, Sha256MultiBuffer::LANES> laneData{};
+        array<size_t, Sha256MultiBuffer::LANES> laneLengths{};
+
+        std::copy(data.begin(), data.end(), laneData.begin());
+        std::copy(lengths.begin(), lengths.end(), laneLengths.begin());
+
+        this->hasher.update(laneData, laneLengths);
     }
-    SHA256_Final(this->shaDigest.data(), &sha256);
 
-    delete[] buffer;
-    trackStream.close();
+    void end(size_t lane, size_t fileIndex, std::exception_ptr error) override
+    {
+        this->errors[fileIndex] = error;
+
+        if (error == nullptr)
+        {
+            this->hasher.finish(lane, this->digests[fileIndex]);
+        }
+    }
+};
+} // namespace
+
+void Track::generateFileHashes(const vector<Track *> &tracks, vector<std::exception_ptr> &errors)
+{
+    vector<fs::path> paths;
+    vector<uint8_t *> digests;
+
+    for (Track *track : tracks)
+    {
+        paths.push_back(track->trackLocation);
+        digests.push_back(track->shaDigest.data());
+    }
+
+    errors.assign(tracks.size(), nullptr);
+
+    MultiBufferHashConsumer consumer(std::move(digests), errors);
+    HashReader::readInterleaved(paths, Sha256MultiBuffer::LANES, consumer);
+
+    for (size_t i = 0; i < tracks.size(); i++)
+    {
+        tracks[i]->fileHashed = errors[i] == nullptr;
+    }
 }
 
 string Track::getHashAsString()
@@ -106,8 +207,6 @@ string Track::getHashAsString()
 
 Format Track::determineFormat(const fs::path &trackPath)
 {
-    const string extension = trackPath.extension().c_str();
-
     std::ifstream trackFile = std::ifstream(trackPath, std::ios::binary);
 
     if (!trackFile.is_open())
@@ -115,113 +214,115 @@ Format Track::determineFormat(const fs::path &trackPath)
         throw std::runtime_error("Failed to open track.");
     }
 
-    unique_ptr<char> buffer;
-
-    Format trackFormat = Format::unknown;
+    char head[FORMAT_SNIFF_LENGTH];
+    trackFile.read(head, FORMAT_SNIFF_LENGTH);
 
-    if (extension == ".flac")
-    {
-        // The first 4 characters in the file will confirm the format.
-        buffer.reset(new char[5]);
-        buffer.get()[4] = '\0';
-        trackFile.readsome(buffer.get(), 4);
+    const size_t length = static_cast<size_t>(trackFile.gcount());
+    trackFile.close();
 
-        int result = strncmp("fLaC", buffer.get(), 4);
+    return Track::sniffFormat(trackPath, reinterpret_cast<const uint8_t *>(head), length);
+}
 
-        if (result == 0)
-        {
-            trackFormat = Format::flac;
-        }
+Format Track::formatFromExtension(const fs::path &trackPath)
+{
+    const string extension = trackPath.extension().string();
 
-        trackFile.seekg(std::ios::beg);
+    if (extension == ".flac")
+    {
+        return Format::flac;
     }
     else if (extension == ".ogg" || extension == ".oga")
     {
-        // Format declarations are between the OggS tags in the top header.
-        // 'vorbis' is always at 0x1D
-        buffer.reset(new char[7]);
-        buffer.get()[6] = '\0';
+        return Format::vorbis;
+    }
 
-        trackFile.seekg(std::ios::beg + 0x1D);
-        trackFile.readsome(buffer.get(), 6);
+    return Format::unknown;
+}
 
-        int result = strncmp("vorbis", buffer.get(), 6);
+const std::vector<string> &Track::supportedExtensions()
+{
+    static const std::vector<string> extensions = {".flac", ".ogg", ".oga"};
+    return extensions;
+}
 
-        if (result == 0)
+Format Track::sniffFormat(const fs::path &trackPath, const uint8_t *head, size_t length)
+{
+    switch (Track::formatFromExtension(trackPath))
+    {
+    case Format::flac:
+        // The first 4 characters in the file will confirm the format.
+        if (length >= 4 && memcmp(head, "fLaC", 4) == 0)
         {
-            trackFormat = Format::vorbis;
+            return Format::flac;
         }
+        break;
+    case Format::vorbis:
+        // Format declarations are between the OggS tags in the top header.
+        // 'vorbis' is always at 0x1D
+        if (length >= 0x1D + 6 && memcmp(head + 0x1D, "vorbis", 6) == 0)
+        {
+            return Format::vorbis;
+        }
+        break;
+    default:
+        break;
     }
 
-    trackFile.close();
-
-    return trackFormat;
+    return Format::unknown;
 }
 
-void Track::parseVorbisCommentMap(const map<string, string> &comments)
+void Track::parseVorbisComments(const vector<VorbisComment> &comments)
 {
     this->artist.clear();
-    for (const auto &entryPair : comments)
+    for (const VorbisComment &comment : comments)
     {
-        int16_t findLoc = -1;
-        findLoc = entryPair.first.find("ARTIST");
-
-        if (findLoc >= 0)
+        switch (comment.field())
         {
+        case VorbisField::artist:
             // Append this artist to the artists vector
-            this->artist.push_back(entryPair.second);
-        }
-        else
-        {
-            // Check for any of the other fields.
-            if (entryPair.first == "TITLE")
-            {
-                this->title = entryPair.second;
-            }
-            else if (entryPair.first == "ALBUM")
-            {
-                this->album = entryPair.second;
-            }
-            else if (entryPair.first == "DATE")
-            {
-                this->date = entryPair.second;
-            }
-            else if (entryPair.first == "DISCNUMBER")
-            {
-                this->discNum = static_cast<uint8_t>(strtoul(entryPair.second.c_str(), nullptr, 10));
-            }
-            else if (entryPair.first == "TOTALDISCS")
-            {
-                this->totalDiscs = static_cast<uint8_t>(strtoul(entryPair.second.c_str(), nullptr, 10));
-            }
-            else if (entryPair.first == "TRACKNUMBER")
-            {
-                this->trackNum = static_cast<uint8_t>(strtoul(entryPair.second.c_str(), nullptr, 10));
-            }
-            else if (entryPair.first == "TOTALTRACKS")
-            {
-                this->totalTracks = static_cast<uint8_t>(strtoul(entryPair.second.c_str(), nullptr, 10));
-            }
-            else if (entryPair.first == "VERSION")
-            {
-                this->version = entryPair.second;
-            }
-            else if (entryPair.first == "PERFORMER")
-            {
-                this->performer = entryPair.second;
-            }
-            else if (entryPair.first == "GENRE")
-            {
-                this->genre = entryPair.second;
-            }
-            else if (entryPair.first == "LICENSE")
-            {
-                this->licence = entryPair.second;
-            }
-            else if (entryPair.first == "DESCRIPTION")
-            {
-                this->description = entryPair.second;
-            }
+            this->artist.emplace_back(comment.value);
+            break;
+        case VorbisField::title:
+            this->title.assign(comment.value);
+            break;
+        case VorbisField::version:
+            this->version.assign(comment.value);
+            break;
+        case VorbisField::album:
+            this->album.assign(comment.value);
+            break;
+        case VorbisField::date:
+            this->date.assign(comment.value);
+            break;
+        case VorbisField::trackNumber:
+            this->trackNum = parseTagNumber(comment.value);
+            break;
+        case VorbisField::totalTracks:
+            this->totalTracks = parseTagNumber(comment.value);
+            break;
+        case VorbisField::discNumber:
+            this->discNum = parseTagNumber(comment.value);
+            break;
+        case VorbisField::totalDiscs:
+            this->totalDiscs = parseTagNumber(comment.value);
+            break;
+        case VorbisField::performer:
+            this->performer.assign(comment.value);
+            break;
+        case VorbisField::copyright:
+            this->copyright.assign(comment.value);
+            break;
+        case VorbisField::license:
+            this->licence.assign(comment.value);
+            break;
+        case VorbisField::description:
+            this->description.assign(comment.value);
+            break;
+        case VorbisField::genre:
+            this->genre.assign(comment.value);
+            break;
+        case VorbisField::unknown:
+            break;
         }
     }
 
@@ -232,112 +333,19 @@ void Track::parseVorbisCommentMap(const map<string, string> &comments)
     }
 }
 
-
-uint32_t Track::findAlbumID(const string& name, const shared_ptr<sqlite3*>& db)
+fs::path Track::getLocation()
 {
-    unique_ptr<sqlite3_stmt*> stmt = std::make_unique<sqlite3_stmt*>();
-
-    sqlite3_prepare_v2(*db, ALBUM_SELECT_SQL.c_str(), -1, stmt.get(), nullptr);
-    sqlite3_bind_text(*stmt, 1, name.c_str(), -1, SQLITE_STATIC);
-    int execResult = sqlite3_step(*stmt);
-
-    uint32_t id = 0;
-    if (execResult != SQLITE_ROW)
-    {
-        return 0;
-    }
-
-    id = sqlite3_column_int(*stmt, 0);
-    sqlite3_finalize(*stmt);
-    return id;
+    return this->trackLocation;
 }
 
-uint32_t Track::getAlbumID(const shared_ptr<sqlite3 *>& db)
+FileFingerprint Track::getFingerprint()
 {
-    uint32_t id = Track::findAlbumID(this->album, db);
-
-    if (id != 0)
-    {
-        return id;
-    }
-
-    unique_ptr<sqlite3_stmt*> stmt = std::make_unique<sqlite3_stmt*>();
-
-    // No corresponding album was found, so a new entry will be created.
-    uint32_t artistID = this->getArtistID(db);
-    static const string ALBUM_INSERT_SQL = "INSERT INTO Albums(Name, Artist) VALUES(\"@name\",@artistID);";
-    sqlite3_prepare_v2(*db, ALBUM_INSERT_SQL.c_str(), -1, stmt.get(), nullptr);
-    sqlite3_bind_text(*stmt, 1, this->album.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_int(*stmt, 2, artistID);
-    sqlite3_step(*stmt);
-    sqlite3_finalize(*stmt);
-
-    id = Track::findAlbumID(this->album, db);
-
-    return id;
+    return this->fingerprint;
 }
 
-uint32_t Track::findArtistID(const string& name, const shared_ptr<sqlite3*>& db)
+void Track::setFingerprint(const FileFingerprint &fingerprint)
 {
-    unique_ptr<sqlite3_stmt*> stmt = std::make_unique<sqlite3_stmt*>();
-
-    sqlite3_prepare_v2(*db, ARTIST_SELECT_SQL.c_str(), -1, stmt.get(), nullptr);
-    sqlite3_bind_text(*stmt, 1, name.c_str(), -1, SQLITE_STATIC);
-    int execResult = sqlite3_step(*stmt);
-
-    uint32_t id = 0;
-    if (execResult != SQLITE_ROW)
-    {
-        return 0;
-    }
-
-    id = sqlite3_column_int(*stmt, 0);
-    sqlite3_finalize(*stmt);
-    return id;
-}
-
-uint32_t Track::getArtistID(const shared_ptr<sqlite3 *>& db)
-{
-    uint32_t id = Track::findArtistID(this->artist[0], db);
-
-    if (id != 0)
-    {
-        return id;
-    }
-
-    unique_ptr<sqlite3_stmt*> stmt = std::make_unique<sqlite3_stmt*>();
-
-    // No corresponding artist was found, so a new entry will be created.
-    static const string ARTIST_INSERT_SQL = "INSERT INTO Artists(Name) VALUES(\"@name\");";
-    sqlite3_prepare_v2(*db, ARTIST_INSERT_SQL.c_str(), -1, stmt.get(), nullptr);
-    sqlite3_bind_text(*stmt, 1, this->artist[0].c_str(), -1, SQLITE_STATIC);
-    sqlite3_step(*stmt);
-    sqlite3_finalize(*stmt);
-
-    id = Track::findArtistID(this->artist[0], db);
-
-    return id;
-}
-
-void Track::addToDatabase(const shared_ptr<sqlite3 *> db)
-{
-    // Start by determining if the track is already in the DB.
-    static const string FIND_CHECKSUM_STMT = "SELECT * FROM Tracks WHERE Checksum == \"?\";";
-
-    unique_ptr<sqlite3_stmt*> stmt = std::make_unique<sqlite3_stmt*>();
-
-    sqlite3_prepare_v2(*db, FIND_CHECKSUM_STMT.c_str(), FIND_CHECKSUM_STMT.length() + SHA256_STR_LEN, stmt.get(), nullptr);
-    sqlite3_bind_text(*stmt, 1, this->getHashAsString().c_str(), -1, SQLITE_STATIC);
-    int execResult = sqlite3_step(*stmt);
-
-    if (execResult != SQLITE_DONE)
-    {
-        // A file with the same checksum was already in the db.
-        sqlite3_finalize(*stmt);
-        return;
-    }
-
-    // Check if the album exists. Also checks for artist.
+    this->fingerprint = fingerprint;
 }
 
 Format Track::getFormat()
@@ -374,9 +382,39 @@ vector<string> Track::getArtists()
  */
 string Track::getArtist()
 {
+    if (this->artist.empty())
+    {
+        return "unknown";
+    }
+
     return this->artist[0];
 }
 
+string Track::getGenre()
+{
+    return this->genre;
+}
+
+bool Track::hasCoverArt()
+{
+    return this->coverArt.length > 0;
+}
+
+EmbeddedPicture Track::getCoverArt()
+{
+    return this->coverArt;
+}
+
+string Track::getCoverHash()
+{
+    return this->coverHash;
+}
+
+void Track::setCoverHash(const string &hash)
+{
+    this->coverHash = hash;
+}
+
 /**
  * Returns the date (as a string) the track was released.
  */
@@ -404,3 +442,8 @@ uint8_t Track::getTotalDiscs()
 {
     return this->totalDiscs;
 };
+
+uint32_t Track::getDuration()
+{
+    return this->duration;
+};
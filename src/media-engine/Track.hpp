@@ -28,6 +28,13 @@
 #include <openssl/sha.h>
 #include <sqlite3.h>
 
+// Local includes
+#include "ContentMatcher.hpp"
+#include "FileFingerprint.hpp"
+#include "HashReader.hpp"
+#include "Sha256Engine.hpp"
+#include "VorbisComment.hpp"
+
 using std::string;
 using std::vector;
 using std::map;
@@ -46,13 +53,10 @@ static const uint8_t SHA256_STR_LEN = 65;
 static const uint32_t KILOBYTE = 1024;
 static const uint32_t MEGABYTE = 1048576;
 
-static const uint32_t HASH_BUFF_SIZE = MEGABYTE;
-
-// SQL STATEMENTS
-static const string ARTIST_SELECT_SQL = "SELECT ID FROM Artists WHERE Name == \"@name\";";
-static const string ALBUM_SELECT_SQL = "SELECT ID FROM Albums WHERE Name == \"@name\";";
-
-static const string INSERT_TRACK_SQL = "INSERT INTO Tracks VALUES(\"@chksum\",\"@loc\",\"@title\",@album,@trackNum,@totalTracks,@discNum,@totalDiscs);";
+/**
+ * Number of bytes at the start of a file needed to confirm its format.
+ */
+static const size_t FORMAT_SNIFF_LENGTH = 64;
 
 enum Format
 {
@@ -61,33 +65,31 @@ enum Format
     unknown
 };
 
+/**
+ * Position of a picture embedded in a track's file. The image itself is left in the
+ * file until the cover art cache reads it.
+ */
+struct EmbeddedPicture
+{
+    uint64_t offset = 0;
+    uint32_t length = 0;
+    string mimeType = "";
+};
+
 class Track
 {
-private:
-    /**
-     * Locates an album's ID in the database.
-     * 
-     * @param name album name to search for (case-sensitive)
-     * @param db database connection
-     * 
-     * @returns the ID of the album if found. 0 otherwise.
-     */
-    static uint32_t findAlbumID(const string& name, const shared_ptr<sqlite3*>& db);
+    // Fills in the hashes of tracks it builds.
+    friend class TrackIngestor;
 
-    /**
-     * Locates an artist's ID in the database.
-     * 
-     * @param name artist name to search for (case-sensitive)
-     * @param db database connection
-     * 
-     * @returns the ID of the artist if found. 0 otherwise.
-     */
-    static uint32_t findArtistID(const string& name, const shared_ptr<sqlite3*>& db);
 protected:
     // Internal data
     Format format;
     fs::path trackLocation;
+    FileFingerprint fingerprint;
     array<uint8_t, SHA256_DIGEST_LENGTH> shaDigest;
+    bool fileHashed = false;
+    string partialHash = "";
+    string audioMD5 = "";
 
     // Track metadata
     string title = "unknown";
@@ -97,6 +99,8 @@ protected:
     uint8_t totalTracks = 1;
     uint8_t discNum = 1;
     uint8_t totalDiscs = 1;
+    // Length of the audio in milliseconds, or 0 if the format does not say.
+    uint32_t duration = 0;
     vector<string> artist;
     string performer = "unknown";
     string copyright = "";
@@ -104,62 +108,103 @@ protected:
     string description = "";
     string genre = "";
     string date = "";
+    EmbeddedPicture coverArt;
+    string coverHash = "";
 
     static string urlEncode(const string &value);
 
     /**
-     * Reads through a map of tags and values to retrieve the relevant metadata.
+     * Reads through a list of Vorbis comments to retrieve the relevant metadata.
      * 
-     * @param map containing Vorbis comment trags and values.
+     * @param comments Vorbis comments, in the order they appear in the file
+     */
+    void parseVorbisComments(const vector<VorbisComment> &comments);
+
+public:
+    explicit Track(const fs::path &trackLocation);
+
+    virtual ~Track() = default;
+
+    /**
+     * Attempts to fill the Track's metadata entries using the data
+     * from the track's file.
      */
-    void parseVorbisCommentMap(const map<string, string> &comments);
+    virtual void importMetadata() = 0;
 
     /**
-     * Attempts to locate the album ID in the database. In the event that the album
-     * does not exist in the database, a new entry is created and the ID of that is returned.
-     * 
-     * @param name name of album to search for or create
-     * @param db shared pointer to the database connection
+     * Determines the track's format using the extension as a hint.
      * 
-     * @returns integer ID of the album.
+     * FLAC and Vorbis are currently supported.
      */
-    uint32_t getAlbumID(const shared_ptr<sqlite3 *>& db);
+    static Format determineFormat(const fs::path &trackPath);
 
     /**
-     * Attempts to locate the artist ID in the database. In the event that the artist
-     * does not exist in the database, a new entry is created and the ID of that is returned.
-     * 
-     * @param name name of artsit to search for or create
-     * @param db shared pointer to the database connection
-     * 
-     * @returns integer ID of the artist.
+     * Determines the format the track's extension claims, without opening the file.
      */
-    uint32_t getArtistID(const shared_ptr<sqlite3 *>& db);
+    static Format formatFromExtension(const fs::path &trackPath);
 
-public:
-    explicit Track(const fs::path &trackLocation);
+    /**
+     * Returns every extension formatFromExtension recognizes, with its dot.
+     */
+    static const std::vector<string> &supportedExtensions();
 
     /**
-     * Determines the track's format using the extension as a hint.
+     * Confirms the format claimed by the extension against the start of the file.
      * 
-     * FLAC and Vorbis are currently supported.
+     * @param trackPath location of the track, for its extension
+     * @param head first bytes of the file
+     * @param length number of bytes in `head`. FORMAT_SNIFF_LENGTH is always enough.
      */
-    static Format determineFormat(const fs::path &trackPath);
+    static Format sniffFormat(const fs::path &trackPath, const uint8_t *head, size_t length);
 
     /**
      * Thread-safe method for generating the SHA256 hash of the track data.
+     * 
+     * @param mode how the file is read. See HashReader.
      */
-    void generateFileHash();
+    void generateFileHash(HashReadMode mode = HashReadMode::pread);
 
     /**
-     * Adds the track and supporting data to the database.
+     * Generates the SHA256 hashes of several tracks at once, reading the files side by
+     * side and hashing them in lock-step with Sha256MultiBuffer.
      * 
-     * Tracks in the database rely on mapping to an album and an artist, so if the
-     * corresponding data is missing it will be created.
+     * @param tracks tracks to hash
+     * @param errors set to the error that stopped each track's hash, or null if it was hashed
+     */
+    static void generateFileHashes(const vector<Track *> &tracks, vector<std::exception_ptr> &errors);
+
+    /**
+     * Computes the cheap partial hash of the track's file. See ContentMatcher.
+     */
+    void generatePartialHash();
+
+    /**
+     * Whether the full SHA256 hash of the file has been generated.
+     */
+    bool hasFileHash();
+
+    /**
+     * Retrieves the identity keys known so far for the track's file. The full hash is
+     * only included once it has been generated.
+     */
+    ContentKey getContentKey();
+
+    /**
+     * Retrieves the location of the track's file.
+     */
+    fs::path getLocation();
+
+    /**
+     * Retrieves the stat fingerprint of the track's file at import time.
+     */
+    FileFingerprint getFingerprint();
+
+    /**
+     * Records the stat fingerprint of the track's file.
      * 
-     * @param db database connection to use.
+     * @param fingerprint fingerprint taken before the file was read
      */
-    void addToDatabase(const shared_ptr<sqlite3 *> db);
+    void setFingerprint(const FileFingerprint &fingerprint);
 
     /**
      * Retrieves the track's associated format.
@@ -186,6 +231,32 @@ public:
      */
     string getArtist();
 
+    /**
+     * Retrieves the track's genre. Empty if the file does not name one.
+     */
+    string getGenre();
+
+    /**
+     * Whether the track's file embeds a picture to use as cover art.
+     */
+    bool hasCoverArt();
+
+    /**
+     * Retrieves the position of the track's cover art in its file.
+     */
+    EmbeddedPicture getCoverArt();
+
+    /**
+     * Retrieves the hash of the track's cover art in the cover art cache. Empty until
+     * the picture has been stored.
+     */
+    string getCoverHash();
+
+    /**
+     * Records the hash the cover art cache stored the track's picture under.
+     */
+    void setCoverHash(const string &hash);
+
     /**
      * Returns the date (as a string) the track was released.
      * 
@@ -221,6 +292,13 @@ public:
      */
     uint8_t getTotalDiscs();
 
+    /**
+     * Returns the length of the audio.
+     * 
+     * @returns length of the audio in milliseconds, or 0 if unknown
+     */
+    uint32_t getDuration();
+
     /**
      * Converts the raw SHA256 hash to a string and returns it.
      * 
@@ -0,0 +1,350 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+// Utility libs
+#include <boost/format.hpp>
+
+// Local includes
+#include "FLACTrack.hpp"
+#include "TrackIngestor.hpp"
+#include "VorbisTrack.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace
+{
+/**
+ * Feeds interleaved file reads to each file's ingestor and to a Sha256MultiBuffer,
+ * one file per lane.
+ */
+class IngestorConsumer : public InterleavedConsumer
+{
+private:
+    Sha256MultiBuffer hasher;
+    const vector<unique_ptr<TrackIngestor>> &ingestors;
+    vector<std::exception_ptr> &errors;
+
+    // File each lane is reading and how far into it the lane is.
+    array<size_t, Sha256MultiBuffer::LANES> laneFiles{};
+    array<uint64_t, Sha256MultiBuffer::LANES> laneOffsets{};
+
+public:
+    IngestorConsumer(const vector<unique_ptr<TrackIngestor>> &ingestors, vector<std::exception_ptr> &errors)
+        : ingestors(ingestors), errors(errors)
+    {
+    }
+
+    void begin(size_t lane, size_t fileIndex) override
+    {
+        this->hasher.reset(lane);
+        this->laneFiles[lane] = fileIndex;
+        this->laneOffsets[lane] = 0;
+    }
+
+    void consume(const vector<const uint8_t *> &data, const vector<size_t> &lengths) override
+    {
+        array<const uint8_t *, Sha256MultiBuffer::LANES> laneData{};
+        array<size_t, Sha256MultiBuffer::LANES> laneLengths{};
+
+        std::copy(data.begin(), data.end(), laneData.begin());
+        std::copy(lengths.begin(), lengths.end(), laneLengths.begin());
+
+        const uint64_t hashStart = monotonicNanos();
+        this->hasher.update(laneData, laneLengths);
+        const uint64_t hashNanos = monotonicNanos() - hashStart;
+
+        // The lanes were hashed together, so each file is charged an equal share.
+        const size_t activeLanes = lengths.size() - std::count(lengths.begin(), lengths.end(), 0);
+
+        for (size_t lane = 0; lane < lengths.size(); lane++)
+        {
+            if (lengths[lane] > 0)
+            {
+                this->ingestors[this->laneFiles[lane]]->addHashTime(hashNanos / activeLanes);
+                this->ingestors[this->laneFiles[lane]]->consume(this->laneOffsets[lane], data[lane], lengths[lane]);
+                this->laneOffsets[lane] += lengths[lane];
+            }
+        }
+    }
+
+    void end(size_t lane, size_t fileIndex, std::exception_ptr error) override
+    {
+        this->errors[fileIndex] = error;
+
+        if (error == nullptr)
+        {
+            uint8_t digest[SHA256_DIGEST_SIZE];
+            this->hasher.finish(lane, digest);
+            this->ingestors[fileIndex]->setFileHash(digest);
+        }
+    }
+};
+} // namespace
+
+TrackIngestor::TrackIngestor(const fs::path &location, const FileFingerprint &fingerprint, bool hashFile)
+    : location(location), fingerprint(fingerprint), hashFile(hashFile), partialHasher(fingerprint.size)
+{
+}
+
+void TrackIngestor::consume(uint64_t offset, const uint8_t *data, size_t length)
+{
+    if (length == 0)
+    {
+        return;
+    }
+
+    this->timings.bytesConsumed += length;
+
+    const uint64_t hashStart = monotonicNanos();
+    if (this->hashFile && offset == this->contiguousEnd)
+    {
+        this->fullHasher.update(data, length);
+    }
+
+    if (offset == this->contiguousEnd)
+    {
+        this->contiguousEnd += length;
+    }
+    this->streamEnd = std::max(this->streamEnd, offset + length);
+
+    this->partialHasher.update(offset, data, length);
+    this->timings.hashNanos += monotonicNanos() - hashStart;
+
+    if (!this->formatKnown)
+    {
+        if (offset < FORMAT_SNIFF_LENGTH && offset == this->headLength)
+        {
+            const size_t count = std::min(FORMAT_SNIFF_LENGTH - this->headLength, length);
+            std::copy(data, data + count, this->head.begin() + this->headLength);
+            this->headLength += count;
+        }
+
+        if (this->headLength < FORMAT_SNIFF_LENGTH && this->contiguousEnd == this->headLength)
+        {
+            // Not enough of the file yet; the head buffer holds everything seen so far.
+            return;
+        }
+
+        this->decideFormat();
+    }
+
+    this->feedMetadata(offset, data, length);
+}
+
+void TrackIngestor::decideFormat()
+{
+    const uint64_t start = monotonicNanos();
+    this->format = Track::sniffFormat(this->location, this->head.data(), this->headLength);
+    this->formatKnown = true;
+    this->timings.detectNanos += monotonicNanos() - start;
+
+    // The parser has not seen the head yet.
+    this->feedMetadata(0, this->head.data(), this->headLength);
+}
+
+void TrackIngestor::feedMetadata(uint64_t offset, const uint8_t *data, size_t length)
+{
+    if (this->metadataError != nullptr)
+    {
+        return;
+    }
+
+    const uint64_t start = monotonicNanos();
+
+    try
+    {
+        // A chunk past the bytes a parser needs means the stream skipped them; finish() reads them.
+        if (this->format == Format::flac && !this->flacParser.isFinished() && offset <= this->flacParser.nextOffset())
+        {
+            this->flacParser.feed(offset, data, length);
+        }
+        else if (this->format == Format::vorbis && !this->vorbisParser.isFinished() &&
+                 offset <= this->vorbisParser.nextOffset())
+        {
+            this->vorbisParser.feed(offset, data, length);
+        }
+    }
+    catch (...)
+    {
+        this->metadataError = std::current_exception();
+    }
+
+    this->timings.parseNanos += monotonicNanos() - start;
+}
+
+void TrackIngestor::addHashTime(uint64_t nanos)
+{
+    this->timings.hashNanos += nanos;
+}
+
+void TrackIngestor::setFileHash(const uint8_t *digest)
+{
+    std::copy(digest, digest + SHA256_DIGEST_SIZE, this->fullDigest.begin());
+    this->fullDigestKnown = true;
+}
+
+unique_ptr<Track> TrackIngestor::finish()
+{
+    if (this->streamEnd != this->fingerprint.size)
+    {
+        std::stringstream errStream;
+        errStream << boost::format("'%s' changed while it was being read.") % this->location;
+        throw std::runtime_error(errStream.str());
+    }
+
+    if (!this->formatKnown)
+    {
+        // The file is shorter than the sniff length.
+        this->decideFormat();
+    }
+
+    unique_ptr<Track> track = TrackIngestor::createTrack(this->format, this->location);
+    if (track == nullptr)
+    {
+        return nullptr;
+    }
+
+    if (this->metadataError != nullptr)
+    {
+        std::rethrow_exception(this->metadataError);
+    }
+
+    uint64_t start = monotonicNanos();
+
+    switch (this->format)
+    {
+    case Format::flac:
+        static_cast<FLACTrack *>(track.get())->applyMetadata(FLACMetadata::read(this->location, this->flacParser));
+        break;
+    case Format::vorbis:
+        static_cast<VorbisTrack *>(track.get())->applyMetadata(OggVorbisMetadata::read(this->location, this->vorbisParser));
+        break;
+    default:
+        break;
+    }
+
+    this->timings.parseNanos += monotonicNanos() - start;
+    start = monotonicNanos();
+
+    track->setFingerprint(this->fingerprint);
+    track->partialHash = this->partialHasher.finish();
+
+    if (this->hashFile && this->contiguousEnd == this->fingerprint.size)
+    {
+        this->fullHasher.finish(this->fullDigest.data());
+        this->fullDigestKnown = true;
+    }
+
+    if (this->fullDigestKnown)
+    {
+        std::copy(this->fullDigest.begin(), this->fullDigest.end(), track->shaDigest.begin());
+        track->fileHashed = true;
+    }
+
+    this->timings.hashNanos += monotonicNanos() - start;
+
+    return track;
+}
+
+unique_ptr<Track> TrackIngestor::read(HashReadMode mode)
+{
+    if (this->hashFile)
+    {
+        uint64_t offset = 0;
+
+        HashReader reader(mode);
+        reader.read(this->location, [this, &offset](const uint8_t *data, size_t length) {
+            this->consume(offset, data, length);
+            offset += length;
+        });
+    }
+    else
+    {
+        HashReader::readEnds(this->location, PARTIAL_HASH_SPAN, [this](uint64_t offset, const uint8_t *data, size_t length) {
+            this->consume(offset, data, length);
+        });
+    }
+
+    return this->finish();
+}
+
+void TrackIngestor::readInterleaved(const vector<unique_ptr<TrackIngestor>> &ingestors, vector<unique_ptr<Track>> &tracks,
+                                    vector<std::exception_ptr> &errors)
+{
+    vector<fs::path> paths;
+    for (const auto &ingestor : ingestors)
+    {
+        paths.push_back(ingestor->location);
+    }
+
+    errors.assign(ingestors.size(), nullptr);
+    tracks.clear();
+    tracks.resize(ingestors.size());
+
+    IngestorConsumer consumer(ingestors, errors);
+    HashReader::readInterleaved(paths, Sha256MultiBuffer::LANES, consumer);
+
+    for (size_t i = 0; i < ingestors.size(); i++)
+    {
+        if (errors[i] != nullptr)
+        {
+            continue;
+        }
+
+        try
+        {
+            tracks[i] = ingestors[i]->finish();
+        }
+        catch (...)
+        {
+            errors[i] = std::current_exception();
+        }
+    }
+}
+
+bool TrackIngestor::canIngest(const fs::path &location)
+{
+    return Track::formatFromExtension(location) != Format::unknown;
+}
+
+unique_ptr<Track> TrackIngestor::createTrack(Format format, const fs::path &location)
+{
+    switch (format)
+    {
+    case Format::flac:
+        return std::make_unique<FLACTrack>(location);
+    case Format::vorbis:
+        return std::make_unique<VorbisTrack>(location);
+    default:
+        return nullptr;
+    }
+}
+
+fs::path TrackIngestor::getLocation()
+{
+    return this->location;
+}
+
+const IngestTimings &TrackIngestor::getTimings() const
+{
+    return this->timings;
+}
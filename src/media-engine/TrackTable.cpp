@@ -0,0 +1,401 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <tuple>
+
+#include "TrackTable.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+StringPool::StringPool()
+{
+    this->strings.emplace_back();
+    this->index.emplace(string_view(), 0);
+}
+
+uint32_t StringPool::intern(string_view value)
+{
+    auto found = this->index.find(value);
+    if (found != this->index.end())
+    {
+        return found->second;
+    }
+
+    char *copy;
+    if (value.size() > CHUNK_SIZE / 4)
+    {
+        // Long strings get a chunk of their own rather than wasting the rest of a shared one.
+        this->chunks.push_back(std::make_unique<char[]>(value.size()));
+        this->chunkBytes += value.size();
+        copy = this->chunks.back().get();
+    }
+    else
+    {
+        if (this->chunkUsed + value.size() > CHUNK_SIZE)
+        {
+            this->chunks.push_back(std::make_unique<char[]>(CHUNK_SIZE));
+            this->chunkBytes += CHUNK_SIZE;
+            this->chunk = this->chunks.back().get();
+            this->chunkUsed = 0;
+        }
+
+        copy = this->chunk + this->chunkUsed;
+        this->chunkUsed += value.size();
+    }
+
+    std::memcpy(copy, value.data(), value.size());
+
+    const uint32_t id = static_cast<uint32_t>(this->strings.size());
+    this->strings.emplace_back(copy, value.size());
+    this->index.emplace(this->strings.back(), id);
+
+    return id;
+}
+
+uint32_t StringPool::find(string_view value) const
+{
+    auto found = this->index.find(value);
+    return found != this->index.end() ? found->second : NOT_FOUND;
+}
+
+vector<uint32_t> StringPool::ranks() const
+{
+    vector<uint32_t> order(this->strings.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [this](uint32_t a, uint32_t b) { return this->strings[a] < this->strings[b]; });
+
+    vector<uint32_t> ranks(this->strings.size());
+    for (uint32_t position = 0; position < order.size(); position++)
+    {
+        ranks[order[position]] = position;
+    }
+
+    return ranks;
+}
+
+size_t StringPool::memoryUsage() const
+{
+    // Each index entry costs a node holding the key, the value and a next pointer, plus a bucket.
+    const size_t indexEntry = sizeof(std::pair<const string_view, uint32_t>) + 2 * sizeof(void *);
+
+    return this->chunkBytes + this->chunks.capacity() * sizeof(this->chunks[0]) +
+           this->strings.capacity() * sizeof(string_view) + this->index.size() * indexEntry +
+           this->index.bucket_count() * sizeof(void *);
+}
+
+void TrackRow::setLocation(string_view location)
+{
+    const size_t slash = location.rfind('/');
+    if (slash == string_view::npos)
+    {
+        this->directory = string_view();
+        this->fileName = location;
+    }
+    else
+    {
+        this->directory = location.substr(0, slash + 1);
+        this->fileName = location.substr(slash + 1);
+    }
+}
+
+string TrackRow::location() const
+{
+    string joined;
+    joined.reserve(this->directory.size() + this->fileName.size());
+    joined.append(this->directory);
+    joined.append(this->fileName);
+    return joined;
+}
+
+void TrackTable::TextColumn::append(string_view value)
+{
+    if (this->chars.size() + value.size() > UINT32_MAX)
+    {
+        throw std::runtime_error("Track table text exceeds 4 GiB.");
+    }
+
+    this->chars.insert(this->chars.end(), value.begin(), value.end());
+    this->ends.push_back(static_cast<uint32_t>(this->chars.size()));
+}
+
+/**
+ * Returns the text in the given column, or an empty view for NULL.
+ */
+static string_view columnText(sqlite3_stmt *stmt, int column)
+{
+    const char *text = reinterpret_cast<const char *>(sqlite3_column_text(stmt, column));
+    if (text == nullptr)
+    {
+        return string_view();
+    }
+
+    return string_view(text, sqlite3_column_bytes(stmt, column));
+}
+
+static uint8_t columnNumber(sqlite3_stmt *stmt, int column)
+{
+    if (sqlite3_column_type(stmt, column) == SQLITE_NULL)
+    {
+        return 1;
+    }
+
+    return static_cast<uint8_t>(std::clamp(sqlite3_column_int(stmt, column), 0, 255));
+}
+
+TrackTable TrackTable::load(const shared_ptr<StatementCache> &statements)
+{
+    TrackTable table;
+
+    CachedStatement count = statements->acquire(TRACK_COUNT_SQL);
+    if (sqlite3_step(count.get()) == SQLITE_ROW)
+    {
+        table.reserve(sqlite3_column_int64(count.get(), 0));
+    }
+
+    // Tracks of one album are usually adjacent, but not always, so remember every album's
+    // interned names instead of only the last one.
+    std::unordered_map<int64_t, std::pair<uint32_t, uint32_t>> albumNames;
+
+    CachedStatement stmt = statements->acquire(TRACK_TABLE_LOAD_SQL);
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW)
+    {
+        sqlite3_stmt *row = stmt.get();
+
+        auto album = albumNames.find(sqlite3_column_int64(row, 9));
+        if (album == albumNames.end())
+        {
+            album = albumNames
+                        .emplace(sqlite3_column_int64(row, 9),
+                                 std::make_pair(table.names.intern(columnText(row, 10)),
+                                                table.names.intern(columnText(row, 11))))
+                        .first;
+        }
+
+        // Split after the last slash. Without one, npos + 1 wraps to 0 and the folder is empty.
+        const string_view location = columnText(row, 2);
+        const size_t slash = location.rfind('/') + 1;
+
+        table.ids.push_back(static_cast<uint32_t>(sqlite3_column_int64(row, 0)));
+        table.titles.append(columnText(row, 1));
+        table.folders.push_back(table.directories.intern(location.substr(0, slash)));
+        table.fileNames.append(location.substr(slash));
+        table.numbers.push_back(
+            {columnNumber(row, 3), columnNumber(row, 4), columnNumber(row, 5), columnNumber(row, 6)});
+        table.genres.push_back(table.names.intern(columnText(row, 7)));
+        table.years.push_back(TrackTable::parseYear(columnText(row, 8)));
+        table.albums.push_back(album->second.first);
+        table.artists.push_back(album->second.second);
+    }
+
+    table.shrinkToFit();
+
+    return table;
+}
+
+uint16_t TrackTable::parseYear(string_view date)
+{
+    if (date.size() < 4)
+    {
+        return 0;
+    }
+
+    uint16_t year = 0;
+    for (size_t i = 0; i < 4; i++)
+    {
+        if (date[i] < '0' || date[i] > '9')
+        {
+            return 0;
+        }
+        year = static_cast<uint16_t>(year * 10 + (date[i] - '0'));
+    }
+
+    return year;
+}
+
+void TrackTable::append(const TrackRow &row)
+{
+    this->ids.push_back(row.id);
+    this->titles.append(row.title);
+    this->folders.push_back(this->directories.intern(row.directory));
+    this->fileNames.append(row.fileName);
+    this->artists.push_back(this->names.intern(row.artist));
+    this->albums.push_back(this->names.intern(row.album));
+    this->genres.push_back(this->names.intern(row.genre));
+    this->years.push_back(row.year);
+    this->numbers.push_back(row.numbers);
+}
+
+void TrackTable::reserve(size_t rows)
+{
+    this->ids.reserve(rows);
+    this->artists.reserve(rows);
+    this->albums.reserve(rows);
+    this->genres.reserve(rows);
+    this->folders.reserve(rows);
+    this->years.reserve(rows);
+    this->numbers.reserve(rows);
+    this->titles.ends.reserve(rows);
+    this->fileNames.ends.reserve(rows);
+}
+
+void TrackTable::shrinkToFit()
+{
+    this->ids.shrink_to_fit();
+    this->artists.shrink_to_fit();
+    this->albums.shrink_to_fit();
+    this->genres.shrink_to_fit();
+    this->folders.shrink_to_fit();
+    this->years.shrink_to_fit();
+    this->numbers.shrink_to_fit();
+    this->titles.chars.shrink_to_fit();
+    this->titles.ends.shrink_to_fit();
+    this->fileNames.chars.shrink_to_fit();
+    this->fileNames.ends.shrink_to_fit();
+}
+
+TrackRow TrackTable::row(size_t row) const
+{
+    TrackRow result;
+    result.id = this->ids[row];
+    result.title = this->titles.get(row);
+    result.directory = this->directories.get(this->folders[row]);
+    result.fileName = this->fileNames.get(row);
+    result.artist = this->names.get(this->artists[row]);
+    result.album = this->names.get(this->albums[row]);
+    result.genre = this->names.get(this->genres[row]);
+    result.year = this->years[row];
+    result.numbers = this->numbers[row];
+    return result;
+}
+
+string TrackTable::location(size_t row) const
+{
+    return this->row(row).location();
+}
+
+vector<uint32_t> TrackTable::selectName(const vector<uint32_t> &column, string_view name) const
+{
+    vector<uint32_t> rows;
+
+    const uint32_t id = this->names.find(name);
+    if (id == StringPool::NOT_FOUND)
+    {
+        return rows;
+    }
+
+    for (uint32_t row = 0; row < column.size(); row++)
+    {
+        if (column[row] == id)
+        {
+            rows.push_back(row);
+        }
+    }
+
+    return rows;
+}
+
+vector<uint32_t> TrackTable::selectArtist(string_view name) const
+{
+    return this->selectName(this->artists, name);
+}
+
+vector<uint32_t> TrackTable::selectAlbum(string_view name) const
+{
+    return this->selectName(this->albums, name);
+}
+
+vector<uint32_t> TrackTable::selectGenre(string_view name) const
+{
+    return this->selectName(this->genres, name);
+}
+
+vector<uint32_t> TrackTable::sortedOrder(TrackSortKey key) const
+{
+    vector<uint32_t> order(this->size());
+    std::iota(order.begin(), order.end(), 0);
+
+    if (key == TrackSortKey::title)
+    {
+        std::stable_sort(order.begin(), order.end(),
+                         [this](uint32_t a, uint32_t b) { return this->titles.get(a) < this->titles.get(b); });
+        return order;
+    }
+
+    // Compare name ranks and packed numbers instead of strings, so the sort only touches
+    // small fixed-size entries.
+    struct SortEntry
+    {
+        uint32_t first;
+        uint32_t second;
+        uint32_t third;
+        uint16_t position;
+        uint32_t row;
+    };
+
+    const vector<uint32_t> ranks = this->names.ranks();
+
+    vector<SortEntry> entries(this->size());
+    for (uint32_t row = 0; row < this->size(); row++)
+    {
+        const uint32_t artist = ranks[this->artists[row]];
+        const uint32_t album = ranks[this->albums[row]];
+        const uint16_t position = static_cast<uint16_t>(this->numbers[row].discNum << 8 | this->numbers[row].trackNum);
+
+        switch (key)
+        {
+        case TrackSortKey::album:
+            entries[row] = {album, 0, 0, position, row};
+            break;
+        case TrackSortKey::genre:
+            entries[row] = {ranks[this->genres[row]], artist, album, position, row};
+            break;
+        case TrackSortKey::year:
+            entries[row] = {this->years[row], artist, album, position, row};
+            break;
+        default:
+            entries[row] = {artist, album, 0, position, row};
+            break;
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const SortEntry &a, const SortEntry &b) {
+        return std::tie(a.first, a.second, a.third, a.position, a.row) <
+               std::tie(b.first, b.second, b.third, b.position, b.row);
+    });
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        order[i] = entries[i].row;
+    }
+
+    return order;
+}
+
+size_t TrackTable::memoryUsage() const
+{
+    return sizeof(TrackTable) + this->names.memoryUsage() + this->directories.memoryUsage() +
+           (this->ids.capacity() + this->artists.capacity() + this->albums.capacity() + this->genres.capacity() +
+            this->folders.capacity()) *
+               sizeof(uint32_t) +
+           this->years.capacity() * sizeof(uint16_t) + this->numbers.capacity() * sizeof(TrackNumbers) +
+           this->titles.chars.capacity() + this->titles.ends.capacity() * sizeof(uint32_t) +
+           this->fileNames.chars.capacity() + this->fileNames.ends.capacity() * sizeof(uint32_t);
+}
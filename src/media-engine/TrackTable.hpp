@@ -0,0 +1,306 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "StatementCache.hpp"
+
+using std::string_view;
+using std::vector;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+static const string TRACK_COUNT_SQL = "SELECT COUNT(*) FROM Tracks;";
+static const string TRACK_TABLE_LOAD_SQL =
+    "SELECT Tracks.ID, Tracks.Title, Tracks.FileLocation, Tracks.TrackNum, Tracks.TotalTracks, Tracks.DiscNum, "
+    "Tracks.TotalDiscs, Tracks.Genre, Tracks.Date, Tracks.Album, Albums.Name, Artists.Name "
+    "FROM Tracks LEFT JOIN Albums ON Albums.ID == Tracks.Album "
+    "LEFT JOIN Artists ON Artists.ID == Albums.Artist ORDER BY Tracks.ID;";
+
+/**
+ * Arena of distinct strings, each identified by a dense 32-bit ID. ID 0 is always
+ * the empty string.
+ *
+ * Strings are copied into fixed-size chunks that never move, so the views the pool
+ * hands out stay valid as it grows and when it is moved.
+ */
+class StringPool
+{
+private:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    vector<std::unique_ptr<char[]>> chunks;
+    char *chunk = nullptr;
+    size_t chunkUsed = CHUNK_SIZE;
+    size_t chunkBytes = 0;
+    vector<string_view> strings;
+    std::unordered_map<string_view, uint32_t> index;
+
+public:
+    static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+
+    StringPool();
+
+    StringPool(StringPool &&) = default;
+    StringPool &operator=(StringPool &&) = default;
+    StringPool(const StringPool &) = delete;
+    StringPool &operator=(const StringPool &) = delete;
+
+    /**
+     * Returns the ID of the given string, copying it into the pool if it is new.
+     */
+    uint32_t intern(string_view value);
+
+    /**
+     * Returns the ID of the given string, or NOT_FOUND if it was never interned.
+     */
+    uint32_t find(string_view value) const;
+
+    string_view get(uint32_t id) const
+    {
+        return this->strings[id];
+    }
+
+    size_t size() const
+    {
+        return this->strings.size();
+    }
+
+    /**
+     * Returns, for every ID, the position of its string in byte-wise sorted order.
+     * Comparing ranks orders strings without touching their characters.
+     */
+    vector<uint32_t> ranks() const;
+
+    /**
+     * Approximate number of bytes held by the pool, including its index.
+     */
+    size_t memoryUsage() const;
+};
+
+/**
+ * Track, disc and total numbers, packed so one load fetches all four.
+ */
+struct TrackNumbers
+{
+    uint8_t trackNum = 1;
+    uint8_t totalTracks = 1;
+    uint8_t discNum = 1;
+    uint8_t totalDiscs = 1;
+};
+
+/**
+ * A single track's fields, as passed to and read back from a TrackTable. The views
+ * borrow from the caller when appending and from the table when reading.
+ */
+struct TrackRow
+{
+    uint32_t id = 0;
+    string_view title;
+    string_view directory;
+    string_view fileName;
+    string_view artist;
+    string_view album;
+    string_view genre;
+    uint16_t year = 0;
+    TrackNumbers numbers;
+
+    /**
+     * Points directory and fileName at the two halves of the given path. The path must
+     * outlive the row.
+     */
+    void setLocation(string_view location);
+
+    /**
+     * Joins directory and fileName back into the full path.
+     */
+    string location() const;
+};
+
+enum class TrackSortKey
+{
+    artist,
+    album,
+    genre,
+    year,
+    title
+};
+
+/**
+ * Column-oriented, read-mostly copy of the library for browsing.
+ *
+ * Every field is stored in its own array, indexed by row, so sorting and filtering
+ * walk only the columns they need. Artist, album and genre names are interned in a
+ * shared pool and stored as 32-bit IDs, and a track's folder is interned separately
+ * so tracks in one folder share it. Only titles and file names are stored per row,
+ * back to back in a single buffer.
+ *
+ * The table is built once, from the database or row by row, and not modified after.
+ */
+class TrackTable
+{
+private:
+    /**
+     * Variable-length strings stored end to end, one per row.
+     */
+    struct TextColumn
+    {
+        vector<char> chars;
+        vector<uint32_t> ends;
+
+        void append(string_view value);
+
+        string_view get(size_t row) const
+        {
+            const uint32_t start = row == 0 ? 0 : this->ends[row - 1];
+            return string_view(this->chars.data() + start, this->ends[row] - start);
+        }
+    };
+
+    StringPool names;
+    StringPool directories;
+
+    vector<uint32_t> ids;
+    vector<uint32_t> artists;
+    vector<uint32_t> albums;
+    vector<uint32_t> genres;
+    vector<uint32_t> folders;
+    vector<uint16_t> years;
+    vector<TrackNumbers> numbers;
+    TextColumn titles;
+    TextColumn fileNames;
+
+    vector<uint32_t> selectName(const vector<uint32_t> &column, string_view name) const;
+
+public:
+    /**
+     * Reads every track in the database, in ID order.
+     *
+     * @param statements statement cache of the connection to read from
+     */
+    static TrackTable load(const shared_ptr<StatementCache> &statements);
+
+    /**
+     * Parses the year from the start of a date tag, such as "2004" or "2004-05-17".
+     *
+     * @returns the year, or 0 if the tag does not start with one.
+     */
+    static uint16_t parseYear(string_view date);
+
+    void append(const TrackRow &row);
+
+    /**
+     * Reserves space for the given number of rows.
+     */
+    void reserve(size_t rows);
+
+    /**
+     * Releases spare capacity left over from loading.
+     */
+    void shrinkToFit();
+
+    size_t size() const
+    {
+        return this->ids.size();
+    }
+
+    TrackRow row(size_t row) const;
+
+    uint32_t id(size_t row) const
+    {
+        return this->ids[row];
+    }
+
+    string_view title(size_t row) const
+    {
+        return this->titles.get(row);
+    }
+
+    string_view artist(size_t row) const
+    {
+        return this->names.get(this->artists[row]);
+    }
+
+    string_view album(size_t row) const
+    {
+        return this->names.get(this->albums[row]);
+    }
+
+    string_view genre(size_t row) const
+    {
+        return this->names.get(this->genres[row]);
+    }
+
+    uint16_t year(size_t row) const
+    {
+        return this->years[row];
+    }
+
+    const TrackNumbers &trackNumbers(size_t row) const
+    {
+        return this->numbers[row];
+    }
+
+    string location(size_t row) const;
+
+    /**
+     * Returns the rows whose artist, album or genre is exactly the given name.
+     * Only the matching column is scanned, comparing IDs.
+     */
+    vector<uint32_t> selectArtist(string_view name) const;
+    vector<uint32_t> selectAlbum(string_view name) const;
+    vector<uint32_t> selectGenre(string_view name) const;
+
+    /**
+     * Returns the rows for which `matches(table, row)` is true, in row order.
+     */
+    template <typename Predicate>
+    vector<uint32_t> select(Predicate &&matches) const
+    {
+        vector<uint32_t> rows;
+        for (uint32_t row = 0; row < this->size(); row++)
+        {
+            if (matches(*this, row))
+            {
+                rows.push_back(row);
+            }
+        }
+        return rows;
+    }
+
+    /**
+     * Returns every row index, ordered by the given key. Artist order is artist, album,
+     * disc then track; album order is album, disc then track; genre and year order group
+     * by genre or year first and then follow artist order. Ties keep row order.
+     */
+    vector<uint32_t> sortedOrder(TrackSortKey key) const;
+
+    /**
+     * Approximate number of bytes held by the table.
+     */
+    size_t memoryUsage() const;
+};
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -0,0 +1,103 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+// Standard libs
+#include <cstdint>
+#include <stdexcept>
+
+// Local includes
+#include "VorbisComment.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+namespace
+{
+/**
+ * Reads a little-endian 32 bit length at `position`, advancing past it.
+ */
+uint32_t readLength(std::string_view block, size_t &position)
+{
+    if (block.size() - position < 4)
+    {
+        throw std::runtime_error("Vorbis comment block is truncated.");
+    }
+
+    const auto *bytes = reinterpret_cast<const uint8_t *>(block.data() + position);
+    position += 4;
+
+    return static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) |
+           (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+/**
+ * Takes a string of the given length at `position`, advancing past it.
+ */
+std::string_view readString(std::string_view block, size_t &position, uint32_t length)
+{
+    if (block.size() - position < length)
+    {
+        throw std::runtime_error("Vorbis comment block is truncated.");
+    }
+
+    std::string_view value = block.substr(position, length);
+    position += length;
+
+    return value;
+}
+} // namespace
+
+bool VorbisComment::nameIs(std::string_view upperName) const
+{
+    return VorbisFields::equalsUpper(this->name, upperName);
+}
+
+VorbisField VorbisComment::field() const
+{
+    return lookupVorbisField(this->name);
+}
+
+size_t Mellophone::MediaEngine::decodeVorbisComments(std::string_view block, std::string_view &vendor,
+                                                      std::vector<VorbisComment> &comments)
+{
+    size_t position = 0;
+
+    vendor = readString(block, position, readLength(block, position));
+
+    const uint32_t count = readLength(block, position);
+
+    // Every comment takes at least its 4 byte length, so a count larger than that is corrupt.
+    if (count > (block.size() - position) / 4)
+    {
+        throw std::runtime_error("Vorbis comment block is truncated.");
+    }
+
+    comments.reserve(comments.size() + count);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        std::string_view entry = readString(block, position, readLength(block, position));
+
+        size_t split = entry.find('=');
+        if (split == std::string_view::npos)
+        {
+            continue;
+        }
+
+        comments.push_back(VorbisComment{entry.substr(0, split), entry.substr(split + 1)});
+    }
+
+    return position;
+}
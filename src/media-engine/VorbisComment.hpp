@@ -0,0 +1,231 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+/**
+ * Vorbis comment fields the engine reads into a Track.
+ */
+enum class VorbisField : uint8_t
+{
+    unknown,
+    title,
+    version,
+    album,
+    trackNumber,
+    totalTracks,
+    discNumber,
+    totalDiscs,
+    artist,
+    performer,
+    copyright,
+    license,
+    description,
+    genre,
+    date
+};
+
+namespace VorbisFields
+{
+struct Entry
+{
+    std::string_view name;
+    VorbisField field;
+};
+
+/**
+ * Recognized field names, in upper case. TRACKTOTAL and DISCTOTAL are the spellings
+ * used by many taggers for TOTALTRACKS and TOTALDISCS.
+ */
+constexpr std::array<Entry, 16> NAMES = {{
+    {"TITLE", VorbisField::title},
+    {"VERSION", VorbisField::version},
+    {"ALBUM", VorbisField::album},
+    {"TRACKNUMBER", VorbisField::trackNumber},
+    {"TOTALTRACKS", VorbisField::totalTracks},
+    {"TRACKTOTAL", VorbisField::totalTracks},
+    {"DISCNUMBER", VorbisField::discNumber},
+    {"TOTALDISCS", VorbisField::totalDiscs},
+    {"DISCTOTAL", VorbisField::totalDiscs},
+    {"ARTIST", VorbisField::artist},
+    {"PERFORMER", VorbisField::performer},
+    {"COPYRIGHT", VorbisField::copyright},
+    {"LICENSE", VorbisField::license},
+    {"DESCRIPTION", VorbisField::description},
+    {"GENRE", VorbisField::genre},
+    {"DATE", VorbisField::date},
+}};
+
+constexpr size_t TABLE_SIZE = 32;
+
+constexpr char toUpper(char c)
+{
+    return c >= 'a' && c <= 'z' ? static_cast<char>(c - ('a' - 'A')) : c;
+}
+
+/**
+ * FNV-1a of the upper-cased name, so names differing only in case hash alike.
+ */
+constexpr uint32_t hashName(std::string_view name)
+{
+    uint32_t hash = 2166136261u;
+    for (char c : name)
+    {
+        hash = (hash ^ static_cast<uint8_t>(toUpper(c))) * 16777619u;
+    }
+
+    return hash;
+}
+
+constexpr size_t slotOf(std::string_view name)
+{
+    return (hashName(name) >> 6) % TABLE_SIZE;
+}
+
+/**
+ * Maps each hash slot to 1 + the index of the name in NAMES, or 0 if it is empty.
+ */
+constexpr std::array<uint8_t, TABLE_SIZE> buildTable()
+{
+    std::array<uint8_t, TABLE_SIZE> table{};
+    for (size_t i = 0; i < NAMES.size(); i++)
+    {
+        table[slotOf(NAMES[i].name)] = static_cast<uint8_t>(i + 1);
+    }
+
+    return table;
+}
+
+constexpr std::array<uint8_t, TABLE_SIZE> TABLE = buildTable();
+
+constexpr bool isPerfect()
+{
+    for (size_t i = 0; i < NAMES.size(); i++)
+    {
+        if (TABLE[slotOf(NAMES[i].name)] != i + 1)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static_assert(isPerfect(), "Vorbis field names collide; change the slot function.");
+
+constexpr bool equalsUpper(std::string_view name, std::string_view upperName)
+{
+    if (name.size() != upperName.size())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < name.size(); i++)
+    {
+        if (toUpper(name[i]) != upperName[i])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Whether `name`, ignoring case, contains an upper-case `part`.
+ */
+constexpr bool containsUpper(std::string_view name, std::string_view part)
+{
+    for (size_t start = 0; start + part.size() <= name.size(); start++)
+    {
+        if (equalsUpper(name.substr(start, part.size()), part))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+} // namespace VorbisFields
+
+/**
+ * Identifies a field name, ignoring case as the Vorbis comment specification
+ * requires. One hash and at most one comparison per known name. Any other name
+ * containing ARTIST, such as ALBUMARTIST, names an artist too, as it always has.
+ *
+ * @param name field name as it appears in the file
+ */
+constexpr VorbisField lookupVorbisField(std::string_view name)
+{
+    const uint8_t entry = VorbisFields::TABLE[VorbisFields::slotOf(name)];
+
+    if (entry == 0 || !VorbisFields::equalsUpper(name, VorbisFields::NAMES[entry - 1].name))
+    {
+        return VorbisFields::containsUpper(name, "ARTIST") ? VorbisField::artist : VorbisField::unknown;
+    }
+
+    return VorbisFields::NAMES[entry - 1].field;
+}
+
+/**
+ * One `NAME=value` entry of a Vorbis comment block. Both halves point into the
+ * buffer the block was decoded from and are only valid as long as it is.
+ */
+struct VorbisComment
+{
+    std::string_view name;
+    std::string_view value;
+
+    /**
+     * Compares the field name against an upper-case name, ignoring case as the
+     * Vorbis comment specification requires.
+     *
+     * @param upperName field name in upper case, such as "TITLE"
+     */
+    bool nameIs(std::string_view upperName) const;
+
+    /**
+     * Identifies the field this comment sets.
+     */
+    VorbisField field() const;
+};
+
+/**
+ * Decodes a Vorbis comment block: the vendor string followed by the comment list,
+ * with little-endian lengths. This is the layout of a FLAC VORBIS_COMMENT block and
+ * of an Ogg Vorbis comment packet after its "\x03vorbis" signature.
+ *
+ * Nothing is copied; the vendor and comments point into `block`. Entries without an
+ * '=' are ignored.
+ *
+ * @param block bytes of the comment block
+ * @param vendor set to the vendor string
+ * @param comments receives the comments, in the order they appear
+ *
+ * @returns the number of bytes of `block` taken by the comments.
+ */
+size_t decodeVorbisComments(std::string_view block, std::string_view &vendor, std::vector<VorbisComment> &comments);
+} // namespace MediaEngine
+} // namespace Mellophone
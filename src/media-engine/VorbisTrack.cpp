@@ -0,0 +1,34 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#include "VorbisTrack.hpp"
+
+using namespace Mellophone::MediaEngine;
+
+VorbisTrack::VorbisTrack(const fs::path &trackLocation) : Track(trackLocation)
+{
+    this->format = Format::vorbis;
+}
+
+void VorbisTrack::importMetadata()
+{
+    this->applyMetadata(OggVorbisMetadata::read(this->trackLocation));
+}
+
+void VorbisTrack::applyMetadata(const OggVorbisMetadata &metadata)
+{
+    this->parseVorbisComments(metadata.comments);
+}
@@ -0,0 +1,48 @@
+/*
+    Copyright 2020 Brenden Davidson
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <filesystem>
+
+#include "OggVorbisMetadata.hpp"
+#include "Track.hpp"
+
+namespace fs = std::filesystem;
+
+namespace Mellophone
+{
+namespace MediaEngine
+{
+class VorbisTrack : public Track
+{
+public:
+    explicit VorbisTrack(const fs::path &trackLocation);
+
+    /**
+     * Attempts to fill the Track's metadata entries using the data
+     * from the track's file.
+     */
+    void importMetadata() override;
+
+    /**
+     * Fills the Track's metadata entries from headers that have already
+     * been read.
+     */
+    void applyMetadata(const OggVorbisMetadata &metadata);
+};
+} // namespace MediaEngine
+} // namespace Mellophone
@@ -18,8 +18,8 @@
 
 extern "C"
 {
+    // Schema version 1: the initial set of tables.
     static const char SQLITE_INIT_STMT[] =
-        "BEGIN TRANSACTION;"
         "CREATE TABLE \"Albums\" ("
         "\"ID\"	INTEGER NOT NULL UNIQUE,"
         "\"Name\"	TEXT NOT NULL,"
@@ -49,8 +49,119 @@ extern "C"
         "FOREIGN KEY(\"Album\") REFERENCES \"Albums\"(\"ID\")"
         "ON UPDATE CASCADE "
         "ON DELETE CASCADE"
+        ");";
+
+    // Schema version 2: stat fingerprints used to skip unchanged files on rescan.
+    static const char SQLITE_FINGERPRINT_STMT[] =
+        "ALTER TABLE \"Tracks\" ADD COLUMN \"FileSize\" INTEGER;"
+        "ALTER TABLE \"Tracks\" ADD COLUMN \"ModifiedTime\" INTEGER;"
+        "ALTER TABLE \"Tracks\" ADD COLUMN \"Inode\" INTEGER;"
+        "ALTER TABLE \"Tracks\" ADD COLUMN \"Device\" INTEGER;";
+
+    // Schema version 3: tiered content keys. The full checksum is only computed when a
+    // cheaper key collides, so it becomes optional and tracks get their own ID.
+    static const char SQLITE_CONTENT_KEYS_STMT[] =
+        "CREATE TABLE \"TracksNew\" ("
+        "\"ID\"	INTEGER NOT NULL UNIQUE,"
+        "\"Checksum\"	TEXT UNIQUE,"
+        "\"PartialHash\"	TEXT,"
+        "\"AudioMD5\"	TEXT,"
+        "\"FileLocation\"	TEXT NOT NULL UNIQUE,"
+        "\"Title\"	TEXT NOT NULL,"
+        "\"Album\"	INTEGER NOT NULL,"
+        "\"TrackNum\"	INTEGER,"
+        "\"TotalTracks\"	INTEGER,"
+        "\"DiscNum\"	INTEGER,"
+        "\"TotalDiscs\"	INTEGER,"
+        "\"FileSize\"	INTEGER,"
+        "\"ModifiedTime\"	INTEGER,"
+        "\"Inode\"	INTEGER,"
+        "\"Device\"	INTEGER,"
+        "PRIMARY KEY(\"ID\"),"
+        "FOREIGN KEY(\"Album\") REFERENCES \"Albums\"(\"ID\")"
+        "ON UPDATE CASCADE "
+        "ON DELETE CASCADE"
         ");"
-        "COMMIT;";
+        "INSERT INTO \"TracksNew\"(\"Checksum\", \"FileLocation\", \"Title\", \"Album\", \"TrackNum\", "
+        "\"TotalTracks\", \"DiscNum\", \"TotalDiscs\", \"FileSize\", \"ModifiedTime\", \"Inode\", \"Device\") "
+        "SELECT \"Checksum\", \"FileLocation\", \"Title\", \"Album\", \"TrackNum\", "
+        "\"TotalTracks\", \"DiscNum\", \"TotalDiscs\", \"FileSize\", \"ModifiedTime\", \"Inode\", \"Device\" "
+        "FROM \"Tracks\";"
+        "DROP TABLE \"Tracks\";"
+        "ALTER TABLE \"TracksNew\" RENAME TO \"Tracks\";"
+        "CREATE INDEX \"TracksBySize\" ON \"Tracks\"(\"FileSize\");";
+
+    // Schema version 4: genre and release date, so the in-memory track table can be
+    // filled from the database alone.
+    static const char SQLITE_TRACK_DETAILS_STMT[] =
+        "ALTER TABLE \"Tracks\" ADD COLUMN \"Genre\" TEXT;"
+        "ALTER TABLE \"Tracks\" ADD COLUMN \"Date\" TEXT;";
 
-    static const int INIT_STMT_LEN = 682;
+    // Schema version 5: indexes for the browse queries. Artist names and file locations
+    // are already indexed by their UNIQUE constraints. The track index carries the title
+    // so an album's track list is read from the index alone.
+    static const char SQLITE_BROWSE_INDEXES_STMT[] =
+        "CREATE INDEX \"AlbumsByArtist\" ON \"Albums\"(\"Artist\", \"Name\");"
+        "CREATE INDEX \"AlbumsByName\" ON \"Albums\"(\"Name\", \"Artist\");"
+        "CREATE INDEX \"TracksByAlbum\" ON \"Tracks\"(\"Album\", \"DiscNum\", \"TrackNum\", \"Title\");";
+
+    // Schema version 6: cover art moves to the on-disk cover art cache. Albums keep the
+    // image's hash instead of the image, so browsing albums no longer pages in BLOBs.
+    static const char SQLITE_COVER_HASH_STMT[] =
+        "CREATE TABLE \"AlbumsNew\" ("
+        "\"ID\"	INTEGER NOT NULL UNIQUE,"
+        "\"Name\"	TEXT NOT NULL,"
+        "\"Artist\"	INTEGER NOT NULL,"
+        "\"CoverHash\"	TEXT,"
+        "PRIMARY KEY(\"ID\"),"
+        "FOREIGN KEY(\"Artist\") REFERENCES \"Artists\"(\"ID\")"
+        "ON UPDATE CASCADE "
+        "ON DELETE CASCADE"
+        ");"
+        "INSERT INTO \"AlbumsNew\"(\"ID\", \"Name\", \"Artist\") SELECT \"ID\", \"Name\", \"Artist\" FROM \"Albums\";"
+        "DROP TABLE \"Albums\";"
+        "ALTER TABLE \"AlbumsNew\" RENAME TO \"Albums\";"
+        "CREATE INDEX \"AlbumsByArtist\" ON \"Albums\"(\"Artist\", \"Name\");"
+        "CREATE INDEX \"AlbumsByName\" ON \"Albums\"(\"Name\", \"Artist\");";
+
+    // Schema version 7: track titles, so the track cursor can list a library by title
+    // without sorting it first.
+    static const char SQLITE_TRACK_TITLE_INDEX_STMT[] = "CREATE INDEX \"TracksByTitle\" ON \"Tracks\"(\"Title\");";
+
+    // Schema version 8: a counter the library bumps before changing its tables, so a
+    // snapshot taken at one generation can tell it is out of date.
+    static const char SQLITE_GENERATION_STMT[] =
+        "CREATE TABLE \"LibraryState\" (\"Generation\" INTEGER NOT NULL);"
+        "INSERT INTO \"LibraryState\" (\"Generation\") VALUES (0);";
+
+    // Schema version 9: track durations, and the report of the duplicate finder. Each
+    // group lists, by location, the tracks and skipped files found to be copies of one
+    // another, and how they were matched. Files skipped at import because a track already
+    // holds their contents are kept with the fingerprint they were skipped with.
+    static const char SQLITE_DUPLICATES_STMT[] =
+        "ALTER TABLE \"Tracks\" ADD COLUMN \"Duration\" INTEGER;"
+        "CREATE TABLE \"DuplicateFiles\" ("
+        "\"FileLocation\"	TEXT NOT NULL UNIQUE,"
+        "\"Track\"	INTEGER NOT NULL,"
+        "\"FileSize\"	INTEGER,"
+        "\"ModifiedTime\"	INTEGER,"
+        "\"Inode\"	INTEGER,"
+        "\"Device\"	INTEGER,"
+        "PRIMARY KEY(\"FileLocation\")"
+        ");"
+        "CREATE INDEX \"DuplicateFilesByTrack\" ON \"DuplicateFiles\"(\"Track\");"
+        "CREATE TABLE \"DuplicateGroups\" ("
+        "\"ID\"	INTEGER NOT NULL UNIQUE,"
+        "\"Kind\"	INTEGER NOT NULL,"
+        "\"Size\"	INTEGER NOT NULL,"
+        "PRIMARY KEY(\"ID\")"
+        ");"
+        "CREATE TABLE \"DuplicateMembers\" ("
+        "\"GroupID\"	INTEGER NOT NULL,"
+        "\"FileLocation\"	TEXT NOT NULL,"
+        "\"Track\"	INTEGER NOT NULL,"
+        "PRIMARY KEY(\"GroupID\", \"FileLocation\"),"
+        "FOREIGN KEY(\"GroupID\") REFERENCES \"DuplicateGroups\"(\"ID\")"
+        "ON DELETE CASCADE"
+        ") WITHOUT ROWID;";
 };
@@ -0,0 +1,147 @@
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <gtest/gtest.h>
+
+#include <ConnectionPool.hpp>
+#include <Schema.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+class ConnectionPoolTest : public ::testing::Test
+{
+protected:
+  const fs::path dataDir = fs::temp_directory_path() / "mellophone-connection-pool-test";
+  std::unique_ptr<ConnectionPool> pool;
+
+  void SetUp() override
+  {
+    fs::remove_all(dataDir);
+    fs::create_directories(dataDir);
+
+    pool = std::make_unique<ConnectionPool>(dataDir / "media_library.sqlite", 2);
+    Schema::migrate(pool->getWriter());
+  }
+
+  void TearDown() override
+  {
+    pool.reset();
+    fs::remove_all(dataDir);
+  }
+
+  static string queryText(sqlite3 *db, const char *sql)
+  {
+    sqlite3_stmt *stmt = nullptr;
+    sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+
+    string value;
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+      value = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+    }
+
+    sqlite3_finalize(stmt);
+    return value;
+  }
+
+  static int countArtists(ReaderLease &reader)
+  {
+    CachedStatement stmt = reader.getStatements()->acquire("SELECT COUNT(*) FROM Artists;");
+    EXPECT_EQ(SQLITE_ROW, sqlite3_step(stmt.get()));
+    return sqlite3_column_int(stmt.get(), 0);
+  }
+};
+
+TEST_F(ConnectionPoolTest, WriterUsesWAL)
+{
+  sqlite3 *writer = *pool->getWriter();
+
+  ASSERT_EQ("wal", queryText(writer, "PRAGMA journal_mode;"));
+  // NORMAL
+  ASSERT_EQ("1", queryText(writer, "PRAGMA synchronous;"));
+  ASSERT_EQ("-65536", queryText(writer, "PRAGMA cache_size;"));
+}
+
+TEST_F(ConnectionPoolTest, ReadersAreReadOnly)
+{
+  ReaderLease reader = pool->acquireReader();
+  sqlite3 *db = *reader.getStatements()->getConnection();
+
+  ASSERT_EQ(SQLITE_READONLY, sqlite3_exec(db, "INSERT INTO Artists (Name) VALUES ('A');", nullptr, nullptr, nullptr));
+}
+
+TEST_F(ConnectionPoolTest, ReadersAreNotBlockedByWriter)
+{
+  sqlite3 *writer = *pool->getWriter();
+  sqlite3_exec(writer, "INSERT INTO Artists (Name) VALUES ('Committed');", nullptr, nullptr, nullptr);
+
+  // An import holds its transaction open across many tracks.
+  sqlite3_exec(writer, "BEGIN TRANSACTION;", nullptr, nullptr, nullptr);
+  sqlite3_exec(writer, "INSERT INTO Artists (Name) VALUES ('Pending');", nullptr, nullptr, nullptr);
+
+  {
+    ReaderLease reader = pool->acquireReader();
+    ASSERT_EQ(1, countArtists(reader));
+  }
+
+  sqlite3_exec(writer, "COMMIT;", nullptr, nullptr, nullptr);
+
+  ReaderLease reader = pool->acquireReader();
+  ASSERT_EQ(2, countArtists(reader));
+}
+
+TEST_F(ConnectionPoolTest, ReusesReturnedReaders)
+{
+  sqlite3 *first;
+  {
+    ReaderLease reader = pool->acquireReader();
+    first = *reader.getStatements()->getConnection();
+  }
+
+  ReaderLease reader = pool->acquireReader();
+  ASSERT_EQ(first, *reader.getStatements()->getConnection());
+}
+
+TEST_F(ConnectionPoolTest, WaitsAtLimit)
+{
+  auto first = std::make_unique<ReaderLease>(pool->acquireReader());
+  ReaderLease second = pool->acquireReader();
+  ASSERT_NE(*first->getStatements()->getConnection(), *second.getStatements()->getConnection());
+
+  std::atomic<bool> acquired{false};
+  std::thread waiter([&] {
+    ReaderLease third = pool->acquireReader();
+    acquired = true;
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(acquired);
+
+  first.reset();
+  waiter.join();
+  ASSERT_TRUE(acquired);
+}
+
+TEST_F(ConnectionPoolTest, OpensPastLimitRatherThanDeadlock)
+{
+  // One thread holding every connection, as a caller iterating several cursors does.
+  ReaderLease first = pool->acquireReader();
+  ReaderLease second = pool->acquireReader();
+
+  for (int i = 0; i < 2; i++)
+  {
+    ReaderLease extra = pool->acquireReader();
+    EXPECT_NE(*first.getStatements()->getConnection(), *extra.getStatements()->getConnection());
+    EXPECT_NE(*second.getStatements()->getConnection(), *extra.getStatements()->getConnection());
+    EXPECT_EQ(0, countArtists(extra));
+  }
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,117 @@
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <ContentMatcher.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+class ContentMatcherTest : public ::testing::Test
+{
+protected:
+  const fs::path dir = fs::temp_directory_path() / "mellophone-content-matcher-test";
+
+  void SetUp() override
+  {
+    fs::create_directories(dir);
+  }
+
+  void TearDown() override
+  {
+    fs::remove_all(dir);
+  }
+
+  ContentKey writeFile(const char *name, const std::vector<char> &contents)
+  {
+    ContentKey key;
+    key.location = dir / name;
+    key.size = contents.size();
+
+    std::ofstream out(key.location, std::ios::binary);
+    out.write(contents.data(), contents.size());
+
+    return key;
+  }
+};
+
+TEST_F(ContentMatcherTest, PartialHashCoversOnlyTheEnds)
+{
+  std::vector<char> contents(3 * PARTIAL_HASH_SPAN, 'x');
+  ContentKey original = writeFile("original", contents);
+
+  contents[contents.size() / 2] = 'y';
+  ContentKey middle = writeFile("middle", contents);
+
+  contents[contents.size() - 1] = 'y';
+  ContentKey tail = writeFile("tail", contents);
+
+  std::string originalHash = ContentMatcher::computePartialHash(original.location);
+  EXPECT_EQ(originalHash, ContentMatcher::computePartialHash(middle.location));
+  EXPECT_NE(originalHash, ContentMatcher::computePartialHash(tail.location));
+
+  // Small files are covered whole, and not confused with a same-content prefix.
+  ContentKey small = writeFile("small", std::vector<char>(100, 'x'));
+  ContentKey smaller = writeFile("smaller", std::vector<char>(99, 'x'));
+  EXPECT_NE(ContentMatcher::computePartialHash(small.location), ContentMatcher::computePartialHash(smaller.location));
+}
+
+TEST_F(ContentMatcherTest, SameContentsComputesOnlyWhatItNeeds)
+{
+  ContentMatcher matcher;
+  std::vector<char> contents(3 * PARTIAL_HASH_SPAN, 'x');
+
+  ContentKey first = writeFile("first", contents);
+  ContentKey copy = writeFile("copy", contents);
+  contents.push_back('x');
+  ContentKey longer = writeFile("longer", contents);
+
+  // Different sizes never open the files.
+  EXPECT_FALSE(matcher.sameContents(first, longer));
+  EXPECT_TRUE(first.partialHash.empty());
+
+  // Mismatched audio MD5s stop before the full hash.
+  first.audioMD5 = "00";
+  copy.audioMD5 = "01";
+  EXPECT_FALSE(matcher.sameContents(first, copy));
+  EXPECT_FALSE(first.partialHash.empty());
+  EXPECT_TRUE(first.fullHash.empty());
+
+  copy.audioMD5 = "00";
+  EXPECT_TRUE(matcher.sameContents(first, copy));
+  EXPECT_EQ(first.fullHash, copy.fullHash);
+}
+
+TEST_F(ContentMatcherTest, GroupsIdenticalFiles)
+{
+  ContentMatcher matcher;
+  std::vector<char> contents(3 * PARTIAL_HASH_SPAN, 'x');
+
+  std::vector<ContentKey> keys;
+  keys.push_back(writeFile("a", contents));
+  keys.push_back(writeFile("unique size", std::vector<char>(10, 'x')));
+  keys.push_back(writeFile("a copy", contents));
+  contents[contents.size() / 2] = 'y';
+  keys.push_back(writeFile("b", contents));
+  keys.push_back(writeFile("b copy", contents));
+
+  ContentKey missing;
+  missing.location = dir / "missing";
+  missing.size = contents.size();
+  keys.push_back(missing);
+
+  std::vector<std::vector<size_t>> groups = matcher.groupIdentical(keys);
+
+  ASSERT_EQ(2, groups.size());
+  EXPECT_EQ((std::vector<size_t>{0, 2}), groups[0]);
+  EXPECT_EQ((std::vector<size_t>{3, 4}), groups[1]);
+
+  // The file with a unique size was never read.
+  EXPECT_TRUE(keys[1].partialHash.empty());
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
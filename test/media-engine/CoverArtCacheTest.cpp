@@ -0,0 +1,184 @@
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <png.h>
+
+#include <CoverArtCache.hpp>
+#include <Thumbnail.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+class CoverArtCacheTest : public ::testing::Test
+{
+protected:
+  fs::path root = fs::temp_directory_path() / "mellophone-cover-art-test";
+
+  void SetUp() override
+  {
+    fs::remove_all(root);
+  }
+
+  void TearDown() override
+  {
+    fs::remove_all(root);
+  }
+
+  static RGBImage gradient(uint32_t width, uint32_t height)
+  {
+    RGBImage image;
+    image.width = width;
+    image.height = height;
+    image.pixels.resize(static_cast<size_t>(width) * height * 3);
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+      for (uint32_t x = 0; x < width; x++)
+      {
+        uint8_t *pixel = image.pixels.data() + (static_cast<size_t>(y) * width + x) * 3;
+        pixel[0] = static_cast<uint8_t>(x * 255 / width);
+        pixel[1] = static_cast<uint8_t>(y * 255 / height);
+        pixel[2] = 128;
+      }
+    }
+
+    return image;
+  }
+
+  static std::vector<uint8_t> encodePNG(const RGBImage &image)
+  {
+    png_image png = {};
+    png.version = PNG_IMAGE_VERSION;
+    png.width = image.width;
+    png.height = image.height;
+    png.format = PNG_FORMAT_RGB;
+
+    png_alloc_size_t size = 0;
+    png_image_write_to_memory(&png, nullptr, &size, 0, image.pixels.data(), 0, nullptr);
+
+    std::vector<uint8_t> encoded(size);
+    png_image_write_to_memory(&png, encoded.data(), &size, 0, image.pixels.data(), 0, nullptr);
+    encoded.resize(size);
+
+    return encoded;
+  }
+
+  size_t countFiles(const fs::path &dir)
+  {
+    size_t count = 0;
+    for (const auto &entry : fs::recursive_directory_iterator(dir))
+    {
+      count += entry.is_regular_file() ? 1 : 0;
+    }
+    return count;
+  }
+};
+
+TEST_F(CoverArtCacheTest, DetectsFormats)
+{
+  const std::vector<uint8_t> jpeg = Thumbnail::encodeJPEG(gradient(8, 8));
+  const std::vector<uint8_t> png = encodePNG(gradient(8, 8));
+  const uint8_t other[] = {'G', 'I', 'F', '8', '9', 'a'};
+
+  EXPECT_EQ(ImageFormat::jpeg, Thumbnail::detectFormat(jpeg.data(), jpeg.size()));
+  EXPECT_EQ(ImageFormat::png, Thumbnail::detectFormat(png.data(), png.size()));
+  EXPECT_EQ(ImageFormat::unknown, Thumbnail::detectFormat(other, sizeof(other)));
+}
+
+TEST_F(CoverArtCacheTest, ThumbnailKeepsAspectRatio)
+{
+  const std::vector<uint8_t> jpeg = Thumbnail::encodeJPEG(gradient(800, 600));
+
+  std::vector<uint8_t> thumbnail;
+  ASSERT_TRUE(Thumbnail::create(jpeg.data(), jpeg.size(), THUMBNAIL_SIZE, thumbnail));
+
+  RGBImage decoded;
+  ASSERT_TRUE(Thumbnail::decode(thumbnail.data(), thumbnail.size(), 0, decoded));
+  EXPECT_EQ(256u, decoded.width);
+  EXPECT_EQ(192u, decoded.height);
+
+  // Small images are not scaled up.
+  const std::vector<uint8_t> png = encodePNG(gradient(100, 40));
+  ASSERT_TRUE(Thumbnail::create(png.data(), png.size(), THUMBNAIL_SIZE, thumbnail));
+  ASSERT_TRUE(Thumbnail::decode(thumbnail.data(), thumbnail.size(), 0, decoded));
+  EXPECT_EQ(100u, decoded.width);
+  EXPECT_EQ(40u, decoded.height);
+}
+
+TEST_F(CoverArtCacheTest, RejectsCorruptImages)
+{
+  std::vector<uint8_t> jpeg = Thumbnail::encodeJPEG(gradient(64, 64));
+  jpeg.resize(20);
+
+  std::vector<uint8_t> thumbnail;
+  EXPECT_FALSE(Thumbnail::create(jpeg.data(), jpeg.size(), THUMBNAIL_SIZE, thumbnail));
+}
+
+TEST_F(CoverArtCacheTest, StoresEachImageOnce)
+{
+  const std::vector<uint8_t> jpeg = Thumbnail::encodeJPEG(gradient(800, 600));
+  const std::vector<uint8_t> png = encodePNG(gradient(300, 300));
+
+  CoverArtCache cache(root, 2);
+  const std::string first = cache.store(jpeg.data(), jpeg.size());
+  const std::string second = cache.store(jpeg.data(), jpeg.size());
+  const std::string third = cache.store(png.data(), png.size());
+  cache.waitForThumbnails();
+
+  EXPECT_EQ(64u, first.size());
+  EXPECT_EQ(first, second);
+  EXPECT_NE(first, third);
+
+  EXPECT_EQ(".jpg", cache.getOriginal(first).extension());
+  EXPECT_EQ(".png", cache.getOriginal(third).extension());
+  EXPECT_EQ(jpeg.size(), fs::file_size(cache.getOriginal(first)));
+  EXPECT_EQ(2u, countFiles(root / "originals"));
+  EXPECT_EQ(2u, countFiles(root / "thumbnails"));
+}
+
+TEST_F(CoverArtCacheTest, ReadsImagesEmbeddedInFiles)
+{
+  const std::vector<uint8_t> jpeg = Thumbnail::encodeJPEG(gradient(400, 400));
+  fs::create_directories(root);
+
+  std::vector<char> file(100, 'x');
+  file.insert(file.end(), jpeg.begin(), jpeg.end());
+  file.insert(file.end(), 50, 'y');
+  std::ofstream(root / "track.flac", std::ios::binary).write(file.data(), file.size());
+
+  CoverArtCache cache(root / "covers");
+  const std::string hash = cache.storeFromFile(root / "track.flac", 100, jpeg.size());
+  ASSERT_FALSE(hash.empty());
+  EXPECT_EQ(hash, cache.store(jpeg.data(), jpeg.size()));
+
+  // Ranges past the end of the file, and oversized ones, are refused.
+  EXPECT_EQ("", cache.storeFromFile(root / "track.flac", 100, jpeg.size() + 100));
+  EXPECT_EQ("", cache.storeFromFile(root / "track.flac", 0, MAX_COVER_ART_SIZE + 1));
+}
+
+TEST_F(CoverArtCacheTest, MakesMissingThumbnailsOnDemand)
+{
+  const std::vector<uint8_t> jpeg = Thumbnail::encodeJPEG(gradient(600, 600));
+
+  std::string hash;
+  {
+    CoverArtCache cache(root, 1);
+    hash = cache.store(jpeg.data(), jpeg.size());
+    cache.waitForThumbnails();
+  }
+  fs::remove(root / "thumbnails" / (hash + ".jpg"));
+
+  CoverArtCache cache(root, 1);
+  const fs::path thumbnail = cache.getThumbnail(hash);
+  ASSERT_TRUE(fs::exists(thumbnail));
+  EXPECT_LT(fs::file_size(thumbnail), jpeg.size());
+
+  EXPECT_EQ(fs::path(), cache.getThumbnail(std::string(64, '0')));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <DirectoryWalker.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+class DirectoryWalkerTest : public ::testing::Test
+{
+protected:
+  const fs::path root = fs::temp_directory_path() / "mellophone-directory-walker-test";
+
+  void SetUp() override
+  {
+    fs::remove_all(root);
+    fs::create_directories(root);
+  }
+
+  void TearDown() override
+  {
+    fs::remove_all(root);
+  }
+
+  void touch(const fs::path &relative)
+  {
+    fs::create_directories((root / relative).parent_path());
+    std::ofstream(root / relative) << "data";
+  }
+
+  /**
+   * Walks the test tree, returning the files found relative to it, sorted.
+   */
+  std::vector<std::string> walk(const WalkOptions &options, WalkSummary *summary = nullptr)
+  {
+    std::mutex lock;
+    std::vector<std::string> found;
+
+    const WalkSummary result = DirectoryWalker(options).walk(root, [&](fs::path &&location) {
+      std::lock_guard<std::mutex> guard(lock);
+      found.push_back(location.lexically_relative(root).string());
+      return true;
+    });
+
+    if (summary != nullptr)
+    {
+      *summary = result;
+    }
+
+    std::sort(found.begin(), found.end());
+    return found;
+  }
+};
+
+TEST_F(DirectoryWalkerTest, FiltersByExtension)
+{
+  touch("a.flac");
+  touch("notes.txt");
+  touch("x/b.ogg");
+  touch("x/y/c.flac");
+  touch("x/y/.flac");
+  touch("x/y/cover.jpg");
+
+  WalkOptions options;
+  options.extensions = {".flac", ".ogg"};
+  WalkSummary summary;
+
+  EXPECT_EQ(std::vector<std::string>({"a.flac", "x/b.ogg", "x/y/c.flac"}), walk(options, &summary));
+  EXPECT_EQ(3u, summary.directories);
+  EXPECT_EQ(3u, summary.files);
+  EXPECT_EQ(3u, summary.filtered);
+
+  // Without extensions, every regular file is reported.
+  EXPECT_EQ(6u, walk(WalkOptions()).size());
+}
+
+TEST_F(DirectoryWalkerTest, SkipsHiddenAndExcludedDirectories)
+{
+  touch("keep/a.flac");
+  touch(".hidden/b.flac");
+  touch("keep/Scans/c.flac");
+  touch("other/Scans/d.flac");
+  touch("drop/e.flac");
+  touch("keep/drop/f.flac");
+
+  WalkOptions options;
+  options.excludedDirectories = {"Scans", (root / "drop/").string()};
+
+  EXPECT_EQ(std::vector<std::string>({"keep/a.flac", "keep/drop/f.flac"}), walk(options));
+
+  options.skipHidden = false;
+  options.excludedDirectories.clear();
+  EXPECT_EQ(6u, walk(options).size());
+}
+
+TEST_F(DirectoryWalkerTest, FollowsLinksWithoutLooping)
+{
+  touch("music/a.flac");
+  touch("elsewhere/b.flac");
+  fs::create_directory_symlink(root / "music", root / "music" / "loop");
+  fs::create_directory_symlink(root / "elsewhere", root / "music" / "link");
+  fs::create_directory_symlink(root / "elsewhere", root / "music" / "again");
+  fs::create_symlink(root / "elsewhere" / "b.flac", root / "music" / "c.flac");
+  fs::create_symlink(root / "missing", root / "music" / "dangling.flac");
+
+  WalkOptions options;
+  options.extensions = {".flac"};
+  options.excludedDirectories = {"elsewhere"};
+  WalkSummary summary;
+
+  // One of the two links to the same directory is read; which depends on the threads.
+  std::vector<std::string> found = walk(options, &summary);
+  ASSERT_EQ(3u, found.size());
+  EXPECT_EQ(1, std::count(found.begin(), found.end(), "music/again/b.flac") +
+                   std::count(found.begin(), found.end(), "music/link/b.flac"));
+  found.erase(std::remove_if(found.begin(), found.end(), [](const std::string &path) {
+                return path.find("/b.flac") != std::string::npos;
+              }),
+              found.end());
+  EXPECT_EQ(std::vector<std::string>({"music/a.flac", "music/c.flac"}), found);
+  EXPECT_EQ(2u, summary.revisited);
+  EXPECT_EQ(1u, summary.unreadable);
+
+  options.followLinks = false;
+  EXPECT_EQ(std::vector<std::string>({"music/a.flac", "music/c.flac"}), walk(options));
+}
+
+TEST_F(DirectoryWalkerTest, SplitsLargeTreesAcrossThreads)
+{
+  for (int i = 0; i < 20; i++)
+  {
+    for (int j = 0; j < 10; j++)
+    {
+      touch("d" + std::to_string(i) + "/e" + std::to_string(j) + "/track.flac");
+    }
+  }
+
+  for (uint32_t threads : {1u, 4u})
+  {
+    WalkOptions options;
+    options.threadCount = threads;
+    WalkSummary summary;
+
+    EXPECT_EQ(200u, walk(options, &summary).size());
+    EXPECT_EQ(221u, summary.directories);
+  }
+}
+
+TEST_F(DirectoryWalkerTest, StopsWhenAsked)
+{
+  for (int i = 0; i < 50; i++)
+  {
+    touch("d" + std::to_string(i % 5) + "/" + std::to_string(i) + ".flac");
+  }
+
+  WalkOptions options;
+  options.threadCount = 2;
+  std::atomic<int> calls{0};
+
+  DirectoryWalker(options).walk(root, [&calls](fs::path &&) { return ++calls < 3; });
+  EXPECT_LT(calls, 50);
+}
+
+TEST_F(DirectoryWalkerTest, RejectsMissingRoot)
+{
+  EXPECT_THROW(DirectoryWalker().walk(root / "missing", [](fs::path &&) { return true; }), std::runtime_error);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
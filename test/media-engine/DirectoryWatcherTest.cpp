@@ -0,0 +1,178 @@
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <DirectoryWatcher.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+class DirectoryWatcherTest : public ::testing::Test
+{
+protected:
+  fs::path root = fs::temp_directory_path() / "mellophone-watcher-test";
+
+  std::mutex lock;
+  std::condition_variable delivered;
+  std::vector<WatchBatch> batches;
+
+  WatchOptions options;
+
+  void SetUp() override
+  {
+    fs::remove_all(root);
+    fs::create_directories(root / "music");
+    options.quietPeriod = std::chrono::milliseconds(50);
+  }
+
+  void TearDown() override
+  {
+    fs::remove_all(root);
+  }
+
+  std::function<void(WatchBatch &&)> collect()
+  {
+    return [this](WatchBatch &&batch) {
+      std::lock_guard<std::mutex> guard(lock);
+      batches.push_back(std::move(batch));
+      delivered.notify_all();
+    };
+  }
+
+  bool waitForBatches(size_t count)
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    return delivered.wait_for(guard, std::chrono::seconds(5), [this, count] { return batches.size() >= count; });
+  }
+};
+
+TEST_F(DirectoryWatcherTest, CoalescesBursts)
+{
+  DirectoryWatcher watcher(root / "music", collect(), options);
+
+  // Each file is written twice, as a tagger rewriting tags in place would.
+  for (int pass = 0; pass < 2; pass++)
+  {
+    for (int i = 0; i < 50; i++)
+    {
+      std::ofstream(root / "music" / (std::to_string(i) + ".flac")) << "pass " << pass;
+    }
+  }
+
+  ASSERT_TRUE(waitForBatches(1));
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  std::lock_guard<std::mutex> guard(lock);
+  ASSERT_EQ(1u, batches.size());
+  EXPECT_EQ(50u, batches[0].changed.size());
+  EXPECT_TRUE(batches[0].removed.empty());
+  EXPECT_FALSE(batches[0].overflowed);
+}
+
+TEST_F(DirectoryWatcherTest, FollowsDirectories)
+{
+  fs::create_directories(root / "music" / "old");
+  std::ofstream(root / "music" / "old" / "a.flac") << "a";
+
+  // An album copied in from elsewhere arrives as one directory move.
+  fs::create_directories(root / "incoming" / "album" / "disc 1");
+  std::ofstream(root / "incoming" / "album" / "disc 1" / "b.flac") << "b";
+
+  DirectoryWatcher watcher(root / "music", collect(), options);
+
+  fs::rename(root / "incoming" / "album", root / "music" / "album");
+  fs::remove_all(root / "music" / "old");
+
+  ASSERT_TRUE(waitForBatches(1));
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    ASSERT_EQ(1u, batches[0].changed.size());
+    EXPECT_EQ(root / "music" / "album" / "disc 1" / "b.flac", batches[0].changed[0]);
+
+    // The deleted file is covered by its deleted directory.
+    ASSERT_EQ(1u, batches[0].removed.size());
+    EXPECT_EQ(root / "music" / "old", batches[0].removed[0]);
+  }
+
+  // The moved-in directories are watched too.
+  std::ofstream(root / "music" / "album" / "disc 1" / "c.flac") << "c";
+  ASSERT_TRUE(waitForBatches(2));
+
+  std::lock_guard<std::mutex> guard(lock);
+  ASSERT_EQ(1u, batches[1].changed.size());
+  EXPECT_EQ(root / "music" / "album" / "disc 1" / "c.flac", batches[1].changed[0]);
+}
+
+TEST_F(DirectoryWatcherTest, LatestChangeWins)
+{
+  std::ofstream(root / "music" / "gone.flac") << "gone";
+
+  DirectoryWatcher watcher(root / "music", collect(), options);
+
+  // Written then deleted: only the removal matters.
+  std::ofstream(root / "music" / "gone.flac") << "rewritten";
+  fs::remove(root / "music" / "gone.flac");
+
+  // Renamed: the old name is removed and the new one changed.
+  std::ofstream(root / "music" / "temp.part") << "download";
+  fs::rename(root / "music" / "temp.part", root / "music" / "done.flac");
+
+  ASSERT_TRUE(waitForBatches(1));
+
+  std::lock_guard<std::mutex> guard(lock);
+  ASSERT_EQ(1u, batches[0].changed.size());
+  EXPECT_EQ(root / "music" / "done.flac", batches[0].changed[0]);
+  ASSERT_EQ(2u, batches[0].removed.size());
+  EXPECT_EQ(root / "music" / "gone.flac", batches[0].removed[0]);
+  EXPECT_EQ(root / "music" / "temp.part", batches[0].removed[1]);
+}
+
+TEST_F(DirectoryWatcherTest, DeliversPendingChangesWhenStopped)
+{
+  options.quietPeriod = std::chrono::seconds(60);
+
+  {
+    DirectoryWatcher watcher(root / "music", collect(), options);
+    std::ofstream(root / "music" / "a.flac") << "a";
+  }
+
+  ASSERT_EQ(1u, batches.size());
+  EXPECT_EQ(1u, batches[0].changed.size());
+}
+
+TEST_F(DirectoryWatcherTest, SkipsExcludedDirectories)
+{
+  fs::create_directories(root / "music" / ".cache");
+  fs::create_directories(root / "music" / "album" / "Scans");
+  options.excludedDirectories = {"Scans", (root / "music" / "trash/").string()};
+
+  DirectoryWatcher watcher(root / "music", collect(), options);
+
+  // Existing excluded directories are not watched, and new ones are not reported.
+  std::ofstream(root / "music" / ".cache" / "a.flac") << "a";
+  std::ofstream(root / "music" / "album" / "Scans" / "b.flac") << "b";
+  fs::create_directories(root / "incoming" / ".hidden");
+  std::ofstream(root / "incoming" / ".hidden" / "c.flac") << "c";
+  fs::rename(root / "incoming" / ".hidden", root / "music" / ".hidden");
+  fs::create_directories(root / "incoming" / "trash");
+  std::ofstream(root / "incoming" / "trash" / "d.flac") << "d";
+  fs::rename(root / "incoming" / "trash", root / "music" / "trash");
+  std::ofstream(root / "music" / "album" / "e.flac") << "e";
+
+  ASSERT_TRUE(waitForBatches(1));
+
+  std::lock_guard<std::mutex> guard(lock);
+  ASSERT_EQ(1u, batches[0].changed.size());
+  EXPECT_EQ(root / "music" / "album" / "e.flac", batches[0].changed[0]);
+  EXPECT_TRUE(batches[0].removed.empty());
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
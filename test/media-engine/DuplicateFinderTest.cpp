@@ -0,0 +1,258 @@
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <DuplicateFinder.hpp>
+#include <Schema.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+class DuplicateFinderTest : public ::testing::Test
+{
+protected:
+  const fs::path dataDir = fs::temp_directory_path() / "mellophone-duplicate-finder-test";
+  shared_ptr<sqlite3 *> db = std::make_shared<sqlite3 *>();
+  shared_ptr<StatementCache> statements;
+
+  void SetUp() override
+  {
+    fs::remove_all(dataDir);
+    fs::create_directories(dataDir);
+
+    sqlite3_open(":memory:", db.get());
+    Schema::migrate(db);
+    statements = std::make_shared<StatementCache>(db);
+
+    sqlite3_exec(*db,
+                 "INSERT INTO Artists(ID, Name) VALUES(1, 'The Band');"
+                 "INSERT INTO Albums(ID, Name, Artist) VALUES(1, 'Record', 1), (2, 'Record (Deluxe Edition)', 1);",
+                 nullptr, nullptr, nullptr);
+  }
+
+  void TearDown() override
+  {
+    statements->finalizeAll();
+    sqlite3_close_v2(*db);
+    fs::remove_all(dataDir);
+  }
+
+  /**
+   * Adds a track row, and its file if `contents` is not empty.
+   */
+  void addTrack(int id, const std::string &title, int album, int duration, const std::string &audioMD5 = "",
+                const std::string &contents = "")
+  {
+    const fs::path location = dataDir / (std::to_string(id) + ".flac");
+    if (!contents.empty())
+    {
+      std::ofstream(location, std::ios::binary) << contents;
+    }
+
+    const std::string sql = "INSERT INTO Tracks(ID, FileLocation, Title, Album, Duration, AudioMD5, FileSize) VALUES(" +
+                            std::to_string(id) + ", '" + location.string() + "', '" + title + "', " +
+                            std::to_string(album) + ", " + (duration > 0 ? std::to_string(duration) : "NULL") + ", " +
+                            (audioMD5.empty() ? "NULL" : "'" + audioMD5 + "'") + ", " +
+                            (contents.empty() ? "NULL" : std::to_string(contents.size())) + ");";
+    sqlite3_exec(*db, sql.c_str(), nullptr, nullptr, nullptr);
+  }
+
+  std::vector<DuplicateGroup> find(const DuplicateOptions &options = DuplicateOptions())
+  {
+    DuplicateFinder finder(options);
+    finder.load(statements);
+    finder.find();
+    finder.store(statements);
+    return finder.getGroups();
+  }
+};
+
+TEST_F(DuplicateFinderTest, NormalizesTags)
+{
+  EXPECT_EQ("song", DuplicateFinder::normalize("The Song (Remastered 2011)"));
+  EXPECT_EQ("rock n roll", DuplicateFinder::normalize("  Rock 'n' Roll!! "));
+  EXPECT_EQ("live at x", DuplicateFinder::normalize("Live [Bonus] at -- X"));
+  EXPECT_EQ("theory", DuplicateFinder::normalize("Theory"));
+  EXPECT_EQ("", DuplicateFinder::normalize("(Intro)"));
+}
+
+TEST_F(DuplicateFinderTest, GroupsIdenticalFiles)
+{
+  const std::string contents(200000, 'a');
+  addTrack(1, "One", 1, 0, "", contents);
+  addTrack(2, "Two", 2, 0, "", contents);
+  addTrack(3, "Three", 1, 0, "", std::string(200000, 'b'));
+  addTrack(4, "Four", 1, 0, "", "small");
+
+  DuplicateOptions options;
+  options.threadCount = 2;
+  const std::vector<DuplicateGroup> groups = find(options);
+
+  ASSERT_EQ(1u, groups.size());
+  EXPECT_EQ(DuplicateKind::identical, groups[0].kind);
+  EXPECT_EQ(std::vector<uint32_t>({1, 2}), groups[0].tracks);
+
+  // The hashes read are kept. Only one of the identical files can keep the full hash.
+  sqlite3_stmt *stmt = nullptr;
+  sqlite3_prepare_v2(*db, "SELECT COUNT(PartialHash), COUNT(Checksum) FROM Tracks;", -1, &stmt, nullptr);
+  ASSERT_EQ(SQLITE_ROW, sqlite3_step(stmt));
+  EXPECT_EQ(3, sqlite3_column_int(stmt, 0));
+  EXPECT_EQ(1, sqlite3_column_int(stmt, 1));
+  sqlite3_finalize(stmt);
+}
+
+TEST_F(DuplicateFinderTest, GroupsCopiesWithTheirTrack)
+{
+  const std::string contents(5000, 'a');
+  addTrack(1, "One", 1, 0, "", std::string(4000, 'b'));
+  addTrack(2, "Two", 1, 0, "", contents);
+  addTrack(3, "Three", 1, 0, "", contents);
+  sqlite3_exec(*db,
+               "INSERT INTO DuplicateFiles(FileLocation, Track) VALUES"
+               "('/copies/one.flac', 1), ('/copies/two.flac', 2), ('/copies/gone.flac', 99);",
+               nullptr, nullptr, nullptr);
+
+  DuplicateFinder finder;
+  finder.load(statements);
+  const DuplicateSummary summary = finder.find();
+  finder.store(statements);
+
+  // The copy of a track that is gone is not reported.
+  EXPECT_EQ(2u, summary.copies);
+  EXPECT_EQ(2u, summary.identicalGroups);
+
+  const std::vector<DuplicateGroup> &groups = finder.getGroups();
+  ASSERT_EQ(2u, groups.size());
+  EXPECT_EQ(std::vector<uint32_t>({2, 3}), groups[0].tracks);
+  ASSERT_EQ(1u, groups[0].copies.size());
+  EXPECT_EQ("/copies/two.flac", groups[0].copies[0].location);
+  EXPECT_EQ(std::vector<uint32_t>({1}), groups[1].tracks);
+  ASSERT_EQ(1u, groups[1].copies.size());
+  EXPECT_EQ("/copies/one.flac", groups[1].copies[0].location);
+
+  // Copies are listed with the tags of the track they copy, ahead of it by location.
+  DuplicateQuery query;
+  query.after.values.resize(2);
+  query.after.values[0].integer = 1;
+  query.after.values[1].isText = true;
+  query.after.values[1].text = (dataDir / "3.flac").string();
+  DuplicateCursor cursor = openDuplicateCursor(ReaderLease(nullptr, statements), query);
+
+  ASSERT_TRUE(cursor.next());
+  EXPECT_EQ(2u, cursor.row().groupID);
+  EXPECT_TRUE(cursor.row().copy);
+  EXPECT_EQ("/copies/one.flac", cursor.row().location);
+  EXPECT_EQ(1u, cursor.row().trackID);
+  EXPECT_EQ("One", cursor.row().title);
+
+  ASSERT_TRUE(cursor.next());
+  EXPECT_FALSE(cursor.row().copy);
+  EXPECT_EQ((dataDir / "1.flac").string(), cursor.row().location);
+  EXPECT_FALSE(cursor.next());
+}
+
+TEST_F(DuplicateFinderTest, GroupsSameAudioUnlessIdentical)
+{
+  const std::string contents(5000, 'a');
+  addTrack(1, "One", 1, 0, "md5-a", contents);
+  addTrack(2, "Two", 1, 0, "md5-a", contents);
+  addTrack(3, "Three", 1, 0, "md5-b", std::string(6000, 'a'));
+  addTrack(4, "Four", 1, 0, "md5-b", std::string(7000, 'a'));
+  addTrack(5, "Five", 1, 0, "md5-b");
+
+  const std::vector<DuplicateGroup> groups = find();
+
+  ASSERT_EQ(2u, groups.size());
+  EXPECT_EQ(DuplicateKind::identical, groups[0].kind);
+  EXPECT_EQ(std::vector<uint32_t>({1, 2}), groups[0].tracks);
+  EXPECT_EQ(DuplicateKind::sameAudio, groups[1].kind);
+  EXPECT_EQ(std::vector<uint32_t>({3, 4, 5}), groups[1].tracks);
+}
+
+TEST_F(DuplicateFinderTest, GroupsSimilarTracks)
+{
+  // Same tags after normalization, within two seconds of each other.
+  addTrack(1, "Song", 1, 200000);
+  addTrack(2, "song (Remastered)", 2, 201500);
+  addTrack(3, "SONG!", 1, 203000);
+  // Same tags but much longer.
+  addTrack(4, "Song", 1, 260000);
+  // Length unknown, but there is more than one recording it could be.
+  addTrack(5, "Song", 1, 0);
+
+  // Untitled tracks are not alike, whatever their length.
+  addTrack(6, "unknown", 1, 100000);
+  addTrack(7, "unknown", 1, 100000);
+
+  // A single recording takes in the tracks of unknown length.
+  addTrack(8, "Other", 1, 0);
+  addTrack(9, "Other", 1, 90000);
+  addTrack(10, "Other", 1, 0);
+
+  const std::vector<DuplicateGroup> groups = find();
+
+  ASSERT_EQ(2u, groups.size());
+  EXPECT_EQ(DuplicateKind::similar, groups[0].kind);
+  EXPECT_EQ(std::vector<uint32_t>({8, 9, 10}), groups[0].tracks);
+  EXPECT_EQ(DuplicateKind::similar, groups[1].kind);
+  EXPECT_EQ(std::vector<uint32_t>({1, 2, 3}), groups[1].tracks);
+}
+
+TEST_F(DuplicateFinderTest, PagesThroughReport)
+{
+  addTrack(1, "One", 1, 0, "md5-a");
+  addTrack(2, "Two", 1, 0, "md5-a");
+  addTrack(3, "Song", 1, 100000);
+  addTrack(4, "Song", 1, 100000);
+  addTrack(5, "Song", 1, 100000);
+  find();
+
+  // Each search replaces the last report.
+  find();
+
+  std::vector<std::pair<uint32_t, uint32_t>> rows;
+  DuplicateQuery query;
+  query.limit = 2;
+
+  for (;;)
+  {
+    DuplicateCursor cursor = openDuplicateCursor(ReaderLease(nullptr, statements), query);
+    size_t count = 0;
+    while (cursor.next())
+    {
+      rows.emplace_back(cursor.row().groupID, cursor.row().trackID);
+      query.after = cursor.key();
+      count++;
+    }
+
+    if (count < query.limit)
+    {
+      break;
+    }
+  }
+
+  const std::vector<std::pair<uint32_t, uint32_t>> expected = {{1, 1}, {1, 2}, {2, 3}, {2, 4}, {2, 5}};
+  EXPECT_EQ(expected, rows);
+
+  query = DuplicateQuery();
+  query.kind = DuplicateKind::similar;
+  DuplicateCursor cursor = openDuplicateCursor(ReaderLease(nullptr, statements), query);
+  ASSERT_TRUE(cursor.next());
+  EXPECT_EQ(DuplicateKind::similar, cursor.row().kind);
+  EXPECT_EQ(3u, cursor.row().trackID);
+  EXPECT_EQ("Song", cursor.row().title);
+  EXPECT_EQ("Record", cursor.row().album);
+  EXPECT_EQ("The Band", cursor.row().artist);
+  EXPECT_EQ(100000u, cursor.row().duration);
+
+  query.after.values.resize(1);
+  EXPECT_THROW(openDuplicateCursor(ReaderLease(nullptr, statements), query), std::invalid_argument);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
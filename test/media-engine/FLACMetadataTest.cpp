@@ -0,0 +1,238 @@
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <FLACMetadata.hpp>
+#include <FLACTrack.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+class FLACMetadataTest : public ::testing::Test
+{
+protected:
+  const fs::path dataFile = fs::temp_directory_path() / "mellophone-flac-metadata-test.flac";
+
+  // Larger than a head read, so the blocks after it need a second read.
+  const uint32_t pictureSize = FLAC_HEAD_READ_SIZE + 1000;
+
+  void TearDown() override
+  {
+    fs::remove(dataFile);
+  }
+
+  static void putBigEndian(std::vector<uint8_t> &out, uint64_t value, size_t length)
+  {
+    for (size_t i = length; i > 0; i--)
+    {
+      out.push_back(static_cast<uint8_t>(value >> ((i - 1) * 8)));
+    }
+  }
+
+  static void putLittleEndian(std::vector<uint8_t> &out, uint32_t value)
+  {
+    for (size_t i = 0; i < 4; i++)
+    {
+      out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+  }
+
+  static void putString(std::vector<uint8_t> &out, const std::string &value)
+  {
+    out.insert(out.end(), value.begin(), value.end());
+  }
+
+  static void putBlock(std::vector<uint8_t> &out, uint8_t type, bool last, const std::vector<uint8_t> &body)
+  {
+    out.push_back(static_cast<uint8_t>(type | (last ? 0x80 : 0)));
+    putBigEndian(out, body.size(), 3);
+    out.insert(out.end(), body.begin(), body.end());
+  }
+
+  std::vector<uint8_t> buildFile(bool withID3)
+  {
+    std::vector<uint8_t> file;
+
+    if (withID3)
+    {
+      // 10 byte header and 20 bytes of tag, with the size stored as a syncsafe integer.
+      putString(file, "ID3");
+      file.insert(file.end(), {4, 0, 0, 0, 0, 0, 20});
+      file.insert(file.end(), 20, 0xAA);
+    }
+
+    putString(file, "fLaC");
+
+    std::vector<uint8_t> streamInfo;
+    putBigEndian(streamInfo, 4096, 2);
+    putBigEndian(streamInfo, 4096, 2);
+    putBigEndian(streamInfo, 16, 3);
+    putBigEndian(streamInfo, 12000, 3);
+    // 44100 Hz, 2 channels, 16 bits per sample, 1000000 samples.
+    putBigEndian(streamInfo, (44100ULL << 44) | (1ULL << 41) | (15ULL << 36) | 1000000ULL, 8);
+    for (uint8_t i = 1; i <= 16; i++)
+    {
+      streamInfo.push_back(i);
+    }
+    putBlock(file, 0, false, streamInfo);
+
+    std::vector<uint8_t> seekTable;
+    putBigEndian(seekTable, 0, 8);
+    putBigEndian(seekTable, 0, 8);
+    putBigEndian(seekTable, 4096, 2);
+    putBigEndian(seekTable, UINT64_MAX, 8);
+    putBigEndian(seekTable, 0, 8);
+    putBigEndian(seekTable, 0, 2);
+    putBlock(file, 3, false, seekTable);
+
+    std::vector<uint8_t> picture;
+    putBigEndian(picture, 3, 4);
+    putBigEndian(picture, 10, 4);
+    putString(picture, "image/jpeg");
+    putBigEndian(picture, 5, 4);
+    putString(picture, "Front");
+    putBigEndian(picture, 500, 4);
+    putBigEndian(picture, 400, 4);
+    putBigEndian(picture, 24, 4);
+    putBigEndian(picture, 0, 4);
+    putBigEndian(picture, pictureSize, 4);
+    picture.insert(picture.end(), pictureSize, 0xFF);
+    putBlock(file, 6, false, picture);
+
+    std::vector<uint8_t> comments;
+    putLittleEndian(comments, 6);
+    putString(comments, "vendor");
+    putLittleEndian(comments, 5);
+    for (const std::string entry : {"ARTIST=First", "artist=Second", "TITLE=Song", "TRACKNUMBER=2/11", "junk"})
+    {
+      putLittleEndian(comments, entry.size());
+      putString(comments, entry);
+    }
+    putBlock(file, 4, false, comments);
+
+    putBlock(file, 1, true, std::vector<uint8_t>(100, 0));
+
+    // Start of the audio frames.
+    file.insert(file.end(), {0xFF, 0xF8});
+
+    return file;
+  }
+
+  void writeFile(const std::vector<uint8_t> &contents)
+  {
+    std::ofstream out(dataFile, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(contents.data()), contents.size());
+  }
+
+  void checkMetadata(const FLACMetadata &metadata, uint64_t fileSize)
+  {
+    ASSERT_TRUE(metadata.hasStreamInfo);
+    EXPECT_EQ(4096u, metadata.streamInfo.maxBlockSize);
+    EXPECT_EQ(12000u, metadata.streamInfo.maxFrameSize);
+    EXPECT_EQ(44100u, metadata.streamInfo.sampleRate);
+    EXPECT_EQ(2, metadata.streamInfo.channels);
+    EXPECT_EQ(16, metadata.streamInfo.bitsPerSample);
+    EXPECT_EQ(1000000u, metadata.streamInfo.totalSamples);
+    EXPECT_EQ(16, metadata.streamInfo.audioMD5[15]);
+
+    // The placeholder point is dropped.
+    ASSERT_EQ(1u, metadata.seekPoints.size());
+    EXPECT_EQ(4096, metadata.seekPoints[0].frameSamples);
+
+    ASSERT_EQ(1u, metadata.pictures.size());
+    EXPECT_EQ(3u, metadata.pictures[0].type);
+    EXPECT_EQ("image/jpeg", metadata.pictures[0].mimeType);
+    EXPECT_EQ("Front", metadata.pictures[0].description);
+    EXPECT_EQ(500u, metadata.pictures[0].width);
+    EXPECT_EQ(pictureSize, metadata.pictures[0].dataLength);
+
+    EXPECT_EQ("vendor", metadata.vendor);
+    ASSERT_EQ(4u, metadata.comments.size());
+    EXPECT_EQ("artist", metadata.comments[1].name);
+    EXPECT_TRUE(metadata.comments[1].nameIs("ARTIST"));
+    EXPECT_EQ("2/11", metadata.comments[3].value);
+
+    EXPECT_EQ(fileSize - 2, metadata.audioOffset);
+  }
+};
+
+TEST_F(FLACMetadataTest, ReadsEveryBlock)
+{
+  std::vector<uint8_t> contents = buildFile(false);
+  writeFile(contents);
+
+  FLACMetadata metadata = FLACMetadata::read(dataFile);
+  checkMetadata(metadata, contents.size());
+
+  // Picture data is located, not read.
+  std::vector<uint8_t> expectedData(pictureSize, 0xFF);
+  ASSERT_TRUE(std::equal(expectedData.begin(), expectedData.end(), contents.begin() + metadata.pictures[0].dataOffset));
+}
+
+TEST_F(FLACMetadataTest, SkipsID3Tag)
+{
+  std::vector<uint8_t> contents = buildFile(true);
+  writeFile(contents);
+
+  checkMetadata(FLACMetadata::read(dataFile), contents.size());
+}
+
+TEST_F(FLACMetadataTest, ParsesByteAtATime)
+{
+  std::vector<uint8_t> contents = buildFile(true);
+
+  FLACMetadataParser parser;
+  for (size_t i = 0; i < contents.size() && !parser.isFinished(); i++)
+  {
+    parser.feed(i, contents.data() + i, 1);
+  }
+
+  ASSERT_TRUE(parser.isFinished());
+  checkMetadata(parser.finish(), contents.size());
+}
+
+TEST_F(FLACMetadataTest, MovedMetadataKeepsViews)
+{
+  writeFile(buildFile(false));
+
+  FLACMetadata original = FLACMetadata::read(dataFile);
+  FLACMetadata moved = std::move(original);
+
+  EXPECT_EQ("vendor", moved.vendor);
+  EXPECT_EQ("Song", moved.comments[2].value);
+}
+
+TEST_F(FLACMetadataTest, RejectsBadFiles)
+{
+  writeFile(std::vector<uint8_t>{'O', 'g', 'g', 'S', 0, 0, 0, 0});
+  EXPECT_THROW(FLACMetadata::read(dataFile), std::runtime_error);
+
+  // Truncated in the middle of the comment block.
+  std::vector<uint8_t> contents = buildFile(false);
+  contents.resize(contents.size() - 120);
+  writeFile(contents);
+  EXPECT_THROW(FLACMetadata::read(dataFile), std::runtime_error);
+}
+
+TEST_F(FLACMetadataTest, TrackUsesComments)
+{
+  writeFile(buildFile(false));
+
+  FLACTrack track(dataFile);
+  track.importMetadata();
+
+  ASSERT_EQ(2u, track.getArtists().size());
+  EXPECT_EQ("First", track.getArtist());
+  EXPECT_EQ("Second", track.getArtists()[1]);
+  EXPECT_EQ("Song", track.getTitle());
+  EXPECT_EQ(2, track.getTrackNum());
+  EXPECT_EQ("unknown", track.getAlbum());
+  EXPECT_EQ("0102030405060708090a0b0c0d0e0f10", track.getContentKey().audioMD5);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,154 @@
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <ContentMatcher.hpp>
+#include <FileBatchReader.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+namespace fs = std::filesystem;
+
+/**
+ * Collects what the reader hands over for each file.
+ */
+class CollectingConsumer : public BatchReadConsumer
+{
+public:
+  std::map<size_t, std::vector<uint8_t>> data;
+  std::map<size_t, std::vector<uint64_t>> offsets;
+  std::map<size_t, FileFingerprint> fingerprints;
+  std::map<size_t, std::exception_ptr> results;
+  size_t declined = SIZE_MAX;
+
+  bool begin(size_t fileIndex, const FileFingerprint &fingerprint, uint64_t) override
+  {
+    fingerprints[fileIndex] = fingerprint;
+    return fileIndex != declined;
+  }
+
+  void consume(size_t fileIndex, uint64_t offset, const uint8_t *chunk, size_t length) override
+  {
+    EXPECT_EQ(0u, results.count(fileIndex));
+    offsets[fileIndex].push_back(offset);
+    data[fileIndex].insert(data[fileIndex].end(), chunk, chunk + length);
+  }
+
+  void end(size_t fileIndex, std::exception_ptr error) override
+  {
+    EXPECT_EQ(0u, results.count(fileIndex));
+    results[fileIndex] = error;
+  }
+};
+
+class FileBatchReaderTest : public ::testing::Test
+{
+protected:
+  const fs::path dataDir = fs::temp_directory_path() / "mellophone-batch-reader-test";
+  std::vector<fs::path> paths;
+  std::vector<std::vector<uint8_t>> contents;
+
+  void SetUp() override
+  {
+    if (!IoRing::isSupported())
+    {
+      GTEST_SKIP() << "io_uring is not available";
+    }
+
+    fs::create_directories(dataDir);
+
+    // Empty, smaller than a read, several reads long, and long enough to have separate ends.
+    for (size_t size : {size_t(0), size_t(1000), 3 * size_t(BATCH_READ_SIZE) + 17, 4 * PARTIAL_HASH_SPAN + 5})
+    {
+      std::vector<uint8_t> bytes(size);
+      for (size_t i = 0; i < size; i++)
+      {
+        bytes[i] = static_cast<uint8_t>(i * 31 + (i >> 8) + paths.size());
+      }
+
+      paths.push_back(dataDir / (std::to_string(paths.size()) + ".bin"));
+      std::ofstream out(paths.back(), std::ios::binary);
+      out.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+      contents.push_back(std::move(bytes));
+    }
+  }
+
+  void TearDown() override
+  {
+    fs::remove_all(dataDir);
+  }
+};
+
+TEST_F(FileBatchReaderTest, ReadsWholeFiles)
+{
+  // Fewer slots than files, so slots are reused.
+  FileBatchReader reader(2);
+  CollectingConsumer consumer;
+  reader.read(paths, ReadExtent::whole, consumer);
+
+  ASSERT_EQ(paths.size(), consumer.results.size());
+  for (size_t i = 0; i < paths.size(); i++)
+  {
+    ASSERT_EQ(nullptr, consumer.results[i]);
+    ASSERT_EQ(contents[i], consumer.data[i]);
+    ASSERT_EQ(contents[i].size(), consumer.fingerprints[i].size);
+  }
+}
+
+TEST_F(FileBatchReaderTest, ReadsEnds)
+{
+  FileBatchReader reader;
+  CollectingConsumer consumer;
+  reader.read(paths, ReadExtent::ends, consumer);
+
+  for (size_t i = 0; i < paths.size(); i++)
+  {
+    ASSERT_EQ(nullptr, consumer.results[i]);
+
+    // Files no larger than twice the span are read whole.
+    std::vector<uint8_t> expected = contents[i];
+    if (expected.size() > 2 * PARTIAL_HASH_SPAN)
+    {
+      expected.erase(expected.begin() + PARTIAL_HASH_SPAN, expected.end() - PARTIAL_HASH_SPAN);
+      ASSERT_EQ(contents[i].size() - PARTIAL_HASH_SPAN, consumer.offsets[i].back());
+    }
+
+    ASSERT_EQ(expected, consumer.data[i]);
+  }
+}
+
+TEST_F(FileBatchReaderTest, ReportsMissingFiles)
+{
+  paths.insert(paths.begin() + 1, dataDir / "missing.bin");
+
+  FileBatchReader reader;
+  CollectingConsumer consumer;
+  reader.read(paths, ReadExtent::whole, consumer);
+
+  ASSERT_EQ(paths.size(), consumer.results.size());
+  ASSERT_NE(nullptr, consumer.results[1]);
+  ASSERT_EQ(0u, consumer.fingerprints.count(1));
+  ASSERT_EQ(nullptr, consumer.results[2]);
+  ASSERT_EQ(contents[1], consumer.data[2]);
+}
+
+TEST_F(FileBatchReaderTest, SkipsDeclinedFiles)
+{
+  FileBatchReader reader;
+  CollectingConsumer consumer;
+  consumer.declined = 2;
+  reader.read(paths, ReadExtent::whole, consumer);
+
+  ASSERT_EQ(paths.size() - 1, consumer.results.size());
+  ASSERT_EQ(0u, consumer.results.count(2));
+  ASSERT_EQ(0u, consumer.data.count(2));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,119 @@
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <openssl/evp.h>
+
+#include <FLACTrack.hpp>
+#include <HashReader.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+class HashReaderTest : public ::testing::Test
+{
+protected:
+  const fs::path dataFile = fs::temp_directory_path() / "mellophone-hash-reader-test.bin";
+  std::vector<uint8_t> contents;
+
+  void SetUp() override
+  {
+    // Spans several read chunks and ends on a partial one.
+    contents.resize(2 * HASH_READ_SIZE + 12345);
+    for (size_t i = 0; i < contents.size(); i++)
+    {
+      contents[i] = static_cast<uint8_t>(i * 31 + (i >> 8));
+    }
+
+    std::ofstream out(dataFile, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(contents.data()), contents.size());
+  }
+
+  void TearDown() override
+  {
+    fs::remove(dataFile);
+  }
+
+  string expectedHash()
+  {
+    uint8_t digest[32];
+    EVP_Digest(contents.data(), contents.size(), digest, nullptr, EVP_sha256(), nullptr);
+
+    char hex[65];
+    for (int i = 0; i < 32; i++)
+    {
+      sprintf(hex + i * 2, "%02x", digest[i]);
+    }
+    return string(hex, 64);
+  }
+};
+
+TEST_F(HashReaderTest, ModesReadWholeFile)
+{
+  for (HashReadMode mode : {HashReadMode::mmap, HashReadMode::pread, HashReadMode::ioUring})
+  {
+    std::vector<uint8_t> readBack;
+    HashReader reader(mode);
+    reader.read(dataFile, [&readBack](const uint8_t *data, size_t length) {
+      ASSERT_LE(length, HASH_READ_SIZE);
+      readBack.insert(readBack.end(), data, data + length);
+    });
+
+    ASSERT_EQ(contents, readBack);
+  }
+}
+
+TEST_F(HashReaderTest, ModesProduceSameHash)
+{
+  FLACTrack track(dataFile);
+
+  track.generateFileHash(HashReadMode::mmap);
+  ASSERT_EQ(expectedHash(), track.getHashAsString());
+
+  track.generateFileHash(HashReadMode::pread);
+  ASSERT_EQ(expectedHash(), track.getHashAsString());
+
+  track.generateFileHash(HashReadMode::ioUring);
+  ASSERT_EQ(expectedHash(), track.getHashAsString());
+}
+
+TEST_F(HashReaderTest, MultiBufferHashesMatchSingleFile)
+{
+  // More tracks than lanes so lanes are refilled, and a missing file in the middle.
+  std::vector<std::unique_ptr<FLACTrack>> tracks;
+  std::vector<Track *> trackPtrs;
+  for (int i = 0; i < 10; i++)
+  {
+    tracks.push_back(std::make_unique<FLACTrack>(i == 4 ? fs::path("/nonexistent/file.flac") : dataFile));
+    trackPtrs.push_back(tracks.back().get());
+  }
+
+  std::vector<std::exception_ptr> errors;
+  Track::generateFileHashes(trackPtrs, errors);
+
+  ASSERT_EQ(tracks.size(), errors.size());
+  for (size_t i = 0; i < tracks.size(); i++)
+  {
+    if (i == 4)
+    {
+      ASSERT_NE(nullptr, errors[i]);
+      continue;
+    }
+
+    ASSERT_EQ(nullptr, errors[i]);
+    ASSERT_EQ(expectedHash(), tracks[i]->getHashAsString());
+  }
+}
+
+TEST_F(HashReaderTest, MissingFileThrows)
+{
+  HashReader reader;
+  EXPECT_THROW(reader.read("/nonexistent/file.flac", [](const uint8_t *, size_t) {}), std::runtime_error);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,256 @@
+#include <fstream>
+#include <memory>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <IngestWriter.hpp>
+#include <Schema.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+/**
+ * Track with metadata filled in directly instead of from a file.
+ */
+class StubTrack : public Track
+{
+public:
+  StubTrack(const string &location, const string &artistName, const string &albumName, uint8_t digestByte)
+      : Track(fs::path(location))
+  {
+    this->artist.push_back(artistName);
+    this->album = albumName;
+    this->title = location;
+    this->shaDigest.fill(digestByte);
+    this->fileHashed = true;
+    this->partialHash = string(64, 'a' + digestByte % 16);
+  }
+
+  /**
+   * Track backed by a real file, with only its partial hash generated like the scanner does.
+   */
+  StubTrack(const fs::path &location, const string &albumName) : Track(location)
+  {
+    this->artist.push_back("Artist");
+    this->album = albumName;
+    this->title = location.filename().string();
+    this->fingerprint.size = fs::file_size(location);
+    this->generatePartialHash();
+  }
+
+  void importMetadata() override {}
+};
+
+class IngestWriterTest : public ::testing::Test
+{
+protected:
+  shared_ptr<sqlite3 *> db = std::make_shared<sqlite3 *>();
+  shared_ptr<StatementCache> statements;
+  shared_ptr<IDCache> ids = std::make_shared<IDCache>();
+
+  void SetUp() override
+  {
+    sqlite3_open(":memory:", db.get());
+    Schema::migrate(db);
+    statements = std::make_shared<StatementCache>(db);
+  }
+
+  void TearDown() override
+  {
+    statements->finalizeAll();
+    sqlite3_close_v2(*db);
+  }
+
+  int count(const char *sql)
+  {
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(*db, sql, -1, &stmt, nullptr);
+    sqlite3_step(stmt);
+    int result = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    return result;
+  }
+};
+
+TEST_F(IngestWriterTest, WritesBatchAndSharesAlbums)
+{
+  vector<unique_ptr<Track>> batch;
+  batch.push_back(std::make_unique<StubTrack>("/a.flac", "Artist", "Album", 1));
+  batch.push_back(std::make_unique<StubTrack>("/b.flac", "Artist", "Album", 2));
+  batch.push_back(std::make_unique<StubTrack>("/c.flac", "Other", "Other Album", 3));
+
+  IngestWriter writer(statements, ids, 2);
+  IngestResult result = writer.write(batch);
+  result += writer.commit();
+
+  EXPECT_EQ(3, result.inserted);
+  EXPECT_EQ(0, result.duplicates);
+  EXPECT_EQ(3, count("SELECT COUNT(*) FROM Tracks;"));
+  EXPECT_EQ(2, count("SELECT COUNT(*) FROM Albums;"));
+  EXPECT_EQ(2, count("SELECT COUNT(*) FROM Artists;"));
+}
+
+TEST_F(IngestWriterTest, SkipsDuplicateChecksums)
+{
+  vector<unique_ptr<Track>> batch;
+  batch.push_back(std::make_unique<StubTrack>("/a.flac", "Artist", "Album", 1));
+  batch.push_back(std::make_unique<StubTrack>("/copy of a.flac", "Artist", "Album", 1));
+
+  IngestWriter writer(statements, ids);
+  IngestResult result = writer.write(batch);
+  result += writer.commit();
+
+  EXPECT_EQ(1, result.inserted);
+  EXPECT_EQ(1, result.duplicates);
+  EXPECT_EQ(1, count("SELECT COUNT(*) FROM Tracks;"));
+
+  // The copy is kept as a copy of the track it matched.
+  EXPECT_EQ(1, count("SELECT COUNT(*) FROM DuplicateFiles JOIN Tracks ON Tracks.ID == DuplicateFiles.Track "
+                     "WHERE DuplicateFiles.FileLocation == '/copy of a.flac' AND Tracks.FileLocation == '/a.flac';"));
+}
+
+TEST_F(IngestWriterTest, ReusesCachedAlbumIDs)
+{
+  IngestWriter writer(statements, ids);
+
+  vector<unique_ptr<Track>> first;
+  first.push_back(std::make_unique<StubTrack>("/a.flac", "Artist", "Album", 1));
+  writer.write(first);
+  writer.commit();
+
+  uint32_t albumID = ids->findAlbumID("Album");
+  EXPECT_NE(0, albumID);
+  EXPECT_NE(0, ids->findArtistID("Artist"));
+
+  // A fresh cache warmed from the database must agree with the writer's.
+  IDCache warmed;
+  warmed.load(statements);
+  EXPECT_EQ(albumID, warmed.findAlbumID("Album"));
+
+  vector<unique_ptr<Track>> second;
+  second.push_back(std::make_unique<StubTrack>("/b.flac", "Artist", "Album", 2));
+  writer.write(second);
+  writer.commit();
+
+  EXPECT_EQ(1, count("SELECT COUNT(*) FROM Albums;"));
+  EXPECT_EQ(2, count("SELECT COUNT(*) FROM Tracks WHERE Album == (SELECT ID FROM Albums WHERE Name == 'Album');"));
+}
+
+TEST_F(IngestWriterTest, RefreshesFingerprintOfUnchangedContents)
+{
+  IngestWriter writer(statements, ids);
+
+  vector<unique_ptr<Track>> first;
+  first.push_back(std::make_unique<StubTrack>("/a.flac", "Artist", "Album", 1));
+  writer.write(first);
+
+  FileFingerprint touched;
+  touched.size = 1234;
+  touched.modifiedTime = 42;
+
+  vector<unique_ptr<Track>> second;
+  second.push_back(std::make_unique<StubTrack>("/a.flac", "Artist", "Album", 1));
+  second[0]->setFingerprint(touched);
+  IngestResult result = writer.write(second);
+  result += writer.commit();
+
+  EXPECT_EQ(1, result.refreshed);
+  EXPECT_EQ(1, count("SELECT COUNT(*) FROM Tracks WHERE FileSize == 1234 AND ModifiedTime == 42;"));
+}
+
+TEST_F(IngestWriterTest, HashesInFullOnlyOnCollision)
+{
+  const fs::path dir = fs::temp_directory_path() / "mellophone-ingest-writer-test";
+  fs::create_directories(dir);
+
+  // Same size and ends, different middle: only the full hash can tell them apart.
+  std::vector<char> contents(3 * PARTIAL_HASH_SPAN, 'x');
+  auto writeFile = [&](const char *name) {
+    std::ofstream out(dir / name, std::ios::binary);
+    out.write(contents.data(), contents.size());
+  };
+  writeFile("a.flac");
+  writeFile("copy.flac");
+  contents[contents.size() / 2] = 'y';
+  writeFile("changed.flac");
+  contents.resize(contents.size() + 1);
+  writeFile("longer.flac");
+
+  IngestWriter writer(statements, ids);
+
+  vector<unique_ptr<Track>> first;
+  first.push_back(std::make_unique<StubTrack>(dir / "a.flac", "Album"));
+  first.push_back(std::make_unique<StubTrack>(dir / "longer.flac", "Album"));
+  IngestResult result = writer.write(first);
+  result += writer.commit();
+
+  // No collisions yet, so nothing was read in full.
+  EXPECT_EQ(2, result.inserted);
+  EXPECT_EQ(0, count("SELECT COUNT(*) FROM Tracks WHERE Checksum IS NOT NULL;"));
+
+  vector<unique_ptr<Track>> second;
+  second.push_back(std::make_unique<StubTrack>(dir / "changed.flac", "Album"));
+  second.push_back(std::make_unique<StubTrack>(dir / "copy.flac", "Album"));
+  result = writer.write(second);
+  result += writer.commit();
+
+  EXPECT_EQ(1, result.inserted);
+  EXPECT_EQ(1, result.duplicates);
+  EXPECT_EQ(3, count("SELECT COUNT(*) FROM Tracks;"));
+
+  // The colliding files had their full hashes computed and kept; the unique size never did.
+  EXPECT_EQ(2, count("SELECT COUNT(*) FROM Tracks WHERE Checksum IS NOT NULL;"));
+  EXPECT_EQ(1, count("SELECT COUNT(*) FROM Tracks WHERE Checksum IS NULL AND FileLocation LIKE '%longer.flac';"));
+
+  // The copy is recorded with its fingerprint, until the file turns out to hold other contents.
+  EXPECT_EQ(1, count("SELECT COUNT(*) FROM DuplicateFiles WHERE FileLocation LIKE '%copy.flac' AND FileSize > 0;"));
+
+  std::ofstream(dir / "copy.flac", std::ios::binary | std::ios::app) << "more";
+  vector<unique_ptr<Track>> third;
+  third.push_back(std::make_unique<StubTrack>(dir / "copy.flac", "Album"));
+  result = writer.write(third);
+  result += writer.commit();
+
+  EXPECT_EQ(1, result.inserted);
+  EXPECT_EQ(0, count("SELECT COUNT(*) FROM DuplicateFiles;"));
+
+  fs::remove_all(dir);
+}
+
+TEST_F(IngestWriterTest, CountsRowsOfFailedCommitAsFailed)
+{
+  // A deferred foreign key that is still violated makes the commit of the transaction
+  // writing '/b.flac' fail.
+  sqlite3_exec(*db,
+               "PRAGMA foreign_keys = ON;"
+               "CREATE TABLE Parent(ID INTEGER PRIMARY KEY);"
+               "CREATE TABLE Child(Parent INTEGER REFERENCES Parent(ID) DEFERRABLE INITIALLY DEFERRED);"
+               "CREATE TRIGGER BreakCommit AFTER INSERT ON Tracks WHEN NEW.FileLocation == '/b.flac' "
+               "BEGIN INSERT INTO Child VALUES(1); END;",
+               nullptr, nullptr, nullptr);
+
+  vector<unique_ptr<Track>> batch;
+  batch.push_back(std::make_unique<StubTrack>("/a.flac", "Artist", "Album", 1));
+  batch.push_back(std::make_unique<StubTrack>("/b.flac", "Artist", "Album", 2));
+  batch.push_back(std::make_unique<StubTrack>("/c.flac", "Other", "Other Album", 3));
+
+  IngestWriter writer(statements, ids, 2);
+  IngestResult result = writer.write(batch);
+
+  // The first transaction was rolled back, and the row of the open one is not counted yet.
+  EXPECT_EQ(0, result.inserted);
+  EXPECT_EQ(2, result.failed);
+
+  result = writer.commit();
+  EXPECT_EQ(1, result.inserted);
+  EXPECT_EQ(0, result.failed);
+
+  EXPECT_EQ(1, count("SELECT COUNT(*) FROM Tracks;"));
+  EXPECT_EQ(0, ids->findAlbumID("Album"));
+  EXPECT_NE(0, ids->findAlbumID("Other Album"));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,248 @@
+#include <memory>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <LibraryQuery.hpp>
+#include <Schema.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+class LibraryQueryTest : public ::testing::Test
+{
+protected:
+  shared_ptr<sqlite3 *> db = std::make_shared<sqlite3 *>();
+  shared_ptr<StatementCache> statements;
+
+  void SetUp() override
+  {
+    sqlite3_open(":memory:", db.get());
+    Schema::migrate(db);
+    statements = std::make_shared<StatementCache>(db);
+
+    sqlite3_exec(*db,
+                 "INSERT INTO Artists(ID, Name) VALUES(1, 'Beta'), (2, 'Alpha');"
+                 "INSERT INTO Albums(ID, Name, Artist, CoverHash) VALUES(1, 'Second', 1, 'abc'), (2, 'First', 2, NULL),"
+                 "(3, 'First', 1, NULL);"
+                 "INSERT INTO Tracks(ID, FileLocation, Title, Album, TrackNum, DiscNum, Genre) VALUES"
+                 "(1, '/m/1.flac', 'Delta', 1, 2, 1, 'Rock'),"
+                 "(2, '/m/2.flac', 'Alpha', 1, 1, 1, 'Rock'),"
+                 "(3, '/m/3.flac', 'Charlie', 2, 1, 1, 'Jazz'),"
+                 "(4, '/m/4.flac', 'Bravo', 3, 1, 2, NULL),"
+                 "(5, '/m/5.flac', 'Alpha', 3, 1, 1, NULL);",
+                 nullptr, nullptr, nullptr);
+  }
+
+  void TearDown() override
+  {
+    statements->finalizeAll();
+    sqlite3_close_v2(*db);
+  }
+
+  ReaderLease lease()
+  {
+    return ReaderLease(nullptr, statements);
+  }
+
+  std::vector<uint32_t> trackIDs(const TrackQuery &query)
+  {
+    std::vector<uint32_t> ids;
+    TrackCursor cursor = openTrackCursor(lease(), query);
+    while (cursor.next())
+    {
+      ids.push_back(cursor.row().id);
+    }
+    return ids;
+  }
+
+  /**
+   * Returns the steps of a query's plan that sort its results.
+   */
+  std::string sortsIn(const std::string &sql)
+  {
+    sqlite3_stmt *stmt;
+    std::string plan = "EXPLAIN QUERY PLAN " + sql;
+    EXPECT_EQ(SQLITE_OK, sqlite3_prepare_v2(*db, plan.c_str(), -1, &stmt, nullptr)) << sqlite3_errmsg(*db);
+
+    std::string sorts;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+      std::string detail = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3));
+      if (detail.find("TEMP B-TREE") != std::string::npos)
+      {
+        sorts += detail + "\n";
+      }
+    }
+    sqlite3_finalize(stmt);
+    return sorts;
+  }
+};
+
+TEST_F(LibraryQueryTest, ReadsTrackRows)
+{
+  TrackQuery query;
+  query.order = TrackOrder::id;
+  TrackCursor cursor = openTrackCursor(lease(), query);
+
+  ASSERT_TRUE(cursor.next());
+  const TrackView &row = cursor.row();
+  EXPECT_EQ(1u, row.id);
+  EXPECT_EQ("Delta", row.title);
+  EXPECT_EQ("/m/1.flac", row.location);
+  EXPECT_EQ(2, row.trackNum);
+  EXPECT_EQ(1, row.discNum);
+  EXPECT_EQ("Rock", row.genre);
+  EXPECT_EQ(1u, row.albumID);
+  EXPECT_EQ("Second", row.album);
+  EXPECT_EQ(1u, row.artistID);
+  EXPECT_EQ("Beta", row.artist);
+
+  ASSERT_TRUE(cursor.next());
+  ASSERT_TRUE(cursor.next());
+  ASSERT_TRUE(cursor.next());
+  EXPECT_EQ(4u, cursor.row().id);
+  EXPECT_EQ("", cursor.row().genre);
+  ASSERT_TRUE(cursor.next());
+  ASSERT_FALSE(cursor.next());
+}
+
+TEST_F(LibraryQueryTest, OrdersAndFiltersTracks)
+{
+  TrackQuery query;
+  EXPECT_EQ((std::vector<uint32_t>{2, 5, 4, 3, 1}), trackIDs(query));
+
+  query.descending = true;
+  EXPECT_EQ((std::vector<uint32_t>{1, 3, 4, 5, 2}), trackIDs(query));
+
+  query = TrackQuery();
+  query.order = TrackOrder::album;
+  EXPECT_EQ((std::vector<uint32_t>{2, 1, 3, 5, 4}), trackIDs(query));
+
+  query.artistID = 1;
+  EXPECT_EQ((std::vector<uint32_t>{2, 1, 5, 4}), trackIDs(query));
+
+  query = TrackQuery();
+  query.albumID = 3;
+  EXPECT_EQ((std::vector<uint32_t>{5, 4}), trackIDs(query));
+
+  query = TrackQuery();
+  query.titlePrefix = "Al";
+  EXPECT_EQ((std::vector<uint32_t>{2, 5}), trackIDs(query));
+}
+
+TEST_F(LibraryQueryTest, PagesByKey)
+{
+  for (TrackOrder order : {TrackOrder::id, TrackOrder::title, TrackOrder::location, TrackOrder::album})
+  {
+    for (bool descending : {false, true})
+    {
+      TrackQuery query;
+      query.order = order;
+      query.descending = descending;
+      const std::vector<uint32_t> all = trackIDs(query);
+
+      // Pages of two, each continuing after the last row of the one before.
+      std::vector<uint32_t> paged;
+      query.limit = 2;
+      while (true)
+      {
+        TrackCursor cursor = openTrackCursor(lease(), query);
+        size_t rows = 0;
+        while (cursor.next())
+        {
+          paged.push_back(cursor.row().id);
+          query.after = cursor.key();
+          rows++;
+        }
+
+        if (rows < query.limit)
+        {
+          break;
+        }
+      }
+
+      EXPECT_EQ(all, paged);
+    }
+  }
+}
+
+TEST_F(LibraryQueryTest, QueriesAlbumsAndArtists)
+{
+  std::vector<std::string> albums;
+  AlbumCursor albumCursor = openAlbumCursor(lease(), AlbumQuery());
+  while (albumCursor.next())
+  {
+    albums.push_back(std::string(albumCursor.row().name) + "/" + std::string(albumCursor.row().artist) + "/" +
+                     std::string(albumCursor.row().coverHash));
+  }
+  EXPECT_EQ((std::vector<std::string>{"First/Beta/", "First/Alpha/", "Second/Beta/abc"}), albums);
+
+  AlbumQuery byArtist;
+  byArtist.artistID = 2;
+  AlbumCursor artistAlbums = openAlbumCursor(lease(), byArtist);
+  ASSERT_TRUE(artistAlbums.next());
+  EXPECT_EQ(2u, artistAlbums.row().id);
+  EXPECT_FALSE(artistAlbums.next());
+
+  ArtistQuery artists;
+  artists.namePrefix = "B";
+  ArtistCursor artistCursor = openArtistCursor(lease(), artists);
+  ASSERT_TRUE(artistCursor.next());
+  EXPECT_EQ("Beta", artistCursor.row().name);
+  EXPECT_FALSE(artistCursor.next());
+}
+
+TEST_F(LibraryQueryTest, RejectsKeyOfOtherOrder)
+{
+  TrackQuery query;
+  query.order = TrackOrder::album;
+  TrackCursor cursor = openTrackCursor(lease(), query);
+  ASSERT_TRUE(cursor.next());
+
+  TrackQuery other;
+  other.order = TrackOrder::title;
+  other.after = cursor.key();
+  EXPECT_THROW(openTrackCursor(lease(), other), std::invalid_argument);
+}
+
+TEST_F(LibraryQueryTest, OrdersComeFromIndexes)
+{
+  for (TrackOrder order : {TrackOrder::id, TrackOrder::title, TrackOrder::location, TrackOrder::album})
+  {
+    for (bool paged : {false, true})
+    {
+      TrackQuery query;
+      query.order = order;
+      query.limit = 100;
+      if (paged)
+      {
+        query.after.values.resize(order == TrackOrder::album ? 5 : order == TrackOrder::title ? 2 : 1);
+      }
+
+      const std::string sql = buildTrackQuery(query);
+      EXPECT_EQ("", sortsIn(sql)) << sql;
+    }
+  }
+
+  for (AlbumOrder order : {AlbumOrder::id, AlbumOrder::name})
+  {
+    AlbumQuery query;
+    query.order = order;
+    EXPECT_EQ("", sortsIn(buildAlbumQuery(query)));
+  }
+
+  // An artist's albums by name come straight from AlbumsByArtist.
+  AlbumQuery artistAlbums;
+  artistAlbums.artistID = 1;
+  EXPECT_EQ("", sortsIn(buildAlbumQuery(artistAlbums)));
+
+  ArtistQuery artists;
+  artists.namePrefix = "A";
+  EXPECT_EQ("", sortsIn(buildArtistQuery(artists)));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,140 @@
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <gtest/gtest.h>
+
+#include <LibrarySnapshot.hpp>
+#include <Schema.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+class LibrarySnapshotTest : public ::testing::Test
+{
+protected:
+  const fs::path dataDir = fs::temp_directory_path() / "mellophone-library-snapshot-test";
+  const fs::path location = dataDir / SNAPSHOT_FILE_NAME;
+  shared_ptr<sqlite3 *> db = std::make_shared<sqlite3 *>();
+  shared_ptr<StatementCache> statements;
+
+  void SetUp() override
+  {
+    fs::remove_all(dataDir);
+    fs::create_directories(dataDir);
+
+    sqlite3_open(":memory:", db.get());
+    Schema::migrate(db);
+    statements = std::make_shared<StatementCache>(db);
+
+    sqlite3_exec(*db,
+                 "INSERT INTO Artists(ID, Name) VALUES(1, 'Beta'), (2, 'Alpha');"
+                 "INSERT INTO Albums(ID, Name, Artist, CoverHash) VALUES(1, 'Second', 1, 'abc'), (2, 'First', 2, NULL);"
+                 "INSERT INTO Tracks(ID, FileLocation, Title, Album, TrackNum, DiscNum, Genre) VALUES"
+                 "(1, '/m/1.flac', 'Delta', 1, 2, 1, 'Rock'),"
+                 "(2, '/m/2.flac', 'Alpha', 1, 1, 1, 'Rock'),"
+                 "(3, '/m/3.flac', 'Charlie', 2, 3, 2, NULL);"
+                 "UPDATE LibraryState SET Generation = 7;",
+                 nullptr, nullptr, nullptr);
+  }
+
+  void TearDown() override
+  {
+    statements->finalizeAll();
+    sqlite3_close_v2(*db);
+    fs::remove_all(dataDir);
+  }
+};
+
+TEST_F(LibrarySnapshotTest, RoundTripsTables)
+{
+  LibrarySnapshot::write(location, statements);
+  std::unique_ptr<LibrarySnapshot> snapshot = LibrarySnapshot::open(location);
+  ASSERT_NE(nullptr, snapshot);
+
+  EXPECT_EQ(7u, snapshot->getGeneration());
+
+  // Tracks by title.
+  ASSERT_EQ(3u, snapshot->trackCount());
+  EXPECT_EQ("Alpha", snapshot->track(0).title);
+  EXPECT_EQ("Charlie", snapshot->track(1).title);
+  EXPECT_EQ("Delta", snapshot->track(2).title);
+
+  const TrackView track = snapshot->track(1);
+  EXPECT_EQ(3u, track.id);
+  EXPECT_EQ("/m/3.flac", track.location);
+  EXPECT_EQ(3, track.trackNum);
+  EXPECT_EQ(2, track.discNum);
+  EXPECT_EQ("", track.genre);
+  EXPECT_EQ(2u, track.albumID);
+  EXPECT_EQ("First", track.album);
+  EXPECT_EQ(2u, track.artistID);
+  EXPECT_EQ("Alpha", track.artist);
+
+  // Albums and artists by name.
+  ASSERT_EQ(2u, snapshot->albumCount());
+  EXPECT_EQ("First", snapshot->album(0).name);
+  EXPECT_EQ("", snapshot->album(0).coverHash);
+  EXPECT_EQ(1u, snapshot->album(1).id);
+  EXPECT_EQ("Beta", snapshot->album(1).artist);
+  EXPECT_EQ("abc", snapshot->album(1).coverHash);
+
+  ASSERT_EQ(2u, snapshot->artistCount());
+  EXPECT_EQ(2u, snapshot->artist(0).id);
+  EXPECT_EQ("Alpha", snapshot->artist(0).name);
+  EXPECT_EQ("Beta", snapshot->artist(1).name);
+}
+
+TEST_F(LibrarySnapshotTest, RejectsDamagedFiles)
+{
+  EXPECT_EQ(nullptr, LibrarySnapshot::open(location));
+
+  LibrarySnapshot::write(location, statements);
+  const uintmax_t size = fs::file_size(location);
+
+  fs::resize_file(location, size - 1);
+  EXPECT_EQ(nullptr, LibrarySnapshot::open(location));
+
+  std::ofstream(location, std::ios::binary | std::ios::trunc) << std::string(size, 'x');
+  EXPECT_EQ(nullptr, LibrarySnapshot::open(location));
+}
+
+TEST_F(LibrarySnapshotTest, ReplacesWithoutDisturbingReaders)
+{
+  LibrarySnapshot::write(location, statements);
+  std::unique_ptr<LibrarySnapshot> before = LibrarySnapshot::open(location);
+  ASSERT_NE(nullptr, before);
+
+  sqlite3_exec(*db,
+               "INSERT INTO Tracks(ID, FileLocation, Title, Album) VALUES(4, '/m/4.flac', 'Aardvark', 2);"
+               "UPDATE LibraryState SET Generation = Generation + 1;",
+               nullptr, nullptr, nullptr);
+  LibrarySnapshot::write(location, statements);
+
+  // The old mapping keeps the file it was opened on.
+  EXPECT_EQ(3u, before->trackCount());
+  EXPECT_EQ("Alpha", before->track(0).title);
+
+  std::unique_ptr<LibrarySnapshot> after = LibrarySnapshot::open(location);
+  ASSERT_NE(nullptr, after);
+  EXPECT_EQ(8u, after->getGeneration());
+  ASSERT_EQ(4u, after->trackCount());
+  EXPECT_EQ("Aardvark", after->track(0).title);
+}
+
+TEST_F(LibrarySnapshotTest, RemovesTemporaryFileOnFailure)
+{
+  // A directory in the way makes the final rename fail.
+  fs::create_directories(location / "in-the-way");
+  EXPECT_THROW(LibrarySnapshot::write(location, statements), fs::filesystem_error);
+
+  for (const auto &entry : fs::directory_iterator(dataDir))
+  {
+    EXPECT_EQ(location, entry.path());
+  }
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,13 +1,57 @@
+#include <algorithm>
+#include <condition_variable>
 #include <filesystem>
+#include <fstream>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 #include <gtest/gtest.h>
 
 #include <Library.hpp>
+#include <Thumbnail.hpp>
 
 using namespace Mellophone::MediaEngine;
 
 class LibraryTest : public ::testing::Test {
 protected:
+    /**
+     * Writes a minimal FLAC file: a STREAMINFO block filled with `seed`, a comment block
+     * holding the single entry `comment`, a front cover if `picture` is not empty, then
+     * `audioBytes` bytes of audio, also filled with `seed`.
+     */
+    static void writeFLAC(const fs::path &path, const std::string &comment, char seed, size_t audioBytes,
+                          const std::vector<uint8_t> &picture = {}) {
+        std::vector<char> file = {'f', 'L', 'a', 'C'};
+        auto addHeader = [&file](char type, bool last, size_t length) {
+            file.insert(file.end(), {static_cast<char>(type | (last ? 0x80 : 0)), static_cast<char>(length >> 16),
+                                     static_cast<char>(length >> 8), static_cast<char>(length)});
+        };
+
+        addHeader(0, false, 34);
+        file.insert(file.end(), 34, seed);
+
+        // Vorbis comment lengths are little-endian: an empty vendor string, then one entry.
+        addHeader(4, picture.empty(), 12 + comment.size());
+        file.insert(file.end(), {0, 0, 0, 0, 1, 0, 0, 0});
+        file.insert(file.end(), {static_cast<char>(comment.size()), static_cast<char>(comment.size() >> 8), 0, 0});
+        file.insert(file.end(), comment.begin(), comment.end());
+
+        if (!picture.empty()) {
+            const std::string mime = "image/jpeg";
+            addHeader(6, true, 32 + mime.size() + picture.size());
+            file.insert(file.end(), {0, 0, 0, 3, 0, 0, 0, static_cast<char>(mime.size())});
+            file.insert(file.end(), mime.begin(), mime.end());
+            // Empty description, then unknown dimensions, depth and colour count.
+            file.insert(file.end(), 20, 0);
+            file.insert(file.end(), {static_cast<char>(picture.size() >> 24), static_cast<char>(picture.size() >> 16),
+                                     static_cast<char>(picture.size() >> 8), static_cast<char>(picture.size())});
+            file.insert(file.end(), picture.begin(), picture.end());
+        }
+
+        file.insert(file.end(), audioBytes, seed);
+        std::ofstream(path, std::ios::binary).write(file.data(), file.size());
+    }
 };
 
 TEST_F(LibraryTest, DetectUserMusicFolder) {
@@ -17,6 +61,440 @@ TEST_F(LibraryTest, DetectUserMusicFolder) {
     ASSERT_EQ(lib.getMusicFolderPath(), musicHome);
 }
 
+TEST_F(LibraryTest, OpensInBackground) {
+    const fs::path root = fs::temp_directory_path() / "mellophone-open-test";
+    fs::remove_all(root);
+    fs::create_directories(root / "music");
+
+    {
+        Library lib = Library(root / "music", root / "data");
+        lib.waitUntilReady();
+        EXPECT_TRUE(lib.isReady());
+        EXPECT_EQ(0u, lib.loadTrackTable().size());
+    }
+
+    // A data folder that cannot be created fails the open, not the constructor.
+    std::ofstream(root / "file") << "in the way";
+    {
+        Library lib = Library(root / "music", root / "file" / "data");
+        EXPECT_THROW(lib.waitUntilReady(), std::runtime_error);
+        EXPECT_TRUE(lib.isReady());
+        EXPECT_THROW(lib.loadTrackTable(), std::runtime_error);
+    }
+
+    fs::remove_all(root);
+}
+
+TEST_F(LibraryTest, ScanSkipsUnsupportedFiles) {
+    const fs::path root = fs::temp_directory_path() / "mellophone-scan-test";
+    fs::remove_all(root);
+    fs::create_directories(root / "music" / "nested");
+
+    std::ofstream(root / "music" / "notes.txt") << "not music";
+    std::ofstream(root / "music" / "nested" / "cover.jpg") << "not music";
+    std::ofstream(root / "music" / "nested" / "fake.flac") << "RIFF";
+
+    ScanSummary summary;
+    {
+        Library lib = Library(root / "music", root / "data");
+
+        ScanOptions options;
+        options.threadCount = 2;
+        summary = lib.scanLibrary(options);
+    }
+
+    EXPECT_EQ(3, summary.filesSeen);
+    EXPECT_EQ(0, summary.imported);
+    EXPECT_EQ(3, summary.skipped);
+    EXPECT_EQ(0, summary.failed);
+
+    fs::remove_all(root);
+}
+
+TEST_F(LibraryTest, ScanReportsProgress) {
+    const fs::path root = fs::temp_directory_path() / "mellophone-scan-progress-test";
+    fs::remove_all(root);
+    fs::create_directories(root / "music");
+
+    for (int i = 0; i < 5; i++) {
+        writeFLAC(root / "music" / (std::to_string(i) + ".flac"), "ARTIST=Artist", i + 1, 1000 * (i + 1));
+    }
+    std::ofstream(root / "music" / "notes.txt") << "not music";
+
+    std::mutex lock;
+    std::vector<ScanProgress> reports;
+    ScanProgress final;
+    {
+        Library lib = Library(root / "music", root / "data");
+
+        ScanOptions options;
+        options.threadCount = 2;
+        options.progressInterval = std::chrono::milliseconds(1);
+        options.onProgress = [&](const ScanProgress &progress) {
+            std::lock_guard<std::mutex> guard(lock);
+            reports.push_back(progress);
+        };
+        lib.scanLibrary(options);
+
+        final = lib.getScanProgress();
+    }
+
+    ASSERT_FALSE(reports.empty());
+    EXPECT_TRUE(reports.back().scanFinished);
+    EXPECT_EQ(6, reports.back().totals.filesSeen);
+    EXPECT_EQ(6, reports.back().filesDone());
+
+    EXPECT_EQ(5, final.totals.imported);
+    EXPECT_EQ(1, final.totals.skipped);
+    // The walker leaves out the text file by its extension, so it is never stat'ed.
+    EXPECT_EQ(5, final.stage(ScanStage::stat).count);
+    EXPECT_EQ(5, final.stage(ScanStage::parse).count);
+    EXPECT_EQ(5, final.stage(ScanStage::hash).count);
+    EXPECT_GE(final.stage(ScanStage::write).count, 1);
+    EXPECT_GT(final.bytesRead, 15000);
+    EXPECT_EQ(0, final.pathQueueDepth);
+    EXPECT_EQ(0, final.trackQueueDepth);
+    EXPECT_EQ(0, final.secondsRemaining());
+
+    fs::remove_all(root);
+}
+
+TEST_F(LibraryTest, ScanThatCannotLoadKnownFilesThrows) {
+    const fs::path root = fs::temp_directory_path() / "mellophone-scan-load-failure-test";
+    fs::remove_all(root);
+    fs::create_directories(root / "music");
+
+    { Library lib = Library(root / "music", root / "data"); }
+
+    // Without the table of skipped copies, the known files cannot be loaded.
+    sqlite3 *db = nullptr;
+    sqlite3_open((root / "data" / "media_library.sqlite").c_str(), &db);
+    sqlite3_exec(db, "DROP TABLE DuplicateFiles;", nullptr, nullptr, nullptr);
+    sqlite3_close(db);
+
+    {
+        Library lib = Library(root / "music", root / "data");
+
+        ScanOptions options;
+        options.onProgress = [](const ScanProgress &) {};
+        EXPECT_THROW(lib.scanLibrary(options), std::runtime_error);
+    }
+
+    fs::remove_all(root);
+}
+
+TEST_F(LibraryTest, ScanWithIoUringBackend) {
+    const fs::path root = fs::temp_directory_path() / "mellophone-scan-io-uring-test";
+    fs::remove_all(root);
+    fs::create_directories(root / "music");
+
+    for (int i = 0; i < 40; i++) {
+        writeFLAC(root / "music" / (std::to_string(i) + ".flac"), "ARTIST=Artist", i + 1, 1000 * (i + 1));
+    }
+    std::ofstream(root / "music" / "notes.txt") << "not music";
+
+    // Falls back to the thread pool where io_uring is unavailable, with the same results.
+    ScanOptions options;
+    options.threadCount = 2;
+    options.readBackend = ReadBackend::ioUring;
+    options.ioQueueDepth = 4;
+    options.hashPolicy = HashPolicy::full;
+
+    ScanSummary first;
+    ScanSummary second;
+    {
+        Library lib = Library(root / "music", root / "data");
+        first = lib.scanLibrary(options);
+        second = lib.scanLibrary(options);
+    }
+
+    EXPECT_EQ(41, first.filesSeen);
+    EXPECT_EQ(40, first.imported);
+    EXPECT_EQ(1, first.skipped);
+    EXPECT_EQ(0, first.failed);
+
+    // The fingerprints taken through the ring match those recorded.
+    EXPECT_EQ(0, second.imported);
+    EXPECT_EQ(41, second.skipped);
+
+    fs::remove_all(root);
+}
+
+TEST_F(LibraryTest, BrowseDuringScan) {
+    const fs::path root = fs::temp_directory_path() / "mellophone-browse-during-scan-test";
+    fs::remove_all(root);
+    fs::create_directories(root / "music");
+
+    for (int i = 0; i < 200; i++) {
+        writeFLAC(root / "music" / (std::to_string(i) + ".flac"), "TITLE=Track " + std::to_string(i), i + 1, 1000);
+    }
+
+    std::vector<size_t> seen;
+    size_t final = 0;
+    {
+        Library lib = Library(root / "music", root / "data");
+
+        // The progress callback runs while the scan holds the writer, so each browse
+        // must be served by a reader without waiting for the scan to finish.
+        ScanOptions options;
+        options.threadCount = 2;
+        options.batchSize = 10;
+        options.progressInterval = std::chrono::milliseconds(1);
+        options.onProgress = [&](const ScanProgress &) {
+            seen.push_back(lib.loadTrackTable().size());
+        };
+        lib.scanLibrary(options);
+
+        final = lib.loadTrackTable().size();
+    }
+
+    ASSERT_FALSE(seen.empty());
+    EXPECT_LE(seen.front(), seen.back());
+    EXPECT_EQ(200, final);
+
+    fs::remove_all(root);
+}
+
+TEST_F(LibraryTest, ScanStoresCoverArt) {
+    const fs::path root = fs::temp_directory_path() / "mellophone-scan-cover-test";
+    fs::remove_all(root);
+    fs::create_directories(root / "music");
+
+    RGBImage image;
+    image.width = 600;
+    image.height = 600;
+    image.pixels.assign(600 * 600 * 3, 200);
+    const std::vector<uint8_t> jpeg = Thumbnail::encodeJPEG(image);
+
+    // Two tracks of the same album, each embedding the same front cover.
+    for (int i = 0; i < 2; i++) {
+        writeFLAC(root / "music" / (std::to_string(i) + ".flac"), "ALBUM=Album", i + 1, 1000, jpeg);
+    }
+
+    {
+        Library lib = Library(root / "music", root / "data");
+        ASSERT_EQ(2, lib.scanLibrary().imported);
+
+        const fs::path thumbnail = lib.getAlbumThumbnail(1);
+        ASSERT_TRUE(fs::exists(thumbnail));
+        EXPECT_EQ(root / "data" / "covers" / "thumbnails", thumbnail.parent_path());
+        EXPECT_EQ(fs::path(), lib.getAlbumThumbnail(2));
+    }
+
+    size_t originals = 0;
+    for (const auto &entry : fs::recursive_directory_iterator(root / "data" / "covers" / "originals")) {
+        originals += entry.is_regular_file() ? 1 : 0;
+    }
+    EXPECT_EQ(1u, originals);
+
+    fs::remove_all(root);
+}
+
+TEST_F(LibraryTest, WatchAppliesChanges) {
+    const fs::path root = fs::temp_directory_path() / "mellophone-watch-test";
+    fs::remove_all(root);
+    fs::create_directories(root / "music" / "album");
+
+    std::mutex lock;
+    std::condition_variable updated;
+    int updates = 0;
+    auto waitForUpdate = [&](int count) {
+        std::unique_lock<std::mutex> guard(lock);
+        return updated.wait_for(guard, std::chrono::seconds(5), [&] { return updates >= count; });
+    };
+
+    {
+        Library lib = Library(root / "music", root / "data");
+        lib.scanLibrary();
+
+        WatchOptions watchOptions;
+        watchOptions.quietPeriod = std::chrono::milliseconds(50);
+        lib.startWatching(ScanOptions(), watchOptions, [&](const ScanSummary &) {
+            std::lock_guard<std::mutex> guard(lock);
+            updates++;
+            updated.notify_all();
+        });
+
+        for (char i = 0; i < 3; i++) {
+            const std::string name = "Track " + std::to_string(i);
+            writeFLAC(root / "music" / "album" / (name + ".flac"), "TITLE=" + name, i + 1, 1000);
+        }
+        ASSERT_TRUE(waitForUpdate(1));
+        EXPECT_EQ(3u, lib.loadTrackTable().size());
+
+        // Removing the album's folder removes its tracks.
+        fs::remove_all(root / "music" / "album");
+        ASSERT_TRUE(waitForUpdate(2));
+        EXPECT_EQ(0u, lib.loadTrackTable().size());
+    }
+
+    fs::remove_all(root);
+}
+
+TEST_F(LibraryTest, FailedRemovalRemovesNothing) {
+    const fs::path root = fs::temp_directory_path() / "mellophone-failed-removal-test";
+    fs::remove_all(root);
+    fs::create_directories(root / "music");
+
+    for (int i = 0; i < 2; i++) {
+        writeFLAC(root / "music" / (std::to_string(i) + ".flac"), "TITLE=Track " + std::to_string(i), i + 1, 1000);
+    }
+
+    { Library(root / "music", root / "data").scanLibrary(); }
+
+    // The second track cannot be deleted.
+    sqlite3 *db = nullptr;
+    sqlite3_open((root / "data" / "media_library.sqlite").c_str(), &db);
+    sqlite3_exec(db,
+                 "CREATE TRIGGER KeepTrack BEFORE DELETE ON Tracks WHEN OLD.FileLocation LIKE '%1.flac' "
+                 "BEGIN SELECT RAISE(ABORT, 'kept'); END;",
+                 nullptr, nullptr, nullptr);
+    sqlite3_close(db);
+
+    {
+        Library lib = Library(root / "music", root / "data");
+
+        WatchBatch batch;
+        batch.removed = {root / "music" / "0.flac", root / "music" / "1.flac"};
+        EXPECT_THROW(lib.applyChanges(batch), std::runtime_error);
+        EXPECT_EQ(2u, lib.loadTrackTable().size());
+    }
+
+    fs::remove_all(root);
+}
+
+TEST_F(LibraryTest, ScanWritesSnapshot) {
+    const fs::path root = fs::temp_directory_path() / "mellophone-snapshot-test";
+    fs::remove_all(root);
+    fs::create_directories(root / "music");
+
+    for (int i = 0; i < 3; i++) {
+        writeFLAC(root / "music" / (std::to_string(i) + ".flac"), "TITLE=Track " + std::to_string(i), i + 1, 1000);
+    }
+
+    {
+        Library lib = Library(root / "music", root / "data");
+        EXPECT_EQ(nullptr, lib.openSnapshot());
+
+        lib.scanLibrary();
+        std::unique_ptr<LibrarySnapshot> snapshot = lib.openSnapshot();
+        ASSERT_NE(nullptr, snapshot);
+        ASSERT_EQ(3u, snapshot->trackCount());
+        EXPECT_EQ("Track 0", snapshot->track(0).title);
+
+        // A rescan that changes nothing keeps the snapshot current without rewriting it.
+        const auto written = fs::last_write_time(root / "data" / SNAPSHOT_FILE_NAME);
+        lib.scanLibrary();
+        EXPECT_EQ(written, fs::last_write_time(root / "data" / SNAPSHOT_FILE_NAME));
+        EXPECT_NE(nullptr, lib.openSnapshot());
+
+        WatchBatch batch;
+        batch.removed.push_back(root / "music" / "1.flac");
+        fs::remove(root / "music" / "1.flac");
+        lib.applyChanges(batch);
+
+        snapshot = lib.openSnapshot();
+        ASSERT_NE(nullptr, snapshot);
+        EXPECT_EQ(2u, snapshot->trackCount());
+    }
+
+    // A change made behind the library's back leaves the snapshot out of date.
+    sqlite3 *db = nullptr;
+    sqlite3_open((root / "data" / "media_library.sqlite").c_str(), &db);
+    sqlite3_exec(db, "UPDATE LibraryState SET Generation = Generation + 1;", nullptr, nullptr, nullptr);
+    sqlite3_close(db);
+
+    {
+        Library lib = Library(root / "music", root / "data");
+        EXPECT_EQ(nullptr, lib.openSnapshot());
+    }
+
+    fs::remove_all(root);
+}
+
+TEST_F(LibraryTest, SnapshotIsRewrittenAfterChangesQuietDown) {
+    const fs::path root = fs::temp_directory_path() / "mellophone-snapshot-delay-test";
+    fs::remove_all(root);
+    fs::create_directories(root / "music");
+
+    for (int i = 0; i < 3; i++) {
+        writeFLAC(root / "music" / (std::to_string(i) + ".flac"), "TITLE=Track " + std::to_string(i), i + 1, 1000);
+    }
+
+    {
+        Library lib = Library(root / "music", root / "data");
+        lib.scanLibrary();
+        const uint64_t scanned = lib.openSnapshot()->getGeneration();
+
+        // Each batch returns without waiting for the snapshot, which is rewritten once
+        // for the whole burst.
+        for (int i = 0; i < 2; i++) {
+            WatchBatch batch;
+            batch.removed.push_back(root / "music" / (std::to_string(i) + ".flac"));
+            fs::remove(batch.removed.back());
+            lib.applyChanges(batch);
+        }
+        EXPECT_EQ(scanned, LibrarySnapshot::open(root / "data" / SNAPSHOT_FILE_NAME)->getGeneration());
+
+        std::unique_ptr<LibrarySnapshot> snapshot = lib.openSnapshot();
+        ASSERT_NE(nullptr, snapshot);
+        EXPECT_EQ(1u, snapshot->trackCount());
+        EXPECT_EQ(scanned + 2, snapshot->getGeneration());
+    }
+
+    fs::remove_all(root);
+}
+
+TEST_F(LibraryTest, FindsDuplicates) {
+    const fs::path root = fs::temp_directory_path() / "mellophone-duplicates-test";
+    fs::remove_all(root);
+    fs::create_directories(root / "music" / "a");
+    fs::create_directories(root / "music" / "b");
+
+    // Both files carry the same STREAMINFO, and so the same audio MD5, under different tags.
+    for (int i = 0; i < 2; i++) {
+        writeFLAC(root / "music" / "a" / (std::to_string(i) + ".flac"), "TITLE=Take " + std::to_string(i), 1, 1000);
+    }
+
+    // A byte-for-byte copy is skipped by the scan, but still reported.
+    fs::copy_file(root / "music" / "a" / "0.flac", root / "music" / "b" / "0.flac");
+
+    {
+        Library lib = Library(root / "music", root / "data");
+        const ScanSummary scan = lib.scanLibrary();
+        EXPECT_EQ(2, scan.imported);
+        EXPECT_EQ(1, scan.skipped);
+
+        // The copy is known by its fingerprint, so a rescan reads none of the files.
+        const ScanSummary rescan = lib.scanLibrary();
+        EXPECT_EQ(0, rescan.imported);
+        EXPECT_EQ(3, rescan.skipped);
+        EXPECT_EQ(0, lib.getScanProgress().stage(ScanStage::parse).count);
+
+        const DuplicateSummary summary = lib.findDuplicates();
+        EXPECT_EQ(2u, summary.tracks);
+        EXPECT_EQ(1u, summary.copies);
+        EXPECT_EQ(1u, summary.identicalGroups);
+        EXPECT_EQ(1u, summary.sameAudioGroups);
+
+        // Tracks are numbered in the order the scan committed them.
+        std::vector<std::string> identical;
+        std::vector<std::string> sameAudio;
+        DuplicateCursor cursor = lib.queryDuplicates();
+        while (cursor.next()) {
+            const DuplicateView &row = cursor.row();
+            const std::string name = std::string(row.title) + (row.copy ? " (copy)" : "");
+            (row.kind == DuplicateKind::identical ? identical : sameAudio).push_back(name);
+        }
+        std::sort(identical.begin(), identical.end());
+        std::sort(sameAudio.begin(), sameAudio.end());
+        EXPECT_EQ(std::vector<std::string>({"Take 0", "Take 0 (copy)"}), identical);
+        EXPECT_EQ(std::vector<std::string>({"Take 0", "Take 1"}), sameAudio);
+    }
+
+    fs::remove_all(root);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
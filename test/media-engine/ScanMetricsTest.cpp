@@ -0,0 +1,86 @@
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <ScanMetrics.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+TEST(ScanMetricsTest, HistogramBucketsByPowerOfTwo)
+{
+  LatencyHistogram histogram;
+  for (uint64_t nanos : {0, 1, 2, 3, 1000, 1023, 1024, 1000000})
+  {
+    histogram.record(nanos);
+  }
+
+  LatencySnapshot snapshot = histogram.snapshot();
+  EXPECT_EQ(8u, snapshot.count);
+  EXPECT_EQ(1000000u, snapshot.maxNanos);
+  EXPECT_EQ(2u, snapshot.buckets[0]);
+  EXPECT_EQ(2u, snapshot.buckets[1]);
+  EXPECT_EQ(2u, snapshot.buckets[9]);
+  EXPECT_EQ(1u, snapshot.buckets[10]);
+  EXPECT_EQ((0 + 1 + 2 + 3 + 1000 + 1023 + 1024 + 1000000) / 8u, snapshot.meanNanos());
+
+  EXPECT_EQ(1u, snapshot.percentileNanos(0.25));
+  EXPECT_EQ(1023u, snapshot.percentileNanos(0.75));
+  EXPECT_EQ(1000000u, snapshot.percentileNanos(1.0));
+  EXPECT_EQ(0u, LatencySnapshot().percentileNanos(0.5));
+}
+
+TEST(ScanMetricsTest, RecordsFromManyThreads)
+{
+  ScanMetrics metrics;
+  metrics.start();
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++)
+  {
+    threads.emplace_back([&metrics] {
+      for (int i = 0; i < 10000; i++)
+      {
+        metrics.record(ScanStage::hash, 500);
+        metrics.bytesRead += 10;
+      }
+    });
+  }
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+
+  ScanProgress progress = metrics.snapshot();
+  EXPECT_EQ(40000u, progress.stage(ScanStage::hash).count);
+  EXPECT_EQ(0u, progress.stage(ScanStage::write).count);
+  EXPECT_EQ(400000u, progress.bytesRead);
+  EXPECT_FALSE(progress.scanFinished);
+
+  // Starting again clears everything.
+  metrics.start();
+  EXPECT_EQ(0u, metrics.snapshot().stage(ScanStage::hash).count);
+}
+
+TEST(ScanMetricsTest, EstimatesTimeRemaining)
+{
+  ScanProgress progress;
+  progress.totals.filesSeen = 100;
+  progress.totals.imported = 20;
+  progress.totals.skipped = 5;
+  progress.elapsedNanos = 25000000000;
+
+  // Unknown until every file has been found.
+  EXPECT_LT(progress.secondsRemaining(), 0);
+
+  progress.walkFinished = true;
+  EXPECT_DOUBLE_EQ(75.0, progress.secondsRemaining());
+
+  progress.scanFinished = true;
+  EXPECT_DOUBLE_EQ(0.0, progress.secondsRemaining());
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,166 @@
+#include <memory>
+#include <string>
+#include <gtest/gtest.h>
+
+#include <BrowseQueries.hpp>
+#include <IngestWriter.hpp>
+#include <LibraryQuery.hpp>
+#include <Schema.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+class SchemaTest : public ::testing::Test
+{
+protected:
+  std::shared_ptr<sqlite3 *> db = std::make_shared<sqlite3 *>();
+
+  void SetUp() override
+  {
+    sqlite3_open(":memory:", db.get());
+  }
+
+  void TearDown() override
+  {
+    sqlite3_close_v2(*db);
+  }
+
+  bool hasColumn(const char *table, const char *column)
+  {
+    sqlite3_stmt *stmt;
+    std::string sql = std::string("SELECT COUNT(*) FROM pragma_table_info('") + table + "') WHERE name == ?;";
+    sqlite3_prepare_v2(*db, sql.c_str(), -1, &stmt, nullptr);
+    sqlite3_bind_text(stmt, 1, column, -1, SQLITE_STATIC);
+    sqlite3_step(stmt);
+    bool found = sqlite3_column_int(stmt, 0) > 0;
+    sqlite3_finalize(stmt);
+    return found;
+  }
+
+  /**
+   * Returns the steps of the query's plan that read a whole table or index, one per line.
+   */
+  std::string scansIn(const std::string &sql)
+  {
+    sqlite3_stmt *stmt;
+    std::string plan = "EXPLAIN QUERY PLAN " + sql;
+    EXPECT_EQ(SQLITE_OK, sqlite3_prepare_v2(*db, plan.c_str(), -1, &stmt, nullptr)) << sqlite3_errmsg(*db);
+
+    std::string scans;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+      std::string detail = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3));
+      if (detail.rfind("SCAN", 0) == 0)
+      {
+        scans += detail + "\n";
+      }
+    }
+    sqlite3_finalize(stmt);
+    return scans;
+  }
+};
+
+TEST_F(SchemaTest, CreatesLatestSchema)
+{
+  ASSERT_EQ(0, Schema::getVersion(db));
+
+  Schema::migrate(db);
+
+  ASSERT_EQ(Schema::getLatestVersion(), Schema::getVersion(db));
+  ASSERT_TRUE(hasColumn("Tracks", "Checksum"));
+  ASSERT_TRUE(hasColumn("Tracks", "ModifiedTime"));
+}
+
+TEST_F(SchemaTest, UpgradesUnversionedDatabase)
+{
+  // Tables as created before the schema was versioned.
+  sqlite3_exec(*db,
+               "CREATE TABLE Albums (ID INTEGER NOT NULL UNIQUE, Name TEXT NOT NULL, Artist INTEGER NOT NULL, "
+               "CoverArt BLOB, PRIMARY KEY(ID));"
+               "CREATE TABLE Artists (ID INTEGER NOT NULL UNIQUE, Name TEXT NOT NULL UNIQUE, Picture BLOB, "
+               "PRIMARY KEY(ID));"
+               "CREATE TABLE Tracks (Checksum TEXT NOT NULL UNIQUE, FileLocation TEXT NOT NULL UNIQUE, "
+               "Title TEXT NOT NULL, Album INTEGER NOT NULL, TrackNum INTEGER, TotalTracks INTEGER, "
+               "DiscNum INTEGER, TotalDiscs INTEGER, PRIMARY KEY(Checksum));"
+               "INSERT INTO Albums VALUES(1, 'Album', 1, NULL);"
+               "INSERT INTO Tracks VALUES('abc', '/a.flac', 'A', 1, 1, 1, 1, 1);",
+               nullptr, nullptr, nullptr);
+  ASSERT_EQ(1, Schema::getVersion(db));
+
+  Schema::migrate(db);
+
+  ASSERT_EQ(Schema::getLatestVersion(), Schema::getVersion(db));
+  ASSERT_TRUE(hasColumn("Tracks", "FileSize"));
+  ASSERT_TRUE(hasColumn("Tracks", "Inode"));
+  ASSERT_TRUE(hasColumn("Tracks", "Device"));
+  ASSERT_TRUE(hasColumn("Tracks", "PartialHash"));
+  ASSERT_TRUE(hasColumn("Tracks", "AudioMD5"));
+  ASSERT_TRUE(hasColumn("Tracks", "Genre"));
+  ASSERT_TRUE(hasColumn("Tracks", "Date"));
+  ASSERT_TRUE(hasColumn("Albums", "CoverHash"));
+  ASSERT_FALSE(hasColumn("Albums", "CoverArt"));
+
+  // Existing rows survive the table rebuild.
+  sqlite3_stmt *stmt;
+  sqlite3_prepare_v2(*db, "SELECT Checksum FROM Tracks WHERE FileLocation == '/a.flac';", -1, &stmt, nullptr);
+  ASSERT_EQ(SQLITE_ROW, sqlite3_step(stmt));
+  EXPECT_STREQ("abc", reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)));
+  sqlite3_finalize(stmt);
+
+  sqlite3_prepare_v2(*db, "SELECT Name FROM Albums WHERE ID == 1;", -1, &stmt, nullptr);
+  ASSERT_EQ(SQLITE_ROW, sqlite3_step(stmt));
+  EXPECT_STREQ("Album", reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)));
+  sqlite3_finalize(stmt);
+}
+
+TEST_F(SchemaTest, BrowseQueriesUseIndexes)
+{
+  Schema::migrate(db);
+
+  for (const std::string &sql : BROWSE_QUERIES)
+  {
+    EXPECT_EQ("", scansIn(sql)) << sql;
+  }
+
+  // The filtered views, as LibraryQuery builds them.
+  ArtistQuery artistsByName;
+  artistsByName.namePrefix = "A";
+  AlbumQuery albumsByName;
+  albumsByName.namePrefix = "A";
+  AlbumQuery artistAlbums;
+  artistAlbums.artistID = 1;
+  TrackQuery albumTracks;
+  albumTracks.albumID = 1;
+  albumTracks.order = TrackOrder::album;
+  TrackQuery artistTracks;
+  artistTracks.artistID = 1;
+  artistTracks.order = TrackOrder::album;
+
+  for (const std::string &sql : {buildArtistQuery(artistsByName), buildAlbumQuery(albumsByName),
+                                 buildAlbumQuery(artistAlbums), buildTrackQuery(albumTracks),
+                                 buildTrackQuery(artistTracks)})
+  {
+    EXPECT_EQ("", scansIn(sql)) << sql;
+  }
+
+  // The lookups an import makes for each file.
+  for (const std::string &sql : {LOCATION_SELECT_SQL, CHECKSUM_SELECT_SQL, SIZE_SELECT_SQL})
+  {
+    EXPECT_EQ("", scansIn(sql)) << sql;
+  }
+
+  // The check itself notices a scan.
+  EXPECT_NE("", scansIn("SELECT ID FROM Tracks WHERE Genre == 'Rock';"));
+}
+
+TEST_F(SchemaTest, MigrateIsIdempotent)
+{
+  Schema::migrate(db);
+  EXPECT_NO_THROW(Schema::migrate(db));
+  ASSERT_EQ(Schema::getLatestVersion(), Schema::getVersion(db));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,113 @@
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <openssl/evp.h>
+
+#include <Sha256Engine.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+using Digest = std::array<uint8_t, SHA256_DIGEST_SIZE>;
+
+class Sha256EngineTest : public ::testing::Test
+{
+protected:
+  std::mt19937 random{1234};
+
+  std::vector<uint8_t> randomBytes(size_t length)
+  {
+    std::vector<uint8_t> bytes(length);
+    for (auto &byte : bytes)
+    {
+      byte = static_cast<uint8_t>(random());
+    }
+    return bytes;
+  }
+
+  static Digest referenceDigest(const std::vector<uint8_t> &data)
+  {
+    Digest digest;
+    EVP_Digest(data.data(), data.size(), digest.data(), nullptr, EVP_sha256(), nullptr);
+    return digest;
+  }
+};
+
+TEST_F(Sha256EngineTest, SingleStreamMatchesOpenSSL)
+{
+  for (Sha256Backend backend : {Sha256Backend::openssl, Sha256Backend::shaNi})
+  {
+    if (!Sha256Engine::isSupported(backend))
+    {
+      continue;
+    }
+
+    // Lengths around the block and padding boundaries, plus a multi-block message.
+    for (size_t length : {0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 100000})
+    {
+      std::vector<uint8_t> data = randomBytes(length);
+      Sha256Hasher hasher(backend);
+
+      // Feed in uneven pieces to exercise the partial-block buffering.
+      size_t offset = 0;
+      for (size_t piece = 1; offset < data.size(); piece = piece * 3 + 1)
+      {
+        size_t take = std::min(piece, data.size() - offset);
+        hasher.update(data.data() + offset, take);
+        offset += take;
+      }
+
+      Digest digest;
+      hasher.finish(digest.data());
+      ASSERT_EQ(referenceDigest(data), digest) << "length " << length;
+    }
+  }
+}
+
+TEST_F(Sha256EngineTest, MultiBufferMatchesOpenSSL)
+{
+  for (Sha256Backend backend : {Sha256Backend::openssl, Sha256Backend::avx2})
+  {
+    Sha256MultiBuffer multiBuffer(backend);
+
+    // Lanes of different lengths, so lanes drop out of the lock-step at different points.
+    std::vector<std::vector<uint8_t>> inputs;
+    for (size_t lane = 0; lane < Sha256MultiBuffer::LANES; lane++)
+    {
+      inputs.push_back(randomBytes(lane * 1000 + lane * 7 + (lane == 3 ? 0 : 4096)));
+    }
+
+    std::array<size_t, Sha256MultiBuffer::LANES> offsets{};
+    const size_t chunk = 777;
+    bool more = true;
+    while (more)
+    {
+      std::array<const uint8_t *, Sha256MultiBuffer::LANES> data{};
+      std::array<size_t, Sha256MultiBuffer::LANES> lengths{};
+      more = false;
+
+      for (size_t lane = 0; lane < Sha256MultiBuffer::LANES; lane++)
+      {
+        lengths[lane] = std::min(chunk, inputs[lane].size() - offsets[lane]);
+        data[lane] = inputs[lane].data() + offsets[lane];
+        offsets[lane] += lengths[lane];
+        more = more || lengths[lane] > 0;
+      }
+
+      multiBuffer.update(data, lengths);
+    }
+
+    for (size_t lane = 0; lane < Sha256MultiBuffer::LANES; lane++)
+    {
+      Digest digest;
+      multiBuffer.finish(lane, digest.data());
+      ASSERT_EQ(referenceDigest(inputs[lane]), digest) << "lane " << lane;
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,194 @@
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <ContentMatcher.hpp>
+#include <FLACTrack.hpp>
+#include <TrackIngestor.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+class TrackIngestorTest : public ::testing::Test
+{
+protected:
+  const fs::path dir = fs::temp_directory_path() / "mellophone-track-ingestor-test";
+
+  void SetUp() override
+  {
+    fs::create_directories(dir);
+  }
+
+  void TearDown() override
+  {
+    fs::remove_all(dir);
+  }
+
+  static void putBlockHeader(std::vector<uint8_t> &out, uint8_t type, bool last, uint32_t length)
+  {
+    out.push_back(static_cast<uint8_t>(type | (last ? 0x80 : 0)));
+    out.push_back(static_cast<uint8_t>(length >> 16));
+    out.push_back(static_cast<uint8_t>(length >> 8));
+    out.push_back(static_cast<uint8_t>(length));
+  }
+
+  static void putLittleEndian(std::vector<uint8_t> &out, uint32_t value)
+  {
+    for (size_t i = 0; i < 4; i++)
+    {
+      out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+  }
+
+  /**
+   * Writes a FLAC file whose comments follow `padding` bytes of padding, then `audio` bytes of audio.
+   */
+  fs::path writeFLAC(const char *name, const std::string &title, uint32_t padding, size_t audio)
+  {
+    std::vector<uint8_t> file = {'f', 'L', 'a', 'C'};
+
+    putBlockHeader(file, 0, false, 34);
+    file.insert(file.end(), 18, 0x10);
+    file.insert(file.end(), 16, 0xAB);
+
+    putBlockHeader(file, 1, false, padding);
+    file.insert(file.end(), padding, 0);
+
+    const std::string entry = "TITLE=" + title;
+    putBlockHeader(file, 4, true, 4 + 4 + 4 + entry.size());
+    putLittleEndian(file, 0);
+    putLittleEndian(file, 1);
+    putLittleEndian(file, entry.size());
+    file.insert(file.end(), entry.begin(), entry.end());
+
+    for (size_t i = 0; i < audio; i++)
+    {
+      file.push_back(static_cast<uint8_t>(i * 7 + name[0]));
+    }
+
+    return writeFile(name, file);
+  }
+
+  fs::path writeFile(const char *name, const std::vector<uint8_t> &contents)
+  {
+    fs::path location = dir / name;
+
+    std::ofstream out(location, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(contents.data()), contents.size());
+
+    return location;
+  }
+
+  static FileFingerprint fingerprintOf(const fs::path &location)
+  {
+    FileFingerprint fingerprint;
+    EXPECT_TRUE(FileFingerprint::read(location, fingerprint));
+    return fingerprint;
+  }
+
+  static string expectedHash(const fs::path &location)
+  {
+    FLACTrack track(location);
+    track.generateFileHash();
+    return track.getHashAsString();
+  }
+};
+
+TEST_F(TrackIngestorTest, SinglePassMatchesSeparateReads)
+{
+  fs::path location = writeFLAC("song.flac", "Song", 100, 3 * HASH_READ_SIZE + 123);
+
+  for (HashReadMode mode : {HashReadMode::pread, HashReadMode::mmap})
+  {
+    TrackIngestor ingestor(location, fingerprintOf(location), true);
+    unique_ptr<Track> track = ingestor.read(mode);
+
+    ASSERT_NE(nullptr, track);
+    EXPECT_EQ(Format::flac, track->getFormat());
+    EXPECT_EQ("Song", track->getTitle());
+    ASSERT_TRUE(track->hasFileHash());
+    EXPECT_EQ(expectedHash(location), track->getHashAsString());
+
+    ContentKey key = track->getContentKey();
+    EXPECT_EQ(ContentMatcher::computePartialHash(location), key.partialHash);
+    EXPECT_EQ("abababababababababababababababab", key.audioMD5);
+  }
+}
+
+TEST_F(TrackIngestorTest, EndsOnlyReadsMetadataPastTheHead)
+{
+  // The comments start beyond the head that readEnds reads.
+  fs::path location = writeFLAC("late-tags.flac", "Late", PARTIAL_HASH_SPAN + 1000, PARTIAL_HASH_SPAN * 2);
+
+  TrackIngestor ingestor(location, fingerprintOf(location), false);
+  unique_ptr<Track> track = ingestor.read(HashReadMode::pread);
+
+  ASSERT_NE(nullptr, track);
+  EXPECT_EQ("Late", track->getTitle());
+  EXPECT_FALSE(track->hasFileHash());
+  EXPECT_EQ(ContentMatcher::computePartialHash(location), track->getContentKey().partialHash);
+}
+
+TEST_F(TrackIngestorTest, InterleavedReadFillsEveryTrack)
+{
+  vector<unique_ptr<TrackIngestor>> ingestors;
+  vector<fs::path> locations;
+
+  // More files than lanes, of different lengths, with one that is not really FLAC.
+  for (size_t i = 0; i < Sha256MultiBuffer::LANES + 2; i++)
+  {
+    string name = std::to_string(i) + ".flac";
+    fs::path location = i == 3 ? writeFile(name.c_str(), std::vector<uint8_t>(5000, 'x'))
+                               : writeFLAC(name.c_str(), "Track " + std::to_string(i), 10, i * HASH_LANE_READ_SIZE / 3);
+
+    locations.push_back(location);
+    ingestors.push_back(std::make_unique<TrackIngestor>(location, fingerprintOf(location), false));
+  }
+
+  vector<unique_ptr<Track>> tracks;
+  vector<std::exception_ptr> errors;
+  TrackIngestor::readInterleaved(ingestors, tracks, errors);
+
+  for (size_t i = 0; i < locations.size(); i++)
+  {
+    ASSERT_EQ(nullptr, errors[i]);
+
+    if (i == 3)
+    {
+      EXPECT_EQ(nullptr, tracks[i]);
+      continue;
+    }
+
+    ASSERT_NE(nullptr, tracks[i]);
+    EXPECT_EQ("Track " + std::to_string(i), tracks[i]->getTitle());
+    EXPECT_EQ(expectedHash(locations[i]), tracks[i]->getHashAsString());
+    EXPECT_EQ(ContentMatcher::computePartialHash(locations[i]), tracks[i]->getContentKey().partialHash);
+  }
+}
+
+TEST_F(TrackIngestorTest, RejectsChangedAndMalformedFiles)
+{
+  fs::path location = writeFLAC("changed.flac", "Changed", 10, 1000);
+  FileFingerprint fingerprint = fingerprintOf(location);
+  fingerprint.size += 1;
+
+  TrackIngestor changed(location, fingerprint, true);
+  EXPECT_THROW(changed.read(HashReadMode::pread), std::runtime_error);
+
+  std::vector<uint8_t> truncated = {'f', 'L', 'a', 'C'};
+  putBlockHeader(truncated, 0, true, 10);
+  location = writeFile("truncated.flac", truncated);
+
+  TrackIngestor malformed(location, fingerprintOf(location), true);
+  EXPECT_THROW(malformed.read(HashReadMode::pread), std::runtime_error);
+
+  EXPECT_FALSE(TrackIngestor::canIngest(dir / "cover.jpg"));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,177 @@
+#include <memory>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <Schema.hpp>
+#include <TrackTable.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+class TrackTableTest : public ::testing::Test
+{
+protected:
+  shared_ptr<sqlite3 *> db = std::make_shared<sqlite3 *>();
+  shared_ptr<StatementCache> statements;
+
+  void SetUp() override
+  {
+    sqlite3_open(":memory:", db.get());
+    Schema::migrate(db);
+    statements = std::make_shared<StatementCache>(db);
+  }
+
+  void TearDown() override
+  {
+    statements->finalizeAll();
+    sqlite3_close_v2(*db);
+  }
+
+  static TrackRow makeRow(uint32_t id, const char *title, const char *artist, const char *album, const char *genre,
+                          uint8_t trackNum)
+  {
+    TrackRow row;
+    row.id = id;
+    row.title = title;
+    row.artist = artist;
+    row.album = album;
+    row.genre = genre;
+    row.numbers.trackNum = trackNum;
+    return row;
+  }
+
+  static std::vector<std::string> titlesIn(const TrackTable &table, const std::vector<uint32_t> &rows)
+  {
+    std::vector<std::string> titles;
+    for (uint32_t row : rows)
+    {
+      titles.emplace_back(table.title(row));
+    }
+    return titles;
+  }
+};
+
+TEST_F(TrackTableTest, InternsSharedNames)
+{
+  StringPool pool;
+  EXPECT_EQ(0u, pool.intern(""));
+
+  const uint32_t first = pool.intern("Artist");
+  std::string copy = "Artist";
+  EXPECT_EQ(first, pool.intern(copy));
+  EXPECT_EQ(StringPool::NOT_FOUND, pool.find("Other"));
+
+  // Views stay put while the pool grows past several chunks and when it is moved.
+  const string_view view = pool.get(first);
+  for (int i = 0; i < 20000; i++)
+  {
+    pool.intern("Name " + std::to_string(i));
+  }
+  pool.intern(std::string(100000, 'x'));
+
+  StringPool moved = std::move(pool);
+  EXPECT_EQ(view.data(), moved.get(first).data());
+  EXPECT_EQ("Artist", moved.get(moved.find("Artist")));
+  EXPECT_EQ(100000u, moved.get(moved.find(std::string(100000, 'x'))).size());
+}
+
+TEST_F(TrackTableTest, RoundTripsRows)
+{
+  TrackTable table;
+
+  const std::string location = "/music/Artist/Album/01 Song.flac";
+  TrackRow row = makeRow(7, "Song", "Artist", "Album", "Jazz", 1);
+  row.setLocation(location);
+  row.year = 1999;
+  row.numbers.totalTracks = 12;
+  table.append(row);
+
+  std::string other = "/music/Artist/Album/02 Other.flac";
+  row = makeRow(8, "Other", "Artist", "Album", "Jazz", 2);
+  row.setLocation(other);
+  table.append(row);
+  other.assign(other.size(), '?');
+
+  ASSERT_EQ(2u, table.size());
+  EXPECT_EQ(location, table.location(0));
+  EXPECT_EQ("/music/Artist/Album/02 Other.flac", table.location(1));
+
+  TrackRow read = table.row(0);
+  EXPECT_EQ(7u, read.id);
+  EXPECT_EQ("Song", read.title);
+  EXPECT_EQ("01 Song.flac", read.fileName);
+  EXPECT_EQ(1999, read.year);
+  EXPECT_EQ(12, read.numbers.totalTracks);
+
+  // Both rows point at the same interned strings.
+  EXPECT_EQ(table.artist(0).data(), table.artist(1).data());
+  EXPECT_EQ(table.row(0).directory.data(), table.row(1).directory.data());
+}
+
+TEST_F(TrackTableTest, SortsAndSelects)
+{
+  TrackTable table;
+  table.append(makeRow(1, "c", "Beta", "Second", "Rock", 2));
+  table.append(makeRow(2, "a", "Alpha", "First", "Jazz", 3));
+  table.append(makeRow(3, "d", "Beta", "Second", "Rock", 1));
+  table.append(makeRow(4, "b", "Alpha", "First", "Rock", 1));
+  table.append(makeRow(5, "e", "Beta", "Another", "Rock", 1));
+
+  EXPECT_EQ((std::vector<std::string>{"b", "a", "e", "d", "c"}), titlesIn(table, table.sortedOrder(TrackSortKey::artist)));
+  EXPECT_EQ((std::vector<std::string>{"e", "b", "a", "d", "c"}), titlesIn(table, table.sortedOrder(TrackSortKey::album)));
+  EXPECT_EQ((std::vector<std::string>{"a", "b", "e", "d", "c"}), titlesIn(table, table.sortedOrder(TrackSortKey::genre)));
+  EXPECT_EQ((std::vector<std::string>{"a", "b", "c", "d", "e"}), titlesIn(table, table.sortedOrder(TrackSortKey::title)));
+
+  EXPECT_EQ((std::vector<uint32_t>{0, 2, 3, 4}), table.selectGenre("Rock"));
+  EXPECT_EQ((std::vector<uint32_t>{1, 3}), table.selectArtist("Alpha"));
+  EXPECT_TRUE(table.selectAlbum("Missing").empty());
+
+  auto firstTracks = table.select([](const TrackTable &t, uint32_t row) { return t.trackNumbers(row).trackNum == 1; });
+  EXPECT_EQ((std::vector<uint32_t>{2, 3, 4}), firstTracks);
+}
+
+TEST_F(TrackTableTest, LoadsFromDatabase)
+{
+  sqlite3_exec(*db,
+               "INSERT INTO Artists(ID, Name) VALUES(1, 'Artist');"
+               "INSERT INTO Albums(ID, Name, Artist) VALUES(1, 'Album', 1), (2, 'Other Album', 1);"
+               "INSERT INTO Tracks(ID, FileLocation, Title, Album, TrackNum, TotalTracks, DiscNum, TotalDiscs, "
+               "Genre, Date) VALUES"
+               "(1, '/music/a.flac', 'A', 1, 3, 10, 1, 2, 'Rock', '2004-05-17'),"
+               "(2, '/music/b.ogg', 'B', 2, NULL, NULL, NULL, NULL, NULL, 'May 2004'),"
+               "(3, 'c.flac', 'C', 1, 300, 1, 1, 1, 'Rock', NULL);",
+               nullptr, nullptr, nullptr);
+
+  TrackTable table = TrackTable::load(statements);
+
+  ASSERT_EQ(3u, table.size());
+  EXPECT_EQ("/music/a.flac", table.location(0));
+  EXPECT_EQ("c.flac", table.location(2));
+  EXPECT_EQ("Album", table.album(0));
+  EXPECT_EQ("Other Album", table.album(1));
+  EXPECT_EQ("Artist", table.artist(1));
+  EXPECT_EQ("Rock", table.genre(0));
+  EXPECT_EQ("", table.genre(1));
+  EXPECT_EQ(2004, table.year(0));
+  EXPECT_EQ(0, table.year(1));
+  EXPECT_EQ(3, table.trackNumbers(0).trackNum);
+  EXPECT_EQ(2, table.trackNumbers(0).totalDiscs);
+  EXPECT_EQ(1, table.trackNumbers(1).trackNum);
+  EXPECT_EQ(255, table.trackNumbers(2).trackNum);
+  EXPECT_EQ((std::vector<uint32_t>{0, 2}), table.selectAlbum("Album"));
+  EXPECT_GT(table.memoryUsage(), 0u);
+}
+
+TEST(TrackTableYearTest, ParsesLeadingYear)
+{
+  EXPECT_EQ(2004, TrackTable::parseYear("2004"));
+  EXPECT_EQ(1969, TrackTable::parseYear("1969-07-20"));
+  EXPECT_EQ(0, TrackTable::parseYear("69"));
+  EXPECT_EQ(0, TrackTable::parseYear("July 1969"));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
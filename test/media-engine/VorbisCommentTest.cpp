@@ -0,0 +1,104 @@
+#include <cctype>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <VorbisComment.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+static std::string commentBlock(const std::vector<std::string> &entries, uint32_t count)
+{
+  auto putLength = [](std::string &out, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+    {
+      out.push_back(static_cast<char>(value >> (i * 8)));
+    }
+  };
+
+  std::string block;
+  putLength(block, 6);
+  block += "vendor";
+  putLength(block, count);
+  for (const auto &entry : entries)
+  {
+    putLength(block, entry.size());
+    block += entry;
+  }
+
+  return block;
+}
+
+TEST(VorbisCommentTest, LookupIgnoresCase)
+{
+  for (const auto &entry : VorbisFields::NAMES)
+  {
+    std::string lower;
+    for (char c : entry.name)
+    {
+      lower.push_back(static_cast<char>(tolower(c)));
+    }
+
+    EXPECT_EQ(entry.field, lookupVorbisField(entry.name));
+    EXPECT_EQ(entry.field, lookupVorbisField(lower));
+  }
+
+  static_assert(lookupVorbisField("DiscTotal") == VorbisField::totalDiscs, "lookup must work at compile time");
+}
+
+TEST(VorbisCommentTest, LookupRejectsOtherNames)
+{
+  EXPECT_EQ(VorbisField::unknown, lookupVorbisField(""));
+  EXPECT_EQ(VorbisField::unknown, lookupVorbisField("TITLES"));
+  EXPECT_EQ(VorbisField::unknown, lookupVorbisField("TITL"));
+  EXPECT_EQ(VorbisField::unknown, lookupVorbisField("REPLAYGAIN_TRACK_GAIN"));
+}
+
+TEST(VorbisCommentTest, LookupReadsOtherArtistsAsArtists)
+{
+  EXPECT_EQ(VorbisField::artist, lookupVorbisField("ALBUMARTIST"));
+  EXPECT_EQ(VorbisField::artist, lookupVorbisField("Album Artist"));
+  EXPECT_EQ(VorbisField::artist, lookupVorbisField("ARTISTSORT"));
+  EXPECT_EQ(VorbisField::unknown, lookupVorbisField("ARTIS"));
+
+  static_assert(lookupVorbisField("albumartist") == VorbisField::artist, "lookup must work at compile time");
+}
+
+TEST(VorbisCommentTest, DecodePointsIntoBlock)
+{
+  std::string block = commentBlock({"TITLE=a=b", "no separator", "Genre="}, 3);
+
+  std::string_view vendor;
+  std::vector<VorbisComment> comments;
+  EXPECT_EQ(block.size(), decodeVorbisComments(block, vendor, comments));
+
+  EXPECT_EQ("vendor", vendor);
+  ASSERT_EQ(2u, comments.size());
+  EXPECT_EQ(VorbisField::title, comments[0].field());
+  EXPECT_EQ("a=b", comments[0].value);
+  EXPECT_EQ(VorbisField::genre, comments[1].field());
+  EXPECT_TRUE(comments[1].value.empty());
+
+  // The views are into the block, not copies.
+  EXPECT_GE(comments[0].value.data(), block.data());
+  EXPECT_LT(comments[0].value.data(), block.data() + block.size());
+}
+
+TEST(VorbisCommentTest, DecodeRejectsTruncatedBlocks)
+{
+  std::string_view vendor;
+  std::vector<VorbisComment> comments;
+
+  std::string block = commentBlock({"TITLE=x"}, 1);
+  EXPECT_THROW(decodeVorbisComments(std::string_view(block).substr(0, block.size() - 1), vendor, comments),
+               std::runtime_error);
+
+  // A comment count far larger than the block could hold.
+  EXPECT_THROW(decodeVorbisComments(commentBlock({}, 1000000), vendor, comments), std::runtime_error);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
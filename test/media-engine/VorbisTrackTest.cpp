@@ -0,0 +1,272 @@
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <OggVorbisMetadata.hpp>
+#include <TrackIngestor.hpp>
+#include <VorbisTrack.hpp>
+
+using namespace Mellophone::MediaEngine;
+
+class VorbisTrackTest : public ::testing::Test
+{
+protected:
+  const fs::path dataFile = fs::temp_directory_path() / "mellophone-vorbis-track-test.ogg";
+
+  void TearDown() override
+  {
+    fs::remove(dataFile);
+  }
+
+  static void putLittleEndian(std::vector<uint8_t> &out, uint64_t value, size_t length)
+  {
+    for (size_t i = 0; i < length; i++)
+    {
+      out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+  }
+
+  static void putString(std::vector<uint8_t> &out, const std::string &value)
+  {
+    out.insert(out.end(), value.begin(), value.end());
+  }
+
+  /**
+   * Appends the packets of one logical stream as pages of at most 255 segments,
+   * continuing packets across pages where needed.
+   */
+  static void putPages(std::vector<uint8_t> &out, uint32_t serial, bool firstPage,
+                       const std::vector<std::vector<uint8_t>> &packets)
+  {
+    std::vector<uint8_t> lacing;
+    std::vector<uint8_t> data;
+    std::vector<bool> endsPacket;
+
+    for (const auto &packet : packets)
+    {
+      for (size_t left = packet.size();; left -= 255)
+      {
+        lacing.push_back(static_cast<uint8_t>(std::min<size_t>(left, 255)));
+        endsPacket.push_back(left < 255);
+        if (left < 255)
+        {
+          break;
+        }
+      }
+      data.insert(data.end(), packet.begin(), packet.end());
+    }
+
+    size_t segment = 0;
+    size_t position = 0;
+    bool continued = false;
+
+    while (segment < lacing.size())
+    {
+      const size_t count = std::min<size_t>(255, lacing.size() - segment);
+
+      putString(out, "OggS");
+      out.push_back(0);
+      out.push_back(static_cast<uint8_t>((continued ? 0x01 : 0) | (firstPage ? 0x02 : 0)));
+      putLittleEndian(out, 0, 8);
+      putLittleEndian(out, serial, 4);
+      putLittleEndian(out, 0, 4);
+      putLittleEndian(out, 0, 4);
+      out.push_back(static_cast<uint8_t>(count));
+
+      size_t bodyLength = 0;
+      for (size_t i = segment; i < segment + count; i++)
+      {
+        out.push_back(lacing[i]);
+        bodyLength += lacing[i];
+      }
+
+      out.insert(out.end(), data.begin() + position, data.begin() + position + bodyLength);
+
+      continued = !endsPacket[segment + count - 1];
+      position += bodyLength;
+      segment += count;
+      firstPage = false;
+    }
+  }
+
+  static std::vector<uint8_t> identification()
+  {
+    std::vector<uint8_t> packet = {0x01};
+    putString(packet, "vorbis");
+    putLittleEndian(packet, 0, 4);
+    packet.push_back(2);
+    putLittleEndian(packet, 44100, 4);
+    putLittleEndian(packet, 0, 4);
+    putLittleEndian(packet, 160000, 4);
+    putLittleEndian(packet, 0, 4);
+    packet.push_back(0xB8);
+    packet.push_back(1);
+    return packet;
+  }
+
+  static std::vector<uint8_t> comments(const std::vector<std::string> &entries)
+  {
+    std::vector<uint8_t> packet = {0x03};
+    putString(packet, "vorbis");
+    putLittleEndian(packet, 7, 4);
+    putString(packet, "encoder");
+    putLittleEndian(packet, entries.size(), 4);
+    for (const auto &entry : entries)
+    {
+      putLittleEndian(packet, entry.size(), 4);
+      putString(packet, entry);
+    }
+    packet.push_back(1);
+    return packet;
+  }
+
+  /**
+   * Builds a file with the given comments and `audioPages` pages of audio. Sets `audioStart`
+   * to the position of the first audio page.
+   */
+  static std::vector<uint8_t> buildFile(const std::vector<std::string> &entries, size_t audioPages, size_t &audioStart)
+  {
+    std::vector<uint8_t> file;
+    putPages(file, 7, true, {identification()});
+    putPages(file, 7, false, {comments(entries), std::vector<uint8_t>(3000, 0x05)});
+
+    audioStart = file.size();
+    for (size_t i = 0; i < audioPages; i++)
+    {
+      putPages(file, 7, false, {std::vector<uint8_t>(4000, static_cast<uint8_t>(i))});
+    }
+
+    return file;
+  }
+
+  void writeFile(const std::vector<uint8_t> &contents)
+  {
+    std::ofstream out(dataFile, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(contents.data()), contents.size());
+  }
+};
+
+TEST_F(VorbisTrackTest, CheckMetadata)
+{
+  size_t audioStart;
+  writeFile(buildFile({"ARTIST=Artist", "album=Album", "TRACKNUMBER=4", "TOTALTRACKS=9"}, 20, audioStart));
+
+  ASSERT_EQ(Format::vorbis, Track::determineFormat(dataFile));
+
+  VorbisTrack track(dataFile);
+  track.importMetadata();
+
+  EXPECT_EQ(Format::vorbis, track.getFormat());
+  EXPECT_EQ("Artist", track.getArtist());
+  EXPECT_EQ("Album", track.getAlbum());
+  EXPECT_EQ(4, track.getTrackNum());
+  EXPECT_EQ(9, track.getTotalTracks());
+
+  OggVorbisMetadata metadata = OggVorbisMetadata::read(dataFile);
+  EXPECT_EQ(2, metadata.streamInfo.channels);
+  EXPECT_EQ(44100u, metadata.streamInfo.sampleRate);
+  EXPECT_EQ(160000, metadata.streamInfo.nominalBitrate);
+  EXPECT_EQ("encoder", metadata.vendor);
+}
+
+TEST_F(VorbisTrackTest, ReadsAlbumArtistAsArtist)
+{
+  size_t audioStart;
+  writeFile(buildFile({"ARTIST=Artist", "ALBUMARTIST=Album Artist"}, 20, audioStart));
+
+  VorbisTrack track(dataFile);
+  track.importMetadata();
+
+  const std::vector<std::string> artists = {"Artist", "Album Artist"};
+  EXPECT_EQ(artists, track.getArtists());
+}
+
+TEST_F(VorbisTrackTest, StopsBeforeAudio)
+{
+  size_t audioStart;
+  std::vector<uint8_t> contents = buildFile({"TITLE=Title"}, 50, audioStart);
+
+  OggVorbisParser parser;
+  for (size_t i = 0; i < contents.size() && !parser.isFinished(); i++)
+  {
+    parser.feed(i, contents.data() + i, 1);
+  }
+
+  ASSERT_TRUE(parser.isFinished());
+  EXPECT_LE(parser.nextOffset(), audioStart);
+  EXPECT_EQ("Title", parser.finish().comments[0].value);
+}
+
+TEST_F(VorbisTrackTest, CommentsSpanningPages)
+{
+  // Far more than the 255 segments a single page can hold.
+  const std::string description(200000, 'd');
+
+  size_t audioStart;
+  writeFile(buildFile({"DESCRIPTION=" + description, "TITLE=After"}, 1, audioStart));
+
+  OggVorbisMetadata metadata = OggVorbisMetadata::read(dataFile);
+  ASSERT_EQ(2u, metadata.comments.size());
+  EXPECT_EQ(description, metadata.comments[0].value);
+  EXPECT_EQ("After", metadata.comments[1].value);
+}
+
+TEST_F(VorbisTrackTest, SkipsOtherStreams)
+{
+  std::vector<uint8_t> file;
+
+  std::vector<uint8_t> skeleton;
+  putString(skeleton, "fishead");
+  skeleton.resize(64, 0);
+
+  putPages(file, 1, true, {skeleton});
+  putPages(file, 2, true, {identification()});
+  putPages(file, 1, false, {std::vector<uint8_t>(500, 0)});
+  putPages(file, 2, false, {comments({"TITLE=Muxed"})});
+  writeFile(file);
+
+  OggVorbisMetadata metadata = OggVorbisMetadata::read(dataFile);
+  EXPECT_EQ(2u, metadata.streamInfo.serialNumber);
+  EXPECT_EQ("Muxed", metadata.comments[0].value);
+}
+
+TEST_F(VorbisTrackTest, IngestorBuildsVorbisTracks)
+{
+  size_t audioStart;
+  writeFile(buildFile({"TITLE=Ingested"}, 5, audioStart));
+
+  FileFingerprint fingerprint;
+  ASSERT_TRUE(FileFingerprint::read(dataFile, fingerprint));
+
+  ASSERT_TRUE(TrackIngestor::canIngest(dataFile));
+  TrackIngestor ingestor(dataFile, fingerprint, true);
+  unique_ptr<Track> track = ingestor.read(HashReadMode::pread);
+
+  ASSERT_NE(nullptr, track);
+  EXPECT_EQ(Format::vorbis, track->getFormat());
+  EXPECT_EQ("Ingested", track->getTitle());
+  EXPECT_TRUE(track->hasFileHash());
+}
+
+TEST_F(VorbisTrackTest, ReadBadFile)
+{
+  writeFile(std::vector<uint8_t>(100, 'x'));
+
+  VorbisTrack track(dataFile);
+  EXPECT_ANY_THROW(track.importMetadata());
+
+  // Ends before the comment header.
+  std::vector<uint8_t> file;
+  putPages(file, 7, true, {identification()});
+  writeFile(file);
+  EXPECT_ANY_THROW(track.importMetadata());
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}